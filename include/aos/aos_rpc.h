@@ -21,6 +21,17 @@
 #include <aos/ump_chan.h>
 
 #define AOS_RPC_RETURN_BIT 0x1000000
+/// Message type of the LMP message handing the bulk frame to the remote end
+#define AOS_RPC_BULK_SETUP 0x2000000
+/// Set in the length word of a varstr/varbytes that was placed in the bulk area
+#define AOS_RPC_BULK_FLAG ((uintptr_t) 1 << 63)
+
+/// Varstr/varbytes payloads above this size are passed through the bulk area
+#define AOS_RPC_BULK_THRESHOLD 256
+/// Size of the frame an LMP binding shares with its remote end on first use
+#define AOS_RPC_BULK_LMP_FRAME_SIZE (8 * BASE_PAGE_SIZE)
+/// Size of the bulk region at the end of a frame set up with aos_rpc_init_ump_bulk
+#define AOS_RPC_BULK_UMP_SIZE (16 * BASE_PAGE_SIZE)
 #define DEFAULT_TIMEOUT 100000000000 // increased by 00
 
 #define min(a,b) \
@@ -70,7 +81,7 @@ enum aos_rpc_argument_type {
     AOS_RPC_NO_TYPE = 0,
     AOS_RPC_WORD,
     AOS_RPC_SHORTSTR, ///< four word string (32 chars) (not implemented)
-    AOS_RPC_STR, ///< longer string in shared page (not implemented)
+    AOS_RPC_STR, ///< same as AOS_RPC_VARSTR
     AOS_RPC_VARSTR,
     AOS_RPC_VARBYTES,
     AOS_RPC_CAPABILITY
@@ -96,8 +107,6 @@ struct aos_rpc_function_binding
     int                             msg_type;
     uint16_t                        n_args;
     uint16_t                        n_rets;
-    void                            *buf_page;
-    void                            *buf_page_remote;
     char                            binding_name[32];
     enum aos_rpc_argument_type      args[AOS_RPC_MAX_FUNCTION_ARGUMENTS];
     enum aos_rpc_argument_type      rets[AOS_RPC_MAX_FUNCTION_ARGUMENTS];
@@ -111,6 +120,25 @@ struct aos_rpc_interface
 };
 
 
+/**
+ * \brief Shared areas for varstr/varbytes payloads above AOS_RPC_BULK_THRESHOLD
+ *
+ * The caller writes large arguments to call_tx, the callee its large return
+ * values to ret_tx; only offset and length travel over the channel. Over LMP,
+ * call_tx and ret_rx are halves of the frame we handed to the remote end on
+ * our first call, call_rx and ret_tx halves of the one it handed to us. Over
+ * UMP, all four are carved out of the channel frame.
+ */
+struct aos_rpc_bulk {
+    char *call_tx;
+    char *ret_rx;
+    size_t local_size;      ///< size of call_tx and ret_rx
+    char *call_rx;
+    char *ret_tx;
+    size_t remote_size;     ///< size of call_rx and ret_tx
+    bool unavailable;       ///< don't try to set up a bulk frame (again)
+};
+
 /* An RPC binding, which may be transported over LMP or UMP. */
 struct aos_rpc {
     struct thread_mutex mutex; 
@@ -137,12 +165,16 @@ struct aos_rpc {
     void **handlers;
     uint64_t timeout;
     bool ump_dont_yield;
+
+    struct aos_rpc_bulk bulk;
 };
 
 errval_t aos_rpc_set_interface(struct aos_rpc *rpc, struct aos_rpc_interface *interface, size_t n_handlers, void **handlers);
 
 errval_t aos_rpc_init_lmp(struct aos_rpc *rpc, struct capref self_ep, struct capref end_ep, struct lmp_endpoint *lmp_ep, struct waitset *waitset);
 errval_t aos_rpc_init_ump_default(struct aos_rpc *rpc, lvaddr_t shared_page, size_t shared_page_size, bool first_half);
+errval_t aos_rpc_init_ump_bulk(struct aos_rpc *rpc, lvaddr_t shared_page, size_t shared_page_size,
+                               size_t bulk_size, bool first_half);
 
 errval_t aos_rpc_free(struct aos_rpc *rpc);
 
@@ -167,6 +199,9 @@ errval_t aos_rpc_get_ram_cap(struct aos_rpc *chan, size_t bytes,
                              size_t alignment, struct capref *retcap,
                              size_t *ret_bytes);
 
+errval_t aos_rpc_get_ram_batch(struct aos_rpc *chan, size_t count, size_t bytes,
+                               struct capref *ret_cap, size_t *ret_count);
+
 errval_t aos_rpc_serial_getchar(struct aos_rpc *chan, char *retc);
 
 errval_t aos_rpc_serial_putchar(struct aos_rpc *chan, char c);
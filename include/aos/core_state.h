@@ -36,6 +36,17 @@ struct morecore_state {
     char *freep;
 };
 
+/**
+ * \brief A RAM cap received through a batched request, which is handed out
+ *        piecewise by retyping it into children at increasing offsets.
+ */
+struct ram_batch {
+    struct capref cap;      ///< parent RAM cap, only valid if size != 0
+    size_t size;            ///< size of the parent cap
+    size_t offset;          ///< offset of the first byte not yet handed out
+    size_t next_request;    ///< size of the next batch to request
+};
+
 struct ram_alloc_state {
     bool mem_connect_done;
     errval_t mem_connect_err;
@@ -44,6 +55,8 @@ struct ram_alloc_state {
     uint64_t default_minbase;
     uint64_t default_maxlimit;
     int base_capnum;
+    struct ram_batch small_batch;   ///< serves requests up to RAM_BATCH_SMALL_MAX
+    struct ram_batch large_batch;   ///< serves large page requests
 };
 
 
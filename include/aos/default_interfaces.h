@@ -28,6 +28,8 @@ enum {
     INIT_MULTI_HOP_CON,
     INIT_BINDING_REQUEST,
     INIT_IFACE_GET_ALL_MODULES,
+    INIT_IFACE_GET_RAM,             ///< RAM for the mm of another core
+    INIT_IFACE_UMP_BENCH,           ///< receive a message burst on a new ump ring
     INIT_IFACE_N_FUNCTIONS, // <- count -- must be last
 };
 
@@ -51,6 +53,8 @@ enum {
 
 enum {
     MM_IFACE_GET_RAM = AOS_RPC_MSG_TYPE_START,
+    MM_IFACE_RAM_CACHE_CTL,
+    MM_IFACE_GET_RAM_BATCH,
     MM_IFACE_N_FUNCTIONS, // <- count -- must be last
 };
 
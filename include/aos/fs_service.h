@@ -1,30 +1,168 @@
+/**
+ * \file fs_service.h
+ * \brief Client side of the file server protocol
+ *
+ * Files and directories are opened once and then accessed through a handle
+ * kept by the server. Reads and writes name their offset explicitly and are
+ * split into chunks of FS_SERVICE_CHUNK_SIZE, one RPC per chunk, directory
+ * entries are transferred in batches.
+ */
+
+#ifndef INCLUDE_AOS_FS_SERVICE_H_
+#define INCLUDE_AOS_FS_SERVICE_H_
+
 #include <aos/nameserver.h>
+#include <fs/fs.h>
+
 #define FS_SERVICE_NAME "/fs"
 
+/// Maximum number of handles open at the server, over all clients
+#define FS_SERVICE_MAX_HANDLES 64
+
+/// Open flags
+#define FS_SERVICE_O_CREATE  0x1    ///< create the file if it does not exist
+#define FS_SERVICE_O_TRUNC   0x2    ///< truncate the file to zero length
+
 enum fs_service_messagetype {
-    F_READ=0,
-    F_WRITE=1,
-    F_RM=2,
-    D_READ=3,
-    D_MKDIR=4,
-    D_RM=5,
-    SPAWN_ELF=6
+    FS_MSG_OPEN = 0,
+    FS_MSG_CLOSE = 1,
+    FS_MSG_READ = 2,
+    FS_MSG_WRITE = 3,
+    FS_MSG_STAT = 4,
+    FS_MSG_OPENDIR = 5,
+    FS_MSG_READDIR = 6,
+    FS_MSG_REMOVE = 7,
+    FS_MSG_MKDIR = 8,
+    FS_MSG_RMDIR = 9,
+    FS_MSG_SPAWN_ELF = 10
 };
 
+/// Handle of a file or directory opened at the server
+typedef uint64_t fs_service_handle_t;
 
 struct fs_service_message {
-    enum fs_service_messagetype type;
-    size_t path_size;
-    size_t data_size;
-    char data[0];
+    uint32_t type;          ///< enum fs_service_messagetype
+    uint32_t flags;         ///< FS_SERVICE_O_* for FS_MSG_OPEN
+    fs_service_handle_t handle;
+    uint64_t offset;        ///< file offset of a read or write
+    uint64_t size;          ///< bytes to read or write
+    char data[0];           ///< path, or the data of a write
+} __attribute__((__packed__));
+
+struct fs_service_response {
+    errval_t err;
+    fs_service_handle_t handle; ///< for FS_MSG_OPEN and FS_MSG_OPENDIR
+    uint64_t size;          ///< bytes read or written, file size for FS_MSG_STAT
+    uint32_t type;          ///< enum fs_filetype for FS_MSG_STAT
+    uint32_t count;         ///< directory entries in data for FS_MSG_READDIR
+    char data[0];           ///< data of a read, directory entries
+} __attribute__((__packed__));
+
+/// A directory entry in the response to FS_MSG_READDIR, followed by the name
+struct fs_service_dirent {
+    uint32_t type;          ///< enum fs_filetype
+    uint64_t size;
+    uint16_t name_len;      ///< including the terminating NUL
+    char name[0];
 } __attribute__((__packed__));
 
+/// Largest payload of a single read or write RPC, leaves room for either header
+#define FS_SERVICE_CHUNK_SIZE (MAX_SERVER_MESSAGE_SIZE - 64)
+
+/// A directory opened at the server, with the entries of the last batch
+struct fs_service_dir {
+    fs_service_handle_t handle;
+    char *batch;            ///< buffer receiving the batches
+    char *next;             ///< next entry in the batch
+    char *batch_end;        ///< end of the received batch
+    uint32_t left;          ///< entries left in the batch
+    bool end;               ///< the server has no more entries
+};
+
+/**
+ * @brief opens the file at path at the file server
+ *
+ * @param path   absolute path of the file
+ * @param flags  FS_SERVICE_O_* flags
+ * @param ret    returns the handle
+ */
+errval_t fs_service_open(const char *path, int flags, fs_service_handle_t *ret);
+
+/**
+ * @brief closes a file handle, writing modified data back to the card
+ */
+errval_t fs_service_close(fs_service_handle_t fh);
+
+/**
+ * @brief reads up to bytes bytes at offset
+ *
+ * Large reads are streamed in chunks of FS_SERVICE_CHUNK_SIZE. Fewer bytes
+ * than requested are only returned at the end of the file.
+ */
+errval_t fs_service_read(fs_service_handle_t fh, uint64_t offset, void *buf,
+                         size_t bytes, size_t *ret_bytes);
+
+/**
+ * @brief writes bytes bytes at offset, extending the file if needed
+ */
+errval_t fs_service_write(fs_service_handle_t fh, uint64_t offset, const void *buf,
+                          size_t bytes, size_t *ret_bytes);
+
+/**
+ * @brief returns type and size of an open file or directory
+ */
+errval_t fs_service_stat(fs_service_handle_t fh, struct fs_fileinfo *info);
+
+/**
+ * @brief opens the directory at path
+ *
+ * @param path  absolute path of the directory
+ * @param ret   returns the (malloced) directory state
+ */
+errval_t fs_service_opendir(const char *path, struct fs_service_dir **ret);
+
+/**
+ * @brief returns the next entry of a directory
+ *
+ * @param dir   the directory
+ * @param name  returns the name, valid until the next call on dir
+ * @param info  returns type and size of the entry, may be NULL
+ *
+ * @return FS_ERR_INDEX_BOUNDS after the last entry
+ */
+errval_t fs_service_readdir(struct fs_service_dir *dir, const char **name,
+                            struct fs_fileinfo *info);
+
+/**
+ * @brief closes a directory and frees its state
+ */
+errval_t fs_service_closedir(struct fs_service_dir *dir);
+
+errval_t fs_service_remove(const char *path);
+errval_t fs_service_mkdir(const char *path);
+errval_t fs_service_rmdir(const char *path);
+
+/*
+ * Convenience wrappers on top of the handle based interface
+ */
+
+/**
+ * @brief reads up to size bytes from the start of a file into ret
+ *
+ * ret is NUL terminated if the file is shorter than size bytes.
+ */
 void read_file(char *path, size_t size, char *ret);
 
+/**
+ * @brief replaces the contents of a file with the string data
+ */
 void write_file(char *path, char *data);
 
 void delete_file(char *path);
 
+/**
+ * @brief returns the names in a directory, one per line, in a malloced string
+ */
 void read_dir(char *path, char **ret);
 
 void create_dir(char *path);
@@ -32,3 +170,5 @@ void create_dir(char *path);
 void delete_dir(char *path);
 
 void spawn_elf_file(char* path);
+
+#endif /* INCLUDE_AOS_FS_SERVICE_H_ */
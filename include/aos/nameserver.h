@@ -27,6 +27,8 @@ struct server_connection {
 	coreid_t core_id;
 	bool direct;
 	struct aos_rpc * rpc;
+	struct aos_rpc * bound_rpc;	///< channel brokered to an indirect server, NULL until first used
+	bool relay;			///< always relay through init, no channel is brokered
 };
 
 
@@ -52,6 +54,30 @@ errval_t nameservice_rpc(nameservice_chan_t chan, void *message, size_t bytes,
                          void **response, size_t *response_bytes,
                          struct capref tx_cap, struct capref rx_cap);
 
+/**
+ * @brief sends a message to a server, receiving the response into a buffer of the caller
+ *
+ * Unlike nameservice_rpc(), nothing is allocated on the heap, so calls on a
+ * steady path can reuse the same request and response buffers.
+ *
+ * @param chan opaque handle of the channel
+ * @param message pointer to the message
+ * @param bytes size of the message in bytes
+ * @param response buffer receiving the response
+ * @param response_size size of the response buffer
+ * @param response_bytes returns the size of the response
+ *
+ * @return error value, LIB_ERR_RPC_ARGUMENT_OVERFLOW if the response doesn't fit
+ */
+errval_t nameservice_rpc_buf(nameservice_chan_t chan, void *message, size_t bytes,
+                             void *response, size_t response_size, size_t *response_bytes,
+                             struct capref tx_cap, struct capref rx_cap);
+
+/**
+ * @brief returns the number of heap and slot allocations made by RPCs of this domain
+ */
+uint64_t nameservice_rpc_allocs(void);
+
 
 
 /**
@@ -110,6 +136,32 @@ errval_t nameservice_lookup(const char *name, nameservice_chan_t *chan);
 
 errval_t nameservice_lookup_with_prop(const char *name,char * properties, nameservice_chan_t *nschan);
 
+/**
+ * @brief drops cached channels to a server
+ *
+ * nameservice_lookup() and nameservice_lookup_with_prop() keep the channels
+ * they resolve, so repeated lookups don't ask the nameserver again. A cached
+ * channel is dropped when an RPC over it fails or the server is deregistered
+ * by this domain, this drops it explicitly.
+ *
+ * @param name  name of the server, NULL drops all cached channels
+ */
+void nameservice_cache_invalidate(const char *name);
+
+/**
+ * @brief selects how messages without caps reach an indirect server
+ *
+ * Such messages normally go over a channel brokered to the server on first
+ * use, LMP on the same core and UMP across cores. Messages passing caps are
+ * always relayed through init. This forces relaying for all messages, to
+ * compare both paths.
+ *
+ * @param chan   the channel
+ * @param relay  relay all messages through init
+ */
+void nameservice_set_relay(nameservice_chan_t chan, bool relay);
+
+
 /**
  * @brief enumerates all entries that match an query (prefix match)
  * 
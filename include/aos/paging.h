@@ -31,6 +31,12 @@ struct paging_region;
 #define PAGING_UNLOCK(st) thread_mutex_unlock(&(st)->mutex)
 
 
+/// Upper bound on the number of base pages mapped on a single fault
+#define PAGING_FAULT_AROUND_MAX_PAGES 16
+/// Upper bound on the number of large pages mapped on a single fault
+#define PAGING_FAULT_AROUND_MAX_LARGE 8
+
+
 struct thread;
 errval_t frame_alloc_and_map_flags(struct capref *cap,size_t bytes,size_t* retbytes,void **buf,int flags);
 
@@ -41,6 +47,7 @@ errval_t frame_alloc_and_map(struct capref *cap,size_t bytes,size_t* retbytes,vo
 errval_t paging_map_stack_guard(struct paging_state* ps, lvaddr_t stack_bottom);
 void page_fault_handler(enum exception_type type, int subtype, void *addr, arch_registers_state_t *regs);
 errval_t paging_map_single_page_at(struct paging_state *st, lvaddr_t addr, int flags, size_t pagesize);
+errval_t paging_region_fault(struct paging_state *st, struct paging_region *pr, lvaddr_t addr);
 
 
 errval_t paging_init_state(struct paging_state *st, lvaddr_t start_vaddr,
@@ -68,6 +75,12 @@ struct paging_region *paging_region_lookup(struct paging_state *st, lvaddr_t vad
 
 errval_t paging_region_delete(struct paging_state *ps, struct paging_region *pr);
 
+/**
+ * \brief map all not yet mapped pages in [base, base + len) of a lazily
+ * mapped region, using large pages wherever a whole 2 MiB range is covered.
+ */
+errval_t paging_region_prefault(struct paging_region *pr, lvaddr_t base, size_t len);
+
 
 /**
  * \brief return a pointer to a bit of the paging region `pr`.
@@ -60,6 +60,9 @@ struct paging_region {
     bool lazily_mapped;
     bool map_large_pages;
     paging_flags_t flags; ///< lazily mapped pages should be mapped using this flag
+
+    lvaddr_t fault_next;  ///< first address after the range mapped on the last fault
+    size_t fault_window;  ///< number of pages mapped on the last fault
     
     struct paging_region *next;
     struct paging_region *prev;
@@ -81,9 +84,6 @@ struct mapping_table
     /// capref to the pagetable
     struct capref pt_cap;
 
-    /// paging region that contains the first vaddr that is mapped in this pt
-    struct paging_region *region;
-
     /// mappings in this table
     struct capref mapping_caps[PTABLE_ENTRIES];
 
@@ -97,6 +97,29 @@ struct mapping_table
 };
 
 
+/**
+ * \brief node of the paging region index, a radix tree over 2 MiB granules
+ *
+ * Each entry is either 0, a pointer to the paging region covering the whole
+ * range of the entry (tagged with the lowest bit), or a pointer to a node of
+ * the next level.
+ */
+struct paging_region_index_node {
+    uintptr_t entries[PTABLE_ENTRIES];
+};
+
+/**
+ * \brief a range of unused virtual address space
+ */
+struct paging_free_range {
+    lvaddr_t base;
+    size_t size;
+    struct paging_free_range *left;     ///< tree ordered by (size, base)
+    struct paging_free_range *right;
+    int height;
+};
+
+
 // struct to store the paging status of a process
 struct paging_state {
     struct thread_mutex mutex;
@@ -107,11 +130,13 @@ struct paging_state {
     bool mappings_alloc_is_refilling;       // Boolean for blocking while refilling
 
     struct paging_region *head;             // Head of the vaddr region linked list
+    struct paging_region_index_node region_index;   // Region index root (lookup by vaddr)
+    struct slab_allocator region_index_alloc;       // Slab allocator for region index nodes
+    struct paging_free_range *free_ranges;          // Free vspace, best-fit tree
+    struct slab_allocator free_range_alloc;         // Slab allocator for free ranges
 
     struct paging_region vaddr_offset_region;   // Region from 0x0 to VADDR_OFFSET
 
-    struct paging_region free_region;   // Free Region at the end
-
     struct paging_region heap_region;   // Heap region
     struct paging_region meta_region;   // Meta region
     struct paging_region stack_region;  // Stack region
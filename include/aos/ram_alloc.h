@@ -24,6 +24,15 @@ __BEGIN_DECLS
 
 struct capref;
 
+/// Requests up to this size (with at most page alignment) are carved from a
+/// locally held batch instead of asking the memory server each time
+#define RAM_BATCH_SMALL_MAX     (512UL * 1024)
+/// Initial and maximum size of the batch used for small requests
+#define RAM_BATCH_SMALL_MIN     (64UL * 1024)
+#define RAM_BATCH_SMALL_LIMIT   (2UL * 1024 * 1024)
+/// Maximum number of large pages fetched in one request
+#define RAM_BATCH_LARGE_LIMIT   8
+
 typedef errval_t (* ram_alloc_func_t)(struct capref *ret, size_t size, size_t alignment);
 
 errval_t ram_alloc_fixed(struct capref *ret, size_t size, size_t alignment);
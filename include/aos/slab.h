@@ -27,16 +27,21 @@ typedef errval_t (*slab_refill_func_t)(struct slab_allocator *slabs);
 
 struct slab_head {
     struct slab_head *next; ///< Next slab in the allocator
-    uint32_t total, free;   ///< Count of total and free blocks in this slab
-    struct block_head *blocks; ///< Pointer to free block list
+    uint32_t total;         ///< Count of blocks in this slab
 };
 
 struct slot_allocator;
 
 struct slab_allocator {
     struct slab_head *slabs;    ///< Pointer to list of slabs
+    struct block_head *blocks;  ///< Free blocks of all slabs, most recently freed first
+    size_t freecount;           ///< Number of blocks in the free list
     size_t blocksize;           ///< Size of blocks managed by this allocator
     slab_refill_func_t refill_func;  ///< Refill function
+
+    size_t allocs;              ///< Number of successful allocations
+    size_t refills;             ///< Number of calls to the refill function
+    size_t grows;               ///< Number of slabs added
 };
 
 void slab_init(struct slab_allocator *slabs, size_t blocksize,
@@ -46,6 +51,7 @@ void *slab_alloc(struct slab_allocator *slabs);
 void slab_free(struct slab_allocator *slabs, void *block);
 size_t slab_freecount(struct slab_allocator *slabs);
 errval_t slab_default_refill(struct slab_allocator *slabs);
+void slab_print_stats(struct slab_allocator *slabs, const char *name);
 
 // size of block header
 #define SLAB_BLOCK_HDRSIZE (sizeof(void *))
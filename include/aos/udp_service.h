@@ -10,7 +10,10 @@ enum udp_service_messagetype {
     DESTROY,
     ARP_TBL,
     ICMP_PING_SEND,
-    ICMP_PING_RECV
+    ICMP_PING_RECV,
+    MAP_RINGS,
+    KICK_TX,
+    SET_NOTIFY
 };
 
 struct udp_socket_create_info {
@@ -18,6 +21,10 @@ struct udp_socket_create_info {
     uint32_t ip_dest;
 };
 
+struct udp_socket_notify_info {
+    coreid_t core;  // the driver only wakes endpoints on its own core
+};
+
 struct udp_service_message {
     enum udp_service_messagetype type;
     uint16_t port;
@@ -27,11 +34,22 @@ struct udp_service_message {
     char data[0];
 } __attribute__((__packed__));
 
+struct udp_socket_rings;
+struct aos_socket_notify;
+
 struct aos_socket {
     uint16_t f_port;  // foreign port
     uint16_t l_port;  // local port
     uint32_t ip_dest;
     nameservice_chan_t _nschan;
+
+    struct udp_socket_rings *rings;  // shared with the driver, NULL if not mapped
+    uint64_t tx_head;  // datagrams written to the tx ring
+    uint64_t tx_tail_cache;  // last seen tail of the tx ring
+    uint64_t rx_tail;  // datagrams consumed from the rx ring
+    uint64_t rx_head_cache;  // last seen head of the rx ring
+    struct aos_socket_notify *notify;  // wakeups from the driver, NULL if not set up
+    bool notify_failed;  // the driver cannot wake this socket, receive polls
 };
 
 struct aos_ping_socket {
@@ -46,6 +64,45 @@ struct udp_msg {
     char data[0];
 } __attribute__((__packed__));
 
+/// Size of a buffer passed to aos_socket_receive()
+#define UDP_MSG_MAX_SIZE (sizeof(struct udp_msg) + MAX_PAYLOAD_LEN)
+
+/// Datagrams held by each ring of a socket
+#define UDP_RING_SLOTS 64
+
+/**
+ * A datagram in a socket ring. On the rx ring ip and f_port name the sender,
+ * on the tx ring the destination, ip 0 sends to the peer of the socket.
+ */
+struct udp_ring_slot {
+    struct udp_msg msg;
+    char data[MAX_PAYLOAD_LEN];
+} __attribute__((aligned(UMP_CACHE_LINE)));
+
+/**
+ * Single producer, single consumer ring of datagrams, indices are running
+ * counts as in struct ump_ring_ctrl.
+ */
+struct udp_ring {
+    volatile uint64_t head;  ///< datagrams published by the producer
+    uint8_t pad0[UMP_CACHE_LINE - sizeof(uint64_t)];
+    volatile uint64_t tail;  ///< datagrams consumed by the consumer
+    uint8_t pad1[UMP_CACHE_LINE - sizeof(uint64_t)];
+    volatile uint64_t drops;  ///< rx: dropped on a full ring, tx: failed to send
+    uint8_t pad2[UMP_CACHE_LINE - sizeof(uint64_t)];
+    volatile uint64_t sleeping;  ///< consumer waits, tx: for KICK_TX, rx: for a wakeup
+    uint8_t pad3[UMP_CACHE_LINE - sizeof(uint64_t)];
+    struct udp_ring_slot slots[UDP_RING_SLOTS];
+};
+
+/// Memory shared between an application and the driver for one socket
+struct udp_socket_rings {
+    struct udp_ring rx;  ///< filled by the driver
+    struct udp_ring tx;  ///< filled by the application
+};
+
+#define UDP_RINGS_SIZE ROUND_UP(sizeof(struct udp_socket_rings), BASE_PAGE_SIZE)
+
 errval_t aos_socket_initialize(struct aos_socket *sockref, uint32_t ip_dest, uint16_t f_port, uint16_t l_port);
 
 errval_t aos_socket_send(struct aos_socket *sockref, void *data, uint16_t len);
@@ -54,8 +111,63 @@ errval_t aos_socket_send_to(struct aos_socket *sockref, void *data, uint16_t len
 
 errval_t aos_socket_receive(struct aos_socket *sockref, struct udp_msg *retptr);
 
+/**
+ * @brief waits for a datagram and receives it into retptr
+ *
+ * Maps the rings of the socket on first use. The caller sleeps until the
+ * driver signals a datagram on an LMP endpoint, if the driver runs on another
+ * core it polls the rx ring instead.
+ */
+errval_t aos_socket_receive_blocking(struct aos_socket *sockref, struct udp_msg *retptr);
+
 errval_t aos_socket_teardown(struct aos_socket *sockref);
 
+/**
+ * @brief maps a tx and rx ring shared with the driver for a socket
+ *
+ * Afterwards datagrams are exchanged through the rings instead of one RPC
+ * each: the driver copies received payloads from its device buffers straight
+ * into the rx ring and sends whatever is published on the tx ring.
+ * aos_socket_send(), aos_socket_send_to() and aos_socket_receive() use the
+ * rings transparently, sending fails with ENET_ERR_RING_FULL while the driver
+ * has not caught up.
+ */
+errval_t aos_socket_map_rings(struct aos_socket *sockref);
+
+/**
+ * @brief returns the next free tx slot of a socket with mapped rings
+ *
+ * The payload is written to slot->data in place, the datagram is handed to
+ * the driver by aos_socket_send_commit().
+ */
+errval_t aos_socket_send_slot(struct aos_socket *sockref, struct udp_ring_slot **ret);
+
+/**
+ * @brief publishes the slot returned by aos_socket_send_slot()
+ *
+ * Wakes the driver with a KICK_TX request if it is waiting for interrupts.
+ *
+ * @param len   payload bytes written to the slot
+ * @param ip    destination, 0 for the peer of the socket
+ * @param port  destination port, ignored if ip is 0
+ */
+errval_t aos_socket_send_commit(struct aos_socket *sockref, uint16_t len,
+                                uint32_t ip, uint16_t port);
+
+/**
+ * @brief returns the oldest received datagram of a socket with mapped rings
+ *
+ * The datagram stays in the ring until aos_socket_receive_release().
+ *
+ * @return LIB_ERR_NOT_IMPLEMENTED if no datagram is pending, as aos_socket_receive()
+ */
+errval_t aos_socket_receive_slot(struct aos_socket *sockref, struct udp_msg **ret);
+
+/**
+ * @brief hands the slot returned by aos_socket_receive_slot() back to the driver
+ */
+void aos_socket_receive_release(struct aos_socket *sockref);
+
 void aos_arp_table_get(char *rtptr);
 
 errval_t aos_ping_init(struct aos_ping_socket *s, uint32_t ip);
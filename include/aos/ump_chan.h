@@ -7,10 +7,18 @@
 #include <aos/waitset.h>
 #include <aos/lmp_chan_arch.h>
 #include <aos/lmp_chan.h>
+#include <aos/systime.h>
 
 #define UMP_MSG_SIZE 64 // TODO: set to cache line size
 #define UMP_MSG_N_WORDS 7
 
+#define UMP_CACHE_LINE 64
+
+/// Bounds and initial value of the adaptive spin window (us)
+#define UMP_ADAPTIVE_WINDOW_MIN_US 5
+#define UMP_ADAPTIVE_WINDOW_MAX_US 1000
+#define UMP_ADAPTIVE_WINDOW_INIT_US 50
+
 #define UMP_FLAG_SENT 1 // flag for sent slots / to be received & ackd
 #define UMP_FLAG_RECEIVED 0 // flag for ackd / open slots
 
@@ -29,8 +37,33 @@ struct ump_msg
 #define DECLARE_MESSAGE(chan, msg_name) uint64_t _temp_##msg_name[1 + ump_chan_get_data_len(&(chan))]; \
     struct ump_msg *msg_name = (struct ump_msg *) &_temp_##msg_name;
 
+/**
+ * \brief Declare an array of `n` ump messages for the channel `chan` on the stack.
+ * Use ump_msg_at() to address the individual messages.
+ */
+#define DECLARE_MESSAGES(chan, msgs_name, n) uint64_t _temp_##msgs_name[(n) * (1 + ump_chan_get_data_len(&(chan)))]; \
+    struct ump_msg *msgs_name = (struct ump_msg *) &_temp_##msgs_name;
+
 /* static_assert(sizeof(struct ump_msg) == UMP_MSG_SIZE, "ump_msg needs to be 64 bytes"); */
 
+/**
+ * \brief Ring indices of one pane, located in the last cache lines of the pane.
+ *
+ * Both are running message counts. `head` is only written by the sender and
+ * `tail` only by the receiver, so each line is written by a single core.
+ * `sleeping` is set by an adaptive receiver that stopped polling and waits
+ * for an ipi, it rarely changes and therefore has a line of its own.
+ */
+struct ump_ring_ctrl
+{
+    volatile uint64_t head; ///< messages published by the sender
+    uint8_t pad0[UMP_CACHE_LINE - sizeof(uint64_t)];
+    volatile uint64_t tail; ///< messages consumed by the receiver
+    uint8_t pad1[UMP_CACHE_LINE - sizeof(uint64_t)];
+    volatile uint64_t sleeping; ///< receiver waits for an ipi
+    uint8_t pad2[UMP_CACHE_LINE - sizeof(uint64_t)];
+};
+
 struct ump_chan
 {
     size_t msg_size; /// < size of a single ump message
@@ -38,10 +71,19 @@ struct ump_chan
     void *recv_pane;
     size_t recv_pane_size;
     size_t recv_buf_index;
+    struct ump_ring_ctrl *recv_ctrl;
+    size_t recv_n_slots;
+    uint64_t recv_tail;         ///< messages consumed from the receive pane
+    uint64_t recv_tail_pub;     ///< `recv_tail` last made visible to the sender
+    uint64_t recv_head_cache;   ///< last seen `head` of the receive pane
 
     void *send_pane;
     size_t send_pane_size;
     size_t send_buf_index;
+    struct ump_ring_ctrl *send_ctrl;
+    size_t send_n_slots;
+    uint64_t send_head;         ///< messages written to the send pane
+    uint64_t send_tail_cache;   ///< last seen `tail` of the send pane
 
     /// whether receiving messages on this channel is done by repeatedly polling
     /// or an ipi notification is expected when a message is receivable
@@ -51,15 +93,32 @@ struct ump_chan
     /// i.e. whether we need to send an ipi after each message we sent
     bool remote_is_pinged;
 
-    union {
-        /// when operating in polled mode, this chanstate is registered in the
-        /// default waitset as a polled channel where it will regularly get polled
-        struct waitset_chanstate waitset_state;
+    /// whether receiving polls for a while after activity and then waits for
+    /// an ipi (see ump_chan_switch_local_adaptive)
+    bool local_is_adaptive;
+
+    /// whether the other endpoint is operating in `local_is_adaptive` mode,
+    /// i.e. whether we need to send an ipi when it announced to be sleeping
+    bool remote_is_adaptive;
+
+    /// when operating in polled (or adaptive, while spinning) mode, this chanstate
+    /// is registered in the waitset as a polled channel where it will regularly get polled
+    struct waitset_chanstate waitset_state;
+
+    /// when operating in pinged (or adaptive, while sleeping) mode, this endpoint is
+    /// registered to receive an empty lmp message when a ump message is available
+    struct lmp_endpoint *lmp_ep;
 
-        /// when operating in pinged mode, this endpoint is registered to receive
-        /// an empty lmp message when a ump message is available
-        struct lmp_endpoint *lmp_ep;
-    };
+    /// waitset and closure of the last receive registration
+    struct waitset *recv_ws;
+    struct event_closure recv_closure;
+
+    /// adaptive mode state
+    bool armed;                 ///< lmp_ep is registered, `sleeping` is set
+    uint64_t adapt_tail;        ///< `recv_tail` at the last registration
+    systime_t spin_window;      ///< how long to poll after activity
+    systime_t spin_until;       ///< end of the current polling phase
+    systime_t sleep_start;      ///< when the receiver armed the ipi
 
     /// if the remote end of the channel is operating in pinged mode (`remote_is_pinged`)
     /// we invoke this capability `invoke_ipi_notify` to notify the other end of a new message
@@ -82,10 +141,24 @@ errval_t ump_chan_destroy(struct ump_chan *chan);
 
 int ump_chan_get_data_len(struct ump_chan *chan);
 
+/**
+ * \brief Address of the `i`-th message of an array declared with DECLARE_MESSAGES
+ */
+static inline struct ump_msg *ump_msg_at(struct ump_chan *chan, struct ump_msg *msgs, size_t i)
+{
+    return (struct ump_msg *) ((uint8_t *) msgs + i * chan->msg_size);
+}
+
 bool ump_chan_send(struct ump_chan *chan, struct ump_msg *send, bool ping_if_pinged);
+size_t ump_chan_send_batch(struct ump_chan *chan, struct ump_msg *msgs, size_t n,
+                           bool ping_if_pinged);
+
+void ump_chan_notify(struct ump_chan *chan);
 
 bool ump_chan_can_receive(struct ump_chan *chan);
+bool ump_chan_poll(struct ump_chan *chan);
 bool ump_chan_receive(struct ump_chan *chan, struct ump_msg *recv);
+size_t ump_chan_receive_batch(struct ump_chan *chan, struct ump_msg *msgs, size_t max);
 
 
 /**
@@ -102,6 +175,21 @@ errval_t ump_chan_switch_local_pinged(struct ump_chan *chan, struct lmp_endpoint
 
 errval_t ump_chan_switch_remote_pinged(struct ump_chan *chan, struct capref ipi_endpoint);
 
+/**
+ * \brief switch to adaptive mode on the local end
+ *
+ * After activity the channel is polled for a spin window, then the receiver
+ * sets the `sleeping` flag of its pane and waits for a ping on `ep`. The window
+ * doubles when a ping arrives shortly after going to sleep and halves when the
+ * channel stays idle for much longer than the window.
+ * The remote end needs to call ump_chan_switch_remote_adaptive.
+ */
+errval_t ump_chan_switch_local_adaptive(struct ump_chan *chan, struct lmp_endpoint *ep);
+
+errval_t ump_chan_switch_remote_adaptive(struct ump_chan *chan, struct capref ipi_endpoint);
+
+void ump_chan_consume_ping(struct ump_chan *chan);
+
 
 errval_t ump_chan_register_recv(struct ump_chan *chan, struct waitset *ws, struct event_closure closure);
 errval_t ump_chan_deregister_recv(struct ump_chan *chan);
@@ -110,6 +198,8 @@ errval_t ump_chan_register_polled_recv(struct ump_chan *chan, struct waitset *ws
 
 errval_t ump_chan_register_pinged_recv(struct ump_chan *chan, struct waitset *ws, struct event_closure closure);
 
+errval_t ump_chan_register_adaptive_recv(struct ump_chan *chan, struct waitset *ws, struct event_closure closure);
+
 
 
 
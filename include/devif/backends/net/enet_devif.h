@@ -13,6 +13,9 @@
 struct enet_queue;
 struct enet_t;
 
+/// TX enqueue flag: more descriptors follow, only devq_notify() starts the DMA
+#define ENET_TX_FLAG_MORE (1UL << 63)
+
 errval_t enet_rx_queue_create(struct enet_queue ** q, struct enet_t* dev);
 
 errval_t enet_tx_queue_create(struct enet_queue ** q, struct enet_t* dev);
@@ -20,7 +20,30 @@
 #define SDHC_BLOCK_SIZE 512
 #define SDHC_TEST_BLOCK 20
 
+/// Largest number of blocks moved by a single command (and request)
+#define SDHC_MAX_BLOCKS 256
+
 struct sdhc_s;
+struct sdhc_req;
+
+typedef void (*sdhc_req_done_fn)(struct sdhc_req *req, errval_t err);
+
+/**
+ * A block transfer for the asynchronous interface. The buffer must be
+ * physically contiguous and accessible by the DMA of the device. The request
+ * is owned by the driver from sdhc_submit until its done callback ran.
+ */
+struct sdhc_req {
+    uint32_t lba;               ///< first block on the card
+    uint32_t count;             ///< number of blocks, 1..SDHC_MAX_BLOCKS
+    lpaddr_t buf;               ///< physical address of the data
+    bool write;                 ///< true to write buf to the card
+    sdhc_req_done_fn done;      ///< called when the transfer finished, may be NULL
+    void *arg;                  ///< for the submitter
+
+    struct sdhc_req *next;      ///< private to the driver
+};
+
 /**
  * Allocate and initialize the SDHC driver. Ensure that base is mapped as
  * read/write and nocache. The sd struct must be freed by the caller.
@@ -66,4 +89,55 @@ errval_t sdhc_write_block(struct sdhc_s* sd, int index, lpaddr_t source);
  */
 errval_t sdhc_read_block(struct sdhc_s* sd, int index, lpaddr_t dest);
 
+/**
+ * Read count consecutive blocks starting at lba to physical address dest.
+ * Uses multi-block transfers of up to SDHC_MAX_BLOCKS blocks each.
+ * Same requirements as sdhc_read_block, blocks until the data has been read.
+ *
+ * \param sd        The driver struct
+ * \param lba       The first block to read
+ * \param count     Number of blocks
+ * \param dest      Physical address where to write
+ */
+errval_t sdhc_read_blocks(struct sdhc_s* sd, uint32_t lba, size_t count, lpaddr_t dest);
+
+/**
+ * Write count consecutive blocks located at source, starting at block lba.
+ * Same requirements as sdhc_write_block, blocks until the data has been written.
+ *
+ * \param sd        The driver struct
+ * \param lba       The first block to write
+ * \param count     Number of blocks
+ * \param source    Physical address of the data to read from
+ */
+errval_t sdhc_write_blocks(struct sdhc_s* sd, uint32_t lba, size_t count, lpaddr_t source);
+
+/**
+ * Queue a transfer request. Requests are started in submission order by
+ * sdhc_poll or sdhc_flush. Consecutive requests in the same direction whose
+ * block ranges are adjacent are merged into a single command, each of them
+ * contributing its own buffer to the scatter-gather list of the transfer.
+ *
+ * \param sd        The driver struct
+ * \param req       The request, must stay valid until its done callback ran
+ */
+errval_t sdhc_submit(struct sdhc_s* sd, struct sdhc_req *req);
+
+/**
+ * Make progress on the request queue without blocking: completes the running
+ * command if it finished (calling the done callbacks of its requests) and
+ * starts the next one.
+ *
+ * \param sd        The driver struct
+ */
+errval_t sdhc_poll(struct sdhc_s* sd);
+
+/**
+ * Run sdhc_poll until all submitted requests completed. Returns the first
+ * error any of them failed with.
+ *
+ * \param sd        The driver struct
+ */
+errval_t sdhc_flush(struct sdhc_s* sd);
+
 #endif
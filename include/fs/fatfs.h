@@ -7,6 +7,9 @@
  * ETH Zurich D-INFK, Universitaetstr 6, CH-8092 Zurich. Attn: Systems Group.
  */
 
+#ifndef INCLUDE_FS_FATFS_H_
+#define INCLUDE_FS_FATFS_H_
+
 #include <fs/fs.h>
 #include <drivers/sdhc.h>
 
@@ -110,10 +113,19 @@ struct fat32_fs
     uint16_t rootDir_sector;
 };
 
+/// Number of sectors cached per mount unless changed with fatfs_set_cache_size()
+#define FATFS_CACHE_DEFAULT_BLOCKS 256
+
+/// Size of the DMA bounce buffer of a mount in sectors, bounds a single card transfer
+#define FATFS_IO_BLOCKS SDHC_MAX_BLOCKS
+
+struct fatfs_cache;
+
 struct fatfs_mount {
     struct fatfs_dirent *root;
     struct fat32_fs *fs;
     struct sdhc_s *ds;
+    struct fatfs_cache *cache;
 };
 
 errval_t fatfs_open(void *st, const char *path, fatfs_handle_t *rethandle);
@@ -150,3 +162,8 @@ errval_t fatfs_closedir(void *st, fatfs_handle_t dhandle);
 errval_t fatfs_mkdir(void *st, const char *path);
 errval_t fatfs_mount(const char *uri, fatfs_mount_t *retst);
 
+errval_t fatfs_sync(void *st);
+errval_t fatfs_set_cache_size(void *st, size_t n_blocks);
+void fatfs_print_cache_stats(void *st);
+
+#endif /* INCLUDE_FS_FATFS_H_ */
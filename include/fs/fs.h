@@ -47,6 +47,24 @@ struct fs_fileinfo {
  */
 errval_t filesystem_init(void);
 
+/**
+ * @brief writes all cached modifications back to the sdcard
+ *
+ * @return SYS_ERR_OK on success
+ *         errval on failure
+ */
+errval_t filesystem_sync(void);
+
+/**
+ * @brief returns the fatfs mount set up by filesystem_init()
+ *
+ * @return the mount, NULL if the filesystem was not initialized
+ *
+ * For servers that access the card through the fatfs interface directly,
+ * sharing the block cache with the libc functions.
+ */
+void *filesystem_get_mount(void);
+
 /**
  * @brief mounts the URI at a give path
  *
@@ -30,6 +30,9 @@ enum nodetype {
     NodeType_Allocated  ///< This region exists and is allocated
 };
 
+/// Number of power-of-two size classes for free nodes (bin i holds [2^i, 2^(i+1)))
+#define MM_NUM_BINS 64
+
 struct capinfo {
     struct capref cap;
     genpaddr_t base;
@@ -44,8 +47,11 @@ struct mmnode {
     struct capinfo cap;       ///< Cap in which this region exists
     struct mmnode *prev;      ///< Previous node in the list.
     struct mmnode *next;      ///< Next node in the list.
-    struct mmnode *free_next; ///< next node in the free-list
-    struct mmnode *free_prev; ///< previous node in the free-list
+    struct mmnode *free_next; ///< next node in the same size-class bin
+    struct mmnode *free_prev; ///< previous node in the same size-class bin
+    struct mmnode *tree_left;  ///< left child in the tree of allocated nodes
+    struct mmnode *tree_right; ///< right child in the tree of allocated nodes
+    int tree_height;           ///< height of the subtree rooted at this node
     genpaddr_t base;          ///< Base address of this region
     gensize_t size;           ///< Size of this free region in cap
 };
@@ -63,8 +69,9 @@ struct mm {
     void *slot_alloc_inst;        ///< Opaque instance pointer for slot allocator
     enum objtype objtype;         ///< Type of capabilities stored
     struct mmnode *head;          ///< Head of doubly-linked list of nodes in order
-    struct mmnode *free_head;     ///< Head of unordered doubly-linked list of free nodes
-    struct mmnode *free_last;     ///< Last of unordered doubly-linked list of free nodes
+    struct mmnode *free_bins[MM_NUM_BINS]; ///< Free nodes, segregated by log2 of their size
+    uint64_t free_bins_mask;      ///< Bit i is set iff free_bins[i] is non-empty
+    struct mmnode *alloc_root;    ///< Root of the AVL tree of allocated nodes, keyed by base
 
     /* statistics */
     gensize_t stats_bytes_max;
@@ -0,0 +1,49 @@
+/**
+ * \file
+ * \brief Thread-caching size-class allocator
+ *
+ * Linking libscmalloc into an application (addLibraries = [ "scmalloc" ])
+ * replaces the K&R malloc/free/realloc of libc, whose definitions are weak.
+ * Objects up to SCMALLOC_SMALL_MAX bytes are carved out of SCMALLOC_SPAN_SIZE
+ * spans, bigger allocations get a span run of their own. Both are taken from
+ * the heap paging region.
+ */
+
+/*
+ * Copyright (c) 2019, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef SCMALLOC_SCMALLOC_H
+#define SCMALLOC_SCMALLOC_H
+
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/// Size and alignment of a span, the unit taken from the heap region
+#define SCMALLOC_SPAN_SIZE (64UL * 1024)
+
+/// Largest request that is served from a size class
+#define SCMALLOC_SMALL_MAX (16UL * 1024)
+
+/// Number of size classes (16 B .. SCMALLOC_SMALL_MAX)
+#define SCMALLOC_NUM_CLASSES 36
+
+/// TLS key under which a thread's cache is stored
+#define SCMALLOC_TLS_KEY 0
+
+void *scmalloc_malloc(size_t bytes);
+void scmalloc_free(void *ptr);
+void *scmalloc_realloc(void *ptr, size_t bytes);
+size_t scmalloc_usable_size(void *ptr);
+void scmalloc_print_stats(void);
+
+__END_DECLS
+
+#endif /* SCMALLOC_SCMALLOC_H */
@@ -7,6 +7,8 @@
 
 
 struct spawninfo *spawn_create_spawninfo(void);
+// keep count spawninfos prepared ahead of time, taken by spawn_create_spawninfo
+errval_t spawn_pool_set_size(size_t count);
 struct aos_rpc *get_rpc_from_spawn_info(domainid_t pid);
 struct spawninfo *get_si_from_rpc(struct aos_rpc * rpc);
 // domainid_t spawn_get_new_domainid(void);
@@ -20,6 +20,48 @@
 #include "aos/aos_rpc.h"
 
 
+/// Where the arguments page is mapped in the child's vspace
+#define SPAWN_ARGS_VADDR (0x700000UL * 0x1000)
+
+/// Where the dispatcher frame is mapped in the child's vspace
+#define SPAWN_DISPATCHER_VADDR ROUND_UP(0x12345678, DISPATCHER_FRAME_SIZE)
+
+/// Most loadable segments a binary may have
+#define SPAWN_IMAGE_MAX_SEGMENTS 8
+
+/**
+ * \brief a loadable segment of a binary, as it is mapped into every child
+ */
+struct spawn_segment {
+    genvaddr_t base;        ///< page aligned start in the child's vspace
+    size_t size;            ///< page aligned size
+    int flags;              ///< flags of the child's mapping
+    bool shared;            ///< read-only, every child maps the same frame
+    struct capref frame;    ///< the loaded segment
+    void *buf;              ///< the frame mapped into our vspace
+};
+
+/**
+ * \brief a binary loaded once and reused for every child spawned from it
+ *
+ * Read-only segments (text, rodata) are shared between all children, each
+ * child gets a private copy of the writable ones (data, bss).
+ */
+struct spawn_image {
+    struct spawn_image *next;
+    char *name;                 ///< name the module was looked up by
+    const char *cmdline;        ///< multiboot command line of the module
+    cslot_t module_slot;        ///< slot of the multiboot module
+    lvaddr_t mapped_elf;        ///< the module mapped into our vspace
+    size_t mapped_elf_size;
+    genvaddr_t entry;           ///< entry point
+    genvaddr_t got_base;        ///< base of .got in the child's vspace
+    size_t n_segments;
+    struct spawn_segment segments[SPAWN_IMAGE_MAX_SEGMENTS];
+    size_t shared_bytes;        ///< bytes of the segments shared by all children
+    size_t private_bytes;       ///< bytes of the segments copied for each child
+    size_t instances;           ///< children spawned from the image
+};
 
 struct spawninfo {
     // the next in the list of spawned domains
@@ -44,6 +86,13 @@ struct spawninfo {
 
     lvaddr_t mapped_elf;
     size_t mapped_elf_size;
+    struct spawn_image *image;  // the loaded binary, NULL to load mapped_elf
+
+    // set up by spawn_prepare, before the binary is known
+    bool prepared;
+    struct cnoderef taskcn;
+    void *args_buf;             // the arguments page, mapped into our vspace
+    void *disp_buf;             // the dispatcher frame, mapped into our vspace
 
     bool spawned;
     domainid_t pid;
@@ -78,12 +127,18 @@ errval_t spawn_load_by_name(char *binary_name, struct spawninfo *si,
 errval_t spawn_setup_by_name(char *binary_name, struct spawninfo *si,
                             domainid_t *pid);
 
-// only map module
+// only map and load the module, once per binary
 errval_t spawn_setup_module_by_name(const char *binary_name, struct spawninfo *si);
 
+// returns the loaded image of a module, loading it if needed
+errval_t spawn_get_image(const char *binary_name, struct spawn_image **ret);
+
 // setup cspace for a dispatcher
 errval_t setup_c_space(struct capref, struct cnoderef *, struct cnoderef *, struct cnoderef *, struct cnoderef *, struct cnoderef *, struct cnoderef *, struct cnoderef *);
 
+// setup the parts of a child that don't depend on the binary
+errval_t spawn_prepare(struct spawninfo *si);
+
 errval_t spawn_setup_dispatcher(int argc, const char *const argv[], struct spawninfo *si,
                 domainid_t *pid);
 errval_t spawn_invoke_dispatcher(struct spawninfo *si);
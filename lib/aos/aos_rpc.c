@@ -34,7 +34,8 @@ struct lmp_msg_info {
 
 /* ================== Function Declarations ================== */
 
-static void aos_rpc_setup_page_handler(struct aos_rpc* rpc, uintptr_t msg_type, uintptr_t frame_size, struct capref frame);
+static void aos_rpc_setup_page_handler(struct aos_rpc* rpc, uintptr_t frame_size, struct capref frame);
+static errval_t lmp_await_response(struct aos_rpc *rpc);
 static errval_t aos_rpc_call_ump(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_type, va_list args);
 static void push_word_ump(struct ump_chan *uc, struct ump_msg *um, int *word_ind, uintptr_t word);
 static void send_remaining_ump(struct ump_chan *uc, struct ump_msg *um, int *word_ind);
@@ -80,6 +81,7 @@ errval_t aos_rpc_init_lmp(struct aos_rpc* rpc, struct capref self_ep, struct cap
     rpc->backend = AOS_RPC_LMP;
 
     rpc->lmp_server_mode = false;
+    memset(&rpc->bulk, 0, sizeof rpc->bulk);
 
     if (waitset) {
         rpc->waitset = waitset;
@@ -124,6 +126,19 @@ errval_t aos_rpc_init_lmp(struct aos_rpc* rpc, struct capref self_ep, struct cap
  *                   (needs to be inverted on the other end)
  */
 errval_t aos_rpc_init_ump_default(struct aos_rpc *rpc, lvaddr_t shared_page, size_t shared_page_size, bool first_half)
+{
+    return aos_rpc_init_ump_bulk(rpc, shared_page, shared_page_size, 0, first_half);
+}
+
+/**
+ * \brief Initialize an RPC struct over UMP with a bulk area for large payloads.
+ *
+ * The last `bulk_size` bytes of the shared frame are not used for the message
+ * rings but split between the two ends for varstr/varbytes payloads above
+ * AOS_RPC_BULK_THRESHOLD. Both ends need to pass the same `bulk_size`.
+ */
+errval_t aos_rpc_init_ump_bulk(struct aos_rpc *rpc, lvaddr_t shared_page, size_t shared_page_size,
+                               size_t bulk_size, bool first_half)
 {
     errval_t err;
 
@@ -131,10 +146,30 @@ errval_t aos_rpc_init_ump_default(struct aos_rpc *rpc, lvaddr_t shared_page, siz
 
     rpc->waitset = get_default_waitset();
 
-    size_t half_page_size = shared_page_size / 2;
+    assert(bulk_size < shared_page_size);
+    assert(bulk_size % (4 * sizeof(uintptr_t)) == 0);
+
+    size_t half_page_size = (shared_page_size - bulk_size) / 2;
 
     assert(half_page_size % UMP_MSG_SIZE == 0);
-    assert(half_page_size + half_page_size == shared_page_size);
+    assert(half_page_size + half_page_size + bulk_size == shared_page_size);
+
+    // each end owns half of the bulk region, split into call and return area
+    memset(&rpc->bulk, 0, sizeof rpc->bulk);
+    if (bulk_size > 0) {
+        char *bulk = (char *) shared_page + shared_page_size - bulk_size;
+        char *own = first_half ? bulk : bulk + bulk_size / 2;
+        char *other = first_half ? bulk + bulk_size / 2 : bulk;
+        size_t area_size = bulk_size / 4;
+
+        rpc->bulk.call_tx = own;
+        rpc->bulk.ret_tx = own + area_size;
+        rpc->bulk.call_rx = other;
+        rpc->bulk.ret_rx = other + area_size;
+        rpc->bulk.local_size = area_size;
+        rpc->bulk.remote_size = area_size;
+    }
+    rpc->bulk.unavailable = true;
 
     void *send_pane = (void *) shared_page;
     void *recv_pane = (void *) shared_page + half_page_size;
@@ -274,43 +309,151 @@ errval_t aos_rpc_call(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_type, ...)
 
 /**
  * \brief Handler for mapping a newly sent frame into the own virtual address space.
- * Is called for setting up a shared page between to endpoints.
+ * Is called when the remote end sets up the bulk frame for its calls to us.
  */
-__unused
-static void aos_rpc_setup_page_handler(struct aos_rpc* rpc, uintptr_t msg_type, uintptr_t frame_size, struct capref frame)
+static void aos_rpc_setup_page_handler(struct aos_rpc* rpc, uintptr_t frame_size, struct capref frame)
 {
-    HERE;
-    debug_printf("NYI!\n");
-    /*debug_printf("aos_rpc_setup_page_handler\n");
-    errval_t err = paging_map_frame(get_current_paging_state(), &rpc->bindings[msg_type].buf_page_remote, frame_size, frame, NULL, NULL);
-    if (err_is_fail(err)) {
-        DEBUG_ERR(err, "setting up communication page\n");
-    }*/
+    errval_t err = SYS_ERR_OK;
+    struct frame_identity fi;
+    void *buf = NULL;
+
+    if (capref_is_null(frame) || frame_size < 2 * AOS_RPC_BULK_THRESHOLD) {
+        err = LIB_ERR_RPC_SETUP_PAGE;
+    }
+    if (err_is_ok(err)) {
+        err = frame_identify(frame, &fi);
+    }
+    if (err_is_ok(err) && fi.bytes < frame_size) {
+        err = LIB_ERR_RPC_SETUP_PAGE;
+    }
+    if (err_is_ok(err)) {
+        err = paging_map_frame_complete(get_current_paging_state(), &buf, frame, NULL, NULL);
+    }
+
+    if (err_is_ok(err)) {
+        rpc->bulk.call_rx = buf;
+        rpc->bulk.ret_tx = (char *) buf + frame_size / 2;
+        rpc->bulk.remote_size = frame_size / 2;
+    }
+    else {
+        DEBUG_ERR(err, "setting up bulk frame\n");
+    }
+
+    struct lmp_msg_info lmi = { .word_index = 0, .cap = NULL_CAP, .cap_taken = false };
+    push_word_lmp(&rpc->channel.lmp, &lmi, AOS_RPC_BULK_SETUP | AOS_RPC_RETURN_BIT);
+    push_word_lmp(&rpc->channel.lmp, &lmi, err);
+    send_remaining_lmp(&rpc->channel.lmp, &lmi);
 }
 
 /**
- * \brief Function for creating the buffer page for sending a (rather long) string over
- * the LMP channel.
+ * \brief Function for creating the bulk frame that carries large arguments of
+ * our calls and large return values over the LMP channel.
  */
-static errval_t setup_buf_page(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_type, uintptr_t buf_size)
+static errval_t setup_buf_page(struct aos_rpc *rpc, size_t buf_size)
 {
-    return LIB_ERR_NOT_IMPLEMENTED;
-    /*struct capref frame;
+    struct lmp_chan *lc = &rpc->channel.lmp;
+    struct capref frame;
+    size_t frame_size;
+    void *buf;
     errval_t err;
 
     // create frame to share
-    err = frame_alloc(&frame, buf_size, NULL);
+    err = frame_alloc(&frame, buf_size, &frame_size);
     ON_ERR_PUSH_RETURN(err, LIB_ERR_FRAME_ALLOC);
 
-    // map into local address space and store address in rpc->bindings[msg_type].buf_page
-    err = paging_map_frame_complete(get_current_paging_state(), &rpc->bindings[msg_type].buf_page, frame, NULL, NULL);
+    err = paging_map_frame_complete(get_current_paging_state(), &buf, frame, NULL, NULL);
     ON_ERR_PUSH_RETURN(err, LIB_ERR_VSPACE_MAP);
 
     // call remote end to install shared frame into its own address space
-    err = aos_rpc_call(rpc, AOS_RPC_SETUP_PAGE, msg_type, buf_size, frame);
-    ON_ERR_PUSH_RETURN(err, LIB_ERR_RPC_SETUP_PAGE); // TODO: New error code
+    struct lmp_msg_info lmi = { .word_index = 0, .cap = NULL_CAP, .cap_taken = false };
+    push_word_lmp(lc, &lmi, AOS_RPC_BULK_SETUP);
+    push_word_lmp(lc, &lmi, frame_size);
+    push_cap_lmp(lc, &lmi, frame);
+    send_remaining_lmp(lc, &lmi);
+
+    err = lmp_await_response(rpc);
+    ON_ERR_PUSH_RETURN(err, LIB_ERR_RPC_SETUP_PAGE);
 
-    return SYS_ERR_OK;*/
+    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;
+    struct capref recieved_cap = NULL_CAP;
+    err = lmp_chan_recv(lc, &msg, &recieved_cap);
+    ON_ERR_PUSH_RETURN(err, LIB_ERR_RPC_SETUP_PAGE);
+
+    if (msg.words[0] != (AOS_RPC_BULK_SETUP | AOS_RPC_RETURN_BIT)) {
+        return LIB_ERR_RPC_SETUP_PAGE;
+    }
+    if (err_is_fail(msg.words[1])) {
+        return err_push(msg.words[1], LIB_ERR_RPC_SETUP_PAGE);
+    }
+
+    rpc->bulk.call_tx = buf;
+    rpc->bulk.ret_rx = (char *) buf + frame_size / 2;
+    rpc->bulk.local_size = frame_size / 2;
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Whether a binding has arguments or return values that may go
+ * through the bulk area.
+ */
+static bool binding_has_payload(struct aos_rpc_function_binding *binding)
+{
+    for (int i = 0; i < binding->n_args; i++) {
+        enum aos_rpc_argument_type t = binding->args[i];
+        if (t == AOS_RPC_STR || t == AOS_RPC_VARSTR || t == AOS_RPC_VARBYTES) {
+            return true;
+        }
+    }
+    for (int i = 0; i < binding->n_rets; i++) {
+        enum aos_rpc_argument_type t = binding->rets[i];
+        if (t == AOS_RPC_STR || t == AOS_RPC_VARSTR || t == AOS_RPC_VARBYTES) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Places a payload in a bulk area if it is large enough to be worth it.
+ *
+ * \param area Bulk area to write to, may be NULL
+ * \param used Bytes of the area used by earlier payloads of the same message
+ * \param offset Filled with the offset of the payload in the area
+ * \return true if the payload is in the area, false if it has to be sent inline
+ */
+static bool bulk_place(char *area, size_t area_size, size_t *used, const void *data, size_t length,
+                       uintptr_t *offset)
+{
+    if (area == NULL || length <= AOS_RPC_BULK_THRESHOLD) {
+        return false;
+    }
+    if (data == area) {
+        // written in place by a handler, reserved before marshalling started
+        *offset = 0;
+        return length <= area_size;
+    }
+
+    size_t start = ROUND_UP(*used, sizeof(uintptr_t));
+    if (start > area_size || length > area_size - start) {
+        return false;
+    }
+    memcpy(area + start, data, length);
+    *used = start + length;
+    *offset = start;
+    return true;
+}
+
+/**
+ * \brief Returns the location of a received bulk payload or NULL if the
+ * descriptor does not lie within the area.
+ */
+static char *bulk_at(char *area, size_t area_size, uintptr_t offset, size_t length)
+{
+    if (area == NULL || offset > area_size || length > area_size - offset) {
+        return NULL;
+    }
+    return area + offset;
 }
 
 
@@ -346,6 +489,7 @@ static errval_t aos_rpc_call_ump(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
     // Send
     int word_ind = 1;
     int ret_ind = 0;
+    size_t bulk_used = 0;
     for (int i = 0; i < n_args; i++) {
         if (binding->args[i] == AOS_RPC_WORD) {
             push_word_ump(&rpc->channel.ump, um, &word_ind, va_arg(args, uintptr_t));
@@ -374,9 +518,15 @@ static errval_t aos_rpc_call_ump(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
                 push_word_ump(&rpc->channel.ump, um, &word_ind, words[j]);
             }
         }
-        else if (binding->args[i] == AOS_RPC_VARSTR) {
+        else if (binding->args[i] == AOS_RPC_VARSTR || binding->args[i] == AOS_RPC_STR) {
             const char *str = va_arg(args, char*);
             size_t msg_len = strlen(str) + 1;
+            uintptr_t offset;
+            if (bulk_place(rpc->bulk.call_tx, rpc->bulk.local_size, &bulk_used, str, msg_len, &offset)) {
+                push_word_ump(&rpc->channel.ump, um, &word_ind, msg_len | AOS_RPC_BULK_FLAG);
+                push_word_ump(&rpc->channel.ump, um, &word_ind, offset);
+                continue;
+            }
             push_word_ump(&rpc->channel.ump, um, &word_ind, msg_len);
             for (int j = 0; j < msg_len; j += sizeof(uintptr_t)) {
                 int word_len = min(sizeof(uintptr_t), msg_len - j);
@@ -388,6 +538,12 @@ static errval_t aos_rpc_call_ump(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
         else if (binding->args[i] == AOS_RPC_VARBYTES) {
             struct aos_rpc_varbytes bytes = va_arg(args, struct aos_rpc_varbytes);
             uintptr_t len = bytes.length;
+            uintptr_t offset;
+            if (bulk_place(rpc->bulk.call_tx, rpc->bulk.local_size, &bulk_used, bytes.bytes, len, &offset)) {
+                push_word_ump(&rpc->channel.ump, um, &word_ind, len | AOS_RPC_BULK_FLAG);
+                push_word_ump(&rpc->channel.ump, um, &word_ind, offset);
+                continue;
+            }
             push_word_ump(&rpc->channel.ump, um, &word_ind, len);
             for (int j = 0; j < len; j += sizeof(uintptr_t)) {
                 int word_len = min(sizeof(uintptr_t), len - j);
@@ -444,6 +600,9 @@ static errval_t aos_rpc_call_ump(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
         response->data[6]
     );*/
 
+    // a response that does not fit is still read to its end, so that the
+    // next call does not take its remaining words as the reply
+    errval_t ret_err = SYS_ERR_OK;
     int ret_offs = 1;
     for (int i = 0; i < n_rets; i++) {
         switch(binding->rets[i]) {
@@ -483,10 +642,21 @@ static errval_t aos_rpc_call_ump(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
             *((struct capref *) retptrs[i]) = forged;
         }
         break;
+        case AOS_RPC_STR:
         case AOS_RPC_VARSTR: {
             char *ret = (char *) retptrs[i];
             size_t len = pull_word_ump(&rpc->channel.ump, response, &ret_offs);
 
+            if (len & AOS_RPC_BULK_FLAG) {
+                len &= ~AOS_RPC_BULK_FLAG;
+                uintptr_t offset = pull_word_ump(&rpc->channel.ump, response, &ret_offs);
+                char *src = bulk_at(rpc->bulk.ret_rx, rpc->bulk.local_size, offset, len);
+                if (src == NULL) {
+                    return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                }
+                memcpy(ret, src, len);
+                break;
+            }
             for (size_t j = 0; j < len; j += 8) {
                 uintptr_t word = pull_word_ump(&rpc->channel.ump, response, &ret_offs);
                 int word_len = min(sizeof(uintptr_t), len - j);
@@ -496,14 +666,34 @@ static errval_t aos_rpc_call_ump(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
         break;
         case AOS_RPC_VARBYTES: {
             size_t len = pull_word_ump(&rpc->channel.ump, response, &ret_offs);
+            bool in_bulk = len & AOS_RPC_BULK_FLAG;
+            len &= ~AOS_RPC_BULK_FLAG;
 
             struct aos_rpc_varbytes *ret = (struct aos_rpc_varbytes *) retptrs[i];
             if (ret->length < len) {
                 debug_printf("allocated bytes buffer not large enough:%ld < %ld\n",ret -> length, len);
-                return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                if (in_bulk) {
+                    pull_word_ump(&rpc->channel.ump, response, &ret_offs);
+                } else {
+                    for (size_t j = 0; j < len; j += 8) {
+                        pull_word_ump(&rpc->channel.ump, response, &ret_offs);
+                    }
+                }
+                ret_err = LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                break;
             }
             ret->length = len;
 
+            if (in_bulk) {
+                uintptr_t offset = pull_word_ump(&rpc->channel.ump, response, &ret_offs);
+                char *src = bulk_at(rpc->bulk.ret_rx, rpc->bulk.local_size, offset, len);
+                if (src == NULL) {
+                    return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                }
+                memcpy(ret->bytes, src, len);
+                break;
+            }
+
             for (size_t j = 0; j < len; j += 8) {
                 uintptr_t word = pull_word_ump(&rpc->channel.ump, response, &ret_offs);
                 int word_len = min(sizeof(uintptr_t), len - j);
@@ -518,7 +708,7 @@ static errval_t aos_rpc_call_ump(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
         }
     }
 
-    return SYS_ERR_OK;
+    return ret_err;
 }
 
 /**
@@ -533,10 +723,7 @@ void aos_rpc_on_ump_message(void *arg)
     DECLARE_MESSAGE(rpc->channel.ump, msg);
     msg->flag = 0;
 
-    if (rpc->channel.ump.local_is_pinged) {
-        struct lmp_recv_buf masg;
-        lmp_endpoint_recv(rpc->channel.ump.lmp_ep, &masg, NULL);
-    }
+    ump_chan_consume_ping(&rpc->channel.ump);
 
 
     bool received = ump_chan_receive(&rpc->channel.ump, msg);
@@ -636,9 +823,7 @@ static void send_remaining_ump(struct ump_chan *uc, struct ump_msg *um, int *wor
         *word_ind = 0;
     }
     else {
-        if (uc->remote_is_pinged) {
-            invoke_ipi_notify(uc->ipi_ep);
-        }
+        ump_chan_notify(uc);
     }
 }
 
@@ -734,8 +919,18 @@ static errval_t aos_rpc_unmarshall_ump_simple_aarch64(struct aos_rpc *rpc, void
 
         }
         break;
+        case AOS_RPC_STR:
         case AOS_RPC_VARSTR: {
             uintptr_t length = pull_word_ump(uc, msg, &word_ind);
+            if (length & AOS_RPC_BULK_FLAG) {
+                uintptr_t offset = pull_word_ump(uc, msg, &word_ind);
+                char *str = bulk_at(rpc->bulk.call_rx, rpc->bulk.remote_size, offset, length & ~AOS_RPC_BULK_FLAG);
+                if (str == NULL) {
+                    return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                }
+                argword((ui) str);
+                break;
+            }
             assert(length < sizeof argstring);
             for (size_t j = 0; j < length; j += sizeof(uintptr_t)) {
                 uintptr_t piece = pull_word_ump(uc, msg, &word_ind);
@@ -746,12 +941,22 @@ static errval_t aos_rpc_unmarshall_ump_simple_aarch64(struct aos_rpc *rpc, void
         break;
         case AOS_RPC_VARBYTES: {
             uintptr_t length = pull_word_ump(uc, msg, &word_ind);
-            assert(length < sizeof abytes);
-            argbytes.length = length;
-            for (size_t j = 0; j < length; j += sizeof(uintptr_t)) {
-                uintptr_t piece = pull_word_ump(uc, msg, &word_ind);
-                memcpy(argbytes.bytes + j, &piece, min(sizeof(uintptr_t), length - j));
+            if (length & AOS_RPC_BULK_FLAG) {
+                length &= ~AOS_RPC_BULK_FLAG;
+                uintptr_t offset = pull_word_ump(uc, msg, &word_ind);
+                argbytes.bytes = bulk_at(rpc->bulk.call_rx, rpc->bulk.remote_size, offset, length);
+                if (argbytes.bytes == NULL) {
+                    return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                }
+            }
+            else {
+                assert(length < sizeof abytes);
+                for (size_t j = 0; j < length; j += sizeof(uintptr_t)) {
+                    uintptr_t piece = pull_word_ump(uc, msg, &word_ind);
+                    memcpy(argbytes.bytes + j, &piece, min(sizeof(uintptr_t), length - j));
+                }
             }
+            argbytes.length = length;
             uintptr_t av[2];
             memcpy(av, &argbytes, sizeof argbytes);
             argdoubleword(av[0], av[1]);
@@ -806,6 +1011,12 @@ static errval_t aos_rpc_unmarshall_ump_simple_aarch64(struct aos_rpc *rpc, void
         }
     }
 
+    // let handlers that fill the buffer they are given write their response in place
+    if (rpc->bulk.ret_tx != NULL) {
+        retbytes.bytes = rpc->bulk.ret_tx;
+        retbytes.length = rpc->bulk.remote_size;
+    }
+
     hd(rpc, arg[0], arg[1], arg[2], arg[3], arg[4], arg[5], arg[6],
        stack_args[0], stack_args[1], stack_args[2], stack_args[3],
        stack_args[4], stack_args[5], stack_args[6], stack_args[7],
@@ -820,6 +1031,7 @@ static errval_t aos_rpc_unmarshall_ump_simple_aarch64(struct aos_rpc *rpc, void
 
     int buf_pos = 1;
     ret_pos = 0;
+    size_t bulk_used = retbytes.bytes == rpc->bulk.ret_tx ? retbytes.length : 0;
     for (int i = 0; i < binding->n_rets; i++) {
         switch(binding->rets[i]) {
         case AOS_RPC_WORD: {
@@ -840,8 +1052,15 @@ static errval_t aos_rpc_unmarshall_ump_simple_aarch64(struct aos_rpc *rpc, void
         }
         break;
 
+        case AOS_RPC_STR:
         case AOS_RPC_VARSTR: {
-            uintptr_t length = strlen(retstring);
+            uintptr_t length = strlen(retstring) + 1;
+            uintptr_t offset;
+            if (bulk_place(rpc->bulk.ret_tx, rpc->bulk.remote_size, &bulk_used, retstring, length, &offset)) {
+                push_word_ump(uc, response, &buf_pos, length | AOS_RPC_BULK_FLAG);
+                push_word_ump(uc, response, &buf_pos, offset);
+                break;
+            }
             push_word_ump(uc, response, &buf_pos, length);
 
             for (int j = 0; j < length; j += sizeof(uintptr_t)) {
@@ -854,6 +1073,12 @@ static errval_t aos_rpc_unmarshall_ump_simple_aarch64(struct aos_rpc *rpc, void
 
         case AOS_RPC_VARBYTES: {
             uintptr_t length = retbytes.length;
+            uintptr_t offset;
+            if (bulk_place(rpc->bulk.ret_tx, rpc->bulk.remote_size, &bulk_used, retbytes.bytes, length, &offset)) {
+                push_word_ump(uc, response, &buf_pos, length | AOS_RPC_BULK_FLAG);
+                push_word_ump(uc, response, &buf_pos, offset);
+                break;
+            }
             push_word_ump(uc, response, &buf_pos, length);
 
             for (int j = 0; j < length; j += sizeof(uintptr_t)) {
@@ -912,10 +1137,20 @@ static errval_t aos_rpc_call_lmp(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
     size_t n_rets = binding->n_rets;
     void* retptrs[8];
 
+    // lmp_server_mode channels are shared by several clients on the remote end
+    if (rpc->bulk.call_tx == NULL && !rpc->bulk.unavailable && !rpc->lmp_server_mode
+        && binding_has_payload(binding)) {
+        err = setup_buf_page(rpc, AOS_RPC_BULK_LMP_FRAME_SIZE);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "bulk frame setup failed, sending payloads inline\n");
+            rpc->bulk.unavailable = true;
+        }
+    }
+
     struct lmp_msg_info lmi;
     lmi.cap = NULL_CAP;
     lmi.cap_taken = false;
-    size_t buf_page_offset = 0;
+    size_t bulk_used = 0;
 
 
     if (rpc->lmp_server_mode) {
@@ -937,9 +1172,16 @@ static errval_t aos_rpc_call_lmp(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
             push_cap_lmp(lc, &lmi, cap);
         }
         break;
+        case AOS_RPC_STR:
         case AOS_RPC_VARSTR: {
             const char *str = va_arg(args, const char *);
             uintptr_t length = strlen(str) + 1;
+            uintptr_t offset;
+            if (bulk_place(rpc->bulk.call_tx, rpc->bulk.local_size, &bulk_used, str, length, &offset)) {
+                push_word_lmp(lc, &lmi, length | AOS_RPC_BULK_FLAG);
+                push_word_lmp(lc, &lmi, offset);
+                break;
+            }
             push_word_lmp(lc, &lmi, length);
 
             for (int j = 0; j < length; j += sizeof(uintptr_t)) {
@@ -952,6 +1194,12 @@ static errval_t aos_rpc_call_lmp(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
         case AOS_RPC_VARBYTES: {
             struct aos_rpc_varbytes bytes = va_arg(args, struct aos_rpc_varbytes);
             uintptr_t len = bytes.length;
+            uintptr_t offset;
+            if (bulk_place(rpc->bulk.call_tx, rpc->bulk.local_size, &bulk_used, bytes.bytes, len, &offset)) {
+                push_word_lmp(lc, &lmi, len | AOS_RPC_BULK_FLAG);
+                push_word_lmp(lc, &lmi, offset);
+                break;
+            }
             push_word_lmp(lc, &lmi, len);
 
             for (int j = 0; j < len; j += sizeof(uintptr_t)) {
@@ -961,27 +1209,6 @@ static errval_t aos_rpc_call_lmp(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
             }
         }
         break;
-        case AOS_RPC_STR: {
-            const char* str = va_arg(args, const char*);
-            size_t buf_page_size = BASE_PAGE_SIZE * 4;
-
-            if (binding->buf_page == NULL) {
-                if (strlen(str) > buf_page_size) {
-                    debug_printf("String is too big to send");
-                    return LIB_ERR_STRING_TOO_LONG;
-                }
-                err = setup_buf_page(rpc, msg_type, buf_page_size);
-                ON_ERR_PUSH_RETURN(err, LIB_ERR_FRAME_ALLOC); // Todo: create new error code
-            }
-            // send the offset into the buf_page
-            push_word_lmp(lc, &lmi, buf_page_offset);
-            size_t length = strlen(str);
-            if (length + buf_page_offset >= BASE_PAGE_SIZE * 4) length = BASE_PAGE_SIZE * 4 - buf_page_offset;
-            strncpy(binding->buf_page + buf_page_offset, str, length);
-            buf_page_offset += length;
-        }
-        break;
-
         default:
             debug_printf("unknown arg type\n");
             break;
@@ -996,6 +1223,31 @@ static errval_t aos_rpc_call_lmp(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
         retptrs[ret_ind++] = va_arg(args, void*);
     }
 
+    err = lmp_await_response(rpc);
+    ON_ERR_RETURN(err);
+
+    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;
+    struct capref recieved_cap = NULL_CAP;
+
+    err = lmp_chan_recv(&rpc->channel.lmp, &msg, &recieved_cap);
+    ON_ERR_RETURN(err);
+
+    if (!capref_is_null(recieved_cap)) {
+        lmp_chan_alloc_recv_slot(&rpc->channel.lmp);
+    }
+
+    err = aos_rpc_unmarshall_retval_aarch64(rpc, retptrs, binding, &msg, recieved_cap);
+    ON_ERR_RETURN(err);
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Waits until a message can be received on the channel or the rpc
+ * timeout expires
+ */
+static errval_t lmp_await_response(struct aos_rpc *rpc)
+{
     assert(rpc -> timeout && "Timeout not set");
     uint64_t start = systime_to_ns(systime_now());
 
@@ -1011,21 +1263,6 @@ static errval_t aos_rpc_call_lmp(struct aos_rpc *rpc, enum aos_rpc_msg_type msg_
         }
         thread_yield_dispatcher(rpc->channel.lmp.remote_cap);
     }
-
-
-    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;
-    struct capref recieved_cap = NULL_CAP;
-
-    err = lmp_chan_recv(&rpc->channel.lmp, &msg, &recieved_cap);
-    ON_ERR_RETURN(err);
-
-    if (!capref_is_null(recieved_cap)) {
-        lmp_chan_alloc_recv_slot(&rpc->channel.lmp);
-    }
-
-    err = aos_rpc_unmarshall_retval_aarch64(rpc, retptrs, binding, &msg, recieved_cap);
-    ON_ERR_RETURN(err);
-
     return SYS_ERR_OK;
 }
 
@@ -1068,6 +1305,15 @@ void aos_rpc_on_lmp_message(void *arg)
 
     uintptr_t msgtype = msg.words[0];
 
+    if (msgtype == AOS_RPC_BULK_SETUP) {
+        aos_rpc_setup_page_handler(rpc, msg.words[1], recieved_cap);
+        err = lmp_chan_register_recv(channel, rpc->waitset ? : get_default_waitset(), MKCLOSURE(&aos_rpc_on_lmp_message, arg));
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "error lmp_chan_register_recv\n");
+        }
+        return;
+    }
+
     bool is_response = false;
     if (msgtype & AOS_RPC_RETURN_BIT) {
         msgtype &= ~AOS_RPC_RETURN_BIT;
@@ -1309,6 +1555,9 @@ static errval_t aos_rpc_unmarshall_retval_aarch64(struct aos_rpc *rpc, void **re
     lmi.cap_taken = false;
     lmi.word_index = 1;
 
+    // a response that does not fit is still read to its end, so that the
+    // next call does not take its remaining words as the reply
+    errval_t ret_err = SYS_ERR_OK;
     for (int i = 0; i < binding->n_rets; i++) {
         switch (binding->rets[i]) {
         case AOS_RPC_WORD: {
@@ -1321,9 +1570,19 @@ static errval_t aos_rpc_unmarshall_retval_aarch64(struct aos_rpc *rpc, void **re
         }
         break;
 
+        case AOS_RPC_STR:
         case AOS_RPC_VARSTR: {
             size_t length = pull_word_lmp(lc, &lmi);
             char *str = (char *) retptrs[i];
+            if (length & AOS_RPC_BULK_FLAG) {
+                length &= ~AOS_RPC_BULK_FLAG;
+                char *src = bulk_at(rpc->bulk.ret_rx, rpc->bulk.local_size, pull_word_lmp(lc, &lmi), length);
+                if (src == NULL) {
+                    return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                }
+                memcpy(str, src, length);
+                break;
+            }
             for (size_t j = 0; j < length; j += sizeof(uintptr_t)) {
                 uintptr_t word = pull_word_lmp(lc, &lmi);
                 memcpy(str + j, &word, min(sizeof(uintptr_t), length - j));
@@ -1332,13 +1591,32 @@ static errval_t aos_rpc_unmarshall_retval_aarch64(struct aos_rpc *rpc, void **re
         break;
         case AOS_RPC_VARBYTES: {
             size_t length = pull_word_lmp(lc, &lmi);
+            bool in_bulk = length & AOS_RPC_BULK_FLAG;
+            length &= ~AOS_RPC_BULK_FLAG;
             struct aos_rpc_varbytes *bytes = (struct aos_rpc_varbytes *) retptrs[i];
             if (bytes->length < length) {
                 // debug_printf("allocated bytes buffer not large enough: %ld\n", len);
-                return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                if (in_bulk) {
+                    pull_word_lmp(lc, &lmi);
+                } else {
+                    for (size_t j = 0; j < length; j += sizeof(uintptr_t)) {
+                        pull_word_lmp(lc, &lmi);
+                    }
+                }
+                ret_err = LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                break;
             }
             bytes->length = length;
 
+            if (in_bulk) {
+                char *src = bulk_at(rpc->bulk.ret_rx, rpc->bulk.local_size, pull_word_lmp(lc, &lmi), length);
+                if (src == NULL) {
+                    return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                }
+                memcpy(bytes->bytes, src, length);
+                break;
+            }
+
             for (int j = 0; j < length; j += sizeof(uintptr_t)) {
                 uintptr_t word = pull_word_lmp(lc, &lmi);
                 memcpy(bytes->bytes + j, &word, min(sizeof(uintptr_t), length - j));
@@ -1352,7 +1630,7 @@ static errval_t aos_rpc_unmarshall_retval_aarch64(struct aos_rpc *rpc, void **re
     }
 
     // debug_printf("Got here\n");
-    return SYS_ERR_OK;
+    return ret_err;
 }
 /**
  *
@@ -1422,13 +1700,17 @@ static errval_t aos_rpc_unmarshall_lmp_aarch64(struct aos_rpc *rpc, void *handle
         }
         break;
 
-        case AOS_RPC_STR: {
-            argword(((ui) binding->buf_page_remote) + pull_word_lmp(lc, lmi));
-        }
-        break;
-
+        case AOS_RPC_STR:
         case AOS_RPC_VARSTR: {
             size_t length = pull_word_lmp(lc, lmi);
+            if (length & AOS_RPC_BULK_FLAG) {
+                char *str = bulk_at(rpc->bulk.call_rx, rpc->bulk.remote_size, pull_word_lmp(lc, lmi), length & ~AOS_RPC_BULK_FLAG);
+                if (str == NULL) {
+                    return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                }
+                argword((ui) str);
+                break;
+            }
             // debug_printf("reading str arg %ld\n", length);
             assert(length < sizeof argstring);
             for (size_t j = 0; j < length; j += sizeof(uintptr_t)) {
@@ -1440,12 +1722,21 @@ static errval_t aos_rpc_unmarshall_lmp_aarch64(struct aos_rpc *rpc, void *handle
         break;
         case AOS_RPC_VARBYTES: {
             size_t length = pull_word_lmp(lc, lmi);
-            assert(length < sizeof abytes);
-            argbytes.length = length;
-            for (size_t j = 0; j < length; j += sizeof(uintptr_t)) {
-                uintptr_t piece = pull_word_lmp(lc, lmi);
-                memcpy(argbytes.bytes + j, &piece, sizeof(uintptr_t));
+            if (length & AOS_RPC_BULK_FLAG) {
+                length &= ~AOS_RPC_BULK_FLAG;
+                argbytes.bytes = bulk_at(rpc->bulk.call_rx, rpc->bulk.remote_size, pull_word_lmp(lc, lmi), length);
+                if (argbytes.bytes == NULL) {
+                    return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+                }
             }
+            else {
+                assert(length < sizeof abytes);
+                for (size_t j = 0; j < length; j += sizeof(uintptr_t)) {
+                    uintptr_t piece = pull_word_lmp(lc, lmi);
+                    memcpy(argbytes.bytes + j, &piece, sizeof(uintptr_t));
+                }
+            }
+            argbytes.length = length;
             uintptr_t aws[2];
             memcpy(aws, &argbytes, sizeof argbytes);
             argdoubleword(aws[0], aws[1]);
@@ -1472,6 +1763,7 @@ static errval_t aos_rpc_unmarshall_lmp_aarch64(struct aos_rpc *rpc, void *handle
             }
             break;
 
+            case AOS_RPC_STR:
             case AOS_RPC_VARSTR: {
                 argword((ui) &retstring);
                 // TODO err check if used twice
@@ -1493,6 +1785,12 @@ static errval_t aos_rpc_unmarshall_lmp_aarch64(struct aos_rpc *rpc, void *handle
         }
     }
 
+    // let handlers that fill the buffer they are given write their response in place
+    if (rpc->bulk.ret_tx != NULL) {
+        retbytes.bytes = rpc->bulk.ret_tx;
+        retbytes.length = rpc->bulk.remote_size;
+    }
+
     //debug_printf("rpc, handler, n_rets: %p, %p %d\n", rpc, h7, binding->n_rets);
     //debug_printf("calling handler %d with %d retargs: %s\n", binding->msg_type, binding->n_rets, binding->binding_name);
     hd(rpc, arg[0], arg[1], arg[2], arg[3], arg[4], arg[5], arg[6],
@@ -1507,6 +1805,7 @@ static errval_t aos_rpc_unmarshall_lmp_aarch64(struct aos_rpc *rpc, void *handle
     lmi->cap_taken = false;
 
     ret_pos = 0;
+    size_t bulk_used = retbytes.bytes == rpc->bulk.ret_tx ? retbytes.length : 0;
 
     for (int i = 0; i < binding->n_rets; i++) {
         switch(binding->rets[i]) {
@@ -1521,8 +1820,15 @@ static errval_t aos_rpc_unmarshall_lmp_aarch64(struct aos_rpc *rpc, void *handle
             }
             break;
 
+            case AOS_RPC_STR:
             case AOS_RPC_VARSTR: {
                 uintptr_t length = strlen(retstring) + 1;
+                uintptr_t offset;
+                if (bulk_place(rpc->bulk.ret_tx, rpc->bulk.remote_size, &bulk_used, retstring, length, &offset)) {
+                    push_word_lmp(lc, lmi, length | AOS_RPC_BULK_FLAG);
+                    push_word_lmp(lc, lmi, offset);
+                    break;
+                }
                 push_word_lmp(lc, lmi, length);
                 for (int j = 0; j < length; j += sizeof(uintptr_t)) {
                     uintptr_t word;
@@ -1534,6 +1840,12 @@ static errval_t aos_rpc_unmarshall_lmp_aarch64(struct aos_rpc *rpc, void *handle
 
             case AOS_RPC_VARBYTES: {
                 uintptr_t length = retbytes.length;
+                uintptr_t offset;
+                if (bulk_place(rpc->bulk.ret_tx, rpc->bulk.remote_size, &bulk_used, retbytes.bytes, length, &offset)) {
+                    push_word_lmp(lc, lmi, length | AOS_RPC_BULK_FLAG);
+                    push_word_lmp(lc, lmi, offset);
+                    break;
+                }
                 push_word_lmp(lc, lmi, length);
                 for (int j = 0; j < length; j += sizeof(uintptr_t)) {
                     uintptr_t word;
@@ -1719,6 +2031,26 @@ errval_t aos_rpc_get_ram_cap(struct aos_rpc *rpc, size_t bytes, size_t alignment
     return aos_rpc_call(rpc, MM_IFACE_GET_RAM, bytes, alignment, ret_cap, ret_bytes ? : &_rs);
 }
 
+/**
+ * \brief Requests `count` blocks of `bytes` each in a single round trip.
+ *
+ * The memory server returns them as one `bytes`-aligned RAM cap of
+ * `*ret_count * bytes` bytes, which the caller retypes into the individual
+ * blocks. Under memory pressure the server may hand out fewer blocks than
+ * requested, but always at least one on success.
+ */
+errval_t aos_rpc_get_ram_batch(struct aos_rpc *rpc, size_t count, size_t bytes,
+                               struct capref *ret_cap, size_t *ret_count)
+{
+    size_t _rc = 0;
+    errval_t err = aos_rpc_call(rpc, MM_IFACE_GET_RAM_BATCH, count, bytes, ret_cap, ret_count ? : &_rc);
+    ON_ERR_RETURN(err);
+    if ((ret_count ? *ret_count : _rc) == 0) {
+        return LIB_ERR_RAM_ALLOC;
+    }
+    return SYS_ERR_OK;
+}
+
 /**
  * \brief Requesting ram via the rpc channel. Must be RPC channel to core 0!
  */
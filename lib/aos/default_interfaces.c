@@ -77,6 +77,12 @@ static void initialize_interfaces(void)
     aos_rpc_initialize_binding(&init_interface, "spawn_extended", INIT_IFACE_GET_ALL_MODULES,
                                0, 1, AOS_RPC_VARSTR);
 
+    aos_rpc_initialize_binding(&init_interface, "get_ram", INIT_IFACE_GET_RAM,
+                               2, 2, AOS_RPC_WORD, AOS_RPC_WORD, AOS_RPC_CAPABILITY, AOS_RPC_WORD);
+
+    aos_rpc_initialize_binding(&init_interface, "ump_bench", INIT_IFACE_UMP_BENCH,
+                               3, 0, AOS_RPC_CAPABILITY, AOS_RPC_WORD, AOS_RPC_WORD);
+
 
     // ===================== Dispatcher Interface =====================
 
@@ -110,13 +116,17 @@ static void initialize_interfaces(void)
 
     // ===================== Memory Server Interface =====================
 
-    memory_server_interface.n_bindings = DISP_IFACE_N_FUNCTIONS;
+    memory_server_interface.n_bindings = MM_IFACE_N_FUNCTIONS;
     memory_server_interface.bindings = memory_server_bindings;
 
     aos_rpc_initialize_binding(&memory_server_interface, "initiate", AOS_RPC_INITIATE,
                                1, 0, AOS_RPC_CAPABILITY);
     aos_rpc_initialize_binding(&memory_server_interface, "get_ram", MM_IFACE_GET_RAM,
                                2, 2, AOS_RPC_WORD, AOS_RPC_WORD, AOS_RPC_CAPABILITY, AOS_RPC_WORD);
+    aos_rpc_initialize_binding(&memory_server_interface, "ram_cache_ctl", MM_IFACE_RAM_CACHE_CTL,
+                               1, 0, AOS_RPC_WORD);
+    aos_rpc_initialize_binding(&memory_server_interface, "get_ram_batch", MM_IFACE_GET_RAM_BATCH,
+                               2, 2, AOS_RPC_WORD, AOS_RPC_WORD, AOS_RPC_CAPABILITY, AOS_RPC_WORD);
 
 
 
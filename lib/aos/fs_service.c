@@ -1,227 +1,423 @@
+/**
+ * \file fs_service.c
+ * \brief Client side of the file server protocol
+ */
+
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <aos/fs_service.h>
 
-
-void read_file(char *path, size_t size, char *ret)
+/// buffer for a single request or response, aligned for the packed headers
+typedef uint64_t fs_service_buf_t[MAX_SERVER_MESSAGE_SIZE / sizeof(uint64_t)];
+
+/**
+ * \brief sends a request and receives the server's response into buf
+ *
+ * On success, the response is returned pointing into buf, along with the
+ * number of data bytes following it. Nothing is allocated, so requests and
+ * responses live in buffers of the caller, mostly on the stack.
+ */
+static errval_t fs_service_call(void *msg, size_t bytes, void *buf, size_t buf_size,
+                                struct fs_service_response **ret, size_t *ret_data)
 {
     errval_t err;
-    nameservice_chan_t _nschan;
+    nameservice_chan_t chan;
 
-    err = nameservice_lookup(FS_SERVICE_NAME, &_nschan);
-    if(err_is_fail(err)) {
-        debug_printf("not found\n");
-        return;
+    // resolved once, nameservice_lookup returns the cached channel afterwards
+    err = nameservice_lookup(FS_SERVICE_NAME, &chan);
+    ON_ERR_RETURN(err);
+
+    size_t response_bytes;
+    err = nameservice_rpc_buf(chan, msg, bytes, buf, buf_size, &response_bytes,
+                              NULL_CAP, NULL_CAP);
+    ON_ERR_RETURN(err);
+
+    struct fs_service_response *resp = buf;
+    if (response_bytes < sizeof(*resp)) {
+        return FS_ERR_BAD_REQUEST;
+    }
+    if (err_is_fail(resp->err)) {
+        return resp->err;
     }
 
-    size_t length = sizeof(struct fs_service_message) + strlen(path);
-    struct fs_service_message *fsm = malloc(length);
-    fsm->type = F_READ;
-    fsm->path_size = strlen(path);
-    fsm->data_size = size;
-    strcpy(fsm->data, path);
+    if (ret != NULL) {
+        *ret = resp;
+    }
+    if (ret_data != NULL) {
+        *ret_data = response_bytes - sizeof(*resp);
+    }
+    return SYS_ERR_OK;
+}
 
-    void *response;
-    size_t response_bytes;
-    //debug_printf("GOT HERE1: %d\n", fsm->type);
-    err = nameservice_rpc(_nschan, (void *) fsm, length,
-                                   &response, &response_bytes,
-                                   NULL_CAP, NULL_CAP);
-    //debug_printf("GOT HERE2\n");
-    strcpy(ret, response);
-    free(response);
-    free(fsm);
+/// sends a request naming a path, the response carries no data
+static errval_t fs_service_path_call(enum fs_service_messagetype type, uint32_t flags,
+                                     const char *path, struct fs_service_response *ret)
+{
+    fs_service_buf_t buf;
+    size_t path_len = strlen(path);
+    size_t bytes = sizeof(struct fs_service_message) + path_len;
+    if (bytes > sizeof(buf)) {
+        return FS_ERR_BAD_REQUEST;
+    }
 
-    if (err_is_fail(err)) {
-        DEBUG_ERR(err, "failed to do the nameservice rpc\n");
+    struct fs_service_message *msg = (struct fs_service_message *)buf;
+    memset(msg, 0, sizeof(*msg));
+    msg->type = type;
+    msg->flags = flags;
+    msg->size = path_len;
+    memcpy(msg->data, path, path_len);
+
+    struct fs_service_response resp_buf, *resp;
+    errval_t err = fs_service_call(msg, bytes, &resp_buf, sizeof(resp_buf), &resp, NULL);
+    ON_ERR_RETURN(err);
+
+    if (ret != NULL) {
+        *ret = *resp;
     }
+    return SYS_ERR_OK;
 }
 
-void write_file(char *path, char *data)
+/// sends a request naming an open handle, the response carries no data
+static errval_t fs_service_handle_call(enum fs_service_messagetype type,
+                                       fs_service_handle_t handle,
+                                       struct fs_service_response *ret)
 {
-    errval_t err;
-    nameservice_chan_t _nschan;
+    struct fs_service_message msg = {
+        .type = type,
+        .handle = handle,
+    };
 
-    err = nameservice_lookup(FS_SERVICE_NAME, &_nschan);
-    if(err_is_fail(err)) {
-        debug_printf("not found\n");
-        return;
+    struct fs_service_response resp_buf, *resp;
+    errval_t err = fs_service_call(&msg, sizeof(msg), &resp_buf, sizeof(resp_buf), &resp, NULL);
+    ON_ERR_RETURN(err);
+
+    if (ret != NULL) {
+        *ret = *resp;
     }
+    return SYS_ERR_OK;
+}
 
-    size_t length = sizeof(struct fs_service_message) + strlen(path) + strlen(data) + 1;
-    struct fs_service_message *fsm = malloc(length);
-    fsm->type = F_WRITE;
-    fsm->path_size = strlen(path);
-    fsm->data_size = strlen(data);
-    strcpy(fsm->data, path);
-    strcat(fsm->data, data);
+errval_t fs_service_open(const char *path, int flags, fs_service_handle_t *ret)
+{
+    struct fs_service_response resp;
+    errval_t err = fs_service_path_call(FS_MSG_OPEN, flags, path, &resp);
+    ON_ERR_RETURN(err);
 
-    void *response;
-    size_t response_bytes;
+    *ret = resp.handle;
+    return SYS_ERR_OK;
+}
 
-    err = nameservice_rpc(_nschan, (void *) fsm, length,
-                          &response, &response_bytes,
-                          NULL_CAP, NULL_CAP);
-    free(fsm);
+errval_t fs_service_close(fs_service_handle_t fh)
+{
+    return fs_service_handle_call(FS_MSG_CLOSE, fh, NULL);
+}
 
-    if (err_is_fail(err)) {
-        DEBUG_ERR(err, "failed to do the nameservice rpc\n");
+errval_t fs_service_read(fs_service_handle_t fh, uint64_t offset, void *ret_buf,
+                         size_t bytes, size_t *ret_bytes)
+{
+    errval_t err = SYS_ERR_OK;
+    fs_service_buf_t buf;
+    size_t done = 0;
+
+    while (done < bytes) {
+        struct fs_service_message msg = {
+            .type = FS_MSG_READ,
+            .handle = fh,
+            .offset = offset + done,
+            .size = MIN(bytes - done, FS_SERVICE_CHUNK_SIZE),
+        };
+
+        struct fs_service_response *resp;
+        size_t data;
+        err = fs_service_call(&msg, sizeof(msg), buf, sizeof(buf), &resp, &data);
+        if (err_is_fail(err)) {
+            break;
+        }
+        if (resp->size > msg.size || resp->size > data) {
+            err = FS_ERR_BAD_REQUEST;
+            break;
+        }
+
+        memcpy((char *)ret_buf + done, resp->data, resp->size);
+        done += resp->size;
+        if (resp->size < msg.size) {
+            break;
+        }
     }
+
+    *ret_bytes = done;
+    return done > 0 ? SYS_ERR_OK : err;
 }
 
-void delete_file(char *path)
+errval_t fs_service_write(fs_service_handle_t fh, uint64_t offset, const void *buf,
+                          size_t bytes, size_t *ret_bytes)
 {
-    errval_t err;
-    nameservice_chan_t _nschan;
-
-    err = nameservice_lookup(FS_SERVICE_NAME, &_nschan);
-    if(err_is_fail(err)) {
-        debug_printf("not found\n");
-        return;
+    errval_t err = SYS_ERR_OK;
+    fs_service_buf_t msg_buf;
+    struct fs_service_message *msg = (struct fs_service_message *)msg_buf;
+    size_t done = 0;
+
+    while (done < bytes) {
+        size_t chunk = MIN(bytes - done, FS_SERVICE_CHUNK_SIZE);
+        msg->type = FS_MSG_WRITE;
+        msg->flags = 0;
+        msg->handle = fh;
+        msg->offset = offset + done;
+        msg->size = chunk;
+        memcpy(msg->data, (const char *)buf + done, chunk);
+
+        struct fs_service_response resp_buf, *resp;
+        err = fs_service_call(msg, sizeof(*msg) + chunk, &resp_buf, sizeof(resp_buf),
+                              &resp, NULL);
+        if (err_is_fail(err)) {
+            break;
+        }
+
+        size_t written = MIN(resp->size, chunk);
+        done += written;
+        if (written < chunk) {
+            break;
+        }
     }
 
-    size_t length = sizeof(struct fs_service_message) + strlen(path);
-    struct fs_service_message *fsm = malloc(length);
-    fsm->type = F_RM;
-    fsm->path_size = strlen(path);
-    fsm->data_size = 0;
-    strcpy(fsm->data, path);
+    *ret_bytes = done;
+    return done > 0 ? SYS_ERR_OK : err;
+}
 
-    void *response;
-    size_t response_bytes;
+errval_t fs_service_stat(fs_service_handle_t fh, struct fs_fileinfo *info)
+{
+    struct fs_service_response resp;
+    errval_t err = fs_service_handle_call(FS_MSG_STAT, fh, &resp);
+    ON_ERR_RETURN(err);
 
-    err = nameservice_rpc(_nschan, (void *) fsm, length,
-                          &response, &response_bytes,
-                          NULL_CAP, NULL_CAP);
-    free(fsm);
+    info->type = resp.type;
+    info->size = resp.size;
+    return SYS_ERR_OK;
+}
+
+errval_t fs_service_opendir(const char *path, struct fs_service_dir **ret)
+{
+    struct fs_service_dir *dir = calloc(1, sizeof(*dir));
+    if (dir == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    // every batch is received into the same buffer
+    dir->batch = malloc(MAX_SERVER_MESSAGE_SIZE);
+    if (dir->batch == NULL) {
+        free(dir);
+        return LIB_ERR_MALLOC_FAIL;
+    }
 
+    struct fs_service_response resp;
+    errval_t err = fs_service_path_call(FS_MSG_OPENDIR, 0, path, &resp);
     if (err_is_fail(err)) {
-        DEBUG_ERR(err, "failed to do the nameservice rpc\n");
+        free(dir->batch);
+        free(dir);
+        return err;
     }
+
+    dir->handle = resp.handle;
+    *ret = dir;
+    return SYS_ERR_OK;
 }
 
-void read_dir(char *path, char **ret)
+/// fetches the next batch of entries
+static errval_t fs_service_readdir_batch(struct fs_service_dir *dir)
+{
+    struct fs_service_message msg = {
+        .type = FS_MSG_READDIR,
+        .handle = dir->handle,
+    };
+
+    struct fs_service_response *resp;
+    size_t data;
+    errval_t err = fs_service_call(&msg, sizeof(msg), dir->batch, MAX_SERVER_MESSAGE_SIZE,
+                                   &resp, &data);
+    ON_ERR_RETURN(err);
+
+    dir->next = resp->data;
+    dir->batch_end = resp->data + data;
+    dir->left = resp->count;
+    // an empty batch means the directory is exhausted
+    dir->end = resp->count == 0;
+    return SYS_ERR_OK;
+}
+
+errval_t fs_service_readdir(struct fs_service_dir *dir, const char **name,
+                            struct fs_fileinfo *info)
 {
     errval_t err;
-    nameservice_chan_t _nschan;
 
-    err = nameservice_lookup(FS_SERVICE_NAME, &_nschan);
-    if(err_is_fail(err)) {
-        debug_printf("not found\n");
-        return;
+    if (dir->left == 0) {
+        if (dir->end) {
+            return FS_ERR_INDEX_BOUNDS;
+        }
+        err = fs_service_readdir_batch(dir);
+        ON_ERR_RETURN(err);
+        if (dir->left == 0) {
+            return FS_ERR_INDEX_BOUNDS;
+        }
     }
 
-    size_t length = sizeof(struct fs_service_message) + strlen(path);
-    struct fs_service_message *fsm = malloc(length);
-    fsm->type = D_READ;
-    fsm->path_size = strlen(path);
-    fsm->data_size = 0;
-    strcpy(fsm->data, path);
+    struct fs_service_dirent *de = (struct fs_service_dirent *)dir->next;
+    if (dir->next + sizeof(*de) > dir->batch_end || de->name_len == 0 ||
+        de->name + de->name_len > dir->batch_end || de->name[de->name_len - 1] != '\0') {
+        dir->left = 0;
+        dir->end = true;
+        return FS_ERR_BAD_REQUEST;
+    }
 
-    void *response;
-    size_t response_bytes;
+    *name = de->name;
+    if (info != NULL) {
+        info->type = de->type;
+        info->size = de->size;
+    }
+    dir->next = de->name + de->name_len;
+    dir->left--;
+    return SYS_ERR_OK;
+}
+
+errval_t fs_service_closedir(struct fs_service_dir *dir)
+{
+    errval_t err = fs_service_handle_call(FS_MSG_CLOSE, dir->handle, NULL);
+    free(dir->batch);
+    free(dir);
+    return err;
+}
 
-    err = nameservice_rpc(_nschan, (void *) fsm, length,
-                          &response, &response_bytes,
-                          NULL_CAP, NULL_CAP);
-    *ret = response;
-    free(fsm);
+errval_t fs_service_remove(const char *path)
+{
+    return fs_service_path_call(FS_MSG_REMOVE, 0, path, NULL);
+}
 
-    if (err_is_fail(err)) {
-        DEBUG_ERR(err, "failed to do the nameservice rpc\n");
-    }
+errval_t fs_service_mkdir(const char *path)
+{
+    return fs_service_path_call(FS_MSG_MKDIR, 0, path, NULL);
 }
 
-void create_dir(char *path)
+errval_t fs_service_rmdir(const char *path)
+{
+    return fs_service_path_call(FS_MSG_RMDIR, 0, path, NULL);
+}
+
+void read_file(char *path, size_t size, char *ret)
 {
     errval_t err;
-    nameservice_chan_t _nschan;
+    fs_service_handle_t fh;
 
-    err = nameservice_lookup(FS_SERVICE_NAME, &_nschan);
-    if(err_is_fail(err)) {
-        debug_printf("not found\n");
+    err = fs_service_open(path, 0, &fh);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "failed to open %s\n", path);
         return;
     }
 
-    size_t length = sizeof(struct fs_service_message) + strlen(path);
-    struct fs_service_message *fsm = malloc(length);
-    fsm->type = D_MKDIR;
-    fsm->path_size = strlen(path);
-    fsm->data_size = 0;
-    strcpy(fsm->data, path);
-
-    void *response;
-    size_t response_bytes;
-
-    err = nameservice_rpc(_nschan, (void *) fsm, length,
-                          &response, &response_bytes,
-                          NULL_CAP, NULL_CAP);
-    free(fsm);
-
+    size_t bytes;
+    err = fs_service_read(fh, 0, ret, size, &bytes);
     if (err_is_fail(err)) {
-        DEBUG_ERR(err, "failed to do the nameservice rpc\n");
+        DEBUG_ERR(err, "failed to read %s\n", path);
+        bytes = 0;
+    }
+    if (bytes < size) {
+        ret[bytes] = '\0';
     }
+
+    fs_service_close(fh);
 }
 
-void delete_dir(char *path)
+void write_file(char *path, char *data)
 {
     errval_t err;
-    nameservice_chan_t _nschan;
+    fs_service_handle_t fh;
 
-    err = nameservice_lookup(FS_SERVICE_NAME, &_nschan);
-    if(err_is_fail(err)) {
-        debug_printf("not found\n");
+    err = fs_service_open(path, FS_SERVICE_O_CREATE | FS_SERVICE_O_TRUNC, &fh);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "failed to open %s\n", path);
         return;
     }
 
-    size_t length = sizeof(struct fs_service_message) + strlen(path);
-    struct fs_service_message *fsm = malloc(length);
-    fsm->type = D_RM;
-    fsm->path_size = strlen(path);
-    fsm->data_size = 0;
-    strcpy(fsm->data, path);
-
-    void *response;
-    size_t response_bytes;
+    size_t bytes;
+    err = fs_service_write(fh, 0, data, strlen(data), &bytes);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "failed to write %s\n", path);
+    }
 
-    err = nameservice_rpc(_nschan, (void *) fsm, length,
-                          &response, &response_bytes,
-                          NULL_CAP, NULL_CAP);
-    free(fsm);
+    fs_service_close(fh);
+}
 
+void delete_file(char *path)
+{
+    errval_t err = fs_service_remove(path);
     if (err_is_fail(err)) {
-        DEBUG_ERR(err, "failed to do the nameservice rpc\n");
+        DEBUG_ERR(err, "failed to remove %s\n", path);
     }
 }
 
-
-void spawn_elf_file(char* path)
+void read_dir(char *path, char **ret)
 {
     errval_t err;
-    nameservice_chan_t _nschan;
+    struct fs_service_dir *dir;
 
-    err = nameservice_lookup(FS_SERVICE_NAME, &_nschan);
-    if(err_is_fail(err)) {
-        debug_printf("not found\n");
+    *ret = NULL;
+    err = fs_service_opendir(path, &dir);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "failed to open %s\n", path);
         return;
     }
 
-    size_t length = sizeof(struct fs_service_message) + strlen(path);
-    struct fs_service_message *fsm = malloc(length);
-    fsm->type = SPAWN_ELF;
-    fsm->path_size = strlen(path);
-    fsm->data_size = 0;
-    strcpy(fsm->data, path);
+    size_t len = 0, cap = 256;
+    char *str = malloc(cap);
+    if (str == NULL) {
+        fs_service_closedir(dir);
+        return;
+    }
+    str[0] = '\0';
+
+    const char *name;
+    while (err_is_ok(err = fs_service_readdir(dir, &name, NULL))) {
+        size_t name_len = strlen(name);
+        if (len + name_len + 2 > cap) {
+            cap = 2 * (len + name_len + 2);
+            char *grown = realloc(str, cap);
+            if (grown == NULL) {
+                err = LIB_ERR_MALLOC_FAIL;
+                break;
+            }
+            str = grown;
+        }
+        memcpy(str + len, name, name_len);
+        len += name_len;
+        str[len++] = '\n';
+        str[len] = '\0';
+    }
+    if (err_no(err) != FS_ERR_INDEX_BOUNDS) {
+        DEBUG_ERR(err, "failed to read %s\n", path);
+    }
 
-    void *response;
-    size_t response_bytes;
+    fs_service_closedir(dir);
+    *ret = str;
+}
 
-    err = nameservice_rpc(_nschan, (void *) fsm, length,
-                          &response, &response_bytes,
-                          NULL_CAP, NULL_CAP);
-    free(fsm);
+void create_dir(char *path)
+{
+    errval_t err = fs_service_mkdir(path);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "failed to create %s\n", path);
+    }
+}
+
+void delete_dir(char *path)
+{
+    errval_t err = fs_service_rmdir(path);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "failed to remove %s\n", path);
+    }
+}
 
+void spawn_elf_file(char* path)
+{
+    errval_t err = fs_service_path_call(FS_MSG_SPAWN_ELF, 0, path, NULL);
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "failed to do the nameservice rpc\n");
     }
-}
\ No newline at end of file
+}
@@ -96,86 +96,246 @@ struct nameservice_chan
 };
 
 
+/// a resolved channel, keyed by the name or query it was looked up with
+struct ns_cache_entry {
+	struct ns_cache_entry *next;
+	char *key;
+	struct server_connection *serv_con;
+};
 
+/// channels resolved by this domain, most recently resolved first
+static struct ns_cache_entry *ns_cache = NULL;
 
+static struct server_connection *ns_cache_get(const char *key)
+{
+	for (struct ns_cache_entry *e = ns_cache; e != NULL; e = e->next) {
+		if (!strcmp(e->key, key)) {
+			return e->serv_con;
+		}
+	}
+	return NULL;
+}
 
+static void ns_cache_put(const char *key, struct server_connection *serv_con)
+{
+	struct ns_cache_entry *e = malloc(sizeof(struct ns_cache_entry));
+	if (e == NULL) {
+		return;
+	}
+	e->key = strdup(key);
+	if (e->key == NULL) {
+		free(e);
+		return;
+	}
+	e->serv_con = serv_con;
+	e->next = ns_cache;
+	ns_cache = e;
+}
+
+/// drops the entries matching serv_con, or the server name if serv_con is NULL
+static void ns_cache_drop(struct server_connection *serv_con, const char *name)
+{
+	struct ns_cache_entry **prev = &ns_cache;
+	while (*prev != NULL) {
+		struct ns_cache_entry *e = *prev;
+		bool match = serv_con ? e->serv_con == serv_con
+		                      : (name == NULL || !strcmp(e->serv_con->name, name));
+		if (match) {
+			// the channel itself stays valid for whoever still holds it
+			*prev = e->next;
+			free(e->key);
+			free(e);
+		} else {
+			prev = &e->next;
+		}
+	}
+}
 
 /**
- * @brief sends a message back to the client who sent us a message
+ * @brief drops the cached channels to a server
  *
- * @param chan opaque handle of the channel
- * @oaram message pointer to the message
- * @param bytes size of the message in bytes
- * @param response the response message
- * @param response_byts the size of the response
- * 
- * @return error value
+ * @param name  name of the server, NULL drops all cached channels
  */
-errval_t nameservice_rpc(nameservice_chan_t chan, void *message, size_t bytes, 
-                         void **response, size_t *response_bytes,
-                         struct capref tx_cap, struct capref rx_cap)
+void nameservice_cache_invalidate(const char *name)
+{
+	ns_cache_drop(NULL, name);
+}
+
+/**
+ * @brief selects whether messages without caps are relayed through init
+ *
+ * @param chan   the channel
+ * @param relay  relay all messages through init
+ */
+void nameservice_set_relay(nameservice_chan_t chan, bool relay)
 {
+	struct server_connection *serv_con = (struct server_connection *) chan;
+	serv_con -> relay = relay;
+}
+
+
 
-	// uint64_t count = 0;
-    // uint64_t sum = 0;
 
 
+
+/**
+ * @brief sets up a channel of our own to a server, brokered by init
+ *
+ * @param name  name of the server
+ * @param core_id core on which the server is running
+ * @param ret_rpc  the channel, LMP on the same core and UMP across cores
+ *
+ * @return  SYS_ERR_OK on success, errval on failure
+ */
+
+static errval_t nameservice_bind(const char *name, coreid_t core_id, struct aos_rpc **ret_rpc){
+	errval_t err;
+	struct capref local_ep_cap;
+	struct aos_rpc * new_client_server_channel;
+	struct capref remote_cap;
+	if(core_id == disp_get_core_id()){
+		err = create_lmp_server_ep(&local_ep_cap,&new_client_server_channel);
+		ON_ERR_RETURN(err);
+		err = aos_rpc_call(get_init_rpc(),INIT_BINDING_REQUEST,name,disp_get_core_id(),core_id,local_ep_cap,&remote_cap);
+		ON_ERR_RETURN(err);
+		new_client_server_channel -> channel.lmp.remote_cap = remote_cap;
+	}
+	else {
+		err = create_ump_server_ep(&local_ep_cap,&new_client_server_channel,true);
+		ON_ERR_RETURN(err);
+		err = aos_rpc_call(get_init_rpc(),INIT_BINDING_REQUEST,name,disp_get_core_id(),core_id,local_ep_cap,&remote_cap);
+		ON_ERR_RETURN(err);
+	}
+	*ret_rpc = new_client_server_channel;
+	return SYS_ERR_OK;
+}
+
+
+
+
+/// heap and slot allocations made by RPCs of this domain
+static uint64_t ns_rpc_allocs = 0;
+
+uint64_t nameservice_rpc_allocs(void)
+{
+	return ns_rpc_allocs;
+}
+
+/**
+ * @brief sends a message to a server and receives the response into a buffer of the caller
+ *
+ * @param chan opaque handle of the channel
+ * @param message pointer to the message
+ * @param bytes size of the message in bytes
+ * @param response buffer receiving the response
+ * @param response_size size of the response buffer
+ * @param response_bytes returns the size of the response
+ * 
+ * @return error value, LIB_ERR_RPC_ARGUMENT_OVERFLOW if the response doesn't fit
+ */
+errval_t nameservice_rpc_buf(nameservice_chan_t chan, void *message, size_t bytes, 
+                             void *response, size_t response_size, size_t *response_bytes,
+                             struct capref tx_cap, struct capref rx_cap)
+{
 	errval_t err;
 	assert(chan && "Invalid namservice channel!");
-	// uint64_t start = systime_to_ns(systime_now());
 	struct server_connection *serv_con = (struct server_connection *) chan;
-	char * response_buffer = (void * ) malloc(MAX_SERVER_MESSAGE_SIZE);
 	struct aos_rpc_varbytes resp_varbytes = {
-		.bytes = response_buffer,
-		.length = MAX_SERVER_MESSAGE_SIZE
+		.bytes = response,
+		.length = response_size
 	};
 	struct aos_rpc_varbytes msg_varbytes;
 	msg_varbytes.length = bytes;
 	msg_varbytes.bytes = (char* ) message;
-	size_t response_size;
-
-
-	// uint64_t end = systime_to_ns(systime_now());
-	// uint64_t tts = end - start;
-	// debug_printf("%lu\n",tts);
+	uintptr_t ret_size;
+	bool no_caps = capref_is_null(rx_cap) && capref_is_null(tx_cap);
 
-	if(serv_con -> direct){
-		if(!capref_is_null(tx_cap) && !capref_is_null(rx_cap)){
-			debug_printf("Trying to send or recv cap over a direct server connection!(impossible to do!)\n");
-			return LIB_ERR_NOT_IMPLEMENTED;
+	if(serv_con -> direct && no_caps){
+		err = aos_rpc_call(serv_con -> rpc,OS_IFACE_DIRECT_MESSAGE,msg_varbytes,&resp_varbytes,&ret_size);
+		if(err_is_fail(err)){
+			// the server may be gone, resolve it again on the next lookup,
+			// a response too large for the caller's buffer says nothing about it
+			if(err_no(err) != LIB_ERR_RPC_ARGUMENT_OVERFLOW){
+				ns_cache_drop(serv_con,NULL);
+			}
+			return err;
 		}
-		// uint64_t start = systime_to_ns(systime_now());
-		err = aos_rpc_call(serv_con -> rpc,OS_IFACE_DIRECT_MESSAGE,msg_varbytes,&resp_varbytes,&response_size);
-		// uint64_t end = systime_to_ns(systime_now());
-		// uint64_t tts = end - start;
-		// debug_printf("%lu\n",tts);
-		ON_ERR_RETURN(err);
 
 
 	}else{
-		
-		struct capref response_cap;
-		slot_alloc(&response_cap);
+		// caps can't be sent over a direct channel, they are relayed through init as for indirect servers
+		struct aos_rpc *init_rpc = get_init_rpc();
+		if(no_caps && !serv_con -> relay && serv_con -> bound_rpc == NULL){
+			// broker a channel of our own on first use, init then only relays cap transfers
+			err = nameservice_bind(serv_con -> name,serv_con -> core_id,&serv_con -> bound_rpc);
+			if(err_is_fail(err)){
+				DEBUG_ERR(err,"Failed to bind to %s, relaying through init\n",serv_con -> name);
+				serv_con -> bound_rpc = NULL;
+				serv_con -> relay = true;
+			}
+		}
 
-		if(capref_is_null(rx_cap) && capref_is_null(tx_cap)){ //no ret no senc cap
-			err = aos_rpc_call(serv_con -> rpc,INIT_CLIENT_CALL2,serv_con -> core_id,serv_con -> name,msg_varbytes,&resp_varbytes,&response_size);
+		if(no_caps && !serv_con -> relay){
+			err = aos_rpc_call(serv_con -> bound_rpc,OS_IFACE_DIRECT_MESSAGE,msg_varbytes,&resp_varbytes,&ret_size);
+		}else if(no_caps){ //no ret no senc cap
+			err = aos_rpc_call(init_rpc,INIT_CLIENT_CALL2,serv_con -> core_id,serv_con -> name,msg_varbytes,&resp_varbytes,&ret_size);
 		}else if(capref_is_null(rx_cap)){ // no ret cap
-			err = aos_rpc_call(serv_con -> rpc,INIT_CLIENT_CALL1,serv_con -> core_id,serv_con -> name,msg_varbytes,tx_cap,&resp_varbytes,&response_size);
-		}
-		else if(capref_is_null(tx_cap)){ //no send cap
-			err = aos_rpc_call(serv_con -> rpc,INIT_CLIENT_CALL3,serv_con -> core_id,serv_con -> name,msg_varbytes,&resp_varbytes,&response_cap,&response_size);
+			err = aos_rpc_call(init_rpc,INIT_CLIENT_CALL1,serv_con -> core_id,serv_con -> name,msg_varbytes,tx_cap,&resp_varbytes,&ret_size);
 		}else{
-			err = aos_rpc_call(serv_con -> rpc,INIT_CLIENT_CALL,serv_con -> core_id,serv_con -> name,msg_varbytes,tx_cap,&resp_varbytes,&response_cap,&response_size);
+			// only a returned cap needs a slot of its own
+			struct capref response_cap;
+			err = slot_alloc(&response_cap);
+			ON_ERR_RETURN(err);
+			ns_rpc_allocs++;
+			if(capref_is_null(tx_cap)){ //no send cap
+				err = aos_rpc_call(init_rpc,INIT_CLIENT_CALL3,serv_con -> core_id,serv_con -> name,msg_varbytes,&resp_varbytes,&response_cap,&ret_size);
+			}else{
+				err = aos_rpc_call(init_rpc,INIT_CLIENT_CALL,serv_con -> core_id,serv_con -> name,msg_varbytes,tx_cap,&resp_varbytes,&response_cap,&ret_size);
+			}
+			if(err_is_ok(err)){
+				cap_copy(rx_cap,response_cap);
+			}
 		}
-		ON_ERR_RETURN(err);
-		cap_copy(rx_cap,response_cap);
-		
-		// *response = realloc(response_buffer,response_size);
+		if(err_is_fail(err)){
+			if(err_no(err) != LIB_ERR_RPC_ARGUMENT_OVERFLOW){
+				ns_cache_drop(serv_con,NULL);
+			}
+			return err;
+		}
+	}
+	*response_bytes = ret_size;
+	return SYS_ERR_OK;
+}
+
+
+/**
+ * @brief sends a message to a server and returns the response in a malloced buffer
+ *
+ * @param chan opaque handle of the channel
+ * @oaram message pointer to the message
+ * @param bytes size of the message in bytes
+ * @param response the response message, to be freed by the caller
+ * @param response_byts the size of the response
+ * 
+ * @return error value
+ */
+errval_t nameservice_rpc(nameservice_chan_t chan, void *message, size_t bytes, 
+                         void **response, size_t *response_bytes,
+                         struct capref tx_cap, struct capref rx_cap)
+{
+	char * response_buffer = (void * ) malloc(MAX_SERVER_MESSAGE_SIZE);
+	if(response_buffer == NULL){
+		return LIB_ERR_MALLOC_FAIL;
+	}
+	ns_rpc_allocs++;
 
+	errval_t err = nameservice_rpc_buf(chan,message,bytes,response_buffer,MAX_SERVER_MESSAGE_SIZE,
+	                                   response_bytes,tx_cap,rx_cap);
+	if(err_is_fail(err)){
+		free(response_buffer);
+		return err;
 	}
 	*response = response_buffer;
-	*response_bytes = response_size;
-	resp_varbytes.length = response_size;
 	return SYS_ERR_OK;
 }
 
@@ -301,12 +461,12 @@ errval_t create_ump_server_ep(struct capref* server_ep,struct aos_rpc** ret_rpc,
 	err = slot_alloc(server_ep);
 	ON_ERR_RETURN(err);
 	size_t urpc_cap_size;
-	err  = frame_alloc(server_ep,BASE_PAGE_SIZE,&urpc_cap_size);
+	err  = frame_alloc(server_ep,BASE_PAGE_SIZE + AOS_RPC_BULK_UMP_SIZE,&urpc_cap_size);
 	ON_ERR_RETURN(err);
 	char *urpc_data = NULL;
 	err = paging_map_frame_complete(get_current_paging_state(), (void **) &urpc_data, *server_ep, NULL, NULL);
 	ON_ERR_RETURN(err);
-	err =  aos_rpc_init_ump_default(new_rpc,(lvaddr_t) urpc_data, BASE_PAGE_SIZE,first_half);
+	err =  aos_rpc_init_ump_bulk(new_rpc,(lvaddr_t) urpc_data, BASE_PAGE_SIZE + AOS_RPC_BULK_UMP_SIZE,AOS_RPC_BULK_UMP_SIZE,first_half);
 	ON_ERR_RETURN(err);
 	err = aos_rpc_set_interface(new_rpc,get_opaque_server_interface(),OS_IFACE_N_FUNCTIONS,get_opaque_server_rpc_handlers);
 	ON_ERR_RETURN(err);
@@ -411,6 +571,7 @@ errval_t nameservice_deregister(const char *name)
 	}
 	if(success){
 		remove_server(name);
+		nameservice_cache_invalidate(name);
 		return SYS_ERR_OK;
 	}
 	else {
@@ -433,6 +594,13 @@ errval_t nameservice_lookup(const char *name, nameservice_chan_t *nschan)
 	uintptr_t success;
 	uintptr_t direct;
 	coreid_t core_id;
+
+	struct server_connection *cached = ns_cache_get(name);
+	if(cached != NULL){
+		*nschan = cached;
+		return SYS_ERR_OK;
+	}
+
 	err = aos_rpc_call(get_ns_rpc(),NS_NAME_LOOKUP,name,&core_id,&direct,&success);
 	ON_ERR_RETURN(err);
 	if(!success){
@@ -442,6 +610,7 @@ errval_t nameservice_lookup(const char *name, nameservice_chan_t *nschan)
 
 	err = nameservice_create_nschan(name,direct,core_id,nschan);
 	ON_ERR_RETURN(err);
+	ns_cache_put(name,*nschan);
 	return SYS_ERR_OK;
 
 }
@@ -476,17 +645,29 @@ errval_t nameservice_lookup_with_prop(const char *name,char * properties, namese
 	err = serialize(name,properties,&query_with_prop);
 	if(err_is_fail(err)){
 		DEBUG_ERR(err,"Failed to serialize query\n");
+		return err;
+	}
+
+	struct server_connection *cached = ns_cache_get(query_with_prop);
+	if(cached != NULL){
+		free(query_with_prop);
+		*nschan = cached;
+		return SYS_ERR_OK;
 	}
+
 	char server_name[SERVER_NAME_SIZE];
 	err = aos_rpc_call(get_ns_rpc(),NS_LOOKUP_PROP,query_with_prop,&core_id,&direct,&success,server_name);
-
-	if(!success){
-		return LIB_ERR_NAMESERVICE_UNKNOWN_NAME;
+	if(err_is_fail(err) || !success){
+		free(query_with_prop);
+		return err_is_fail(err) ? err : LIB_ERR_NAMESERVICE_UNKNOWN_NAME;
 	}
 
 	err = nameservice_create_nschan(server_name,direct,core_id,nschan);
-	ON_ERR_RETURN(err);
-	return SYS_ERR_OK;
+	if(err_is_ok(err)){
+		ns_cache_put(query_with_prop,*nschan);
+	}
+	free(query_with_prop);
+	return err;
 
 }
 
@@ -510,26 +691,15 @@ errval_t nameservice_create_nschan(const char *name,bool direct , coreid_t core_
 
 	strcpy(serv_con -> name,name);
 	serv_con -> core_id = core_id;
+	serv_con -> bound_rpc = NULL;
+	serv_con -> relay = false;
 	if(direct){
 		serv_con -> direct = true;
-		struct capref local_ep_cap;
-		struct aos_rpc * new_client_server_channel;
-		struct capref remote_cap;
-		if(serv_con -> core_id == disp_get_core_id()){
-			err = create_lmp_server_ep(&local_ep_cap,&new_client_server_channel);
-			ON_ERR_RETURN(err);
-			err = aos_rpc_call(get_init_rpc(),INIT_BINDING_REQUEST,name,disp_get_core_id(),serv_con -> core_id,local_ep_cap,&remote_cap);
-			ON_ERR_RETURN(err);
-			new_client_server_channel -> channel.lmp.remote_cap = remote_cap;
-		}
-		else {
-			err = create_ump_server_ep(&local_ep_cap,&new_client_server_channel,true);
-			ON_ERR_RETURN(err);
-			err = aos_rpc_call(get_init_rpc(),INIT_BINDING_REQUEST,name,disp_get_core_id(),serv_con -> core_id,local_ep_cap,&remote_cap);
-			ON_ERR_RETURN(err);
+		err = nameservice_bind(name,core_id,&serv_con -> rpc);
+		if(err_is_fail(err)){
+			free(serv_con);
+			return err;
 		}
-		serv_con -> rpc = new_client_server_channel;
-
 	}
 	else{
 		serv_con -> direct = false;
@@ -633,13 +803,17 @@ void nameservice_reveice_handler_wrapper(struct aos_rpc * rpc,struct aos_rpc_var
 	struct srv_entry * se = (struct srv_entry *) rpc -> serv_entry;
 	
 	se -> recv_handler(se -> st,(void *) message.bytes,message.length,(void*)&response -> bytes,response_size,tx_cap,rx_cap);
+	response -> length = *response_size;
 
 }
 
 
 void namservice_receive_handler_wrapper_direct(struct aos_rpc *rpc, struct aos_rpc_varbytes message,struct aos_rpc_varbytes * response,uintptr_t* response_size){
 	struct srv_entry * se = (struct srv_entry *) rpc -> serv_entry;
-	se -> recv_handler(se -> st,(void *) message.bytes,message.length,(void*)&response -> bytes,response_size,NULL_CAP,NULL);
+	// indirect servers may set a cap to return, it can't be sent over this channel
+	struct capref unused_cap = NULL_CAP;
+	se -> recv_handler(se -> st,(void *) message.bytes,message.length,(void*)&response -> bytes,response_size,NULL_CAP,&unused_cap);
+	response -> length = *response_size;
 
 
 }
@@ -661,7 +835,7 @@ void nameservice_binding_request_handler(struct aos_rpc *rpc,uintptr_t remote_co
 		if(err_is_fail(err)){
 			DEBUG_ERR(err,"Failed to map ump frame into VSpace\n");
 		}
-		err = aos_rpc_init_ump_default(new_server_con,(lvaddr_t) urpc_data,BASE_PAGE_SIZE,false);
+		err = aos_rpc_init_ump_bulk(new_server_con,(lvaddr_t) urpc_data,BASE_PAGE_SIZE + AOS_RPC_BULK_UMP_SIZE,AOS_RPC_BULK_UMP_SIZE,false);
 		if(err_is_fail(err)){
 			DEBUG_ERR(err,"Failed to init ump default\n");
 		}
@@ -22,6 +22,9 @@
 #include <string.h>
 
 static struct paging_state current;
+
+static errval_t free_range_add(struct paging_state *st, lvaddr_t base, size_t size);
+
 errval_t frame_alloc_and_map_flags(struct capref *cap,size_t bytes,size_t* retbytes,void **buf,int flags){
     errval_t err;
     err = frame_alloc(cap,bytes,retbytes);
@@ -77,14 +80,23 @@ void page_fault_handler(enum exception_type type, int subtype, void *addr, arch_
         }
         else if (region->lazily_mapped) {
             // in a lazily mapped region we should only page fault if a page is not mapped, so we map it
+            // (and possibly some of its neighbours)
             // debug_printf("Handling pag fault in lazily mapped region\n");
-            err = paging_map_single_page_at(st,
-                    (lvaddr_t) addr,
-                    VREGION_FLAGS_READ_WRITE,
-                    region->map_large_pages ? LARGE_PAGE_SIZE : BASE_PAGE_SIZE
-            );
-            
+            err = paging_region_fault(st, region, (lvaddr_t) addr);
+
+            if (err_no(err) == LIB_ERR_PMAP_EXISTING_MAPPING) {
+                int flags = region->flags ? : VREGION_FLAGS_READ_WRITE;
+                if (subtype == PAGEFLT_READ ||
+                        (subtype == PAGEFLT_WRITE && (flags & VREGION_FLAGS_WRITE))) {
+                    // another thread mapped the page after we faulted, retry the access
+                    return;
+                }
+                debug_printf("access not allowed by the mapping at 0x%" PRIxLPADDR "\n", addr);
+                debug_printf("ip: 0x%" PRIxLPADDR "\n", regs->named.pc);
+                thread_exit(1);
+            }
             if (err_is_fail(err)) {
+                DEBUG_ERR(err, "mapping 0x%" PRIxLPADDR, addr);
                 debug_printf("error mapping page in page fauilt handler\n");
                 thread_exit(1);
             }
@@ -110,6 +122,182 @@ void page_fault_handler(enum exception_type type, int subtype, void *addr, arch_
 }
 
 
+/**
+ * \brief checks whether nothing is mapped in the page of size `pagesize` at `vaddr`
+ */
+static bool paging_range_is_free(struct paging_state *st, lvaddr_t vaddr, size_t pagesize)
+{
+    int level = pagesize == LARGE_PAGE_SIZE ? 2 : 3;
+    struct mapping_table *table;
+    errval_t err = paging_spt_find(st, level, vaddr, false, &table);
+    if (err_is_fail(err)) {
+        // a superpage is mapped on the way
+        return false;
+    }
+    if (table == NULL) {
+        return true;
+    }
+
+    int index = (vaddr >> (level == 2 ? LARGE_PAGE_BITS : BASE_PAGE_BITS)) & 0x1FF;
+    return capref_is_null(table->mapping_caps[index]) &&
+           (level == 3 || table->children[index] == NULL);
+}
+
+/**
+ * \brief backs [vaddr, vaddr + bytes) with a single newly allocated frame
+ */
+static errval_t paging_map_new_frame(struct paging_state *st, lvaddr_t vaddr, size_t bytes,
+                                     size_t alignment, int flags)
+{
+    struct capref frame;
+    size_t retbytes;
+    errval_t err = frame_alloc_aligned(&frame, bytes, alignment, &retbytes);
+    ON_ERR_RETURN(err);
+
+    err = paging_map_fixed_attr(st, vaddr, frame, bytes, flags);
+    if (err_is_fail(err)) {
+        cap_destroy(frame);
+    }
+    return err;
+}
+
+static errval_t paging_prefault_locked(struct paging_state *st, struct paging_region *pr,
+                                       lvaddr_t start, lvaddr_t end)
+{
+    errval_t err;
+    int flags = pr->flags ? : VREGION_FLAGS_READ_WRITE;
+    const size_t max_large_run = PAGING_FAULT_AROUND_MAX_LARGE * LARGE_PAGE_SIZE;
+
+    lvaddr_t vaddr = start;
+    while (vaddr < end) {
+        size_t run;
+        if (vaddr % LARGE_PAGE_SIZE == 0 && vaddr + LARGE_PAGE_SIZE <= end &&
+                paging_range_is_free(st, vaddr, LARGE_PAGE_SIZE)) {
+            // whole 2 MiB ranges are backed by physically contiguous frames,
+            // so paging_map_fixed_attr maps them as L2 blocks
+            run = LARGE_PAGE_SIZE;
+            while (run < max_large_run && vaddr + run + LARGE_PAGE_SIZE <= end &&
+                    paging_range_is_free(st, vaddr + run, LARGE_PAGE_SIZE)) {
+                run += LARGE_PAGE_SIZE;
+            }
+            err = paging_map_new_frame(st, vaddr, run, LARGE_PAGE_SIZE, flags);
+            ON_ERR_RETURN(err);
+        }
+        else if (paging_range_is_free(st, vaddr, BASE_PAGE_SIZE)) {
+            // a run of base pages never crosses into the next 2 MiB range, as
+            // that one might be mappable as a whole
+            run = BASE_PAGE_SIZE;
+            while (vaddr + run < end && (vaddr + run) % LARGE_PAGE_SIZE != 0 &&
+                    paging_range_is_free(st, vaddr + run, BASE_PAGE_SIZE)) {
+                run += BASE_PAGE_SIZE;
+            }
+            err = paging_map_new_frame(st, vaddr, run, BASE_PAGE_SIZE, flags);
+            ON_ERR_RETURN(err);
+        }
+        else {
+            run = BASE_PAGE_SIZE;
+        }
+        vaddr += run;
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief map all not yet mapped pages in [base, base + len) of a lazily
+ * mapped region.
+ *
+ * Meant for callers that are about to stream through a buffer and want to
+ * avoid taking one fault after another. Every 2 MiB aligned range that is
+ * fully covered and not mapped yet is mapped as a large page.
+ */
+errval_t paging_region_prefault(struct paging_region *pr, lvaddr_t base, size_t len)
+{
+    assert(pr != NULL);
+    struct paging_state *st = get_current_paging_state();
+
+    lvaddr_t start = ROUND_DOWN(base, BASE_PAGE_SIZE);
+    lvaddr_t end = ROUND_UP(base + len, BASE_PAGE_SIZE);
+    if (pr->map_large_pages) {
+        start = ROUND_DOWN(start, LARGE_PAGE_SIZE);
+        end = ROUND_UP(end, LARGE_PAGE_SIZE);
+    }
+    if (start < pr->base_addr) {
+        start = pr->base_addr;
+    }
+    if (end > pr->base_addr + pr->region_size) {
+        end = pr->base_addr + pr->region_size;
+    }
+
+    PAGING_LOCK(st);
+    errval_t err = paging_prefault_locked(st, pr, start, end);
+    PAGING_UNLOCK(st);
+    return err;
+}
+
+/**
+ * \brief handles a fault at `addr` inside the lazily mapped region `pr`
+ *
+ * If the fault directly follows the range mapped on the previous fault, the
+ * access is considered sequential and the number of pages mapped per fault is
+ * doubled (up to PAGING_FAULT_AROUND_MAX_PAGES or _LARGE), otherwise it falls
+ * back to a single page. Once a base page region streams at the maximum
+ * window, the whole surrounding 2 MiB range is mapped, as a large page if
+ * nothing in it is mapped yet. Stacks grow downwards and have a guard page,
+ * so they are always mapped page by page.
+ *
+ * \return LIB_ERR_PMAP_EXISTING_MAPPING if the page at `addr` is mapped
+ * already, e.g. by another thread or read-only
+ */
+errval_t paging_region_fault(struct paging_state *st, struct paging_region *pr, lvaddr_t addr)
+{
+    size_t pagesize = pr->map_large_pages ? LARGE_PAGE_SIZE : BASE_PAGE_SIZE;
+    size_t max_window = pr->map_large_pages ? PAGING_FAULT_AROUND_MAX_LARGE : PAGING_FAULT_AROUND_MAX_PAGES;
+    lvaddr_t vaddr = ROUND_DOWN(addr, pagesize);
+    lvaddr_t region_end = pr->base_addr + pr->region_size;
+
+    // the window is shared by all threads faulting in the region
+    PAGING_LOCK(st);
+
+    // only an unmapped page faults for lack of a mapping, anything else
+    // would fault again after returning
+    if (!paging_range_is_free(st, ROUND_DOWN(addr, BASE_PAGE_SIZE), BASE_PAGE_SIZE)) {
+        PAGING_UNLOCK(st);
+        return LIB_ERR_PMAP_EXISTING_MAPPING;
+    }
+
+    if (pr->type == PAGING_REGION_STACK) {
+        pr->fault_window = 1;
+    }
+    else if (vaddr == pr->fault_next && pr->fault_window > 0) {
+        pr->fault_window = pr->fault_window * 2 > max_window ? max_window : pr->fault_window * 2;
+    }
+    else {
+        pr->fault_window = 1;
+    }
+
+    lvaddr_t start = vaddr;
+    lvaddr_t end = vaddr + pr->fault_window * pagesize;
+    if (!pr->map_large_pages) {
+        lvaddr_t large_start = ROUND_DOWN(vaddr, LARGE_PAGE_SIZE);
+        if (pr->fault_window == max_window && pr->type != PAGING_REGION_STACK &&
+                large_start >= pr->base_addr && large_start + LARGE_PAGE_SIZE <= region_end) {
+            start = large_start;
+            end = large_start + LARGE_PAGE_SIZE;
+        }
+        else if (end > large_start + LARGE_PAGE_SIZE) {
+            end = large_start + LARGE_PAGE_SIZE;
+        }
+    }
+    if (end > region_end) {
+        end = region_end;
+    }
+    pr->fault_next = end;
+
+    errval_t err = paging_prefault_locked(st, pr, start, end);
+    PAGING_UNLOCK(st);
+    return err;
+}
+
 /**
  * \brief creates a frame and maps it around the specified address
  * 
@@ -171,13 +359,19 @@ errval_t paging_init_state(struct paging_state *st, lvaddr_t start_vaddr,
     slab_init(&st->mappings_alloc, sizeof(struct mapping_table), NULL);
     slab_grow(&st->mappings_alloc, init_mem, sizeof(init_mem));
 
-    struct paging_region *free_region = &st->free_region;
-    free_region->base_addr = 0;
-    free_region->region_size = 0x0000FFFFFFFFFFFFULL;
-    free_region->type = PAGING_REGION_FREE;
-    free_region->prev = NULL;
-    free_region->next = NULL;
-    st->head = &st->free_region;
+    // Init region index and free vspace, all of the address space is free at first
+    static char index_mem[SLAB_STATIC_SIZE(8, sizeof(struct paging_region_index_node))];
+    slab_init(&st->region_index_alloc, sizeof(struct paging_region_index_node), slab_default_refill);
+    slab_grow(&st->region_index_alloc, index_mem, sizeof(index_mem));
+
+    static char free_range_mem[SLAB_STATIC_SIZE(32, sizeof(struct paging_free_range))];
+    slab_init(&st->free_range_alloc, sizeof(struct paging_free_range), slab_default_refill);
+    slab_grow(&st->free_range_alloc, free_range_mem, sizeof(free_range_mem));
+
+    st->head = NULL;
+    st->free_ranges = NULL;
+    errval_t err = free_range_add(st, 0, 1UL << 48);
+    ON_ERR_RETURN(err);
 
     paging_region_init(st, &st->vaddr_offset_region, start_vaddr, 0);
     st->vaddr_offset_region.lazily_mapped = false;
@@ -361,70 +555,295 @@ errval_t paging_region_init_aligned(struct paging_state *st, struct paging_regio
 }
 
 
-struct paging_region *paging_region_lookup(struct paging_state *st, lvaddr_t vaddr)
+/*
+ * Region index
+ *
+ * All paging regions are 2 MiB aligned and sized, so every 2 MiB granule of
+ * the address space belongs to at most one region. The index is a three level
+ * radix tree over these granules (9 bits per level, like the page tables).
+ * An entry is either 0, a region pointer tagged with PAGING_RIDX_LEAF if the
+ * whole range covered by the entry belongs to that region, or a pointer to a
+ * node of the next level.
+ *
+ * Updates happen under the paging lock. Nodes are fully initialized before
+ * they are published and never freed, so lookups do not need the lock.
+ */
+
+#define PAGING_RIDX_LEAF ((uintptr_t) 1)
+#define PAGING_RIDX_BITS 9
+
+static inline size_t ridx_entry_granules(int level)
 {
-    PAGING_LOCK(st);
-    const uint64_t pt_index[4] = {
-        (vaddr >> (12 + 3 * 9)) & 0x1FF,
-        (vaddr >> (12 + 2 * 9)) & 0x1FF,
-        (vaddr >> (12 + 1 * 9)) & 0x1FF,
-        (vaddr >> (12 + 0 * 9)) & 0x1FF,
-    };
+    return (size_t) 1 << (PAGING_RIDX_BITS * (2 - level));
+}
+
+static errval_t ridx_set(struct paging_state *st, struct paging_region_index_node *node, int level,
+                         uint64_t node_first, uint64_t first, uint64_t last, uintptr_t value)
+{
+    size_t span = ridx_entry_granules(level);
+    size_t from = first > node_first ? (first - node_first) / span : 0;
+    size_t to = (last - node_first) / span;
+    if (to >= PTABLE_ENTRIES) {
+        to = PTABLE_ENTRIES - 1;
+    }
+
+    for (size_t i = from; i <= to; i++) {
+        uint64_t entry_first = node_first + i * span;
+        uint64_t entry_last = entry_first + span - 1;
+
+        if (first <= entry_first && entry_last <= last) {
+            // a child node that is dropped here stays valid for concurrent lookups
+            __atomic_store_n(&node->entries[i], value, __ATOMIC_RELEASE);
+            continue;
+        }
 
-    struct mapping_table *nearest = &st->map_l0;
-    for (size_t i = 0; i < 3; i++) {
-        struct mapping_table *nearest_child = nearest->children[pt_index[i]];
-        if (nearest_child != NULL) {
-            nearest = nearest_child;
+        uintptr_t entry = node->entries[i];
+        struct paging_region_index_node *child;
+        if (entry == 0 || (entry & PAGING_RIDX_LEAF)) {
+            child = slab_alloc(&st->region_index_alloc);
+            NULLPTR_CHECK(child, LIB_ERR_SLAB_ALLOC_FAIL);
+            for (size_t j = 0; j < PTABLE_ENTRIES; j++) {
+                child->entries[j] = entry;
+            }
+            __atomic_store_n(&node->entries[i], (uintptr_t) child, __ATOMIC_RELEASE);
         }
         else {
-            break;
+            child = (struct paging_region_index_node *) entry;
         }
+
+        errval_t err = ridx_set(st, child, level + 1, entry_first, first, last, value);
+        ON_ERR_RETURN(err);
     }
+    return SYS_ERR_OK;
+}
 
-    struct paging_region *region = nearest->region ? : st->head;
-    for (; region != NULL; region = region->next) {
-        if (region->base_addr <= vaddr && region->base_addr + region->region_size > vaddr) {
-            PAGING_UNLOCK(st);
-            return region;
-        }
+/**
+ * \brief sets the region of all granules in [base, base + size) to `pr` (may be NULL)
+ */
+static errval_t ridx_update(struct paging_state *st, lvaddr_t base, size_t size, struct paging_region *pr)
+{
+    if (size == 0) {
+        return SYS_ERR_OK;
     }
+    uintptr_t value = pr == NULL ? 0 : (uintptr_t) pr | PAGING_RIDX_LEAF;
+    return ridx_set(st, &st->region_index, 0, 0, base >> LARGE_PAGE_BITS,
+                    (base + size - 1) >> LARGE_PAGE_BITS, value);
+}
 
-    PAGING_UNLOCK(st);
+/**
+ * \brief finds the paging region containing `vaddr`
+ *
+ * This is called on every page fault. It does not take the paging lock and
+ * takes at most three memory accesses.
+ */
+struct paging_region *paging_region_lookup(struct paging_state *st, lvaddr_t vaddr)
+{
+    if (vaddr > 0x0000FFFFFFFFFFFFULL) {
+        return NULL;
+    }
+
+    uint64_t granule = vaddr >> LARGE_PAGE_BITS;
+    struct paging_region_index_node *node = &st->region_index;
+    for (int level = 0; level < 3; level++) {
+        size_t index = (granule >> (PAGING_RIDX_BITS * (2 - level))) & (PTABLE_ENTRIES - 1);
+        uintptr_t entry = __atomic_load_n(&node->entries[index], __ATOMIC_ACQUIRE);
+        if (entry == 0) {
+            return NULL;
+        }
+        if (entry & PAGING_RIDX_LEAF) {
+            return (struct paging_region *) (entry & ~PAGING_RIDX_LEAF);
+        }
+        node = (struct paging_region_index_node *) entry;
+    }
     return NULL;
 }
 
 
-static bool pr_intersects(lvaddr_t addr, size_t size, struct paging_region *pr) {
-    return (addr + size > pr->base_addr) || (pr->base_addr + pr->region_size > addr);
+/*
+ * Free virtual address ranges, kept in an AVL tree ordered by (size, base)
+ * for best-fit allocation.
+ */
+
+static inline bool free_range_less(struct paging_free_range *a, struct paging_free_range *b)
+{
+    return a->size < b->size || (a->size == b->size && a->base < b->base);
 }
 
-static bool pr_inside(lvaddr_t addr, struct paging_region *pr) {
-    return (addr >= pr->base_addr) && (addr < pr->base_addr + pr->region_size);
+static inline int free_range_height(struct paging_free_range *r)
+{
+    return r == NULL ? 0 : r->height;
 }
 
-static errval_t update_spt(struct mapping_table *mt, lvaddr_t mt_start, int level, struct paging_region *pr)
+static inline void free_range_update(struct paging_free_range *r)
 {
-    if (pr_inside(mt_start, pr)) {
-        mt->region = pr;
+    int l = free_range_height(r->left);
+    int h = free_range_height(r->right);
+    r->height = (l > h ? l : h) + 1;
+}
+
+static struct paging_free_range *free_range_rotate_right(struct paging_free_range *r)
+{
+    struct paging_free_range *l = r->left;
+    r->left = l->right;
+    l->right = r;
+    free_range_update(r);
+    free_range_update(l);
+    return l;
+}
+
+static struct paging_free_range *free_range_rotate_left(struct paging_free_range *r)
+{
+    struct paging_free_range *h = r->right;
+    r->right = h->left;
+    h->left = r;
+    free_range_update(r);
+    free_range_update(h);
+    return h;
+}
+
+static struct paging_free_range *free_range_rebalance(struct paging_free_range *r)
+{
+    free_range_update(r);
+    int balance = free_range_height(r->left) - free_range_height(r->right);
+    if (balance > 1) {
+        if (free_range_height(r->left->left) < free_range_height(r->left->right)) {
+            r->left = free_range_rotate_left(r->left);
+        }
+        return free_range_rotate_right(r);
+    }
+    if (balance < -1) {
+        if (free_range_height(r->right->right) < free_range_height(r->right->left)) {
+            r->right = free_range_rotate_right(r->right);
+        }
+        return free_range_rotate_left(r);
     }
+    return r;
+}
 
-    int shift_level = 12 + (3 - level) * 9;
-    for (size_t i = 0; i < PTABLE_ENTRIES; i++) {
-        lvaddr_t this_start = mt_start + (i << shift_level);
+static struct paging_free_range *free_range_insert(struct paging_free_range *root,
+                                                   struct paging_free_range *r)
+{
+    if (root == NULL) {
+        r->left = r->right = NULL;
+        r->height = 1;
+        return r;
+    }
+    if (free_range_less(r, root)) {
+        root->left = free_range_insert(root->left, r);
+    }
+    else {
+        root->right = free_range_insert(root->right, r);
+    }
+    return free_range_rebalance(root);
+}
+
+static struct paging_free_range *free_range_remove_min(struct paging_free_range *root,
+                                                       struct paging_free_range **min)
+{
+    if (root->left == NULL) {
+        *min = root;
+        return root->right;
+    }
+    root->left = free_range_remove_min(root->left, min);
+    return free_range_rebalance(root);
+}
 
-        if (level < 3 && mt->children[i] != NULL && 
-                pr_intersects(this_start, 1 << shift_level, pr)) {
-            update_spt(mt->children[i], this_start, level + 1, pr);
+static struct paging_free_range *free_range_remove(struct paging_free_range *root,
+                                                   struct paging_free_range *r)
+{
+    if (root == NULL) {
+        return NULL;
+    }
+    if (root == r) {
+        if (r->right == NULL) {
+            return r->left;
         }
+        struct paging_free_range *succ;
+        struct paging_free_range *right = free_range_remove_min(r->right, &succ);
+        succ->left = r->left;
+        succ->right = right;
+        return free_range_rebalance(succ);
     }
-    return SYS_ERR_OK;
+    if (free_range_less(r, root)) {
+        root->left = free_range_remove(root->left, r);
+    }
+    else {
+        root->right = free_range_remove(root->right, r);
+    }
+    return free_range_rebalance(root);
 }
 
+static inline bool free_range_fits(struct paging_free_range *r, size_t bytes, size_t alignment)
+{
+    lvaddr_t start = ROUND_UP(r->base, alignment);
+    return start >= r->base && start + bytes <= r->base + r->size;
+}
+
+/**
+ * \brief finds the smallest free range that can hold `bytes` at `alignment`
+ */
+static struct paging_free_range *free_range_best_fit(struct paging_free_range *root,
+                                                     size_t bytes, size_t alignment)
+{
+    if (root == NULL) {
+        return NULL;
+    }
+    if (root->size < bytes) {
+        return free_range_best_fit(root->right, bytes, alignment);
+    }
+    struct paging_free_range *best = free_range_best_fit(root->left, bytes, alignment);
+    if (best != NULL) {
+        return best;
+    }
+    if (free_range_fits(root, bytes, alignment)) {
+        return root;
+    }
+    return free_range_best_fit(root->right, bytes, alignment);
+}
 
-static errval_t update_region_lookups(struct paging_state *st, struct paging_region *pr)
+static errval_t free_range_add(struct paging_state *st, lvaddr_t base, size_t size)
 {
-    return update_spt(&st->map_l0, 0, 0, pr);
+    struct paging_free_range *r = slab_alloc(&st->free_range_alloc);
+    NULLPTR_CHECK(r, LIB_ERR_SLAB_ALLOC_FAIL);
+    r->base = base;
+    r->size = size;
+    st->free_ranges = free_range_insert(st->free_ranges, r);
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief takes `bytes` of virtual address space at `alignment` out of the free ranges
+ *
+ * The paging lock must be held.
+ */
+static errval_t vspace_alloc(struct paging_state *st, size_t bytes, size_t alignment, lvaddr_t *ret)
+{
+    assert(alignment > 0);
+    struct paging_free_range *r = free_range_best_fit(st->free_ranges, bytes, alignment);
+    NULLPTR_CHECK(r, LIB_ERR_VSPACE_MMU_AWARE_NO_SPACE);
+
+    st->free_ranges = free_range_remove(st->free_ranges, r);
+
+    lvaddr_t start = ROUND_UP(r->base, alignment);
+    size_t prefix = start - r->base;
+    size_t suffix = r->base + r->size - (start + bytes);
+
+    // reuse the node for the suffix, the prefix (if any) needs a new one
+    if (suffix > 0) {
+        r->base = start + bytes;
+        r->size = suffix;
+        st->free_ranges = free_range_insert(st->free_ranges, r);
+    }
+    else {
+        slab_free(&st->free_range_alloc, r);
+    }
+    if (prefix > 0) {
+        errval_t err = free_range_add(st, start - prefix, prefix);
+        ON_ERR_RETURN(err);
+    }
+
+    *ret = start;
+    return SYS_ERR_OK;
 }
 
 
@@ -441,52 +860,46 @@ errval_t paging_region_init(struct paging_state *st, struct paging_region *pr,
                             size_t size, paging_flags_t flags)
 {
     assert(st != NULL && pr != NULL);
+    errval_t err;
 
     // make sure all paging regions are 2 MiB aligned
     size = ROUND_UP(size, LARGE_PAGE_SIZE);
 
-    struct paging_region *region = st->head;
-    for (; region != NULL; region = region->next) {
-        if (region->type == PAGING_REGION_FREE && region->region_size >= size) {
-            break;
-        }
+    PAGING_LOCK(st);
+    lvaddr_t base;
+    err = vspace_alloc(st, size, LARGE_PAGE_SIZE, &base);
+    if (err_is_fail(err)) {
+        PAGING_UNLOCK(st);
+        return err;
     }
 
-    NULLPTR_CHECK(region, LIB_ERR_VSPACE_MMU_AWARE_NO_SPACE);
-
     // set lazy mapping to true as default
     pr->lazily_mapped = true;
+    pr->fault_next = 0;
+    pr->fault_window = 0;
 
     pr->region_size = size;
     pr->flags = flags;
-    pr->next = region;
-    pr->prev = region->prev;
-    pr->base_addr = region->base_addr;
+    pr->base_addr = base;
     pr->current_addr = pr->base_addr;
 
-    if (st->head == region) {
-        st->head = pr;
+    pr->prev = NULL;
+    pr->next = st->head;
+    if (st->head != NULL) {
+        st->head->prev = pr;
     }
+    st->head = pr;
 
-    region->base_addr += size;
-    region->region_size -= size;
-    region->current_addr = region->base_addr;
-    region->prev = pr;
-
-    if(pr->prev != NULL) {
-        pr->prev->next = pr;
-    }
-    errval_t err = update_region_lookups(st, pr);
+    err = ridx_update(st, base, size, pr);
+    PAGING_UNLOCK(st);
     ON_ERR_RETURN(err);
 
     return SYS_ERR_OK;
-    //return paging_region_init_aligned(st, pr, size, BASE_PAGE_SIZE, flags);
 }
 
 errval_t paging_region_delete(struct paging_state *ps, struct paging_region *pr)
 {
-    // TODO: implement
-
+    PAGING_LOCK(ps);
     if (pr->prev == NULL) {
         ps->head = pr->next;
     }
@@ -497,7 +910,16 @@ errval_t paging_region_delete(struct paging_state *ps, struct paging_region *pr)
         pr->next->prev = pr->prev;
     }
     pr->type = PAGING_REGION_FREE;
-    return SYS_ERR_OK;
+
+    errval_t err = ridx_update(ps, pr->base_addr, pr->region_size, NULL);
+    if (err_is_ok(err)) {
+        // XXX: the pages mapped in the region are not unmapped (see
+        //      paging_unmap), so the next lazily mapped region placed here just
+        //      reuses them. This is what makes thread stacks cheap to recycle.
+        err = free_range_add(ps, pr->base_addr, pr->region_size);
+    }
+    PAGING_UNLOCK(ps);
+    return err;
 }
 
 /**
@@ -546,9 +968,10 @@ errval_t paging_region_unmap(struct paging_region *pr, lvaddr_t base, size_t byt
 }
 
 /** 
- * TODO(M2): Implement this function.
  * \brief Find a bit of free virtual address space that is large enough to accomodate a
  *        buffer of size 'bytes'.
+ *
+ * The smallest free range that can hold the buffer is used (best fit).
  * 
  * \param st A pointer to the paging state.
  * \param buf This parameter is used to return the free virtual address that was found.
@@ -561,24 +984,21 @@ errval_t paging_region_unmap(struct paging_region *pr, lvaddr_t base, size_t byt
 
 errval_t paging_alloc(struct paging_state *st, void **buf, size_t bytes, size_t alignment)
 {
-    /**
-     * TODO(M2): Implement this function
-     * \brief Find a bit of free virtual address space that is large enough to
-     *        accomodate a buffer of size `bytes`.
-     */
     assert(st != NULL);
-    /*
-    if (st->current_address + bytes < st->current_address) {
-        HERE;
-        DEBUG_PRINTF("critical: vspace exhausted");
+    if (bytes == 0) {
         return LIB_ERR_VSPACE_MMU_AWARE_NO_SPACE;
     }
+    if (alignment < BASE_PAGE_SIZE) {
+        alignment = BASE_PAGE_SIZE;
+    }
 
-    lvaddr_t base = ROUND_UP(st->current_address, alignment);
-    st->current_address = ROUND_UP(base + ROUND_UP(bytes, BASE_PAGE_SIZE), BASE_PAGE_SIZE);
+    lvaddr_t base;
+    PAGING_LOCK(st);
+    errval_t err = vspace_alloc(st, ROUND_UP(bytes, BASE_PAGE_SIZE), alignment, &base);
+    PAGING_UNLOCK(st);
+    ON_ERR_RETURN(err);
 
-    *buf = (void*) base;
-    */
+    *buf = (void *) base;
     return SYS_ERR_OK;
 }
 
@@ -824,9 +1244,6 @@ errval_t paging_spt_find(struct paging_state *st, int level, lvaddr_t vaddr, boo
 
             init_mapping_table(child);
 
-            lvaddr_t vnode_start_address = vaddr & ~((1 << (12 + (3 - i) * 9)) - 1);
-            child->region = paging_region_lookup(st, vnode_start_address);
-
             child->pt_cap = pt_cap;
             table->children[index] = child;
             table->mapping_caps[index] = mapping_cap;
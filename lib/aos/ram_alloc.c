@@ -16,12 +16,104 @@
 #include <aos/aos_rpc.h>
 #include <aos/core_state.h>
 
+/**
+ * \brief hands out `size` bytes of a batch by retyping them into a new RAM cap
+ *
+ * If the batch is exhausted, a new one is requested and whatever is left in
+ * the old one is dropped together with its parent cap. The children already
+ * handed out stay valid, as they are descendants of it.
+ *
+ * The lock is never held while allocating slots or talking to the memory
+ * server: the slot allocator and the paging code call back into ram_alloc
+ * while holding their own locks, and refilling them may page fault.
+ */
+static errval_t ram_batch_alloc(struct thread_mutex *lock, struct ram_batch *batch,
+                                struct capref *ret, size_t block, size_t limit, size_t size)
+{
+    errval_t err;
+    size = ROUND_UP(size, BASE_PAGE_SIZE);
+
+    err = slot_alloc(ret);
+    ON_ERR_PUSH_RETURN(err, LIB_ERR_SLOT_ALLOC);
+
+    thread_mutex_lock_nested(lock);
+    if (batch->offset + size <= batch->size) {
+        err = cap_retype(*ret, batch->cap, batch->offset, ObjType_RAM, size, 1);
+        if (err_is_ok(err)) {
+            batch->offset += size;
+        }
+        thread_mutex_unlock(lock);
+    }
+    else {
+        size_t request = ROUND_UP(size, block);
+        if (batch->next_request > request) {
+            request = batch->next_request;
+        }
+        // grow the batches while a domain keeps allocating
+        if (batch->next_request < limit) {
+            batch->next_request *= 2;
+        }
+        thread_mutex_unlock(lock);
+
+        struct capref cap;
+        size_t ret_count;
+        err = aos_rpc_get_ram_batch(aos_rpc_get_memory_channel(), request / block, block,
+                                    &cap, &ret_count);
+        if (err_is_ok(err) && ret_count * block < size) {
+            cap_destroy(cap);
+            err = LIB_ERR_RAM_ALLOC;
+        }
+        if (err_is_fail(err)) {
+            slot_free(*ret);
+            return err;
+        }
+
+        // another thread might have refilled in the meantime, but the fresh
+        // batch is at least as good as whatever it got
+        thread_mutex_lock_nested(lock);
+        struct capref old = batch->cap;
+        bool drop_old = batch->size != 0;
+        batch->cap = cap;
+        batch->size = ret_count * block;
+        batch->offset = 0;
+        err = cap_retype(*ret, batch->cap, 0, ObjType_RAM, size, 1);
+        if (err_is_ok(err)) {
+            batch->offset = size;
+        }
+        thread_mutex_unlock(lock);
+
+        if (drop_old) {
+            cap_destroy(old);
+        }
+    }
+
+    if (err_is_fail(err)) {
+        slot_free(*ret);
+        return err_push(err, LIB_ERR_CAP_RETYPE);
+    }
+    return SYS_ERR_OK;
+}
+
 /* remote (indirect through a channel) version of ram_alloc, for most domains */
 static errval_t ram_alloc_remote(struct capref *ret, size_t size, size_t alignment)
 {
-    //TODO(M3): Implement me!
+    struct ram_alloc_state *state = get_ram_alloc_state();
+
+    // Small allocations (page tables, slab and shadow page table refills,
+    // cnodes) and large pages for the lazily mapped heap come in bursts, so
+    // they are served from batches fetched in a single round trip each.
+    // Domains never give ram back to the memory server, so handing out
+    // children of a bigger cap does not break freeing.
+    if (size <= RAM_BATCH_SMALL_MAX && alignment <= BASE_PAGE_SIZE) {
+        return ram_batch_alloc(&state->ram_alloc_lock, &state->small_batch, ret,
+                               BASE_PAGE_SIZE, RAM_BATCH_SMALL_LIMIT, size);
+    }
+    if (size == LARGE_PAGE_SIZE && alignment <= LARGE_PAGE_SIZE) {
+        return ram_batch_alloc(&state->ram_alloc_lock, &state->large_batch, ret,
+                               LARGE_PAGE_SIZE, RAM_BATCH_LARGE_LIMIT * LARGE_PAGE_SIZE, size);
+    }
+
     return aos_rpc_get_ram_cap(aos_rpc_get_memory_channel(), size, alignment, ret, NULL);
-    //return LIB_ERR_NOT_IMPLEMENTED;
 }
 
 
@@ -118,6 +210,11 @@ void ram_alloc_init(void)
     ram_alloc_state->default_minbase  = 0;
     ram_alloc_state->default_maxlimit = 0;
     ram_alloc_state->base_capnum      = 0;
+
+    memset(&ram_alloc_state->small_batch, 0, sizeof(struct ram_batch));
+    memset(&ram_alloc_state->large_batch, 0, sizeof(struct ram_batch));
+    ram_alloc_state->small_batch.next_request = RAM_BATCH_SMALL_MIN;
+    ram_alloc_state->large_batch.next_request = LARGE_PAGE_SIZE;
 }
 
 /**
@@ -1,4 +1,4 @@
-    /**
+/**
  * \file
  * \brief Simple slab allocator.
  *
@@ -38,8 +38,13 @@ void slab_init(struct slab_allocator *slabs, size_t blocksize,
     assert(slabs != NULL);
 
     slabs->slabs = NULL;
+    slabs->blocks = NULL;
+    slabs->freecount = 0;
     slabs->blocksize = SLAB_REAL_BLOCKSIZE(blocksize);
     slabs->refill_func = refill_func;
+    slabs->allocs = 0;
+    slabs->refills = 0;
+    slabs->grows = 0;
 }
 
 
@@ -62,26 +67,34 @@ void slab_grow(struct slab_allocator *slabs, void *buf, size_t buflen)
     /* calculate number of blocks in buffer */
     size_t blocksize = slabs->blocksize;
     assert(buflen / blocksize <= UINT32_MAX);
-    head->free = head->total = buflen / blocksize;
+    head->total = buflen / blocksize;
     assert(head->total > 0);
 
-    /* enqueue blocks in freelist */
-    struct block_head *bh = head->blocks = buf;
+    /* enqueue blocks in freelist, in address order in front of the old ones */
+    struct block_head *first = buf;
+    struct block_head *bh = first;
     for (uint32_t i = head->total; i > 1; i--) {
         buf = (char *)buf + blocksize;
         bh->next = buf;
         bh = buf;
     }
-    bh->next = NULL;
+    bh->next = slabs->blocks;
+    slabs->blocks = first;
+    slabs->freecount += head->total;
 
     /* enqueue slab in list of slabs */
     head->next = slabs->slabs;
     slabs->slabs = head;
+    slabs->grows++;
 }
 
 /**
  * \brief Allocate a new block from the slab allocator
  *
+ * Free blocks of all slabs are kept in a single list, so this does not depend
+ * on the number of slabs. As slabs are never given back, there is no need to
+ * track which slab a block belongs to.
+ *
  * \param slabs Pointer to slab allocator instance
  *
  * \returns Pointer to block on success, NULL on error (out of memory)
@@ -90,37 +103,28 @@ void *slab_alloc(struct slab_allocator *slabs)
 {
     assert(slabs != NULL);
 
-  
-    errval_t err;
-    /* find a slab with free blocks */
-    struct slab_head *sh;
-    for (sh = slabs->slabs; sh != NULL && sh->free == 0; sh = sh->next);
-
-    if (sh == NULL) {
+    if (slabs->blocks == NULL) {
         /* out of memory. try refill function if we have one */
-
         if (!slabs->refill_func) {
             return NULL;
-        } else {
-            err = slabs->refill_func(slabs);
-            
-            if (err_is_fail(err)) {
-                DEBUG_ERR(err, "slab refill_func failed");
-                return NULL;
-            }
-            for (sh = slabs->slabs; sh != NULL && sh->free == 0; sh = sh->next);
-            if (sh == NULL) {
-                return NULL;
-            }
+        }
+
+        slabs->refills++;
+        errval_t err = slabs->refill_func(slabs);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "slab refill_func failed");
+            return NULL;
+        }
+        if (slabs->blocks == NULL) {
+            return NULL;
         }
     }
 
     /* dequeue top block from freelist */
-    assert(sh != NULL);
-    struct block_head *bh = sh->blocks;
-    assert(bh != NULL);
-    sh->blocks = bh->next;
-    sh->free--;
+    struct block_head *bh = slabs->blocks;
+    slabs->blocks = bh->next;
+    slabs->freecount--;
+    slabs->allocs++;
     return bh;
 }
 
@@ -138,24 +142,10 @@ void slab_free(struct slab_allocator *slabs, void *block)
 
     struct block_head *bh = (struct block_head *)block;
 
-    /* find matching slab */
-    struct slab_head *sh;
-    size_t blocksize = slabs->blocksize;
-    for (sh = slabs->slabs; sh != NULL; sh = sh->next) {
-        /* check if block falls inside this slab */
-        uintptr_t slab_limit = (uintptr_t)sh + sizeof(struct slab_head)
-                               + blocksize * sh->total;
-        if ((uintptr_t)bh > (uintptr_t)sh && (uintptr_t)bh < slab_limit) {
-            break;
-        }
-    }
-    assert(sh != NULL);
-
-    /* re-enqueue in slab's free list */
-    bh->next = sh->blocks;
-    sh->blocks = bh;
-    sh->free++;
-    assert(sh->free <= sh->total);
+    /* re-enqueue in the free list, it is the most likely one to be cache hot */
+    bh->next = slabs->blocks;
+    slabs->blocks = bh;
+    slabs->freecount++;
 }
 
 /**
@@ -168,14 +158,21 @@ void slab_free(struct slab_allocator *slabs, void *block)
 size_t slab_freecount(struct slab_allocator *slabs)
 {
     assert(slabs != NULL);
+    return slabs->freecount;
+}
 
-    size_t ret = 0;
-
+/**
+ * \brief Prints how often the allocator had to be refilled
+ */
+void slab_print_stats(struct slab_allocator *slabs, const char *name)
+{
+    size_t total = 0;
     for (struct slab_head *sh = slabs->slabs; sh != NULL; sh = sh->next) {
-        ret += sh->free;
+        total += sh->total;
     }
-
-    return ret;
+    debug_printf("slab %s: blocksize %zu, %zu/%zu blocks free, %zu allocs, "
+                 "%zu refills, %zu slabs\n", name, slabs->blocksize, slabs->freecount,
+                 total, slabs->allocs, slabs->refills, slabs->grows);
 }
 
 /**
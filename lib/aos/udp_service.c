@@ -1,127 +1,340 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <aos/nameserver.h>
 #include <aos/udp_service.h>
 
+/**
+ * \brief sends a request to the network service, returning its errval_t response
+ *
+ * Requests and responses are kept on the stack of the caller, no heap
+ * allocation is made for the call.
+ */
+static errval_t udp_service_call(nameservice_chan_t chan, struct udp_service_message *usm,
+                                 size_t msgsize, struct capref cap)
+{
+    errval_t ret;
+    size_t response_bytes;
+
+    errval_t err = nameservice_rpc_buf(chan, (void *) usm, msgsize,
+                                       &ret, sizeof(ret), &response_bytes,
+                                       cap, NULL_CAP);
+    ON_ERR_RETURN(err);
+    if (response_bytes != sizeof(ret)) {
+        return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+    }
+    return ret;
+}
+
 /**
  * \brief initialize an aos-socket with the given configurations.
  * \param sockref reference to socket instance data - all flags will be overwritten
  */
 errval_t aos_socket_initialize(struct aos_socket *sockref,
                                uint32_t ip_dest, uint16_t f_port, uint16_t l_port) {
-    errval_t *erref;
     errval_t err;
     err = nameservice_lookup(ENET_SERVICE_NAME, &sockref->_nschan);
     if (err_is_fail(err)) {
         return err;
     }
 
-    size_t msgsize =
-        sizeof(struct udp_service_message) +
-        sizeof(struct udp_socket_create_info);
+    struct {
+        struct udp_service_message usm;
+        struct udp_socket_create_info usci;
+    } __attribute__((__packed__)) msg;
 
-    struct udp_service_message *usm = malloc(msgsize);
-    usm->type = CREATE;
-    usm->port = l_port;
-    usm->len = 0;
-    struct udp_socket_create_info *usci = (struct udp_socket_create_info *) usm->data;
-    usci->f_port = f_port;
-    usci->ip_dest = ip_dest;
+    msg.usm.type = CREATE;
+    msg.usm.port = l_port;
+    msg.usm.len = 0;
+    msg.usci.f_port = f_port;
+    msg.usci.ip_dest = ip_dest;
 
-    size_t response_bytes;
-
-    err = nameservice_rpc(sockref->_nschan, (void *) usm, msgsize,
-                          (void **) &erref, &response_bytes,
-                          NULL_CAP, NULL_CAP);
-    free(usm);
+    err = udp_service_call(sockref->_nschan, &msg.usm, sizeof(msg), NULL_CAP);
 
     sockref->ip_dest = ip_dest;
     sockref->f_port = f_port;
     sockref->l_port = l_port;
+    sockref->rings = NULL;
+    sockref->notify = NULL;
+    sockref->notify_failed = false;
+
+    return err;
+}
 
-    if (!err_is_fail(err)) {
-        err = *erref;
+STATIC_ASSERT(offsetof(struct udp_ring_slot, data) == sizeof(struct udp_msg),
+              "payload of a ring slot has to follow its header");
+
+/**
+ * \brief maps rings shared with the driver for the socket
+ *
+ * The frame is handed to the driver with the request, from then on both sides
+ * only touch the ring indices.
+ */
+errval_t aos_socket_map_rings(struct aos_socket *sockref)
+{
+    if (sockref->rings != NULL) {
+        return SYS_ERR_OK;
     }
 
-    free(erref);
-    return err;
+    struct capref frame;
+    void *buf;
+    errval_t err = frame_alloc(&frame, UDP_RINGS_SIZE, NULL);
+    ON_ERR_PUSH_RETURN(err, LIB_ERR_FRAME_ALLOC);
+
+    err = paging_map_frame_complete(get_current_paging_state(), &buf, frame, NULL, NULL);
+    if (err_is_fail(err)) {
+        cap_destroy(frame);
+        return err_push(err, LIB_ERR_VSPACE_MAP);
+    }
+    memset(buf, 0, sizeof(struct udp_socket_rings));
+
+    struct udp_service_message usm = {
+        .type = MAP_RINGS,
+        .port = sockref->l_port,
+    };
+    err = udp_service_call(sockref->_nschan, &usm, sizeof(usm), frame);
+    if (err_is_fail(err)) {
+        // NOTE: unmapping is not supported, the mapping stays unused
+        cap_destroy(frame);
+        return err;
+    }
+
+    sockref->tx_head = 0;
+    sockref->tx_tail_cache = 0;
+    sockref->rx_tail = 0;
+    sockref->rx_head_cache = 0;
+    sockref->rings = buf;
+    return SYS_ERR_OK;
+}
+
+errval_t aos_socket_send_slot(struct aos_socket *sockref, struct udp_ring_slot **ret)
+{
+    struct udp_ring *tx = &sockref->rings->tx;
+
+    if (sockref->tx_head - sockref->tx_tail_cache == UDP_RING_SLOTS) {
+        sockref->tx_tail_cache = tx->tail;
+        if (sockref->tx_head - sockref->tx_tail_cache == UDP_RING_SLOTS) {
+            return ENET_ERR_RING_FULL;
+        }
+        dmb();  // overwrite slots only after the driver is done with them
+    }
+
+    *ret = &tx->slots[sockref->tx_head % UDP_RING_SLOTS];
+    return SYS_ERR_OK;
+}
+
+errval_t aos_socket_send_commit(struct aos_socket *sockref, uint16_t len,
+                                uint32_t ip, uint16_t port)
+{
+    if (len > MAX_PAYLOAD_LEN) {
+        return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+    }
+
+    struct udp_ring *tx = &sockref->rings->tx;
+    struct udp_ring_slot *slot = &tx->slots[sockref->tx_head % UDP_RING_SLOTS];
+    slot->msg.len = len;
+    slot->msg.ip = ip;
+    slot->msg.f_port = port;
+
+    dmb();  // publish after write
+    tx->head = ++sockref->tx_head;
+
+    dmb();  // read the flag after publishing head, pairs with the driver arming
+    if (tx->sleeping) {
+        struct udp_service_message usm = {
+            .type = KICK_TX,
+            .port = sockref->l_port,
+        };
+        return udp_service_call(sockref->_nschan, &usm, sizeof(usm), NULL_CAP);
+    }
+    return SYS_ERR_OK;
+}
+
+errval_t aos_socket_receive_slot(struct aos_socket *sockref, struct udp_msg **ret)
+{
+    struct udp_ring *rx = &sockref->rings->rx;
+
+    if (sockref->rx_tail == sockref->rx_head_cache) {
+        sockref->rx_head_cache = rx->head;
+        if (sockref->rx_tail == sockref->rx_head_cache) {
+            return LIB_ERR_NOT_IMPLEMENTED;
+        }
+        dmb();  // read datagrams after head
+    }
+
+    *ret = &rx->slots[sockref->rx_tail % UDP_RING_SLOTS].msg;
+    return SYS_ERR_OK;
+}
+
+void aos_socket_receive_release(struct aos_socket *sockref)
+{
+    dmb();  // release slots after read
+    sockref->rings->rx.tail = ++sockref->rx_tail;
 }
 
 /**
- * \brief send data over an aos_socket
+ * \brief copies a datagram into the tx ring, the driver picks it up from there
  */
-errval_t aos_socket_send(struct aos_socket *sockref, void *data, uint16_t len) {
-    errval_t *erref;
-    size_t msgsize = sizeof(struct udp_service_message) + len * sizeof(char);
-    struct udp_service_message *usm = malloc(msgsize);
+static errval_t ring_send(struct aos_socket *sockref, void *data, uint16_t len,
+                          uint32_t ip, uint16_t port)
+{
+    struct udp_ring_slot *slot;
+    errval_t err = aos_socket_send_slot(sockref, &slot);
+    ON_ERR_RETURN(err);
+
+    memcpy(slot->data, data, len);
+    return aos_socket_send_commit(sockref, len, ip, port);
+}
 
-    usm->type = SEND;
-    usm->port = sockref->l_port;
-    usm->len = len;
-    memcpy((void *) usm->data, data, len);
+/// endpoint the driver signals datagrams on, while the socket sleeps
+struct aos_socket_notify {
+    struct capref ep_cap;
+    struct lmp_endpoint *ep;
+    struct waitset ws;  ///< only the endpoint is waited on
+    bool woken;
+};
+
+static void socket_notify_handler(void *arg)
+{
+    struct aos_socket_notify *n = arg;
+    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;
+
+    // wakeups carry no payload, one is as good as many
+    while (err_is_ok(lmp_endpoint_recv(n->ep, &msg.buf, NULL))) {
+    }
+    n->woken = true;
+}
 
+/**
+ * \brief hands an endpoint to the driver that it signals rx datagrams on
+ */
+static errval_t socket_notify_setup(struct aos_socket *sockref)
+{
+    struct aos_socket_notify *n = malloc(sizeof(struct aos_socket_notify));
+    if (n == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
 
-    size_t response_bytes;
+    errval_t err = endpoint_create(DEFAULT_LMP_BUF_WORDS, &n->ep_cap, &n->ep);
+    if (err_is_fail(err)) {
+        free(n);
+        return err_push(err, LIB_ERR_ENDPOINT_CREATE);
+    }
+    waitset_init(&n->ws);
 
-    errval_t err = nameservice_rpc(sockref->_nschan, (void *) usm, msgsize,
-                                   (void **) &erref, &response_bytes,
-                                   NULL_CAP, NULL_CAP);
-    free(usm);
+    struct {
+        struct udp_service_message usm;
+        struct udp_socket_notify_info info;
+    } __attribute__((__packed__)) msg;
+
+    msg.usm.type = SET_NOTIFY;
+    msg.usm.port = sockref->l_port;
+    msg.usm.len = 0;
+    msg.info.core = disp_get_core_id();
 
-    if (!err_is_fail(err)) {
-        err = *erref;
+    err = udp_service_call(sockref->_nschan, &msg.usm, sizeof(msg), n->ep_cap);
+    if (err_is_fail(err)) {
+        lmp_endpoint_free(n->ep);
+        cap_destroy(n->ep_cap);
+        waitset_destroy(&n->ws);
+        free(n);
+        return err;
     }
 
-    free(erref);
-    return err;
+    sockref->notify = n;
+    return SYS_ERR_OK;
 }
 
-errval_t aos_socket_send_to(struct aos_socket *sockref, void *data, uint16_t len,
-                            uint32_t ip, uint16_t port) {
-    errval_t *erref = malloc(sizeof(errval_t));
-    size_t msgsize = sizeof(struct udp_service_message) + len * sizeof(char);
-    struct udp_service_message *usm = malloc(msgsize);
+static errval_t socket_notify_wait(struct aos_socket_notify *n)
+{
+    n->woken = false;
+    errval_t err = lmp_endpoint_register(n->ep, &n->ws,
+                                         MKCLOSURE(socket_notify_handler, n));
+    ON_ERR_RETURN(err);
 
-    usm->type = SEND_TO;
-    usm->port = sockref->l_port;
-    usm->len = len;
-    usm->ip = ip;
-    usm->tgt_port = port;
-    memcpy((void *) usm->data, data, len);
+    while (!n->woken) {
+        err = event_dispatch(&n->ws);
+        ON_ERR_RETURN(err);
+    }
+    return SYS_ERR_OK;
+}
 
-    size_t response_bytes;
+/// a request carrying the largest payload
+struct udp_service_send_buf {
+    struct udp_service_message usm;
+    char data[MAX_PAYLOAD_LEN];
+} __attribute__((__packed__));
 
-    errval_t err = nameservice_rpc(sockref->_nschan, (void *) usm, msgsize,
-                                   (void **) &erref, &response_bytes,
-                                   NULL_CAP, NULL_CAP);
-    free(usm);
+/**
+ * \brief send data over an aos_socket
+ */
+errval_t aos_socket_send(struct aos_socket *sockref, void *data, uint16_t len) {
+    if (len > MAX_PAYLOAD_LEN) {
+        return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+    }
+    if (sockref->rings != NULL) {
+        return ring_send(sockref, data, len, 0, 0);
+    }
 
-    if (!err_is_fail(err)) {
-        err = *erref;
+    struct udp_service_send_buf msg;
+    msg.usm.type = SEND;
+    msg.usm.port = sockref->l_port;
+    msg.usm.len = len;
+    memcpy(msg.data, data, len);
+
+    return udp_service_call(sockref->_nschan, &msg.usm,
+                            sizeof(struct udp_service_message) + len, NULL_CAP);
+}
+
+errval_t aos_socket_send_to(struct aos_socket *sockref, void *data, uint16_t len,
+                            uint32_t ip, uint16_t port) {
+    if (len > MAX_PAYLOAD_LEN) {
+        return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
+    }
+    if (sockref->rings != NULL) {
+        return ring_send(sockref, data, len, ip, port);
     }
 
-    free(erref);
-    return err;
+    struct udp_service_send_buf msg;
+    msg.usm.type = SEND_TO;
+    msg.usm.port = sockref->l_port;
+    msg.usm.len = len;
+    msg.usm.ip = ip;
+    msg.usm.tgt_port = port;
+    memcpy(msg.data, data, len);
+
+    return udp_service_call(sockref->_nschan, &msg.usm,
+                            sizeof(struct udp_service_message) + len, NULL_CAP);
 }
 
+/**
+ * \brief receive a datagram into retptr
+ *
+ * retptr has to hold UDP_MSG_MAX_SIZE bytes, the datagram is received into it
+ * directly.
+ */
 errval_t aos_socket_receive(struct aos_socket *sockref, struct udp_msg *retptr) {
-    size_t msgsize = sizeof(struct udp_service_message);
-    struct udp_service_message *usm = malloc(msgsize);
+    if (sockref->rings != NULL) {
+        struct udp_msg *msg;
+        errval_t err = aos_socket_receive_slot(sockref, &msg);
+        ON_ERR_RETURN(err);
+        memcpy(retptr, msg, sizeof(struct udp_msg) + msg->len);
+        aos_socket_receive_release(sockref);
+        return SYS_ERR_OK;
+    }
 
-    usm->type = RECV;
-    usm->port = sockref->l_port;
-    usm->len = 0;
+    struct udp_service_message usm = {
+        .type = RECV,
+        .port = sockref->l_port,
+        .len = 0,
+    };
 
-    void *response;
     size_t response_bites;
 
-    __unused errval_t err = nameservice_rpc(sockref->_nschan, (void *) usm, msgsize,
-                                   &response, &response_bites,
-                                   NULL_CAP, NULL_CAP);
-    free(usm);
-
-    memcpy(retptr, response, response_bites);
-    free(response);
+    errval_t err = nameservice_rpc_buf(sockref->_nschan, (void *) &usm, sizeof(usm),
+                                       retptr, UDP_MSG_MAX_SIZE, &response_bites,
+                                       NULL_CAP, NULL_CAP);
+    ON_ERR_RETURN(err);
 
     if (response_bites == 0) {
         return LIB_ERR_NOT_IMPLEMENTED;
@@ -130,24 +343,60 @@ errval_t aos_socket_receive(struct aos_socket *sockref, struct udp_msg *retptr)
     return SYS_ERR_OK;
 }
 
-errval_t aos_socket_teardown(struct aos_socket *sockref) {
-    errval_t *erref = malloc(sizeof(errval_t));
-    size_t msgsize = sizeof(struct udp_service_message);
-    struct udp_service_message *usm = malloc(msgsize);
-
-    usm->type = DESTROY;
-    usm->port = sockref->l_port;
-
-    size_t response_botes;
+/**
+ * \brief receive a datagram into retptr, sleeping until one arrives
+ */
+errval_t aos_socket_receive_blocking(struct aos_socket *sockref, struct udp_msg *retptr)
+{
+    errval_t err = aos_socket_map_rings(sockref);
+    ON_ERR_RETURN(err);
+
+    if (sockref->notify == NULL && !sockref->notify_failed) {
+        err = socket_notify_setup(sockref);
+        sockref->notify_failed = err_is_fail(err);
+    }
 
-    errval_t err = nameservice_rpc(sockref->_nschan, (void *) usm, msgsize,
-                                   (void **) &erref, &response_botes,
-                                   NULL_CAP, NULL_CAP);
-    free(usm);
+    struct udp_ring *rx = &sockref->rings->rx;
+    while (true) {
+        err = aos_socket_receive(sockref, retptr);
+        if (err != LIB_ERR_NOT_IMPLEMENTED) {
+            return err;
+        }
+
+        if (sockref->notify == NULL) {
+            thread_yield();
+            continue;
+        }
+
+        rx->sleeping = 1;
+        dmb();  // read head after announcing, pairs with the driver's wakeup
+        if (rx->head == sockref->rx_tail) {
+            err = socket_notify_wait(sockref->notify);
+        }
+        rx->sleeping = 0;
+        ON_ERR_RETURN(err);
+    }
+}
 
-    err = err_is_fail(err) ? err : *erref;
+errval_t aos_socket_teardown(struct aos_socket *sockref) {
+    struct udp_service_message usm = {
+        .type = DESTROY,
+        .port = sockref->l_port,
+    };
+
+    errval_t err = udp_service_call(sockref->_nschan, &usm, sizeof(usm), NULL_CAP);
+
+    if (sockref->notify != NULL) {
+        lmp_endpoint_free(sockref->notify->ep);
+        cap_destroy(sockref->notify->ep_cap);
+        waitset_destroy(&sockref->notify->ws);
+        free(sockref->notify);
+        sockref->notify = NULL;
+    }
 
-    free(erref);
+    // the driver no longer drains the rings, fall back to RPCs
+    // NOTE: unmapping is not supported, the mapping stays unused
+    sockref->rings = NULL;
     return err;
 }
 
@@ -189,42 +438,28 @@ errval_t aos_ping_init(struct aos_ping_socket *s, uint32_t ip) {
 }
 
 errval_t aos_ping_send(struct aos_ping_socket *s) {
-    errval_t *erref;
-    size_t msgsize = sizeof(struct udp_service_message);
-    struct udp_service_message *usm = malloc(msgsize);
-
-    usm->type = ICMP_PING_SEND;
-    usm->ip = s->ip;
-    usm->port = -1;
-    usm->len = -1;
-    usm->tgt_port = -1;
-
-    size_t response_betes;
-
-    errval_t err = nameservice_rpc(s->_nschan, (void *) usm, msgsize,
-                                   (void **) &erref, &response_betes,
-                                   NULL_CAP, NULL_CAP);
-    free(usm);
-    err = err_is_fail(err) ? err : *erref;
-    free(erref);
-    return err;
+    struct udp_service_message usm = {
+        .type = ICMP_PING_SEND,
+        .ip = s->ip,
+        .port = -1,
+        .len = -1,
+        .tgt_port = -1,
+    };
+
+    return udp_service_call(s->_nschan, &usm, sizeof(usm), NULL_CAP);
 }
 
 uint16_t aos_ping_recv(struct aos_ping_socket *s) {
-    uint16_t *resref;
-    size_t msgsize = sizeof(struct udp_service_message);
-    struct udp_service_message *usm = malloc(msgsize);
-
-    usm->type = ICMP_PING_RECV;
-    usm->ip = s->ip;
+    struct udp_service_message usm = {
+        .type = ICMP_PING_RECV,
+        .ip = s->ip,
+    };
 
+    uint16_t res;
     size_t response_betes;
 
-    errval_t err = nameservice_rpc(s->_nschan, (void *) usm, msgsize,
-                                   (void **) &resref, &response_betes,
-                                   NULL_CAP, NULL_CAP);
-    free(usm);
-    uint16_t res = err_is_fail(err) ? 0 : *resref;
-    free(resref);
-    return res;
+    errval_t err = nameservice_rpc_buf(s->_nschan, (void *) &usm, sizeof(usm),
+                                       &res, sizeof(res), &response_betes,
+                                       NULL_CAP, NULL_CAP);
+    return err_is_fail(err) || response_betes != sizeof(res) ? 0 : res;
 }
@@ -4,6 +4,24 @@
 #include <aos/dispatcher_arch.h>
 #include <aos/waitset.h>
 #include <aos/waitset_chan.h>
+#include <aos/systime.h>
+
+/**
+ * \brief Locate the ring indices of a pane and compute the number of message slots.
+ *
+ * The indices live at the end of the pane, so whatever is written to the start
+ * of a fresh frame before the channel is set up (e.g. the boot words in the
+ * URPC frame) is never mistaken for published messages.
+ */
+static void ump_chan_init_pane(void *pane, size_t pane_size, size_t msg_size,
+                               struct ump_ring_ctrl **ctrl, size_t *n_slots)
+{
+    assert(pane_size >= sizeof(struct ump_ring_ctrl) + msg_size);
+    assert(((lvaddr_t) pane + pane_size) % UMP_CACHE_LINE == 0);
+
+    *ctrl = pane + pane_size - sizeof(struct ump_ring_ctrl);
+    *n_slots = (pane_size - sizeof(struct ump_ring_ctrl)) / msg_size;
+}
 
 /**
  * \brief Like ump_chan_init_default, just with (maybe) a different msg_size than UMP_MSG_SIZE
@@ -18,10 +36,25 @@ errval_t ump_chan_init_size(struct ump_chan *chan, size_t msg_size,
     chan->send_pane = send_buf;
     chan->send_pane_size = send_buf_size;
     chan->send_buf_index = 0;
+    chan->send_head = 0;
+    chan->send_tail_cache = 0;
+    ump_chan_init_pane(send_buf, send_buf_size, msg_size, &chan->send_ctrl, &chan->send_n_slots);
 
     chan->recv_pane = recv_buf;
     chan->recv_pane_size = recv_buf_size;
     chan->recv_buf_index = 0;
+    chan->recv_tail = 0;
+    chan->recv_tail_pub = 0;
+    chan->recv_head_cache = 0;
+    ump_chan_init_pane(recv_buf, recv_buf_size, msg_size, &chan->recv_ctrl, &chan->recv_n_slots);
+
+    chan->local_is_pinged = false;
+    chan->remote_is_pinged = false;
+    chan->local_is_adaptive = false;
+    chan->remote_is_adaptive = false;
+    chan->lmp_ep = NULL;
+    chan->recv_ws = NULL;
+    chan->armed = false;
 
     waitset_chanstate_init(&chan->waitset_state, CHANTYPE_UMP_IN);
     chan->waitset_state.arg = chan;
@@ -45,8 +78,9 @@ errval_t ump_chan_init_len(struct ump_chan *chan, int len,
 
 /**
  * \brief Initialize an ump_chan struct. Please make sure that both the send- and
- * the receive-buffer have all their flag-bytes (or just everything to be sure) set
- * to 0 before initializing the channel from either side.
+ * the receive-buffer have their last cache lines (struct ump_ring_ctrl, or just
+ * everything to be sure) set to 0 before initializing the channel from either side.
+ * Each buffer is used as a ring of messages, its size determines the ring size.
  * \param chan Pointer to instance to initialize
  * \param send_buf, send_buf_size Location and size of the channel's send-buffer
  * \param recv_buf, recv_buf_size Location and size of the channel's receive-buffer
@@ -78,54 +112,162 @@ int ump_chan_get_data_len(struct ump_chan *chan) {
 }
 
 /**
- * \brief Send a message over an ump-channel.
+ * \brief Send a burst of messages over an ump-channel.
+ *
+ * All messages are copied into the ring before the new head is published with
+ * a single barrier. The receiver's tail is only re-read when the cached copy
+ * says the ring is too full.
+ *
  * \param chan Channel to use.
- * \param send Pointer to the message to send.
+ * \param msgs `n` consecutive messages of the channel's message size (see
+ *             DECLARE_MESSAGES).
  * \param ping_if_pinged If the channel is operating in pinged mode, determines whether
  *                       a ping will be sent. Otherwise ignored.
- * \return true if the message could be sent, false if the
- * message could not be sent (because send-buffer is full).
+ * \return Number of messages sent, less than `n` if the ring is full.
  */
-bool ump_chan_send(struct ump_chan *chan, struct ump_msg *send, bool ping_if_pinged)
+size_t ump_chan_send_batch(struct ump_chan *chan, struct ump_msg *msgs, size_t n,
+                           bool ping_if_pinged)
 {
-    void *send_location = chan->send_pane + chan->send_buf_index * chan->msg_size;
-    
-    // ensure cache line alignedness
-    assert(((lvaddr_t) send_location) % chan->msg_size == 0);
-    
-    // assert flag state
-    send->flag = 0;
+    size_t space = chan->send_n_slots - (chan->send_head - chan->send_tail_cache);
+    if (space < n) {
+        chan->send_tail_cache = chan->send_ctrl->tail;
+        dmb();  // overwrite slots only after the receiver is done with them
+        space = chan->send_n_slots - (chan->send_head - chan->send_tail_cache);
+    }
+    if (n > space) {
+        n = space;
+    }
+    if (n == 0) {
+        return 0;
+    }
 
-    struct ump_msg *write = send_location;
-    if (write->flag != UMP_FLAG_RECEIVED) // check if previous msg at location was acked
-        return false;
+    for (size_t i = 0; i < n; i++) {
+        struct ump_msg *write = chan->send_pane + chan->send_buf_index * chan->msg_size;
+        memcpy(write, ump_msg_at(chan, msgs, i), chan->msg_size);
+        write->flag = UMP_FLAG_SENT;
 
-    dmb();  // write after check
-    memcpy(write, send, chan->msg_size);
+        if (++chan->send_buf_index == chan->send_n_slots) {
+            chan->send_buf_index = 0;
+        }
+    }
 
-    dmb();  // set after write
-    write->flag = UMP_FLAG_SENT;
+    dmb();  // publish after write
+    chan->send_head += n;
+    chan->send_ctrl->head = chan->send_head;
 
-    chan->send_buf_index++;
-    chan->send_buf_index %= chan->send_pane_size / chan->msg_size;
+    if (ping_if_pinged) {
+        ump_chan_notify(chan);
+    }
+    return n;
+}
 
-    if (chan->remote_is_pinged && ping_if_pinged) {
+/**
+ * \brief Notify the remote end about published messages, if it needs that.
+ *
+ * A pinged remote is always notified, an adaptive remote only when it set its
+ * `sleeping` flag. Clearing the flag with an atomic exchange makes sure only one
+ * ipi is sent per sleep.
+ */
+void ump_chan_notify(struct ump_chan *chan)
+{
+    if (chan->remote_is_pinged) {
         invoke_ipi_notify(chan->ipi_ep);
     }
-    return true;
+    else if (chan->remote_is_adaptive) {
+        dmb();  // read the flag after publishing head, pairs with the receiver arming
+        if (chan->send_ctrl->sleeping
+            && __atomic_exchange_n(&chan->send_ctrl->sleeping, 0, __ATOMIC_SEQ_CST)) {
+            invoke_ipi_notify(chan->ipi_ep);
+        }
+    }
 }
 
+/**
+ * \brief Send a message over an ump-channel.
+ * \param chan Channel to use.
+ * \param send Pointer to the message to send.
+ * \param ping_if_pinged If the channel is operating in pinged mode, determines whether
+ *                       a ping will be sent. Otherwise ignored.
+ * \return true if the message could be sent, false if the
+ * message could not be sent (because send-buffer is full).
+ */
+bool ump_chan_send(struct ump_chan *chan, struct ump_msg *send, bool ping_if_pinged)
+{
+    return ump_chan_send_batch(chan, send, 1, ping_if_pinged) == 1;
+}
+
+/**
+ * \brief Number of messages that can be received without re-reading the sender's head.
+ */
+static size_t ump_chan_available(struct ump_chan *chan)
+{
+    size_t avail = chan->recv_head_cache - chan->recv_tail;
+    if (avail == 0) {
+        chan->recv_head_cache = chan->recv_ctrl->head;
+        avail = chan->recv_head_cache - chan->recv_tail;
+        if (avail > 0) {
+            dmb();  // read messages after head
+        }
+    }
+    return avail;
+}
 
 bool ump_chan_can_receive(struct ump_chan *chan)
 {
-    void *poll_location = chan->recv_pane + chan->recv_buf_index * chan->msg_size;
-    
-    // ensure cache line alignedness
-    assert(((lvaddr_t) poll_location) % chan->msg_size == 0);
-    
-    struct ump_msg *read = poll_location;
+    return ump_chan_available(chan) > 0;
+}
 
-    return read->flag == UMP_FLAG_SENT;
+/**
+ * \brief Check a polled channel: true if a message is available or the spin
+ * window of an adaptive channel ran out (so the handler re-registers and the
+ * channel goes to sleep).
+ */
+bool ump_chan_poll(struct ump_chan *chan)
+{
+    if (ump_chan_available(chan) > 0) {
+        return true;
+    }
+    return chan->local_is_adaptive && systime_now() >= chan->spin_until;
+}
+
+/**
+ * \brief Receive up to `max` messages from an ump-channel.
+ *
+ * The consumed slots are handed back to the sender (one barrier and one write
+ * of the tail) once everything seen in the last head update is consumed, or
+ * when half of the ring is waiting to be handed back.
+ *
+ * \param chan Channel to poll
+ * \param msgs Space for `max` consecutive messages (see DECLARE_MESSAGES).
+ * \return Number of messages received and written to `msgs`.
+ */
+size_t ump_chan_receive_batch(struct ump_chan *chan, struct ump_msg *msgs, size_t max)
+{
+    size_t n = ump_chan_available(chan);
+    if (n > max) {
+        n = max;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        void *read = chan->recv_pane + chan->recv_buf_index * chan->msg_size;
+        memcpy(ump_msg_at(chan, msgs, i), read, chan->msg_size);
+
+        if (++chan->recv_buf_index == chan->recv_n_slots) {
+            chan->recv_buf_index = 0;
+        }
+    }
+    chan->recv_tail += n;
+
+    if (chan->recv_tail == chan->recv_head_cache
+        || chan->recv_tail - chan->recv_tail_pub >= chan->recv_n_slots / 2) {
+        dmb();  // release slots after read
+        chan->recv_ctrl->tail = chan->recv_tail;
+        chan->recv_tail_pub = chan->recv_tail;
+    }
+    return n;
 }
 
 /**
@@ -137,50 +279,48 @@ bool ump_chan_can_receive(struct ump_chan *chan)
  */
 bool ump_chan_receive(struct ump_chan *chan, struct ump_msg *recv)
 {
-    void *poll_location = chan->recv_pane + chan->recv_buf_index * chan->msg_size;
-    
-    // ensure cache line alignedness
-    assert(((lvaddr_t) poll_location) % chan->msg_size == 0);
-    
-    struct ump_msg *read = poll_location;
-    if (*((volatile uint8_t *) &read->flag) == UMP_FLAG_SENT) {
+    return ump_chan_receive_batch(chan, recv, 1) == 1;
+}
 
-        dmb();
-        memcpy(recv, read, chan->msg_size);
-        dmb();
-        read->flag = UMP_FLAG_RECEIVED;
 
-        chan->recv_buf_index++;
-        chan->recv_buf_index %= chan->recv_pane_size / chan->msg_size;
-        
-        return true;
+/**
+ * \brief Remove the current receive registration before switching modes.
+ *
+ * \return the waitset and closure to register with in the new mode
+ */
+static errval_t ump_chan_take_registration(struct ump_chan *chan, struct waitset **ws,
+                                           struct event_closure *closure)
+{
+    *ws = chan->recv_ws;
+    *closure = chan->recv_closure;
+    if (*ws == NULL) {
+        return LIB_ERR_UMP_SWITCH_NO_WAITSET;
     }
-    
-    return false;
-}
 
+    // may not be registered right now (handler running), which is fine
+    ump_chan_deregister_recv(chan);
+    chan->armed = false;
+    chan->recv_ctrl->sleeping = 0;
+    return SYS_ERR_OK;
+}
 
 errval_t ump_chan_switch_local_pinged(struct ump_chan *chan, struct lmp_endpoint *ep)
 {
     assert(!chan->local_is_pinged);
     errval_t err;
 
-    struct waitset *ws = chan->waitset_state.waitset;
-    struct event_closure closure = chan->waitset_state.closure;
-
-    if (ws == NULL) {
-        return LIB_ERR_UMP_SWITCH_NO_WAITSET;
-    }
-
-    waitset_chan_deregister(&chan->waitset_state);
-
-    err = lmp_endpoint_register(ep, ws, closure);
-    ON_ERR_PUSH_RETURN(err, LIB_ERR_UMP_REGISTER_PINGED_EP);
+    struct waitset *ws;
+    struct event_closure closure;
+    err = ump_chan_take_registration(chan, &ws, &closure);
+    ON_ERR_RETURN(err);
 
     chan->local_is_pinged = true;
-    // chan->waitset_state will now be overwritten
+    chan->local_is_adaptive = false;
     chan->lmp_ep = ep;
 
+    err = ump_chan_register_recv(chan, ws, closure);
+    ON_ERR_PUSH_RETURN(err, LIB_ERR_UMP_REGISTER_PINGED_EP);
+
     return SYS_ERR_OK;
 }
 
@@ -188,16 +328,97 @@ errval_t ump_chan_switch_local_pinged(struct ump_chan *chan, struct lmp_endpoint
 errval_t ump_chan_switch_remote_pinged(struct ump_chan *chan, struct capref ipi_endpoint)
 {
     chan->remote_is_pinged = true;
+    chan->remote_is_adaptive = false;
     chan->ipi_ep = ipi_endpoint;
 
     return SYS_ERR_OK;
 }
 
+errval_t ump_chan_switch_local_adaptive(struct ump_chan *chan, struct lmp_endpoint *ep)
+{
+    errval_t err;
+
+    struct waitset *ws;
+    struct event_closure closure;
+    err = ump_chan_take_registration(chan, &ws, &closure);
+    ON_ERR_RETURN(err);
+
+    chan->local_is_pinged = false;
+    chan->local_is_adaptive = true;
+    chan->lmp_ep = ep;
+    chan->spin_window = us_to_systime(UMP_ADAPTIVE_WINDOW_INIT_US);
+    chan->spin_until = systime_now() + chan->spin_window;
+    chan->adapt_tail = chan->recv_tail;
+
+    err = ump_chan_register_recv(chan, ws, closure);
+    ON_ERR_PUSH_RETURN(err, LIB_ERR_UMP_REGISTER_PINGED_EP);
+
+    return SYS_ERR_OK;
+}
+
+errval_t ump_chan_switch_remote_adaptive(struct ump_chan *chan, struct capref ipi_endpoint)
+{
+    chan->remote_is_pinged = false;
+    chan->remote_is_adaptive = true;
+    chan->ipi_ep = ipi_endpoint;
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Must be called by the receive handler before receiving: takes the ping
+ * off the endpoint if the channel was woken by one.
+ *
+ * In adaptive mode this is where the spin window is tuned: a ping that came
+ * within one window after going to sleep means polling a bit longer would have
+ * caught the message, a long sleep means the channel is idle.
+ */
+void ump_chan_consume_ping(struct ump_chan *chan)
+{
+    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT
+
+    if (chan->local_is_pinged) {
+        lmp_endpoint_recv(chan->lmp_ep, &msg.buf, NULL);
+        return;
+    }
+    if (!chan->local_is_adaptive || !chan->armed) {
+        return;
+    }
+
+    lmp_endpoint_recv(chan->lmp_ep, &msg.buf, NULL);
+    chan->armed = false;
+    chan->recv_ctrl->sleeping = 0;
+
+    systime_t now = systime_now();
+    systime_t slept = now - chan->sleep_start;
+    if (slept < chan->spin_window) {
+        chan->spin_window *= 2;
+        systime_t max = us_to_systime(UMP_ADAPTIVE_WINDOW_MAX_US);
+        if (chan->spin_window > max) {
+            chan->spin_window = max;
+        }
+    }
+    else if (slept > 16 * chan->spin_window) {
+        chan->spin_window /= 2;
+        systime_t min = us_to_systime(UMP_ADAPTIVE_WINDOW_MIN_US);
+        if (chan->spin_window < min) {
+            chan->spin_window = min;
+        }
+    }
+    chan->spin_until = now + chan->spin_window;
+}
+
 errval_t ump_chan_register_recv(struct ump_chan *chan, struct waitset *ws, struct event_closure closure)
 {
+    chan->recv_ws = ws;
+    chan->recv_closure = closure;
+
     if (chan->local_is_pinged) {
         return ump_chan_register_pinged_recv(chan, ws, closure);
     }
+    else if (chan->local_is_adaptive) {
+        return ump_chan_register_adaptive_recv(chan, ws, closure);
+    }
     else {
         return ump_chan_register_polled_recv(chan, ws, closure);
     }
@@ -207,7 +428,7 @@ errval_t ump_chan_register_recv(struct ump_chan *chan, struct waitset *ws, struc
 errval_t ump_chan_deregister_recv(struct ump_chan *chan)
 {
 
-    if (chan->local_is_pinged) {
+    if (chan->local_is_pinged || (chan->local_is_adaptive && chan->armed)) {
         return lmp_endpoint_deregister(chan->lmp_ep);
     }
     else {
@@ -232,6 +453,37 @@ errval_t ump_chan_register_pinged_recv(struct ump_chan *chan, struct waitset *ws
     return err;
 }
 
+/**
+ * \brief Register in adaptive mode: poll while within the spin window (which
+ * any received message extends), otherwise announce sleeping and wait for a ping.
+ */
+errval_t ump_chan_register_adaptive_recv(struct ump_chan *chan, struct waitset *ws, struct event_closure closure)
+{
+    systime_t now = systime_now();
+
+    if (chan->recv_tail != chan->adapt_tail) {
+        chan->adapt_tail = chan->recv_tail;
+        chan->spin_until = now + chan->spin_window;
+    }
+
+    if (now < chan->spin_until) {
+        return ump_chan_register_polled_recv(chan, ws, closure);
+    }
+
+    chan->recv_ctrl->sleeping = 1;
+    dmb();  // read head after announcing, pairs with ump_chan_notify
+    if (ump_chan_can_receive(chan)) {
+        // raced with a sender, a ping may still arrive and is harmless
+        chan->recv_ctrl->sleeping = 0;
+        chan->spin_until = now + chan->spin_window;
+        return ump_chan_register_polled_recv(chan, ws, closure);
+    }
+
+    chan->armed = true;
+    chan->sleep_start = now;
+    return ump_chan_register_pinged_recv(chan, ws, closure);
+}
+
 
 
 
@@ -18,11 +18,11 @@
 #include <aos/systime.h>
 
 #include "fs_internal.h"
+#include "fatfs_cache.h"
 
 //#define BULK_MEM_SIZE       (1U << 16)      // 64kB
 //#define BULK_BLOCK_SIZE     BULK_MEM_SIZE   // (it's RPC)
 
-#define WAIT_TIME 3000000
 // Directory attributes
 #define ATTR_READ_ONLY ((uint8_t) 0x01)
 #define ATTR_HIDDEN ((uint8_t) 0x02)
@@ -60,6 +60,16 @@ struct fatfs_dirent
     };*/
 };
 
+/**
+ * @brief a run of clusters that are consecutive in the file and on the card
+ */
+struct fatfs_extent
+{
+    uint32_t logical;           ///< index of the first cluster within the file
+    uint32_t physical;          ///< first cluster on the card
+    uint32_t length;            ///< number of clusters
+};
+
 /**
  * @brief a handle to the open
  */
@@ -72,6 +82,15 @@ struct fatfs_handle
 
     off_t file_pos;    ///< offset in bytes
     off_t dir_pos;     ///< offset in bytes
+
+    // Cluster chain of the file as far as it was walked
+    struct fatfs_extent *extents;
+    size_t n_extents;
+    size_t max_extents;
+    uint32_t mapped;            ///< clusters covered by the extents
+    bool map_complete;          ///< the extents end at the end of the chain
+    uint32_t map_start;         ///< content cluster the extents belong to
+    uint64_t map_generation;    ///< FAT generation the extents are valid for
 };
 
 const int DEVFRAME_ATTRIBUTES = KPI_PAGING_FLAGS_READ
@@ -79,16 +98,9 @@ const int DEVFRAME_ATTRIBUTES = KPI_PAGING_FLAGS_READ
                                 | KPI_PAGING_FLAGS_NOCACHE;
 
 
-static errval_t long_sdhc_read(struct sdhc_s *ds, int index, lpaddr_t dest){
-    errval_t err = sdhc_read_block(ds, index, dest);
-    for(volatile int t = 0; t < WAIT_TIME; t++);
-    return err;
-}
-
-static errval_t long_sdhc_write(struct sdhc_s *ds, int index, lpaddr_t dest){
-    for(volatile int t = 0; t < WAIT_TIME; t++);
-    errval_t err = sdhc_write_block(ds, index, dest);
-    return err;
+static inline bool fat_is_eoc(uint32_t entry)
+{
+    return (entry & FAT_ENTRY_MASK) >= 0x0ffffff8;
 }
 
 static errval_t initialize_sdhc_driver(struct sdhc_s **ds)
@@ -141,17 +153,15 @@ static void pathname_to_fat32name(const char *pathname, char *fat32name)
 static errval_t set_cluster_zero(struct fatfs_mount *mount, uint32_t cluster) {
     errval_t err;
 
-    // Set buf page (512B) to zero
-    for (int i = 0; i < 64; i++) {
-        ((uint64_t *) mount->fs->buf_va)[i] = 0;
-    }
-
     uint32_t start_sector = mount->fs->data_sector + (cluster - 2) * mount->fs->bpb.secPerClus;
 
-    // Iterate through the full cluster and set it 0 (the buf page)
+    // Iterate through the full cluster and set it 0, no need to read it first
     for (int i = 0; i < mount->fs->bpb.secPerClus; i++) {
-        int sector = (int) (start_sector + i);
-        err = long_sdhc_write(mount->ds, sector, get_phys_addr(mount->fs->buf_cap));
+        struct fatfs_block *b;
+        err = fatfs_cache_get_zeroed(mount, start_sector + i, &b);
+        ON_ERR_RETURN(err);
+
+        err = fatfs_cache_mark_dirty(mount, b);
         ON_ERR_RETURN(err);
     }
 
@@ -160,71 +170,26 @@ static errval_t set_cluster_zero(struct fatfs_mount *mount, uint32_t cluster) {
 
 static errval_t get_free_fat_entry(struct fatfs_mount *mount, uint32_t *ret){
     errval_t err;
-    uint16_t fat_sec = (int) mount->fs->fat_sector;
+    uint32_t new_cluster;
 
-    // Iterate over FAT cluster
-    for (int i = 0; i < mount->fs->bpb.secPerClus; i++) {
-        //err = long_sdhc_read(mount->ds, fat_sec + i, get_phys_addr(mount->fs->buf_cap));
-        //err = sdhc_read_block(mount->ds, fat_sec + i, get_phys_addr(mount->fs->buf_cap));
-        err = long_sdhc_read(mount->ds, fat_sec + i, get_phys_addr(mount->fs->buf_cap));
-        ON_ERR_RETURN(err);
-        uint32_t *addr = mount->fs->buf_va;
-        //debug_printf(">>> FAT ADDR ONE: %x\n", *addr);
-
-        // Iterate over FAT sector
-        for (int j = 0; j < 128; j++) {
-            //debug_printf(">>> FAT SECTOR: %d\n", fat_sec);
-            //debug_printf(">>> FAT SECTOR i: %d\n", i);
-            //debug_printf(">>> FAT SECTOR j: %d\n", j);
-            //debug_printf(">>> FAT ENTRY: %x\n", addr[j]);
-            //debug_printf(">>> FAT ADDR: %x\n", *((uint32_t *) mount->fs->buf_va));
-            uint32_t entry = addr[j] & 0x0fffffff;
-            //debug_printf(">>> FAT ENTRY: %x\n", entry);
-            if (entry != 0x0ffffff8 && entry != 0x0fffffff && entry == 0x00000000) {
-                addr[j] = -1;
-                uint32_t new_cluster = j + (128 * i);
-
-                // Write back assigned FAT entry (value -1)
-                err = long_sdhc_write(mount->ds, fat_sec + i, get_phys_addr(mount->fs->buf_cap));
-                ON_ERR_RETURN(err);
-
-                // Set new cluster to zero
-                err = set_cluster_zero(mount, new_cluster);
-                ON_ERR_RETURN(err);
-                //debug_printf(">>> new cluster: %d\n", new_cluster);
-                *ret = new_cluster;
-                return SYS_ERR_OK;
-            }
-        }
-    }
-    return FS_ERR_INDEX_BOUNDS;
-}
-
-static errval_t get_next_fat_entry(struct fatfs_mount *mount, uint32_t cur, uint32_t *ret) {
-    errval_t err;
-    uint16_t fat_sec = (int) (mount->fs->fat_sector + (cur / 128));
-
-    err = long_sdhc_read(mount->ds, fat_sec, get_phys_addr(mount->fs->buf_cap));
+    // Take a free cluster, it is marked as end of chain in the FAT
+    err = fatfs_fat_alloc(mount, &new_cluster);
     ON_ERR_RETURN(err);
 
-    *ret = (((uint32_t *) mount->fs->buf_va)[cur % 128]) & 0x0fffffff;
+    // Set new cluster to zero
+    err = set_cluster_zero(mount, new_cluster);
+    ON_ERR_RETURN(err);
 
+    *ret = new_cluster;
     return SYS_ERR_OK;
 }
 
-static errval_t insert_new_fat_link(struct fatfs_mount *mount, size_t parent, size_t new){
-    errval_t err;
-    uint16_t fat_sec = (int) (mount->fs->fat_sector + (parent / 128));
-
-    err = long_sdhc_read(mount->ds, fat_sec, get_phys_addr(mount->fs->buf_cap));
-    ON_ERR_RETURN(err);
-
-    ((uint32_t *) mount->fs->buf_va)[parent % 128] = new;
-
-    err = long_sdhc_write(mount->ds, fat_sec, get_phys_addr(mount->fs->buf_cap));
-    ON_ERR_RETURN(err);
+static errval_t get_next_fat_entry(struct fatfs_mount *mount, uint32_t cur, uint32_t *ret) {
+    return fatfs_fat_get(mount, cur, ret);
+}
 
-    return SYS_ERR_OK;
+static errval_t insert_new_fat_link(struct fatfs_mount *mount, size_t parent, size_t new){
+    return fatfs_fat_set(mount, parent, new);
 }
 
 static errval_t initialize_fat32_partition(struct sdhc_s *ds, struct fat32_fs *fs) {
@@ -232,17 +197,17 @@ static errval_t initialize_fat32_partition(struct sdhc_s *ds, struct fat32_fs *f
 
     // Setup buffer communication page
     size_t retbytes;
-    err = frame_alloc_and_map_flags(&fs->buf_cap, SDHC_BLOCK_SIZE, &retbytes, &fs->buf_va, VREGION_FLAGS_READ_WRITE_NOCACHE);
+    err = frame_alloc_and_map_flags(&fs->buf_cap, FATFS_IO_BLOCKS * SDHC_BLOCK_SIZE, &retbytes, &fs->buf_va, VREGION_FLAGS_READ_WRITE_NOCACHE);
     ON_ERR_RETURN(err);
     //debug_printf("PA: %x\n", get_phys_addr(fs->buf_cap));
     //debug_printf("VA: %x\n", fs->buf_va);
     //debug_dump_hw_ptables(fs->buf_va);
-    assert(SDHC_BLOCK_SIZE <= retbytes && "Allocated blocksize is too small");
+    assert(FATFS_IO_BLOCKS * SDHC_BLOCK_SIZE <= retbytes && "Allocated blocksize is too small");
 
     // Read first sector
     fs->bpb_sector = 0;
 
-    err = long_sdhc_read(ds, fs->bpb_sector, get_phys_addr(fs->buf_cap));
+    err = sdhc_read_block(ds, fs->bpb_sector, get_phys_addr(fs->buf_cap));
     ON_ERR_RETURN(err);
 
     memcpy(&fs->bpb, fs->buf_va, sizeof(struct fatfs_bpb));
@@ -255,7 +220,7 @@ static errval_t initialize_fat32_partition(struct sdhc_s *ds, struct fat32_fs *f
     fs->rootDir_sector = fs->data_sector + fs->bpb.secPerClus * (fs->bpb.rootClus - 2);
 
     // Read fsinfo sector
-    err = long_sdhc_read(ds, fs->fsinfo_sector, get_phys_addr(fs->buf_cap));
+    err = sdhc_read_block(ds, fs->fsinfo_sector, get_phys_addr(fs->buf_cap));
     ON_ERR_RETURN(err);
 
     memcpy(&fs->fsi, fs->buf_va, sizeof(struct fs_info));
@@ -288,10 +253,233 @@ static struct fatfs_handle *handle_open(struct fatfs_mount *mount, struct fatfs_
 static inline void handle_close(struct fatfs_handle *h)
 {
     // Free all pointers in handle and handle itself
+    free(h->extents);
     free(h->path);
     free(h);
 }
 
+/**
+ * @brief drops the cluster map of a handle
+ */
+static void map_reset(struct fatfs_mount *mount, struct fatfs_handle *h)
+{
+    h->n_extents = 0;
+    h->mapped = 0;
+    h->map_complete = false;
+    h->map_start = h->dirent->content_cluster;
+    h->map_generation = mount->cache->fat_generation;
+}
+
+/**
+ * @brief adds the next cluster of the file to the map of a handle
+ */
+static errval_t map_append(struct fatfs_handle *h, uint32_t cluster)
+{
+    if (h->n_extents > 0) {
+        struct fatfs_extent *last = &h->extents[h->n_extents - 1];
+        if (last->physical + last->length == cluster) {
+            last->length++;
+            h->mapped++;
+            return SYS_ERR_OK;
+        }
+    }
+
+    if (h->n_extents == h->max_extents) {
+        size_t max = h->max_extents ? 2 * h->max_extents : 4;
+        struct fatfs_extent *e = realloc(h->extents, max * sizeof(*e));
+        if (e == NULL) {
+            return LIB_ERR_MALLOC_FAIL;
+        }
+        h->extents = e;
+        h->max_extents = max;
+    }
+
+    h->extents[h->n_extents++] = (struct fatfs_extent) {
+        .logical = h->mapped,
+        .physical = cluster,
+        .length = 1
+    };
+    h->mapped++;
+    return SYS_ERR_OK;
+}
+
+/**
+ * @brief extends the cluster map of a handle to cover cluster index
+ *
+ * The map is rebuilt if the file got a different first cluster or clusters
+ * were freed anywhere since it was built. Stops early at the end of the chain.
+ */
+static errval_t map_extend(struct fatfs_mount *mount, struct fatfs_handle *h, uint32_t index)
+{
+    errval_t err;
+
+    if (h->map_start != h->dirent->content_cluster
+        || h->map_generation != mount->cache->fat_generation) {
+        map_reset(mount, h);
+    }
+
+    if (h->mapped == 0 && !h->map_complete) {
+        uint32_t first = h->dirent->content_cluster;
+        if (first < 2 || fat_is_eoc(first)) {
+            h->map_complete = true;
+            return SYS_ERR_OK;
+        }
+        err = map_append(h, first);
+        ON_ERR_RETURN(err);
+    }
+
+    while (h->mapped <= index && !h->map_complete) {
+        struct fatfs_extent *last = &h->extents[h->n_extents - 1];
+        uint32_t next;
+        err = fatfs_fat_get(mount, last->physical + last->length - 1, &next);
+        ON_ERR_RETURN(err);
+
+        if (fat_is_eoc(next) || next < 2) {
+            h->map_complete = true;
+        } else {
+            err = map_append(h, next);
+            ON_ERR_RETURN(err);
+        }
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * @brief looks up a cluster of the file in the map of a handle
+ *
+ * \param index    index of the cluster within the file
+ * \param ret      the cluster on the card
+ * \param run      number of clusters from ret on that are consecutive on the card
+ */
+static errval_t map_lookup(struct fatfs_mount *mount, struct fatfs_handle *h, uint32_t index,
+                           uint32_t *ret, uint32_t *run)
+{
+    errval_t err;
+
+    err = map_extend(mount, h, index);
+    ON_ERR_RETURN(err);
+
+    if (index >= h->mapped) {
+        return FS_ERR_INDEX_BOUNDS;
+    }
+
+    // Binary search for the extent holding index
+    size_t lo = 0, hi = h->n_extents;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (h->extents[mid].logical <= index) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    struct fatfs_extent *e = &h->extents[lo];
+    *ret = e->physical + (index - e->logical);
+    *run = e->length - (index - e->logical);
+    return SYS_ERR_OK;
+}
+
+/**
+ * @brief makes sure the file of a handle has at least n clusters
+ *
+ * New clusters are not zeroed, only the written part of them is ever read.
+ */
+static errval_t map_grow(struct fatfs_mount *mount, struct fatfs_handle *h, uint32_t n)
+{
+    errval_t err;
+
+    if (n == 0) {
+        return SYS_ERR_OK;
+    }
+
+    err = map_extend(mount, h, n - 1);
+    ON_ERR_RETURN(err);
+
+    while (h->mapped < n) {
+        uint32_t cluster;
+        err = fatfs_fat_alloc(mount, &cluster);
+        ON_ERR_RETURN(err);
+
+        if (h->mapped == 0) {
+            // First cluster of the file, link it from the directory entry
+            struct fatfs_block *b;
+            err = fatfs_cache_get(mount, h->dirent->sector, &b);
+            ON_ERR_RETURN(err);
+
+            struct fatfs_short_dirent *dir = (struct fatfs_short_dirent *) (b->data + h->dirent->sector_offset);
+            dir->fstClusLow = (uint16_t) (cluster & 0x0000FFFF);
+            dir->fstClusHi = (uint16_t) ((cluster >> 16) & 0x0000FFFF);
+
+            err = fatfs_cache_mark_dirty(mount, b);
+            ON_ERR_RETURN(err);
+
+            h->dirent->content_cluster = cluster;
+            h->map_start = cluster;
+        } else {
+            struct fatfs_extent *last = &h->extents[h->n_extents - 1];
+            err = insert_new_fat_link(mount, last->physical + last->length - 1, cluster);
+            ON_ERR_RETURN(err);
+        }
+
+        err = map_append(h, cluster);
+        ON_ERR_RETURN(err);
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * @brief reads or writes bytes at offset of the file of a handle
+ *
+ * The file must have enough clusters. Every run of clusters that is
+ * consecutive on the card is transferred with one call into the cache.
+ */
+static errval_t file_io(struct fatfs_mount *mount, struct fatfs_handle *h, size_t offset,
+                        void *buf, size_t bytes, bool write)
+{
+    errval_t err;
+    struct fat32_fs *fs = mount->fs;
+    size_t cluster_bytes = fs->bpb.bytsPerSec * fs->bpb.secPerClus;
+    uint8_t *p = buf;
+
+    // Map the whole range first, so that the runs found below are complete
+    if (bytes > 0) {
+        err = map_extend(mount, h, (offset + bytes - 1) / cluster_bytes);
+        ON_ERR_RETURN(err);
+    }
+
+    while (bytes > 0) {
+        uint32_t cluster, run;
+        err = map_lookup(mount, h, offset / cluster_bytes, &cluster, &run);
+        if (err_is_fail(err)) {
+            if (err_no(err) == FS_ERR_INDEX_BOUNDS) {
+                debug_printf(">> Error: cluster chain shorter than the file\n");
+                return write ? FS_ERR_WRITE : FS_ERR_READ;
+            }
+            return err;
+        }
+
+        size_t in_cluster = offset % cluster_bytes;
+        size_t chunk = MIN(bytes, (size_t) run * cluster_bytes - in_cluster);
+        uint32_t sector = fs->data_sector + (cluster - 2) * fs->bpb.secPerClus;
+
+        if (write) {
+            err = fatfs_cache_write(mount, sector, in_cluster, p, chunk);
+        } else {
+            err = fatfs_cache_read(mount, sector, in_cluster, p, chunk);
+        }
+        ON_ERR_RETURN(err);
+
+        p += chunk;
+        offset += chunk;
+        bytes -= chunk;
+    }
+
+    return SYS_ERR_OK;
+}
+
 static errval_t find_dirent(struct fatfs_mount *mount, struct fatfs_dirent *root, const char *name,
                             struct fatfs_dirent **ret_de)
 {
@@ -300,13 +488,12 @@ static errval_t find_dirent(struct fatfs_mount *mount, struct fatfs_dirent *root
         return FS_ERR_NOTDIR;
     }
     struct fatfs_dirent *d = root;
-    struct fatfs_dirent *nd = calloc(1, sizeof(*nd));
 
     uint32_t current_cluster = d->content_cluster;
     uint32_t start_sector;
     //debug_printf(">> find dirent: |%s| in |%s| with cc |%d|\n", name, root->name, current_cluster);
     // Read linked clusters until entry is found of empty region is reached
-    while((current_cluster & 0x0fffffff) != 0x0ffffff8 && (current_cluster & 0x0fffffff) != 0x0fffffff) {
+    while(!fat_is_eoc(current_cluster)) {
         start_sector = mount->fs->data_sector + (current_cluster - 2) * mount->fs->bpb.secPerClus;
         //debug_printf(">> base sector: |%d|\n", start_sector);
         // Iterate through all sectors in cluster
@@ -315,10 +502,11 @@ static errval_t find_dirent(struct fatfs_mount *mount, struct fatfs_dirent *root
             //debug_printf(">> current sector: |%d|\n", current_sector);
 
             // Read sector
-            err = long_sdhc_read(mount->ds, (int) current_sector, get_phys_addr(mount->fs->buf_cap));
+            struct fatfs_block *b;
+            err = fatfs_cache_get(mount, current_sector, &b);
             ON_ERR_RETURN(err);
 
-            uint8_t *current = (uint8_t *) mount->fs->buf_va;
+            uint8_t *current = b->data;
 
             // Iterate through all dir entrys in sector
             for(int j = 0; j < mount->fs->bpb.bytsPerSec; j += sizeof(struct fatfs_short_dirent)) {
@@ -350,7 +538,17 @@ static errval_t find_dirent(struct fatfs_mount *mount, struct fatfs_dirent *root
                     // Compare name (11B)
                     if (memcmp(name, dirname, 11) == 0){
                         // Entry found -> return
-                        nd->name = dir.name;
+                        struct fatfs_dirent *nd = calloc(1, sizeof(*nd));
+                        if (nd == NULL) {
+                            return LIB_ERR_MALLOC_FAIL;
+                        }
+                        nd->name = malloc(12);
+                        if (nd->name == NULL) {
+                            free(nd);
+                            return LIB_ERR_MALLOC_FAIL;
+                        }
+                        memcpy(nd->name, dir.name, 11);
+                        nd->name[11] = '\0';
                         nd->size = dir.fileSize;
                         nd->parent = root;
                         nd->cluster = current_cluster;
@@ -526,7 +724,7 @@ static errval_t dirent_insert(struct fatfs_mount *mount, struct fatfs_dirent *pa
     // Insert/write into folder-cluster/-sector on sdcard
     uint32_t current_cluster = parent->content_cluster;
     uint32_t start_sector;
-    while(current_cluster != 0xffffff8) {
+    while(!fat_is_eoc(current_cluster)) {
         start_sector = mount->fs->data_sector + (current_cluster - 2) * mount->fs->bpb.secPerClus;
 
         // Iterate through all sectors in cluster
@@ -534,10 +732,11 @@ static errval_t dirent_insert(struct fatfs_mount *mount, struct fatfs_dirent *pa
             uint32_t current_sector = start_sector + i;
 
             // Read sector from sdcard
-            err = long_sdhc_read(mount->ds, (int) current_sector, get_phys_addr(mount->fs->buf_cap));
+            struct fatfs_block *b;
+            err = fatfs_cache_get(mount, current_sector, &b);
             ON_ERR_RETURN(err);
 
-            uint8_t *current = (uint8_t *) mount->fs->buf_va;
+            uint8_t *current = b->data;
 
             // Iterate through all dirents in sector
             for(int j = 0; j < mount->fs->bpb.bytsPerSec; j += sizeof(struct fatfs_short_dirent)) {
@@ -584,20 +783,14 @@ static errval_t dirent_insert(struct fatfs_mount *mount, struct fatfs_dirent *pa
                     dir.fstClusHi = (uint16_t) ((entry->content_cluster >> 16) & 0x0000FFFF);
                     dir.fileSize = 0;
 
-                    // Write new dir entry back to sdcard
-                    err = long_sdhc_read(mount->ds, (int) entry->sector, get_phys_addr(mount->fs->buf_cap));
+                    // Write new dir entry back, the FAT allocation above may have evicted the sector
+                    err = fatfs_cache_get(mount, entry->sector, &b);
                     ON_ERR_RETURN(err);
-                    //debug_printf(">>> WTF: |%d|\n", entry->sector_offset);
-                    memcpy(mount->fs->buf_va + entry->sector_offset, &dir, sizeof(struct fatfs_short_dirent));
 
-                    err = long_sdhc_write(mount->ds, (int) entry->sector, get_phys_addr(mount->fs->buf_cap));
-                    ON_ERR_RETURN(err);
-                    //debug_printf(">>> WTF: |%d|\n", entry->sector);
+                    memcpy(b->data + entry->sector_offset, &dir, sizeof(struct fatfs_short_dirent));
 
-                    //err = long_sdhc_read(mount->ds, (int) entry->sector, get_phys_addr(mount->fs->buf_cap));
-                    //ON_ERR_RETURN(err);
-                    //struct fatfs_short_dirent *diro = (struct fatfs_short_dirent *)(mount->fs->buf_va + entry->sector_offset);
-                    //debug_printf(">>> ROLOLO |%s|\n", diro->name);
+                    err = fatfs_cache_mark_dirty(mount, b);
+                    ON_ERR_RETURN(err);
 
                     exit = true;
                     break;
@@ -617,7 +810,7 @@ static errval_t dirent_insert(struct fatfs_mount *mount, struct fatfs_dirent *pa
         ON_ERR_RETURN(err);
 
         // Check if cluster is full
-        if (current_cluster == -1){
+        if (fat_is_eoc(current_cluster)){
             err = get_free_fat_entry(mount, &current_cluster);
             ON_ERR_RETURN(err);
             err = insert_new_fat_link(mount, old_cluster, current_cluster);
@@ -664,7 +857,7 @@ errval_t fatfs_create(void *st, const char *path, fatfs_handle_t *rethandle)
     }
 
     // Translate to fat32 namestyle
-    char fat32name[11];
+    char fat32name[12] = { 0 };
     pathname_to_fat32name(childname, fat32name);
     childname = fat32name;
 
@@ -712,7 +905,7 @@ errval_t fatfs_read(void *st, fatfs_handle_t handle, void *buffer, uint32_t byte
     assert(h->file_pos >= 0);
 
     // Check what we can read and adjust "bytes"
-    if (h->dirent->content_cluster == 0 || h->dirent->content_cluster == -1) {
+    if (h->dirent->content_cluster == 0 || fat_is_eoc(h->dirent->content_cluster)) {
         bytes = 0;
     } else if (h->dirent->size < h->file_pos) {
         bytes = 0;
@@ -728,34 +921,10 @@ errval_t fatfs_read(void *st, fatfs_handle_t handle, void *buffer, uint32_t byte
         return SYS_ERR_OK;
     }
 
-    // Get cluster we want to read from
-    uint32_t cluster_offset = h->file_pos/(mount->fs->bpb.bytsPerSec * mount->fs->bpb.secPerClus);
-    uint32_t current_cluster = h->dirent->content_cluster;
-    for (int i = 0; i < cluster_offset; i++) {
-        // Read FAT
-        get_next_fat_entry(mount, current_cluster, &current_cluster);
-
-        if (current_cluster == -1) {
-            debug_printf(">> Error: This should not happen\n");
-        }
-    }
-
-    // Load sector from sdhc
-    uint32_t sector = (int)(mount->fs->data_sector + (current_cluster - 2) * mount->fs->bpb.secPerClus + (h->file_pos / mount->fs->bpb.bytsPerSec));
-    //debug_printf("READ\n");
-    //systime_t start = systime_now();
-    err = long_sdhc_read(mount->ds, (int) sector, get_phys_addr(mount->fs->buf_cap));
-    //systime_t end = systime_now();
-    //systime_t diff = systime_to_us(end - start)/1000;
-    //debug_printf(">> fread ms: %lu\n", diff);
+    // Read everything at once, the cluster map finds the runs on the card
+    err = file_io(mount, h, h->file_pos, buffer, bytes, false);
     ON_ERR_RETURN(err);
 
-    // Adjust read length for simplicity
-    bytes = MIN(mount->fs->bpb.bytsPerSec - h->file_pos%mount->fs->bpb.bytsPerSec, bytes);
-
-    // Copy read bytes into buffer
-    memcpy(buffer, mount->fs->buf_va + (h->file_pos%(mount->fs->bpb.bytsPerSec)), bytes);
-
     // Adjust index
     h->file_pos += bytes;
     *bytes_read = bytes;
@@ -888,7 +1057,7 @@ errval_t fatfs_mkdir(void *st, const char *path)
     }
 
     // Translate to fat32 namestyle
-    char fat32name[11];
+    char fat32name[12] = { 0 };
     pathname_to_fat32name(childname, fat32name);
     childname = fat32name;
 
@@ -953,19 +1122,22 @@ errval_t fatfs_dir_read_next(void *st, fatfs_handle_t inhandle, char **retname,
         err = get_next_fat_entry(mount, current_cluster, &current_cluster);
         ON_ERR_RETURN(err);
 
-        if (current_cluster == -1) {
-            debug_printf(">> Error: This should not happen\n");
+        if (fat_is_eoc(current_cluster)) {
+            // Past the last cluster of the directory
+            return FS_ERR_INDEX_BOUNDS;
         }
     }
 
     // Read next folder entry from sector
-    uint32_t sector = (int)(mount->fs->data_sector + (current_cluster - 2) * mount->fs->bpb.secPerClus + (h->dir_pos / mount->fs->bpb.bytsPerSec));
+    uint32_t sector = (int)(mount->fs->data_sector + (current_cluster - 2) * mount->fs->bpb.secPerClus
+                            + (h->dir_pos / mount->fs->bpb.bytsPerSec) % mount->fs->bpb.secPerClus);
 
-    err = long_sdhc_read(mount->ds, (int) sector, get_phys_addr(mount->fs->buf_cap));
+    struct fatfs_block *b;
+    err = fatfs_cache_get(mount, sector, &b);
     ON_ERR_RETURN(err);
 
     struct fatfs_short_dirent fsd;
-    memcpy(&fsd, mount->fs->buf_va + (h->dir_pos % mount->fs->bpb.bytsPerSec), sizeof(struct fatfs_short_dirent));
+    memcpy(&fsd, b->data + (h->dir_pos % mount->fs->bpb.bytsPerSec), sizeof(struct fatfs_short_dirent));
 
     // Check if entry is valid
     if (((fsd.attr == 0x0) && (((uint8_t) fsd.name[0]) != 0xE5)) || (((uint8_t) fsd.name[0]) == 0x00)) {
@@ -1007,10 +1179,10 @@ errval_t fatfs_closedir(void *st, fatfs_handle_t dhandle)
 errval_t fatfs_write(void *st, fatfs_handle_t handle, const void *buffer,
                      size_t bytes, size_t *bytes_written)
 {
-    //debug_printf(">> ENTRY WRITE\n");
     errval_t err;
     struct fatfs_mount *mount = st;
     struct fatfs_handle *h = handle;
+    static const uint8_t zeros[SDHC_BLOCK_SIZE];
 
     assert(h->file_pos >= 0);
 
@@ -1019,100 +1191,51 @@ errval_t fatfs_write(void *st, fatfs_handle_t handle, const void *buffer,
         return FS_ERR_NOTFILE;
     }
 
-    // For simplicity only writes to the end possible (at least for the start)
-    h->file_pos = (off_t) h->dirent->size;
+    // File sizes are 32 bit in the directory entry
     size_t offset = h->file_pos;
+    if (offset + bytes > UINT32_MAX) {
+        return FS_ERR_INDEX_BOUNDS;
+    }
 
-    size_t sector_offset = offset / mount->fs->bpb.bytsPerSec;
-    size_t cluster_offset = sector_offset / mount->fs->bpb.secPerClus;
-    uint32_t current_cluster = h->dirent->content_cluster;
-
-    size_t bytes_to_write = MIN(bytes, mount->fs->bpb.bytsPerSec - (offset % mount->fs->bpb.bytsPerSec));
-    // Get current cluster
-    if (current_cluster != 0) {
-        // Content cluster available
-        // Check if the one we need to access does exist
-        uint32_t old_cluster = current_cluster;
-        for (int f = 0; f < cluster_offset; f++) {
-            old_cluster = current_cluster;
-            err = get_next_fat_entry(mount, current_cluster, &current_cluster);
-            ON_ERR_RETURN(err);
-        }
-
-        // If the cluster we need to access does not exist create one
-        if (current_cluster == -1) {
-            err = get_free_fat_entry(mount, &current_cluster);
-            ON_ERR_RETURN(err);
-
-            err = insert_new_fat_link(mount, old_cluster, current_cluster);
-            ON_ERR_RETURN(err);
-        }
-    } else {
-        //debug_printf(">>> Should come here\n");
-        // There is no cluster available, so create one
-        err = get_free_fat_entry(mount, &current_cluster);
-        ON_ERR_RETURN(err);
-
-        // Write content cluster origin into file entry, important, sector includes data offset
-        err = long_sdhc_read(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
-        ON_ERR_RETURN(err);
-
-        struct fatfs_short_dirent *dir = ((struct fatfs_short_dirent *) ((uint8_t *) mount->fs->buf_va + h->dirent->sector_offset));
-        //debug_printf(">>> cluster: %d\n", current_cluster);
-        //debug_printf(">>> sector offset: %d\n", h->dirent->sector_offset);
-        dir->fstClusLow = (uint16_t) (current_cluster & 0x0000FFFF);
-        dir->fstClusHi = (uint16_t) ((current_cluster >> 16) & 0x0000FFFF);
+    // Allocate all clusters up front, so that they can be mapped in large runs
+    size_t cluster_bytes = mount->fs->bpb.bytsPerSec * mount->fs->bpb.secPerClus;
+    err = map_grow(mount, h, DIVIDE_ROUND_UP(offset + bytes, cluster_bytes));
+    ON_ERR_RETURN(err);
 
-        //debug_printf(">>> clusterlow: %d\n", dir->fstClusLow);
-        //debug_printf(">>> clusterhi: %d\n", dir->fstClusHi);
-        //debug_printf(">>> sector: %d\n", h->dirent->sector);
-        err = long_sdhc_write(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
+    // Writing behind the end leaves a hole, which has to read as zeros
+    for (size_t pos = h->dirent->size; pos < offset; ) {
+        size_t chunk = MIN(sizeof(zeros), offset - pos);
+        err = file_io(mount, h, pos, (void *) zeros, chunk, true);
         ON_ERR_RETURN(err);
-
-        // Update handler directory entry
-        h->dirent->content_cluster = current_cluster;
-        current_cluster = current_cluster;
+        pos += chunk;
     }
-    //debug_printf(">>> cluster: %d\n", current_cluster);
-    // Mount the cluster we want to write into / don't forget the sector offset to get the right sector
-    size_t sector = mount->fs->data_sector + ((current_cluster - 2) * mount->fs->bpb.secPerClus) + (sector_offset % mount->fs->bpb.secPerClus);
-    err = long_sdhc_read(mount->ds, (int) sector, get_phys_addr(mount->fs->buf_cap));
-    ON_ERR_RETURN(err);
-    //debug_printf(">>> write off: %zu\n", offset);
-    //debug_printf(">>> write secoff: %zu\n", sector_offset);
-    memcpy(mount->fs->buf_va + (offset % mount->fs->bpb.bytsPerSec), buffer, bytes_to_write);
-    //debug_printf(">>> to write: |%s|\n", (char *) buffer);
-    err = long_sdhc_write(mount->ds, (int) sector, get_phys_addr(mount->fs->buf_cap));
-    ON_ERR_RETURN(err);
 
-    err = long_sdhc_read(mount->ds, (int) sector, get_phys_addr(mount->fs->buf_cap));
+    err = file_io(mount, h, offset, (void *) buffer, bytes, true);
     ON_ERR_RETURN(err);
-    //debug_printf(">>> to write: |%s|\n", (char *) mount->fs->buf_va);
 
     // Set return values
     if (bytes_written) {
-        *bytes_written = bytes_to_write;
+        *bytes_written = bytes;
     }
 
     // Adjust handle index variables
-    h->file_pos += (off_t) bytes_to_write;
-    h->dirent->size += bytes_to_write;
+    h->file_pos += (off_t) bytes;
+    if (h->file_pos <= h->dirent->size) {
+        return SYS_ERR_OK;
+    }
+    h->dirent->size = h->file_pos;
 
     // Write updated file size into file entry
-    err = long_sdhc_read(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
+    struct fatfs_block *b;
+    err = fatfs_cache_get(mount, h->dirent->sector, &b);
     ON_ERR_RETURN(err);
 
-    struct fatfs_short_dirent *dir = ((struct fatfs_short_dirent *) ((uint8_t *) mount->fs->buf_va + h->dirent->sector_offset));
-    //debug_printf(">>>>>> OIOIOIsi %u\n", (uint32_t) h->dirent->size);
-    //debug_printf(">>>>>> OIOIOIsec %u\n", (uint32_t) h->dirent->sector_offset);
-    //debug_printf(">>>>>> OIOIOInam |%11s|\n", dir->name);
-
+    struct fatfs_short_dirent *dir = ((struct fatfs_short_dirent *) (b->data + h->dirent->sector_offset));
     dir->fileSize = (uint32_t) h->dirent->size;
 
-    err = long_sdhc_write(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
+    err = fatfs_cache_mark_dirty(mount, b);
     ON_ERR_RETURN(err);
 
-    //debug_printf(">> WEIRD\n");
     return SYS_ERR_OK;
 }
 
@@ -1134,10 +1257,11 @@ errval_t fatfs_truncate(void *st, fatfs_handle_t handle, size_t bytes)
     }
 
     // Change the size in file
-    err = long_sdhc_read(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
+    struct fatfs_block *b;
+    err = fatfs_cache_get(mount, h->dirent->sector, &b);
     ON_ERR_RETURN(err);
 
-    struct fatfs_short_dirent *dir = ((struct fatfs_short_dirent *) ((uint8_t *) mount->fs->buf_va + h->dirent->sector_offset));
+    struct fatfs_short_dirent *dir = ((struct fatfs_short_dirent *) (b->data + h->dirent->sector_offset));
     dir->fileSize = (uint32_t) bytes;
 
     // If bytes is zero, delete hi and low in file --> delete assigned content cluster
@@ -1146,39 +1270,39 @@ errval_t fatfs_truncate(void *st, fatfs_handle_t handle, size_t bytes)
         dir->fstClusHi = (uint16_t) 0;
     }
 
-    err = long_sdhc_write(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
+    err = fatfs_cache_mark_dirty(mount, b);
     ON_ERR_RETURN(err);
 
     // Remove clusters from FAT (Set to 0x0) (if cluster boundary is crossed)
-    // Get cluster_offset which ends in bytes
-    size_t sector_offset = bytes / mount->fs->bpb.bytsPerSec;
-    size_t cluster_offset = sector_offset / mount->fs->bpb.secPerClus;
+    // Get cluster_offset of the last cluster still holding data
+    size_t cluster_bytes = mount->fs->bpb.bytsPerSec * mount->fs->bpb.secPerClus;
+    size_t cluster_offset = (bytes == 0) ? 0 : (bytes - 1) / cluster_bytes;
     uint32_t current_cluster = h->dirent->content_cluster;
-    size_t out_cluster = current_cluster;
 
-    // FAT tablewalk to remove entries
-    for (int c = 0; ((current_cluster & 0x0fffffff) != 0x0fffffff) && ((current_cluster & 0x0fffffff) != 0x0ffffff8); c++) {
-        //debug_printf(">> SO LONG\n");
+    // FAT tablewalk to remove entries, files without content have no chain at all
+    for (int c = 0; current_cluster >= 2 && !fat_is_eoc(current_cluster); c++) {
         uint32_t old_cluster = current_cluster;
-        get_next_fat_entry(mount, current_cluster, &current_cluster);
+        err = get_next_fat_entry(mount, current_cluster, &current_cluster);
+        ON_ERR_RETURN(err);
 
         // Apply conditional changes
         if (c > cluster_offset) {
-            insert_new_fat_link(mount, old_cluster, 0);
+            err = insert_new_fat_link(mount, old_cluster, 0);
         } else if (c == cluster_offset) {
             if (bytes == 0) {
-                insert_new_fat_link(mount, old_cluster, 0);;
+                err = insert_new_fat_link(mount, old_cluster, 0);
             } else {
-                insert_new_fat_link(mount, old_cluster, 0x0fffffff);
+                err = insert_new_fat_link(mount, old_cluster, FAT_ENTRY_EOC);
             }
-        } else {
-            out_cluster = current_cluster;
         }
+        ON_ERR_RETURN(err);
     }
 
     // Change size in handle dir entry
     h->dirent->size = bytes;
-    h->dirent->content_cluster = out_cluster;
+    if (bytes == 0) {
+        h->dirent->content_cluster = 0;
+    }
     h->file_pos = MIN(h->file_pos, bytes);
 
     return SYS_ERR_OK;
@@ -1206,19 +1330,17 @@ errval_t fatfs_remove(void *st, const char *path)
     ON_ERR_RETURN(err);
     //debug_printf(">> REACHED TRUNCATE\n");
     // Set first byte in file entry to 0xE5 and attr to 0
-    err = long_sdhc_read(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
+    struct fatfs_block *b;
+    err = fatfs_cache_get(mount, h->dirent->sector, &b);
     ON_ERR_RETURN(err);
 
-    uint8_t *dir = ((uint8_t *) mount->fs->buf_va) + h->dirent->sector_offset;
+    uint8_t *dir = b->data + h->dirent->sector_offset;
     dir[0] = 0xE5;
     dir[11] = 0;
 
-    err = long_sdhc_write(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
-    ON_ERR_RETURN(err);
-    err = long_sdhc_read(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
+    err = fatfs_cache_mark_dirty(mount, b);
     ON_ERR_RETURN(err);
-    dir = ((uint8_t *) mount->fs->buf_va) + h->dirent->sector_offset;
-    //debug_printf(">> REACHED 0x%x\n", dir[0]);
+
     handle_close(h);
     return SYS_ERR_OK;
 }
@@ -1238,15 +1360,16 @@ errval_t fatfs_rmdir(void *st, const char *path)
 
     // Check if folder is empty (only contains . and ..)
     uint8_t start_byte = 1;
-    uint32_t current_cluster = h->dirent->cluster;
+    uint32_t current_cluster = h->dirent->content_cluster;
     size_t start_offset = 2 * sizeof(struct fatfs_short_dirent); // To skip . and ..
-    while (start_byte != 0 && ((current_cluster & 0x0fffffff) != 0x0fffffff) && ((current_cluster & 0x0fffffff) != 0x0ffffff8)) {
+    while (start_byte != 0 && !fat_is_eoc(current_cluster)) {
         int sector = (int) (mount->fs->data_sector + (current_cluster - 2) * mount->fs->bpb.secPerClus);
         for (int i = 0; (i < mount->fs->bpb.secPerClus) && (start_byte != 0); i++) {
-            err = long_sdhc_read(mount->ds, sector + i, get_phys_addr(mount->fs->buf_cap));
+            struct fatfs_block *b;
+            err = fatfs_cache_get(mount, sector + i, &b);
             ON_ERR_RETURN(err);
 
-            for (uint8_t *addr = mount->fs->buf_va + start_offset; (addr - (uint8_t *) mount->fs->buf_va) < mount->fs->bpb.bytsPerSec; addr += sizeof(struct fatfs_short_dirent)) {
+            for (uint8_t *addr = b->data + start_offset; (addr - b->data) < mount->fs->bpb.bytsPerSec; addr += sizeof(struct fatfs_short_dirent)) {
                 if ((addr[11] != 0) && (addr[0] != 0xE5) && (addr[0] != 0x00)) {
                     handle_close(h);
                     return FS_ERR_NOTEMPTY;
@@ -1268,7 +1391,7 @@ errval_t fatfs_rmdir(void *st, const char *path)
     // Remove content cluster from fat (set to 0x0)
     current_cluster = h->dirent->content_cluster;
     uint32_t parent = current_cluster;
-    while (((parent & 0x0fffffff) != 0x0fffffff) && ((parent & 0x0fffffff) != 0x0ffffff8)) {
+    while (!fat_is_eoc(parent)) {
         uint32_t child;
         err = get_next_fat_entry(mount, parent, &child);
         ON_ERR_RETURN(err);
@@ -1280,14 +1403,15 @@ errval_t fatfs_rmdir(void *st, const char *path)
     }
 
     // Set first byte in dir entry to 0xE5 and attr to 0
-    err = long_sdhc_read(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
+    struct fatfs_block *b;
+    err = fatfs_cache_get(mount, h->dirent->sector, &b);
     ON_ERR_RETURN(err);
 
-    uint8_t *dir = ((uint8_t *) mount->fs->buf_va) + h->dirent->sector_offset;
+    uint8_t *dir = b->data + h->dirent->sector_offset;
     dir[0] = 0xE5;
     dir[11] = 0;
 
-    err = long_sdhc_write(mount->ds, (int) h->dirent->sector, get_phys_addr(mount->fs->buf_cap));
+    err = fatfs_cache_mark_dirty(mount, b);
     ON_ERR_RETURN(err);
 
     handle_close(h);
@@ -1338,7 +1462,7 @@ errval_t fatfs_mount(const char *path, fatfs_mount_t *retst)
         free(mount);
         return LIB_ERR_MALLOC_FAIL;
     }
-    char fat32name[11];
+    char fat32name[12] = { 0 };
     pathname_to_fat32name(path+1, fat32name);
     fatfs_root->size = 0;
     fatfs_root->is_dir = true;
@@ -1355,6 +1479,16 @@ errval_t fatfs_mount(const char *path, fatfs_mount_t *retst)
     mount->fs = fs;
     mount->ds = ds;
 
+    err = fatfs_cache_init(mount, FATFS_CACHE_DEFAULT_BLOCKS);
+    if (err_is_fail(err)) {
+        free(fatfs_root->name);
+        free(fatfs_root);
+        free(ds);
+        free(fs);
+        free(mount);
+        return err;
+    }
+
     *retst = mount;
 
     //measurments(mount);
@@ -1368,7 +1502,7 @@ errval_t fatfs_mount(const char *path, fatfs_mount_t *retst)
     debug_printf(">>> RootClus: %d\n", fs->bpb.rootClus);
     uint8_t *current;
     for (int j = 0; j < fs->bpb.secPerClus/fs->bpb.secPerClus; j++) {
-        err = long_sdhc_read(ds, fs->rootDir_sector + j, get_phys_addr(fs->buf_cap));
+        err = sdhc_read_block(ds, fs->rootDir_sector + j, get_phys_addr(fs->buf_cap));
         ON_ERR_RETURN(err);
         current = fs->buf_va;
         for (int i = 0; i < 16/8; i++) {
@@ -1406,7 +1540,7 @@ errval_t fatfs_mount(const char *path, fatfs_mount_t *retst)
         }
     }
 
-    err = long_sdhc_read(ds, fs->data_sector + (3-2) * fs->bpb.secPerClus, get_phys_addr(fs->buf_cap));
+    err = sdhc_read_block(ds, fs->data_sector + (3-2) * fs->bpb.secPerClus, get_phys_addr(fs->buf_cap));
     ON_ERR_RETURN(err);
 
     debug_printf(">>> Print FOLDER\n");
@@ -1443,7 +1577,7 @@ errval_t fatfs_mount(const char *path, fatfs_mount_t *retst)
         }
     }
 
-    err = long_sdhc_read(ds, fs->data_sector + (4-2) * fs->bpb.secPerClus, get_phys_addr(fs->buf_cap));
+    err = sdhc_read_block(ds, fs->data_sector + (4-2) * fs->bpb.secPerClus, get_phys_addr(fs->buf_cap));
     ON_ERR_RETURN(err);
 
     debug_printf(">>> Print FILE SHORT\n");
@@ -1454,7 +1588,7 @@ errval_t fatfs_mount(const char *path, fatfs_mount_t *retst)
     }
 
     debug_printf(">>> Print FAT\n");
-    err = long_sdhc_read(ds, fs->fat_sector, get_phys_addr(fs->buf_cap));
+    err = sdhc_read_block(ds, fs->fat_sector, get_phys_addr(fs->buf_cap));
     ON_ERR_RETURN(err);
 
     uint32_t fatentry;
@@ -1463,7 +1597,7 @@ errval_t fatfs_mount(const char *path, fatfs_mount_t *retst)
         debug_printf(">> fatentry %d: 0x%x\n", i, fatentry);
     }
 /*
-    err = long_sdhc_read(ds, fs->data_sector + (7-2) * fs->bpb.secPerClus, get_phys_addr(fs->buf_cap));
+    err = sdhc_read_block(ds, fs->data_sector + (7-2) * fs->bpb.secPerClus, get_phys_addr(fs->buf_cap));
     ON_ERR_RETURN(err);
 
     debug_printf(">>> Print FILE LONG\n");
@@ -1484,7 +1618,7 @@ void measurments(struct fatfs_mount *mount)
     debug_printf(">> Sequential reads:\n");
     for(int i = 0; i < 100; i++) {
         start = systime_now();
-        long_sdhc_read(mount->ds, i, get_phys_addr(mount->fs->buf_cap));
+        sdhc_read_block(mount->ds, i, get_phys_addr(mount->fs->buf_cap));
         end = systime_now();
         diff = systime_to_us(end - start)/1000;
         debug_printf(">> ms: %lu\n", diff);
@@ -1493,7 +1627,7 @@ void measurments(struct fatfs_mount *mount)
     debug_printf(">> Sequential writes:\n");
     for(int i = 0; i < 100; i++) {
         start = systime_now();
-        long_sdhc_read(mount->ds, i, get_phys_addr(mount->fs->buf_cap));
+        sdhc_read_block(mount->ds, i, get_phys_addr(mount->fs->buf_cap));
         end = systime_now();
         diff = systime_to_us(end - start)/1000;
         debug_printf(">> ms: %lu\n", diff);
@@ -1502,8 +1636,8 @@ void measurments(struct fatfs_mount *mount)
     debug_printf(">> Sequential read/writes:\n");
     for(int i = 0; i < 50; i++) {
         start = systime_now();
-        long_sdhc_read(mount->ds, i, get_phys_addr(mount->fs->buf_cap));
-        long_sdhc_write(mount->ds, i, get_phys_addr(mount->fs->buf_cap));
+        sdhc_read_block(mount->ds, i, get_phys_addr(mount->fs->buf_cap));
+        sdhc_write_block(mount->ds, i, get_phys_addr(mount->fs->buf_cap));
         end = systime_now();
         diff = systime_to_us(end - start)/1000;
         debug_printf(">> ms: %lu\n", diff);
@@ -0,0 +1,828 @@
+/**
+ * \file
+ * \brief Block cache and in-memory FAT of a fatfs mount
+ *
+ * All card accesses of the fatfs go through the nocache bounce buffer of the
+ * mount. The block cache keeps recently used sectors in ordinary (cached)
+ * memory, indexed by a hash table and evicted in LRU order. A miss on a data
+ * sector reads the rest of its cluster with a single command, and further
+ * ahead when it continues the previous read. Changes are only written back on
+ * eviction or an explicit fatfs_sync(), which queues the dirty sectors in
+ * order so that the driver merges adjacent ones into multi-block writes. The
+ * FAT is kept in memory as well, sector by sector as it is touched, and
+ * modified FAT sectors are written to every FAT copy on sync.
+ *
+ * File data is accessed in ranges of consecutive sectors. Long runs of whole
+ * sectors that are not cached are moved between the card and the caller's
+ * buffer directly (through the bounce buffer), so that streaming a large file
+ * takes few commands and does not flush the cache.
+ *
+ * With a cache size of zero every access reads and writes the card directly
+ * through the bounce buffer.
+ */
+
+/*
+ * Copyright (c) 2019, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <string.h>
+#include <aos/aos.h>
+
+#include <fs/fs.h>
+#include <fs/fatfs.h>
+#include <drivers/sdhc.h>
+
+#include "fatfs_cache.h"
+
+static inline size_t sector_size(struct fatfs_mount *mount)
+{
+    return mount->fs->bpb.bytsPerSec;
+}
+
+static inline uint32_t fat_entries_per_sector(struct fatfs_mount *mount)
+{
+    return sector_size(mount) / sizeof(uint32_t);
+}
+
+static inline void lru_unlink(struct fatfs_block *b)
+{
+    b->prev->next = b->next;
+    b->next->prev = b->prev;
+}
+
+static inline void lru_push_front(struct fatfs_cache *c, struct fatfs_block *b)
+{
+    b->prev = &c->lru;
+    b->next = c->lru.next;
+    c->lru.next->prev = b;
+    c->lru.next = b;
+}
+
+static inline void lru_push_back(struct fatfs_cache *c, struct fatfs_block *b)
+{
+    b->next = &c->lru;
+    b->prev = c->lru.prev;
+    c->lru.prev->next = b;
+    c->lru.prev = b;
+}
+
+static inline size_t bucket_of(struct fatfs_cache *c, uint32_t sector)
+{
+    return sector & (c->n_buckets - 1);
+}
+
+static struct fatfs_block *lookup(struct fatfs_cache *c, uint32_t sector)
+{
+    struct fatfs_block *b = c->buckets[bucket_of(c, sector)];
+    while (b != NULL && b->sector != sector) {
+        b = b->hnext;
+    }
+    return b;
+}
+
+static void unhash(struct fatfs_cache *c, struct fatfs_block *b)
+{
+    struct fatfs_block **p = &c->buckets[bucket_of(c, b->sector)];
+    while (*p != b) {
+        p = &(*p)->hnext;
+    }
+    *p = b->hnext;
+    b->hnext = NULL;
+}
+
+static int compare_sector(const void *a, const void *b)
+{
+    const struct fatfs_block *x = *(struct fatfs_block * const *) a;
+    const struct fatfs_block *y = *(struct fatfs_block * const *) b;
+    return (x->sector > y->sector) - (x->sector < y->sector);
+}
+
+static void insert(struct fatfs_cache *c, struct fatfs_block *b, uint32_t sector)
+{
+    size_t bucket = bucket_of(c, sector);
+
+    b->sector = sector;
+    b->valid = true;
+    b->dirty = false;
+    b->hnext = c->buckets[bucket];
+    c->buckets[bucket] = b;
+
+    lru_unlink(b);
+    lru_push_front(c, b);
+}
+
+/**
+ * \brief writes a cached block back to the card through the bounce buffer
+ */
+static errval_t write_block(struct fatfs_mount *mount, struct fatfs_block *b)
+{
+    errval_t err;
+
+    memcpy(mount->fs->buf_va, b->data, sector_size(mount));
+    err = sdhc_write_block(mount->ds, (int) b->sector, mount->cache->buf_p);
+    ON_ERR_RETURN(err);
+
+    b->dirty = false;
+    mount->cache->writebacks++;
+    return SYS_ERR_OK;
+}
+
+static void wb_done(struct sdhc_req *req, errval_t err)
+{
+    struct fatfs_cache *c = req->arg;
+
+    if (err_is_fail(err) && err_is_ok(c->wb_err)) {
+        c->wb_err = err;
+    }
+}
+
+/**
+ * \brief waits for all queued writes, which frees the bounce buffer again
+ */
+static errval_t wb_flush(struct fatfs_mount *mount)
+{
+    struct fatfs_cache *c = mount->cache;
+
+    sdhc_flush(mount->ds);
+
+    errval_t err = c->wb_err;
+    c->wb_used = 0;
+    c->wb_err = SYS_ERR_OK;
+    return err;
+}
+
+/**
+ * \brief queues the write of a sector through the next bounce buffer slot
+ *
+ * Writes of adjacent sectors queued in ascending order end up in one command.
+ */
+static errval_t wb_queue(struct fatfs_mount *mount, uint32_t sector, const void *data)
+{
+    errval_t err;
+    struct fatfs_cache *c = mount->cache;
+    size_t size = sector_size(mount);
+
+    if (c->wb_used == FATFS_IO_BLOCKS) {
+        err = wb_flush(mount);
+        ON_ERR_RETURN(err);
+    }
+
+    size_t slot = c->wb_used++;
+    memcpy((uint8_t *) mount->fs->buf_va + slot * size, data, size);
+
+    struct sdhc_req *req = &c->wb_reqs[slot];
+    req->lba = sector;
+    req->count = 1;
+    req->buf = c->buf_p + slot * size;
+    req->write = true;
+    req->done = wb_done;
+    req->arg = c;
+    return sdhc_submit(mount->ds, req);
+}
+
+/**
+ * \brief frees the least recently used block, writing it back if necessary
+ */
+static errval_t evict(struct fatfs_mount *mount, struct fatfs_block **ret)
+{
+    errval_t err;
+    struct fatfs_cache *c = mount->cache;
+    struct fatfs_block *b = c->lru.prev;
+
+    if (b->valid) {
+        if (b->dirty) {
+            err = write_block(mount, b);
+            ON_ERR_RETURN(err);
+        }
+        unhash(c, b);
+        b->valid = false;
+    }
+
+    *ret = b;
+    return SYS_ERR_OK;
+}
+
+static void cache_free(struct fatfs_cache *c, uint32_t fat_sectors)
+{
+    if (c->fat != NULL) {
+        for (uint32_t i = 0; i < fat_sectors; i++) {
+            free(c->fat[i]);
+        }
+    }
+    free(c->fat);
+    free(c->fat_dirty);
+    free(c->sorted);
+    free(c->buckets);
+    free(c->data);
+    free(c->blocks);
+    free(c);
+}
+
+/**
+ * \brief sets up the cache of a mount
+ *
+ * \param mount     the mount, its fs and ds have to be initialized
+ * \param n_blocks  number of sectors to cache, 0 to access the card directly
+ */
+errval_t fatfs_cache_init(struct fatfs_mount *mount, size_t n_blocks)
+{
+    struct fat32_fs *fs = mount->fs;
+
+    struct fatfs_cache *c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    c->n_blocks = n_blocks;
+    c->lru.prev = &c->lru;
+    c->lru.next = &c->lru;
+    c->direct.data = fs->buf_va;
+    c->buf_p = get_phys_addr(fs->buf_cap);
+    c->wb_err = SYS_ERR_OK;
+
+    c->n_clusters = (fs->bpb.totSec32 - fs->data_sector) / fs->bpb.secPerClus + 2;
+    if (fs->fsi.nxt_Free >= 2 && fs->fsi.nxt_Free < c->n_clusters) {
+        c->fat_next_free = fs->fsi.nxt_Free;
+    } else {
+        c->fat_next_free = 2;
+    }
+
+    if (n_blocks > 0) {
+        c->n_buckets = 1;
+        while (c->n_buckets < n_blocks) {
+            c->n_buckets <<= 1;
+        }
+
+        c->blocks = calloc(n_blocks, sizeof(*c->blocks));
+        c->data = malloc(n_blocks * sector_size(mount));
+        c->buckets = calloc(c->n_buckets, sizeof(*c->buckets));
+        c->sorted = calloc(n_blocks, sizeof(*c->sorted));
+        c->fat = calloc(fs->bpb.fatSz32, sizeof(*c->fat));
+        c->fat_dirty = calloc(fs->bpb.fatSz32, sizeof(*c->fat_dirty));
+        if (c->blocks == NULL || c->data == NULL || c->buckets == NULL
+            || c->sorted == NULL || c->fat == NULL || c->fat_dirty == NULL) {
+            cache_free(c, fs->bpb.fatSz32);
+            return LIB_ERR_MALLOC_FAIL;
+        }
+
+        for (size_t i = 0; i < n_blocks; i++) {
+            c->blocks[i].data = c->data + i * sector_size(mount);
+            lru_push_back(c, &c->blocks[i]);
+        }
+    }
+
+    mount->cache = c;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief writes back everything and frees the cache of a mount
+ */
+errval_t fatfs_cache_destroy(struct fatfs_mount *mount)
+{
+    errval_t err;
+
+    if (mount->cache == NULL) {
+        return SYS_ERR_OK;
+    }
+
+    err = fatfs_cache_sync(mount);
+    ON_ERR_RETURN(err);
+
+    cache_free(mount->cache, mount->fs->bpb.fatSz32);
+    mount->cache = NULL;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief number of sectors to read on a miss of sector
+ *
+ * Data sectors are read up to the end of their cluster, and further ahead if
+ * the miss continues the previous read. The run ends before the first sector
+ * that is cached already, as the cached copy may be newer than the card.
+ */
+static size_t read_run_length(struct fatfs_mount *mount, uint32_t sector)
+{
+    struct fatfs_cache *c = mount->cache;
+    struct fat32_fs *fs = mount->fs;
+    size_t n = 1;
+
+    if (sector >= fs->data_sector) {
+        n = fs->bpb.secPerClus - (sector - fs->data_sector) % fs->bpb.secPerClus;
+        if (sector == c->ra_next) {
+            n = MAX(n, FATFS_READAHEAD_BLOCKS);
+        }
+    }
+
+    // Leave most of the cache to what was used already
+    n = MIN(n, MAX(c->n_blocks / 4, 1));
+    n = MIN(n, FATFS_IO_BLOCKS);
+    n = MIN(n, fs->bpb.totSec32 - sector);
+
+    for (size_t i = 1; i < n; i++) {
+        if (lookup(c, sector + i) != NULL) {
+            return i;
+        }
+    }
+    return n;
+}
+
+/**
+ * \brief returns the block holding a sector, reading it on a miss
+ */
+errval_t fatfs_cache_get(struct fatfs_mount *mount, uint32_t sector,
+                         struct fatfs_block **ret)
+{
+    errval_t err;
+    struct fatfs_cache *c = mount->cache;
+    struct fatfs_block *b;
+
+    if (c->n_blocks == 0) {
+        err = sdhc_read_block(mount->ds, (int) sector, c->buf_p);
+        ON_ERR_RETURN(err);
+
+        c->direct.sector = sector;
+        c->direct.valid = true;
+        c->misses++;
+        *ret = &c->direct;
+        return SYS_ERR_OK;
+    }
+
+    b = lookup(c, sector);
+    if (b != NULL) {
+        lru_unlink(b);
+        lru_push_front(c, b);
+        c->hits++;
+        *ret = b;
+        return SYS_ERR_OK;
+    }
+
+    // Take the blocks for the whole run off the LRU end first, so that the
+    // evictions (and their write-backs) are done before the read
+    struct fatfs_block *run[FATFS_IO_BLOCKS];
+    size_t n = read_run_length(mount, sector);
+    for (size_t i = 0; i < n; i++) {
+        err = evict(mount, &run[i]);
+        if (err_is_fail(err)) {
+            n = i;
+            goto out_release;
+        }
+        lru_unlink(run[i]);
+        lru_push_front(c, run[i]);
+    }
+
+    err = sdhc_read_blocks(mount->ds, sector, n, c->buf_p);
+    if (err_is_fail(err)) {
+        goto out_release;
+    }
+
+    // Insert backwards so that the requested sector is the most recently used
+    for (size_t i = n; i-- > 0;) {
+        memcpy(run[i]->data, (uint8_t *) mount->fs->buf_va + i * sector_size(mount),
+               sector_size(mount));
+        insert(c, run[i], sector + i);
+    }
+    c->ra_next = sector + n;
+    c->misses++;
+    c->readahead += n - 1;
+
+    *ret = run[0];
+    return SYS_ERR_OK;
+
+out_release:
+    for (size_t i = 0; i < n; i++) {
+        lru_unlink(run[i]);
+        lru_push_back(c, run[i]);
+    }
+    return err;
+}
+
+/**
+ * \brief returns a zero filled block for a sector without reading the card
+ *
+ * The caller is expected to mark the block dirty.
+ */
+errval_t fatfs_cache_get_zeroed(struct fatfs_mount *mount, uint32_t sector,
+                                struct fatfs_block **ret)
+{
+    errval_t err;
+    struct fatfs_cache *c = mount->cache;
+    struct fatfs_block *b;
+
+    if (c->n_blocks == 0) {
+        b = &c->direct;
+        b->sector = sector;
+        b->valid = true;
+    } else {
+        b = lookup(c, sector);
+        if (b != NULL) {
+            lru_unlink(b);
+            lru_push_front(c, b);
+        } else {
+            err = evict(mount, &b);
+            ON_ERR_RETURN(err);
+            insert(c, b, sector);
+        }
+    }
+
+    memset(b->data, 0, sector_size(mount));
+    *ret = b;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief records a modification of a block returned by the cache
+ *
+ * With the cache disabled the block is written to the card right away.
+ */
+errval_t fatfs_cache_mark_dirty(struct fatfs_mount *mount, struct fatfs_block *b)
+{
+    struct fatfs_cache *c = mount->cache;
+
+    if (c->n_blocks == 0) {
+        assert(b == &c->direct);
+        return sdhc_write_block(mount->ds, (int) b->sector, c->buf_p);
+    }
+
+    b->dirty = true;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief number of whole sectors from sector on that bypass the cache
+ *
+ * Only long runs of sectors that are not cached are transferred directly,
+ * shorter ones go through the cache and its readahead. With the cache
+ * disabled every run is direct.
+ */
+static size_t direct_run(struct fatfs_mount *mount, uint32_t sector, size_t max)
+{
+    struct fatfs_cache *c = mount->cache;
+    size_t n = 0;
+
+    max = MIN(max, FATFS_IO_BLOCKS);
+    if (c->n_blocks == 0) {
+        return max;
+    }
+    if (max < FATFS_DIRECT_MIN_BLOCKS) {
+        return 0;
+    }
+
+    while (n < max && lookup(c, sector + n) == NULL) {
+        n++;
+    }
+    return n >= FATFS_DIRECT_MIN_BLOCKS ? n : 0;
+}
+
+/**
+ * \brief reads bytes starting at offset into a run of consecutive sectors
+ */
+errval_t fatfs_cache_read(struct fatfs_mount *mount, uint32_t sector, size_t offset,
+                          void *buf, size_t bytes)
+{
+    errval_t err;
+    struct fatfs_cache *c = mount->cache;
+    size_t size = sector_size(mount);
+    uint8_t *dst = buf;
+
+    sector += offset / size;
+    offset %= size;
+
+    while (bytes > 0) {
+        size_t chunk = MIN(bytes, size - offset);
+
+        size_t n = offset == 0 ? direct_run(mount, sector, bytes / size) : 0;
+        if (n > 0) {
+            err = sdhc_read_blocks(mount->ds, sector, n, c->buf_p);
+            ON_ERR_RETURN(err);
+
+            memcpy(dst, mount->fs->buf_va, n * size);
+            c->direct_blocks += n;
+            chunk = n * size;
+            sector += n;
+        } else {
+            struct fatfs_block *b;
+            err = fatfs_cache_get(mount, sector, &b);
+            ON_ERR_RETURN(err);
+
+            memcpy(dst, b->data + offset, chunk);
+            sector++;
+        }
+
+        dst += chunk;
+        bytes -= chunk;
+        offset = 0;
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief writes bytes starting at offset into a run of consecutive sectors
+ *
+ * Directly written sectors reach the card before this returns, all others
+ * are written back on sync (or right away with the cache disabled).
+ */
+errval_t fatfs_cache_write(struct fatfs_mount *mount, uint32_t sector, size_t offset,
+                           const void *buf, size_t bytes)
+{
+    errval_t err;
+    struct fatfs_cache *c = mount->cache;
+    size_t size = sector_size(mount);
+    const uint8_t *src = buf;
+
+    sector += offset / size;
+    offset %= size;
+
+    while (bytes > 0) {
+        size_t chunk = MIN(bytes, size - offset);
+
+        size_t n = offset == 0 ? direct_run(mount, sector, bytes / size) : 0;
+        if (n > 0) {
+            memcpy(mount->fs->buf_va, src, n * size);
+            err = sdhc_write_blocks(mount->ds, sector, n, c->buf_p);
+            ON_ERR_RETURN(err);
+
+            c->direct_blocks += n;
+            chunk = n * size;
+            sector += n;
+        } else {
+            // A whole sector is overwritten, no need to read it first
+            struct fatfs_block *b;
+            if (chunk == size) {
+                err = fatfs_cache_get_zeroed(mount, sector, &b);
+            } else {
+                err = fatfs_cache_get(mount, sector, &b);
+            }
+            ON_ERR_RETURN(err);
+
+            memcpy(b->data + offset, src, chunk);
+            err = fatfs_cache_mark_dirty(mount, b);
+            ON_ERR_RETURN(err);
+            sector++;
+        }
+
+        src += chunk;
+        bytes -= chunk;
+        offset = 0;
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief writes a FAT sector to all copies of the FAT
+ */
+static errval_t fat_write_sector(struct fatfs_mount *mount, uint32_t index, uint32_t *data)
+{
+    errval_t err;
+    struct fat32_fs *fs = mount->fs;
+
+    if ((void *) data != fs->buf_va) {
+        memcpy(fs->buf_va, data, sector_size(mount));
+    }
+
+    for (int k = 0; k < fs->bpb.numFATs; k++) {
+        uint32_t sector = fs->fat_sector + k * fs->bpb.fatSz32 + index;
+        err = sdhc_write_block(mount->ds, (int) sector, mount->cache->buf_p);
+        ON_ERR_RETURN(err);
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief returns the in-memory copy of a FAT sector, loading it on first use
+ */
+static errval_t fat_sector(struct fatfs_mount *mount, uint32_t index, uint32_t **ret)
+{
+    errval_t err;
+    struct fatfs_cache *c = mount->cache;
+    struct fat32_fs *fs = mount->fs;
+
+    if (index >= fs->bpb.fatSz32) {
+        return FS_ERR_INDEX_BOUNDS;
+    }
+
+    if (c->n_blocks == 0) {
+        err = sdhc_read_block(mount->ds, (int) (fs->fat_sector + index), c->buf_p);
+        ON_ERR_RETURN(err);
+        *ret = fs->buf_va;
+        return SYS_ERR_OK;
+    }
+
+    if (c->fat[index] == NULL) {
+        uint32_t *s = malloc(sector_size(mount));
+        if (s == NULL) {
+            return LIB_ERR_MALLOC_FAIL;
+        }
+
+        err = sdhc_read_block(mount->ds, (int) (fs->fat_sector + index), c->buf_p);
+        if (err_is_fail(err)) {
+            free(s);
+            return err;
+        }
+
+        memcpy(s, fs->buf_va, sector_size(mount));
+        c->fat[index] = s;
+        c->fat_loads++;
+    }
+
+    *ret = c->fat[index];
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief returns the FAT entry of a cluster (without the reserved bits)
+ */
+errval_t fatfs_fat_get(struct fatfs_mount *mount, uint32_t cluster, uint32_t *ret)
+{
+    errval_t err;
+    uint32_t per = fat_entries_per_sector(mount);
+    uint32_t *s;
+
+    if (cluster >= mount->cache->n_clusters) {
+        return FS_ERR_INDEX_BOUNDS;
+    }
+
+    err = fat_sector(mount, cluster / per, &s);
+    ON_ERR_RETURN(err);
+
+    *ret = s[cluster % per] & FAT_ENTRY_MASK;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief sets the FAT entry of a cluster, preserving the reserved bits
+ */
+errval_t fatfs_fat_set(struct fatfs_mount *mount, uint32_t cluster, uint32_t value)
+{
+    errval_t err;
+    struct fatfs_cache *c = mount->cache;
+    uint32_t per = fat_entries_per_sector(mount);
+    uint32_t *s;
+
+    if (cluster >= c->n_clusters) {
+        return FS_ERR_INDEX_BOUNDS;
+    }
+
+    err = fat_sector(mount, cluster / per, &s);
+    ON_ERR_RETURN(err);
+
+    uint32_t old = s[cluster % per] & FAT_ENTRY_MASK;
+    s[cluster % per] = (s[cluster % per] & ~FAT_ENTRY_MASK) | (value & FAT_ENTRY_MASK);
+
+    if (value == 0 && old != 0) {
+        c->fat_generation++;
+        if (cluster >= 2 && cluster < c->fat_next_free) {
+            c->fat_next_free = cluster;
+        }
+    }
+
+    if (c->n_blocks == 0) {
+        return fat_write_sector(mount, cluster / per, s);
+    }
+
+    c->fat_dirty[cluster / per] = 1;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief finds a free cluster and marks it as the end of a chain
+ */
+errval_t fatfs_fat_alloc(struct fatfs_mount *mount, uint32_t *ret)
+{
+    errval_t err;
+    struct fatfs_cache *c = mount->cache;
+    uint32_t per = fat_entries_per_sector(mount);
+    uint32_t total = c->n_clusters - 2;
+    uint32_t cluster = c->fat_next_free;
+    uint32_t scanned = 0;
+
+    while (scanned < total) {
+        if (cluster >= c->n_clusters) {
+            cluster = 2;
+        }
+
+        uint32_t *s;
+        err = fat_sector(mount, cluster / per, &s);
+        ON_ERR_RETURN(err);
+
+        // Scan the rest of this FAT sector
+        do {
+            if ((s[cluster % per] & FAT_ENTRY_MASK) == 0) {
+                err = fatfs_fat_set(mount, cluster, FAT_ENTRY_EOC);
+                ON_ERR_RETURN(err);
+
+                c->fat_next_free = cluster + 1;
+                *ret = cluster;
+                return SYS_ERR_OK;
+            }
+            cluster++;
+            scanned++;
+        } while (cluster % per != 0 && cluster < c->n_clusters && scanned < total);
+    }
+
+    return FS_ERR_INDEX_BOUNDS;
+}
+
+/**
+ * \brief writes all dirty blocks and FAT sectors back to the card
+ */
+errval_t fatfs_cache_sync(struct fatfs_mount *mount)
+{
+    errval_t err;
+    struct fatfs_cache *c = mount->cache;
+
+    if (c->n_blocks == 0) {
+        return SYS_ERR_OK;
+    }
+
+    struct fat32_fs *fs = mount->fs;
+    size_t n_dirty = 0;
+    for (size_t i = 0; i < c->n_blocks; i++) {
+        struct fatfs_block *b = &c->blocks[i];
+        if (b->valid && b->dirty) {
+            c->sorted[n_dirty++] = b;
+        }
+    }
+    qsort(c->sorted, n_dirty, sizeof(*c->sorted), compare_sector);
+
+    for (size_t i = 0; i < n_dirty; i++) {
+        err = wb_queue(mount, c->sorted[i]->sector, c->sorted[i]->data);
+        ON_ERR_RETURN(err);
+    }
+
+    for (int k = 0; k < fs->bpb.numFATs; k++) {
+        for (uint32_t i = 0; i < fs->bpb.fatSz32; i++) {
+            if (c->fat_dirty[i]) {
+                uint32_t sector = fs->fat_sector + k * fs->bpb.fatSz32 + i;
+                err = wb_queue(mount, sector, c->fat[i]);
+                ON_ERR_RETURN(err);
+            }
+        }
+    }
+
+    err = wb_flush(mount);
+    ON_ERR_RETURN(err);
+
+    for (size_t i = 0; i < n_dirty; i++) {
+        c->sorted[i]->dirty = false;
+    }
+    c->writebacks += n_dirty;
+    memset(c->fat_dirty, 0, fs->bpb.fatSz32);
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief writes all modified sectors of a mount back to the card
+ */
+errval_t fatfs_sync(void *st)
+{
+    return fatfs_cache_sync(st);
+}
+
+/**
+ * \brief changes the number of cached sectors of a mount
+ *
+ * Everything is written back first. A size of 0 disables the cache, every
+ * access goes to the card then.
+ */
+errval_t fatfs_set_cache_size(void *st, size_t n_blocks)
+{
+    errval_t err;
+    struct fatfs_mount *mount = st;
+
+    struct fatfs_cache *old = mount->cache;
+
+    // Keeps cluster maps of open handles from being mistaken as valid
+    uint64_t generation = old->fat_generation + 1;
+
+    err = fatfs_cache_sync(mount);
+    ON_ERR_RETURN(err);
+
+    // only replaces mount->cache on success, the old cache stays usable
+    err = fatfs_cache_init(mount, n_blocks);
+    ON_ERR_RETURN(err);
+
+    cache_free(old, mount->fs->bpb.fatSz32);
+    mount->cache->fat_generation = generation;
+    return SYS_ERR_OK;
+}
+
+void fatfs_print_cache_stats(void *st)
+{
+    struct fatfs_mount *mount = st;
+    struct fatfs_cache *c = mount->cache;
+
+    debug_printf("fatfs cache: %zu blocks, %lu hits, %lu misses, %lu read ahead, "
+                 "%lu direct, %lu writebacks, %lu FAT sectors loaded\n", c->n_blocks,
+                 c->hits, c->misses, c->readahead, c->direct_blocks, c->writebacks,
+                 c->fat_loads);
+}
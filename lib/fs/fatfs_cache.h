@@ -0,0 +1,104 @@
+/**
+ * \file
+ * \brief Block cache and in-memory FAT of a fatfs mount
+ */
+
+/*
+ * Copyright (c) 2019, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef FS_FATFS_CACHE_H_
+#define FS_FATFS_CACHE_H_
+
+#include <aos/aos.h>
+#include <fs/fatfs.h>
+#include <drivers/sdhc.h>
+
+/// FAT entries are 28 bit, the upper 4 bits are reserved
+#define FAT_ENTRY_MASK 0x0fffffff
+
+/// Value of a FAT entry terminating a cluster chain
+#define FAT_ENTRY_EOC 0x0fffffff
+
+/// Sectors read on a miss that continues the previous read
+#define FATFS_READAHEAD_BLOCKS 32
+
+/// Runs of at least this many uncached sectors are transferred bypassing the cache
+#define FATFS_DIRECT_MIN_BLOCKS 16
+
+/**
+ * \brief a cached sector
+ *
+ * The data pointer is only valid until the next call into the cache of the
+ * same mount, as the block may be evicted (or, with the cache disabled, the
+ * bounce buffer reused) by it.
+ */
+struct fatfs_block
+{
+    uint32_t sector;                ///< sector number on the card
+    bool valid;                     ///< data holds the sector contents
+    bool dirty;                     ///< data has to be written back
+    uint8_t *data;                  ///< the sector data (bytsPerSec)
+
+    struct fatfs_block *prev;       ///< LRU list, most recently used first
+    struct fatfs_block *next;       ///< LRU list, most recently used first
+    struct fatfs_block *hnext;      ///< next block in the same hash bucket
+};
+
+/**
+ * \brief block cache and FAT copy of a mount
+ */
+struct fatfs_cache
+{
+    size_t n_blocks;                ///< number of cached blocks, 0 = disabled
+    struct fatfs_block *blocks;     ///< block descriptors
+    uint8_t *data;                  ///< backing memory of the blocks
+    struct fatfs_block **buckets;   ///< sector hash table
+    size_t n_buckets;               ///< size of the hash table (power of two)
+    struct fatfs_block lru;         ///< sentinel of the LRU list
+    struct fatfs_block direct;      ///< bounce buffer block if disabled
+    lpaddr_t buf_p;                 ///< physical address of the bounce buffer
+    uint32_t ra_next;               ///< sector following the last read run
+
+    struct fatfs_block **sorted;    ///< dirty blocks in sector order, for sync
+    struct sdhc_req wb_reqs[FATFS_IO_BLOCKS]; ///< queued writes, one per bounce buffer slot
+    size_t wb_used;                 ///< bounce buffer slots in use by queued writes
+    errval_t wb_err;                ///< first error of a queued write
+
+    uint32_t **fat;                 ///< FAT sectors, loaded on first use
+    uint8_t *fat_dirty;             ///< FAT sectors to write back
+    uint32_t fat_next_free;         ///< where the next free cluster search starts
+    uint32_t n_clusters;            ///< number of clusters (incl. the two reserved)
+    uint64_t fat_generation;        ///< incremented whenever a cluster is freed
+
+    uint64_t hits;                  ///< lookups served from the cache
+    uint64_t misses;                ///< lookups that read the card
+    uint64_t readahead;             ///< sectors read along with a missed one
+    uint64_t direct_blocks;         ///< sectors transferred bypassing the cache
+    uint64_t writebacks;            ///< dirty blocks written to the card
+    uint64_t fat_loads;             ///< FAT sectors read from the card
+};
+
+errval_t fatfs_cache_init(struct fatfs_mount *mount, size_t n_blocks);
+errval_t fatfs_cache_destroy(struct fatfs_mount *mount);
+errval_t fatfs_cache_get(struct fatfs_mount *mount, uint32_t sector,
+                         struct fatfs_block **ret);
+errval_t fatfs_cache_get_zeroed(struct fatfs_mount *mount, uint32_t sector,
+                                struct fatfs_block **ret);
+errval_t fatfs_cache_mark_dirty(struct fatfs_mount *mount, struct fatfs_block *b);
+errval_t fatfs_cache_read(struct fatfs_mount *mount, uint32_t sector, size_t offset,
+                          void *buf, size_t bytes);
+errval_t fatfs_cache_write(struct fatfs_mount *mount, uint32_t sector, size_t offset,
+                           const void *buf, size_t bytes);
+errval_t fatfs_cache_sync(struct fatfs_mount *mount);
+
+errval_t fatfs_fat_get(struct fatfs_mount *mount, uint32_t cluster, uint32_t *ret);
+errval_t fatfs_fat_set(struct fatfs_mount *mount, uint32_t cluster, uint32_t value);
+errval_t fatfs_fat_alloc(struct fatfs_mount *mount, uint32_t *ret);
+
+#endif /* FS_FATFS_CACHE_H_ */
@@ -13,6 +13,9 @@
 
 #include "fs_internal.h"
 
+/// the mount set up by filesystem_init()
+static fatfs_mount_t fs_mount = NULL;
+
 /*
  * Copyright (c) 2016 ETH Zurich.
  * All rights reserved.
@@ -43,6 +46,7 @@ errval_t filesystem_init(void)
     }
 
     /* TODO: Mount your sdcard at /sdcard */
+    fs_mount = st;
 
     /* register libc fopen/fread and friends */
     fs_libc_init(st);
@@ -50,6 +54,31 @@ errval_t filesystem_init(void)
     return SYS_ERR_OK;
 }
 
+/**
+ * @brief writes all cached modifications back to the sdcard
+ *
+ * @return SYS_ERR_OK on success
+ *         errval on failure
+ */
+errval_t filesystem_sync(void)
+{
+    if (fs_mount == NULL) {
+        return SYS_ERR_OK;
+    }
+
+    return fatfs_sync(fs_mount);
+}
+
+/**
+ * @brief returns the fatfs mount set up by filesystem_init()
+ *
+ * @return the mount, NULL if the filesystem was not initialized
+ */
+void *filesystem_get_mount(void)
+{
+    return fs_mount;
+}
+
 /**
  * @brief mounts the URI at a give path
  *
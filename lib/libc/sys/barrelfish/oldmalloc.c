@@ -34,8 +34,11 @@ void __malloc_dump(void);
 
 /*
  * malloc: general-purpose storage allocator
+ *
+ * malloc, free and realloc are weak so that an allocator library linked into
+ * the application (e.g. libscmalloc) replaces them at link time.
  */
-void *
+__attribute__((weak)) void *
 malloc(size_t nbytes)
 {
     if (alt_malloc != NULL) {
@@ -145,7 +148,7 @@ __free_locked(void *ap)
 #endif
 }
 
-void free(void *ap)
+__attribute__((weak)) void free(void *ap)
 {
     if (ap == NULL) {
         return;
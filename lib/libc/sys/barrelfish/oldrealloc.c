@@ -11,7 +11,7 @@
 typedef void *(*alt_realloc_t)(void *p, size_t bytes);
 alt_realloc_t alt_realloc = NULL;
 
-void *
+__attribute__((weak)) void *
 realloc(void *ptr, size_t size)
 {
     if (alt_realloc != NULL) {
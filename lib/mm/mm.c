@@ -47,8 +47,11 @@ errval_t mm_init(struct mm *mm, enum objtype objtype,
 
     slab_init(&mm->slabs, sizeof(struct mmnode), slab_refill_func);
     mm->head = NULL;
-    mm->free_head = NULL;
-    mm->free_last = NULL;
+    for (int i = 0; i < MM_NUM_BINS; i++) {
+        mm->free_bins[i] = NULL;
+    }
+    mm->free_bins_mask = 0;
+    mm->alloc_root = NULL;
     mm->objtype = objtype;
     mm->slot_alloc_priv = slot_alloc_func;
     mm->slot_refill = slot_refill_func;
@@ -90,53 +93,61 @@ void mm_destroy(struct mm *mm)
 }
 
 /**
- * \brief Add a node to the list of free nodes.
+ * \brief Size-class bin a free node of the given size belongs to.
+ */
+static inline uint8_t size_to_bin(gensize_t size)
+{
+    assert(size > 0);
+    return log2floor(size);
+}
+
+/**
+ * \brief Add a node to the bin of free nodes matching its size.
  *
  * \param mm Pointer to MM allocator instance data.
- * \param node Node to add to the list of free nodes.
+ * \param node Node to add to the free bins.
  */
 static void add_node_to_free_list(struct mm *mm, struct mmnode *node)
 {
     assert(mm != NULL && node != NULL);
 
-    node->free_prev = mm->free_last;
-    if (mm->free_last) {
-        mm->free_last->free_next = node;
-    } else {
-        mm->free_head = node;
+    uint8_t bin = size_to_bin(node->size);
+
+    node->free_prev = NULL;
+    node->free_next = mm->free_bins[bin];
+    if (node->free_next) {
+        node->free_next->free_prev = node;
     }
 
-    mm->free_last = node;
-    node->free_next = NULL;
+    mm->free_bins[bin] = node;
+    mm->free_bins_mask |= 1ULL << bin;
 }
 
 /**
- * \brief Remove a node from the list of free nodes. This is necessary
- * for cases like coalesce, since two nodes to coalesce might not be
- * adjacent in the free_list.
+ * \brief Remove a node from its bin of free nodes. This is necessary
+ * for cases like coalesce or split, since the size of the node (and thereby
+ * its bin) is about to change.
  *
  * \param mm Pointer to MM allocator instance data.
- * \param node Node to remove from the list of free nodes.
+ * \param node Node to remove from the free bins.
  */
 static void remove_node_from_free_list(struct mm *mm, struct mmnode *node)
 {
     assert(mm != NULL && node != NULL);
 
-    if (node == mm->free_head) {
-        mm->free_head = node->free_next;
-        if (mm->free_head) {
-            mm->free_head->free_prev = NULL;
-        }
-    } else {
+    uint8_t bin = size_to_bin(node->size);
+
+    if (node->free_prev) {
         node->free_prev->free_next = node->free_next;
+    } else {
+        assert(mm->free_bins[bin] == node);
+        mm->free_bins[bin] = node->free_next;
+        if (mm->free_bins[bin] == NULL) {
+            mm->free_bins_mask &= ~(1ULL << bin);
+        }
     }
 
-    if (node == mm->free_last) {
-        mm->free_last = node->free_prev;
-        if (mm->free_last) {
-            mm->free_last->free_next = NULL;
-        }
-    } else {
+    if (node->free_next) {
         node->free_next->free_prev = node->free_prev;
     }
 
@@ -144,14 +155,144 @@ static void remove_node_from_free_list(struct mm *mm, struct mmnode *node)
     node->free_prev = NULL;
 }
 
+static inline int tree_height(struct mmnode *node)
+{
+    return node ? node->tree_height : 0;
+}
+
+static inline void tree_update_height(struct mmnode *node)
+{
+    int l = tree_height(node->tree_left);
+    int r = tree_height(node->tree_right);
+    node->tree_height = 1 + (l > r ? l : r);
+}
+
+static struct mmnode *tree_rotate_right(struct mmnode *node)
+{
+    struct mmnode *left = node->tree_left;
+    node->tree_left = left->tree_right;
+    left->tree_right = node;
+    tree_update_height(node);
+    tree_update_height(left);
+    return left;
+}
+
+static struct mmnode *tree_rotate_left(struct mmnode *node)
+{
+    struct mmnode *right = node->tree_right;
+    node->tree_right = right->tree_left;
+    right->tree_left = node;
+    tree_update_height(node);
+    tree_update_height(right);
+    return right;
+}
+
+/**
+ * \brief Restore the AVL invariant at `node` after one of its subtrees changed.
+ *
+ * \returns the new root of the subtree
+ */
+static struct mmnode *tree_rebalance(struct mmnode *node)
+{
+    tree_update_height(node);
+    int balance = tree_height(node->tree_left) - tree_height(node->tree_right);
+
+    if (balance > 1) {
+        if (tree_height(node->tree_left->tree_left) < tree_height(node->tree_left->tree_right)) {
+            node->tree_left = tree_rotate_left(node->tree_left);
+        }
+        return tree_rotate_right(node);
+    }
+    if (balance < -1) {
+        if (tree_height(node->tree_right->tree_right) < tree_height(node->tree_right->tree_left)) {
+            node->tree_right = tree_rotate_right(node->tree_right);
+        }
+        return tree_rotate_left(node);
+    }
+    return node;
+}
+
+/**
+ * \brief Insert an allocated node into the address-ordered tree.
+ *
+ * \returns the new root of the tree
+ */
+static struct mmnode *tree_insert(struct mmnode *root, struct mmnode *node)
+{
+    if (root == NULL) {
+        node->tree_left = NULL;
+        node->tree_right = NULL;
+        node->tree_height = 1;
+        return node;
+    }
+
+    if (node->base < root->base) {
+        root->tree_left = tree_insert(root->tree_left, node);
+    } else {
+        assert(node->base != root->base);
+        root->tree_right = tree_insert(root->tree_right, node);
+    }
+    return tree_rebalance(root);
+}
+
+static struct mmnode *tree_remove_min(struct mmnode *root, struct mmnode **min)
+{
+    if (root->tree_left == NULL) {
+        *min = root;
+        return root->tree_right;
+    }
+    root->tree_left = tree_remove_min(root->tree_left, min);
+    return tree_rebalance(root);
+}
+
+/**
+ * \brief Remove `node` from the address-ordered tree.
+ *
+ * \returns the new root of the tree
+ */
+static struct mmnode *tree_remove(struct mmnode *root, struct mmnode *node)
+{
+    assert(root != NULL);
+
+    if (node->base < root->base) {
+        root->tree_left = tree_remove(root->tree_left, node);
+    } else if (node->base > root->base) {
+        root->tree_right = tree_remove(root->tree_right, node);
+    } else {
+        assert(root == node);
+        if (root->tree_left == NULL) {
+            return root->tree_right;
+        }
+        if (root->tree_right == NULL) {
+            return root->tree_left;
+        }
+        struct mmnode *succ;
+        struct mmnode *right = tree_remove_min(root->tree_right, &succ);
+        succ->tree_left = root->tree_left;
+        succ->tree_right = right;
+        return tree_rebalance(succ);
+    }
+    return tree_rebalance(root);
+}
+
+/**
+ * \brief Find the allocated node starting at `base`, or NULL.
+ */
+static struct mmnode *tree_find(struct mmnode *root, genpaddr_t base)
+{
+    while (root != NULL && root->base != base) {
+        root = base < root->base ? root->tree_left : root->tree_right;
+    }
+    return root;
+}
+
 /**
- * DONE: also insert to free list
  * \brief simply insert a new node at the front of our linked list structure.
- * If the provided node is of type "NodeType_Free", it is also placed at the
- * head of the free list.
+ * If the provided node is of type "NodeType_Free", it is also placed in the
+ * matching free bin.
  *
  * \param mm Pointer to MM allocator instance data.
- * \param node Node to remove from the list of free nodes.
+ * \param node Node to insert.
  */
 static void insert_node_as_head(struct mm *mm, struct mmnode *node)
 {
@@ -165,22 +306,27 @@ static void insert_node_as_head(struct mm *mm, struct mmnode *node)
     mm->head = node;
     node->next = old_head;
     node->prev = NULL;
+    node->tree_left = NULL;
+    node->tree_right = NULL;
+    node->tree_height = 0;
 
-    // maybe also insert into free list
+    // maybe also insert into free bins
     if (node->type == NodeType_Free) {
         add_node_to_free_list(mm, node);
     } else {
         node->free_next = NULL;
         node->free_prev = NULL;
+        mm->alloc_root = tree_insert(mm->alloc_root, node);
     }
 }
 
 /**
- * TODO: Also, maybe param "a" could be removed, as it will just point
- * to "node" anyways.
  * \brief Split the provided mmnode to create one node with the
  * requested size and one with the remaining size.
  *
+ * Neither part is put into a free bin, the caller is responsible for that
+ * (and must have removed `node` from its bin beforehand).
+ *
  * \param mm Pointer to MM allocator instance data.
  * \param node Existing mmnode that will be split.
  * \param offset Requested size of the newly created node "a".
@@ -199,6 +345,8 @@ static errval_t split_node(struct mm *mm, struct mmnode *node, size_t offset, st
     *new_node = *node;
     new_node->base += offset;
     new_node->size -= offset;
+    new_node->free_next = NULL;
+    new_node->free_prev = NULL;
 
     node->size = offset;
 
@@ -209,16 +357,64 @@ static errval_t split_node(struct mm *mm, struct mmnode *node, size_t offset, st
         new_node->next->prev = new_node;
     }
 
-    if (new_node->type == NodeType_Free) {
-        add_node_to_free_list(mm, new_node);
-    }
-
     *a = node;
     *b = new_node;
 
     return SYS_ERR_OK;
 }
 
+/**
+ * \brief Check whether a free node can hold `size` bytes at the given alignment.
+ */
+static inline bool node_fits(struct mmnode *node, size_t size, size_t alignment)
+{
+    gensize_t offset = node->base % alignment ? alignment - (node->base % alignment) : 0;
+    return offset <= node->size && node->size - offset >= size;
+}
+
+/**
+ * \brief Find a free node that can hold `size` bytes at the given alignment.
+ *
+ * Every node in a bin whose lower bound is at least size plus the worst-case
+ * alignment padding fits, so the first non-empty such bin is found in O(1)
+ * through the bin mask. Only if all of those are empty do we fall back to
+ * scanning the bins of nodes that might fit.
+ *
+ * \returns a fitting free node, or NULL if there is none
+ */
+static struct mmnode *find_free_node(struct mm *mm, size_t size, size_t alignment)
+{
+    gensize_t worst = size;
+    if (alignment > BASE_PAGE_SIZE) {
+        worst += alignment - BASE_PAGE_SIZE;
+    }
+    uint8_t lo_bin = size_to_bin(size);
+    uint8_t fit_bin = log2ceil(worst);
+
+    if (fit_bin < MM_NUM_BINS) {
+        uint64_t mask = mm->free_bins_mask & ~((1ULL << fit_bin) - 1);
+        while (mask != 0) {
+            uint8_t bin = __builtin_ctzll(mask);
+            for (struct mmnode *node = mm->free_bins[bin]; node; node = node->free_next) {
+                if (node_fits(node, size, alignment)) {
+                    return node;
+                }
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    for (uint8_t bin = lo_bin; bin < fit_bin && bin < MM_NUM_BINS; bin++) {
+        for (struct mmnode *node = mm->free_bins[bin]; node; node = node->free_next) {
+            if (node_fits(node, size, alignment)) {
+                return node;
+            }
+        }
+    }
+
+    return NULL;
+}
+
 /**
  * QUESTION: should the check for refilling be closer to the function call?
  * \brief Check if the slab allocator requires a refill, and refill it
@@ -244,7 +440,6 @@ static void mm_check_refill(struct mm *mm)
 }
 
 /**
- * DONE: free list?
  * \brief Adds an mmnode to the given MM allocator instance data
  *
  * \param mm Pointer to MM allocator instance data
@@ -271,11 +466,11 @@ errval_t mm_add(struct mm *mm, struct capref cap, genpaddr_t base, size_t size)
     };
 
     new_node->type = NodeType_Free;
+    new_node->base = base;
+    new_node->size = size;
 
     insert_node_as_head(mm, new_node);
 
-    new_node->base = base;
-    new_node->size = size;
     mm->stats_bytes_available += size;
     mm->stats_bytes_max += size;
 
@@ -284,7 +479,6 @@ errval_t mm_add(struct mm *mm, struct capref cap, genpaddr_t base, size_t size)
 }
 
 /**
- * DONE: loop free list
  * \brief Allocates aligned memory in the form of a RAM capability
  *
  * \param mm Pointer to MM allocator instance data
@@ -307,58 +501,56 @@ errval_t mm_alloc_aligned(struct mm *mm, size_t size, size_t alignment, struct c
     err = mm_slot_alloc(mm, retcap);
     ON_ERR_PUSH_RETURN(err, LIB_ERR_SLOT_ALLOC);
 
-    struct mmnode *node;
-
-
     thread_mutex_lock_nested(&mm->mutex);
 
-    for (node = mm->free_head; node != NULL; node = node->free_next) {
-        if (node->size >= size) {
-            struct mmnode *a, *b;
-
-            if (node->base % alignment != 0) {
-                uint64_t offset = alignment - (node->base % alignment);
-                if (node->size - offset < size) {
-                    continue;
-                }
-                err = split_node(mm, node, offset, &a, &b);
-                if (err_is_fail(err)) {
-                    thread_mutex_unlock(&mm->mutex);
-                    return err;
-                }
-
-                node = b;
-            }
+    struct mmnode *node = find_free_node(mm, size, alignment);
+    if (node == NULL) {
+        thread_mutex_unlock(&mm->mutex);
+        return LIB_ERR_RAM_ALLOC_FIXED_EXHAUSTED;
+    }
 
-            err = cap_retype(*retcap, node->cap.cap, node->base - node->cap.base, mm->objtype, size, 1);
-            if (err_is_fail(err)) {
-                thread_mutex_unlock(&mm->mutex);
-                return err_push(err, LIB_ERR_CAP_RETYPE);
-            }
+    remove_node_from_free_list(mm, node);
 
-            if (size < node->size) {
-                err = split_node(mm, node, size, &a, &b);
-                if (err_is_fail(err)) {
-                    thread_mutex_unlock(&mm->mutex);
-                    return err;
-                }
+    struct mmnode *a, *b;
+    if (node->base % alignment != 0) {
+        uint64_t offset = alignment - (node->base % alignment);
+        err = split_node(mm, node, offset, &a, &b);
+        if (err_is_fail(err)) {
+            add_node_to_free_list(mm, node);
+            thread_mutex_unlock(&mm->mutex);
+            return err;
+        }
 
-                node = a;
-            }
+        add_node_to_free_list(mm, a);
+        node = b;
+    }
 
-            node->type = NodeType_Allocated;
-            remove_node_from_free_list(mm, node);
-            mm->stats_bytes_available -= node->size;
+    err = cap_retype(*retcap, node->cap.cap, node->base - node->cap.base, mm->objtype, size, 1);
+    if (err_is_fail(err)) {
+        add_node_to_free_list(mm, node);
+        thread_mutex_unlock(&mm->mutex);
+        return err_push(err, LIB_ERR_CAP_RETYPE);
+    }
 
-            mm_check_refill(mm);
+    if (size < node->size) {
+        err = split_node(mm, node, size, &a, &b);
+        if (err_is_fail(err)) {
+            add_node_to_free_list(mm, node);
             thread_mutex_unlock(&mm->mutex);
-            return SYS_ERR_OK;
+            return err;
         }
+
+        add_node_to_free_list(mm, b);
+        node = a;
     }
 
+    node->type = NodeType_Allocated;
+    mm->alloc_root = tree_insert(mm->alloc_root, node);
+    mm->stats_bytes_available -= node->size;
 
+    mm_check_refill(mm);
     thread_mutex_unlock(&mm->mutex);
-    return LIB_ERR_RAM_ALLOC_FIXED_EXHAUSTED;
+    return SYS_ERR_OK;
 }
 
 errval_t mm_alloc(struct mm *mm, size_t size, struct capref *retcap)
@@ -370,9 +562,10 @@ errval_t mm_alloc(struct mm *mm, size_t size, struct capref *retcap)
 
 
 /**
- * DONE: update free list
  * \brief Tries to merge an mmnode with its right neighbour.
  *        The merging only happens if they are adjacent and both free.
+ *        `node` must not be in a free bin, the right neighbour is removed
+ *        from its bin if merged.
  *
  * \param mm Pointer to MM allocator instance data
  * \param mmnode Pointer to the mmnode
@@ -390,6 +583,8 @@ static bool coalesce(struct mm *mm, struct mmnode *node)
     if (node->type == NodeType_Free && right->type == NodeType_Free) {
         assert(node->base + node->size == right->base);
 
+        remove_node_from_free_list(mm, right); // right node no longer usable
+
         node->size += right->size;
         node->next = right->next;
 
@@ -397,7 +592,6 @@ static bool coalesce(struct mm *mm, struct mmnode *node)
             node->next->prev = node;
         }
 
-        remove_node_from_free_list(mm, right); // right node no longer usable
         slab_free(&mm->slabs, right);
 
         return true;
@@ -406,7 +600,6 @@ static bool coalesce(struct mm *mm, struct mmnode *node)
 }
 
 /**
- * DONE: add to free list
  * \brief Freeing allocated RAM and associated capability
  *
  * \param mm Pointer to MM allocator instance data
@@ -420,44 +613,47 @@ errval_t mm_free(struct mm *mm, struct capref cap, genpaddr_t base, gensize_t si
 
     errval_t err;
 
-
     thread_mutex_lock_nested(&mm->mutex);
 
-    for (struct mmnode* node = mm->head; node; node = node->next) {
-        if (node->base == base && node->size == size) {
-            node->type = NodeType_Free;
-            err = cap_destroy(cap);
-
-            // Spannend
-            if (err_no(err) == LIB_ERR_WHILE_FREEING_SLOT) {
-                err = err_pop(err);
-                if (err_no(err) == LIB_ERR_SLOT_ALLOC_WRONG_CNODE) {
-                    err = mm_slot_free(mm, cap);
-                }
-            }
-            if(err_is_fail(err)) {
-                thread_mutex_unlock(&mm->mutex);
-                return err_push(err, LIB_ERR_CAP_DESTROY);
-            }
+    struct mmnode *node = tree_find(mm->alloc_root, base);
+    if (node == NULL || node->size != size) {
+        thread_mutex_unlock(&mm->mutex);
+        return LIB_ERR_RAM_ALLOC_WRONG_SIZE;
+    }
 
+    err = cap_destroy(cap);
 
-            mm->stats_bytes_available += size;
+    // Spannend
+    if (err_no(err) == LIB_ERR_WHILE_FREEING_SLOT) {
+        err = err_pop(err);
+        if (err_no(err) == LIB_ERR_SLOT_ALLOC_WRONG_CNODE) {
+            err = mm_slot_free(mm, cap);
+        }
+    }
+    if (err_is_fail(err)) {
+        thread_mutex_unlock(&mm->mutex);
+        return err_push(err, LIB_ERR_CAP_DESTROY);
+    }
 
-            coalesce(mm, node);
+    mm->alloc_root = tree_remove(mm->alloc_root, node);
+    node->type = NodeType_Free;
+    mm->stats_bytes_available += size;
 
-            // if node can be coalesced with its predecessor, that one is added to
-            // the free list, otherwise just add node
-            struct mmnode *new_free = node->prev;
-            new_free = coalesce(mm, new_free) ? new_free : node;
+    coalesce(mm, node);
 
-            add_node_to_free_list(mm, new_free);
+    add_node_to_free_list(mm, node);
 
-            return SYS_ERR_OK;
-        }
+    // if node can be coalesced with its predecessor, that one is put back
+    // into the free bins with its new size
+    struct mmnode *left = node->prev;
+    if (left != NULL && left->type == NodeType_Free && capcmp(left->cap.cap, node->cap.cap)) {
+        remove_node_from_free_list(mm, left);
+        coalesce(mm, left);
+        add_node_to_free_list(mm, left);
     }
 
     thread_mutex_unlock(&mm->mutex);
-    return LIB_ERR_RAM_ALLOC_WRONG_SIZE;
+    return SYS_ERR_OK;
 }
 
 
@@ -493,7 +689,16 @@ void print_mm_state(struct mm *mm)
     printf("free nodes: %d, unfree nodes: %d\n", free_nodes, unfree_nodes);
 
     int free_count = 0;
-    for (struct mmnode* node = mm->free_head; node; node = node->free_next)
-        free_count++;
-    printf("%d nodes in free list\n", free_count);
+    for (int bin = 0; bin < MM_NUM_BINS; bin++) {
+        int bin_count = 0;
+        for (struct mmnode* node = mm->free_bins[bin]; node; node = node->free_next) {
+            bin_count++;
+        }
+        if (bin_count) {
+            printf("bin %d: %d free nodes\n", bin, bin_count);
+        }
+        free_count += bin_count;
+    }
+    printf("%d nodes in free bins\n", free_count);
+    slab_print_stats(&mm->slabs, "mm nodes");
 }
@@ -0,0 +1,419 @@
+/**
+ * \file
+ * \brief Thread-caching size-class allocator
+ *
+ * Memory is taken from the heap paging region in spans of SCMALLOC_SPAN_SIZE
+ * bytes, aligned to their size, so the span header of any object is found by
+ * rounding its address down. A small span serves objects of a single size
+ * class, a large allocation occupies a run of spans of its own.
+ *
+ * Every size class has a central free list (protected by one mutex) and every
+ * thread keeps a cache of free objects per class under SCMALLOC_TLS_KEY. The
+ * fast path of malloc/free only touches the thread cache, objects move between
+ * the cache and the central lists in batches.
+ *
+ * Nothing is ever given back to the heap region (paging_region_unmap is not
+ * implemented), freed large runs are kept on a list and reused best-fit. The
+ * cache of an exiting thread is not reclaimed.
+ */
+
+/*
+ * Copyright (c) 2019, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <aos/aos.h>
+#include <aos/core_state.h>
+#include <aos/paging.h>
+#include <aos/static_assert.h>
+#include <aos/threads.h>
+#include <scmalloc/scmalloc.h>
+
+/// Bytes reserved at the start of a span for its header (keeps objects 16 B aligned)
+#define SPAN_HDR_SIZE 64
+
+#define SPAN_MAGIC 0x5ca1ab1e
+
+/// Size class of spans holding a large allocation
+#define SPAN_LARGE 0xffff
+
+/// Upper bound of objects moved between a thread cache and a central list at once
+#define SC_BATCH_MAX 32
+
+struct sc_span {
+    uint32_t magic;
+    uint16_t sclass;        ///< size class or SPAN_LARGE
+    size_t bytes;           ///< bytes mapped for this span (run)
+    struct sc_span *next;   ///< next free large run
+};
+STATIC_ASSERT(sizeof(struct sc_span) <= SPAN_HDR_SIZE, "span header too big");
+
+struct sc_obj {
+    struct sc_obj *next;
+};
+
+struct sc_central {
+    struct sc_obj *free;    ///< freed objects of this class
+    lvaddr_t bump;          ///< next never used object in the current span
+    lvaddr_t bump_end;      ///< end of the current span
+};
+
+struct sc_tcache {
+    struct sc_obj *head[SCMALLOC_NUM_CLASSES];
+    uint32_t count[SCMALLOC_NUM_CLASSES];
+};
+
+static struct {
+    struct thread_mutex mutex;
+    struct sc_central classes[SCMALLOC_NUM_CLASSES];
+    struct sc_span *large_free;
+
+    // statistics
+    size_t spans;
+    size_t large_runs;
+    size_t large_reused;
+    size_t refills;
+    size_t flushes;
+} sc = { .mutex = THREAD_MUTEX_INITIALIZER };
+
+/**
+ * \brief Size class of a request of `bytes` bytes (<= SCMALLOC_SMALL_MAX)
+ *
+ * Classes are spaced 16 B apart up to 128 B, above that every power of two
+ * is split into four classes.
+ */
+static inline unsigned sc_class_of(size_t bytes)
+{
+    if (bytes <= 128) {
+        return bytes == 0 ? 0 : (bytes - 1) >> 4;
+    }
+    unsigned b = 63 - __builtin_clzl(bytes - 1);
+    return 8 + (b - 7) * 4 + (((bytes - 1) - (1UL << b)) >> (b - 2));
+}
+
+static inline size_t sc_class_size(unsigned c)
+{
+    if (c < 8) {
+        return 16 * (c + 1);
+    }
+    unsigned g = (c - 8) / 4;
+    unsigned s = (c - 8) % 4;
+    return (1UL << (7 + g)) + (s + 1) * (1UL << (5 + g));
+}
+
+/// Number of objects moved between a thread cache and the central list at once
+static inline size_t sc_batch(unsigned c)
+{
+    size_t n = 8192 / sc_class_size(c);
+    if (n < 2) {
+        return 2;
+    }
+    return n > SC_BATCH_MAX ? SC_BATCH_MAX : n;
+}
+
+static inline struct sc_span *sc_span_of(void *ptr)
+{
+    return (struct sc_span *)ROUND_DOWN((lvaddr_t)ptr, SCMALLOC_SPAN_SIZE);
+}
+
+/**
+ * \brief Reserve `bytes` (a multiple of the span size) of span aligned heap.
+ *
+ * The heap region is shared with morecore, so its mutex serializes the
+ * bump allocation. The memory is backed lazily by the page fault handler.
+ */
+static struct sc_span *sc_map_span(size_t bytes)
+{
+    struct morecore_state *ms = get_morecore_state();
+    struct paging_region *pr = ms->region;
+    if (pr == NULL) {
+        pr = &get_current_paging_state()->heap_region;
+    }
+
+    thread_mutex_lock(&ms->mutex);
+    size_t pad = ROUND_UP(pr->current_addr, SCMALLOC_SPAN_SIZE) - pr->current_addr;
+    void *buf;
+    size_t ret_size;
+    errval_t err = paging_region_map(pr, pad + bytes, &buf, &ret_size);
+    thread_mutex_unlock(&ms->mutex);
+    if (err_is_fail(err) || ret_size < pad + bytes) {
+        return NULL;
+    }
+
+    struct sc_span *span = (struct sc_span *)((lvaddr_t)buf + pad);
+    span->magic = SPAN_MAGIC;
+    span->bytes = bytes;
+    span->next = NULL;
+    return span;
+}
+
+/**
+ * \brief Take up to `n` objects of class `c` from the central list.
+ *
+ * Must be called with sc.mutex held. A new span is only started when
+ * nothing at all could be handed out.
+ */
+static struct sc_obj *sc_central_get(unsigned c, size_t n, size_t *got)
+{
+    struct sc_central *cc = &sc.classes[c];
+    size_t size = sc_class_size(c);
+    struct sc_obj *head = NULL;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        struct sc_obj *obj;
+        if (cc->free != NULL) {
+            obj = cc->free;
+            cc->free = obj->next;
+        } else {
+            if (cc->bump + size > cc->bump_end) {
+                if (i > 0) {
+                    break;
+                }
+                struct sc_span *span = sc_map_span(SCMALLOC_SPAN_SIZE);
+                if (span == NULL) {
+                    break;
+                }
+                span->sclass = c;
+                cc->bump = (lvaddr_t)span + SPAN_HDR_SIZE;
+                cc->bump_end = (lvaddr_t)span + SCMALLOC_SPAN_SIZE;
+                sc.spans++;
+            }
+            obj = (struct sc_obj *)cc->bump;
+            cc->bump += size;
+        }
+        obj->next = head;
+        head = obj;
+    }
+
+    *got = i;
+    return head;
+}
+
+/**
+ * \brief Returns the calling thread's cache, creating it on first use.
+ *
+ * Returns NULL before the thread system is up, callers then fall back to
+ * the central lists.
+ */
+static struct sc_tcache *sc_tcache_get(void)
+{
+    if (thread_self() == NULL) {
+        return NULL;
+    }
+
+    struct sc_tcache *tc = thread_get_tls_key(SCMALLOC_TLS_KEY);
+    if (tc == NULL) {
+        size_t got;
+        thread_mutex_lock(&sc.mutex);
+        tc = (struct sc_tcache *)sc_central_get(sc_class_of(sizeof(*tc)), 1, &got);
+        thread_mutex_unlock(&sc.mutex);
+        if (tc == NULL) {
+            return NULL;
+        }
+        memset(tc, 0, sizeof(*tc));
+        thread_set_tls_key(SCMALLOC_TLS_KEY, tc);
+    }
+    return tc;
+}
+
+static void *sc_large_alloc(size_t bytes)
+{
+    size_t need = ROUND_UP(bytes + SPAN_HDR_SIZE, SCMALLOC_SPAN_SIZE);
+    if (need < bytes) {
+        return NULL;
+    }
+
+    thread_mutex_lock(&sc.mutex);
+    struct sc_span **best = NULL;
+    for (struct sc_span **s = &sc.large_free; *s != NULL; s = &(*s)->next) {
+        if ((*s)->bytes >= need && (best == NULL || (*s)->bytes < (*best)->bytes)) {
+            best = s;
+            if ((*s)->bytes == need) {
+                break;
+            }
+        }
+    }
+
+    struct sc_span *span;
+    if (best != NULL) {
+        span = *best;
+        *best = span->next;
+        sc.large_reused++;
+    } else {
+        span = sc_map_span(need);
+        if (span != NULL) {
+            span->sclass = SPAN_LARGE;
+            sc.large_runs++;
+        }
+    }
+    thread_mutex_unlock(&sc.mutex);
+
+    if (span == NULL) {
+        return NULL;
+    }
+    return (void *)((lvaddr_t)span + SPAN_HDR_SIZE);
+}
+
+void *scmalloc_malloc(size_t bytes)
+{
+    if (bytes > SCMALLOC_SMALL_MAX) {
+        return sc_large_alloc(bytes);
+    }
+
+    unsigned c = sc_class_of(bytes);
+    struct sc_tcache *tc = sc_tcache_get();
+    size_t got;
+
+    if (tc == NULL) {
+        thread_mutex_lock(&sc.mutex);
+        struct sc_obj *obj = sc_central_get(c, 1, &got);
+        thread_mutex_unlock(&sc.mutex);
+        return obj;
+    }
+
+    struct sc_obj *obj = tc->head[c];
+    if (obj == NULL) {
+        thread_mutex_lock(&sc.mutex);
+        obj = sc_central_get(c, sc_batch(c), &got);
+        sc.refills++;
+        thread_mutex_unlock(&sc.mutex);
+        if (obj == NULL) {
+            return NULL;
+        }
+        tc->count[c] = got;
+    }
+
+    tc->head[c] = obj->next;
+    tc->count[c]--;
+    return obj;
+}
+
+void scmalloc_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    struct sc_span *span = sc_span_of(ptr);
+    if (span->magic != SPAN_MAGIC) {
+        debug_printf("%s: Trying to free not malloced region %p by %p\n",
+                     __func__, ptr, __builtin_return_address(0));
+        return;
+    }
+
+    if (span->sclass == SPAN_LARGE) {
+        thread_mutex_lock(&sc.mutex);
+        span->next = sc.large_free;
+        sc.large_free = span;
+        thread_mutex_unlock(&sc.mutex);
+        return;
+    }
+
+    unsigned c = span->sclass;
+    struct sc_obj *obj = ptr;
+    struct sc_tcache *tc = sc_tcache_get();
+
+    if (tc == NULL) {
+        thread_mutex_lock(&sc.mutex);
+        obj->next = sc.classes[c].free;
+        sc.classes[c].free = obj;
+        thread_mutex_unlock(&sc.mutex);
+        return;
+    }
+
+    obj->next = tc->head[c];
+    tc->head[c] = obj;
+    size_t batch = sc_batch(c);
+    if (++tc->count[c] <= 2 * batch) {
+        return;
+    }
+
+    // cache overflows, hand the most recently freed batch back
+    struct sc_obj *first = tc->head[c];
+    struct sc_obj *last = first;
+    for (size_t i = 1; i < batch; i++) {
+        last = last->next;
+    }
+    tc->head[c] = last->next;
+    tc->count[c] -= batch;
+
+    thread_mutex_lock(&sc.mutex);
+    last->next = sc.classes[c].free;
+    sc.classes[c].free = first;
+    sc.flushes++;
+    thread_mutex_unlock(&sc.mutex);
+}
+
+/**
+ * \brief Number of bytes usable in the allocation at `ptr`
+ */
+size_t scmalloc_usable_size(void *ptr)
+{
+    if (ptr == NULL) {
+        return 0;
+    }
+    struct sc_span *span = sc_span_of(ptr);
+    if (span->magic != SPAN_MAGIC) {
+        return 0;
+    }
+    if (span->sclass == SPAN_LARGE) {
+        return span->bytes - SPAN_HDR_SIZE;
+    }
+    return sc_class_size(span->sclass);
+}
+
+void *scmalloc_realloc(void *ptr, size_t bytes)
+{
+    if (ptr == NULL) {
+        return scmalloc_malloc(bytes);
+    }
+
+    size_t old_size = scmalloc_usable_size(ptr);
+    if (bytes <= old_size) {
+        return ptr;
+    }
+
+    void *new_ptr = scmalloc_malloc(bytes);
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, old_size);
+    scmalloc_free(ptr);
+    return new_ptr;
+}
+
+void scmalloc_print_stats(void)
+{
+    thread_mutex_lock(&sc.mutex);
+    debug_printf("scmalloc: %zu spans, %zu large runs (%zu reused), "
+                 "%zu refills, %zu flushes\n", sc.spans, sc.large_runs,
+                 sc.large_reused, sc.refills, sc.flushes);
+    thread_mutex_unlock(&sc.mutex);
+}
+
+/*
+ * The libc K&R allocator defines these weakly, linking this library replaces it.
+ */
+
+void *malloc(size_t bytes)
+{
+    return scmalloc_malloc(bytes);
+}
+
+void free(void *ptr)
+{
+    scmalloc_free(ptr);
+}
+
+void *realloc(void *ptr, size_t bytes)
+{
+    return scmalloc_realloc(ptr, bytes);
+}
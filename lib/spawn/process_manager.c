@@ -1,4 +1,5 @@
 #include "spawn/process_manager.h"
+#include <aos/deferred.h>
 
 
 
@@ -6,6 +7,12 @@ struct process_manager
 {
     struct slab_allocator si_allocator;
     struct spawninfo *first;
+
+    struct spawninfo *pool;         ///< prepared spawninfos, not yet spawned
+    size_t pool_count;
+    size_t pool_target;             ///< number of spawninfos to keep prepared
+    struct deferred_event pool_refill;
+    bool pool_refill_pending;
 } instance;
 
 
@@ -35,20 +42,85 @@ static struct process_manager *get_process_manager(void)
         slab_init(&instance.si_allocator, sizeof(struct spawninfo), &slab_big_refill);
         slab_big_refill(&instance.si_allocator);
         instance.first = NULL;
+        instance.pool = NULL;
+        instance.pool_count = 0;
+        instance.pool_target = 0;
+        deferred_event_init(&instance.pool_refill);
+        instance.pool_refill_pending = false;
         initialized = true;
     }
     return &instance;
 }
 
 
+/**
+ * \brief prepares spawninfos until the pool holds pool_target of them
+ */
+static errval_t spawn_pool_fill(struct process_manager *pm)
+{
+    while (pm->pool_count < pm->pool_target) {
+        struct spawninfo *si = slab_alloc(&pm->si_allocator);
+        if (si == NULL) {
+            return LIB_ERR_SLAB_ALLOC_FAIL;
+        }
+        si->image = NULL;
+        si->prepared = false;
+
+        errval_t err = spawn_prepare(si);
+        if (err_is_fail(err)) {
+            slab_free(&pm->si_allocator, si);
+            return err;
+        }
+
+        si->next = pm->pool;
+        pm->pool = si;
+        pm->pool_count++;
+    }
+    return SYS_ERR_OK;
+}
+
+static void spawn_pool_refill_handler(void *arg)
+{
+    struct process_manager *pm = arg;
+    pm->pool_refill_pending = false;
+
+    errval_t err = spawn_pool_fill(pm);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "failed to refill the spawn pool\n");
+    }
+}
+
+errval_t spawn_pool_set_size(size_t count)
+{
+    struct process_manager *pm = get_process_manager();
+    pm->pool_target = count;
+    return spawn_pool_fill(pm);
+}
+
 struct spawninfo *spawn_create_spawninfo(void)
 {
     struct process_manager *pm = get_process_manager();
-    struct spawninfo *si = slab_alloc(&pm->si_allocator);
-    //memset(si, 0, sizeof(struct spawninfo));
-    if (si == NULL) {
-        return NULL;
+    struct spawninfo *si;
+    if (pm->pool != NULL) {
+        si = pm->pool;
+        pm->pool = si->next;
+        pm->pool_count--;
+
+        // prepare the next one once we are idle, not while spawning
+        if (!pm->pool_refill_pending) {
+            errval_t err = deferred_event_register(&pm->pool_refill, get_default_waitset(), 0,
+                                                   MKCLOSURE(spawn_pool_refill_handler, pm));
+            pm->pool_refill_pending = err_is_ok(err);
+        }
+    } else {
+        si = slab_alloc(&pm->si_allocator);
+        //memset(si, 0, sizeof(struct spawninfo));
+        if (si == NULL) {
+            return NULL;
+        }
+        si->prepared = false;
     }
+    si->image = NULL;
 
     // insert new si at head of list
     si->next = pm->first;
@@ -106,13 +106,188 @@ errval_t setup_c_space(struct capref cnode_l1,
 }
 
 
-errval_t spawn_setup_dispatcher(int argc, const char *const *argv, struct spawninfo *si,
-                domainid_t *pid)
+/// binaries loaded so far, most recently loaded first
+static struct spawn_image *spawn_images = NULL;
+
+/// converts ELF segment flags to the flags of a mapping
+static int elf_to_paging_flags(uint32_t flags)
+{
+    int actual_flags = 0;
+    if (flags & PF_R)
+        actual_flags |= KPI_PAGING_FLAGS_READ;
+    if (flags & PF_W)
+        actual_flags |= KPI_PAGING_FLAGS_WRITE;
+    if (flags & PF_X)
+        actual_flags |= KPI_PAGING_FLAGS_EXECUTE;
+    return actual_flags;
+}
+
+/**
+ * \brief elf_load callback, allocates a segment of an image
+ *
+ * The segment gets a frame of its own, mapped into our vspace, which elf_load
+ * then fills. The frame is kept in the image for all children.
+ */
+static errval_t spawn_image_alloc_segment(void *state, genvaddr_t base, size_t size,
+                                          uint32_t flags, void **ret)
+{
+    struct spawn_image *img = (struct spawn_image *) state;
+    if (img->n_segments == SPAWN_IMAGE_MAX_SEGMENTS) {
+        return SPAWN_ERR_ELF_MAP;
+    }
+
+    struct spawn_segment *seg = &img->segments[img->n_segments];
+    seg->base = ROUND_DOWN(base, BASE_PAGE_SIZE);
+    seg->flags = elf_to_paging_flags(flags);
+    seg->shared = !(flags & PF_W);
+
+    errval_t err = frame_alloc(&seg->frame, ROUND_UP(size + (base - seg->base), BASE_PAGE_SIZE),
+                               &seg->size);
+    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_ELF_MAP);
+
+    err = paging_map_frame(get_current_paging_state(), &seg->buf, seg->size, seg->frame,
+                           NULL, NULL);
+    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_ELF_MAP);
+
+    if (seg->shared) {
+        img->shared_bytes += seg->size;
+    } else {
+        img->private_bytes += seg->size;
+    }
+    img->n_segments++;
+
+    *ret = (char *) seg->buf + (base - seg->base);
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief maps the segments of an image into a child's vspace
+ *
+ * Read-only segments map the frame of the image, writable segments are copied
+ * into a frame of the child's own.
+ */
+static errval_t spawn_map_image(struct spawn_image *img, struct paging_state *ps)
+{
+    errval_t err;
+
+    for (size_t i = 0; i < img->n_segments; i++) {
+        struct spawn_segment *seg = &img->segments[i];
+        struct capref frame = seg->frame;
+
+        if (!seg->shared) {
+            size_t actual_size;
+            err = frame_alloc(&frame, seg->size, &actual_size);
+            ON_ERR_PUSH_RETURN(err, SPAWN_ERR_ELF_MAP);
+
+            void *buf;
+            err = paging_map_frame(get_current_paging_state(), &buf, seg->size, frame,
+                                   NULL, NULL);
+            ON_ERR_PUSH_RETURN(err, SPAWN_ERR_ELF_MAP);
+            memcpy(buf, seg->buf, seg->size);
+        }
+
+        err = paging_map_fixed_attr(ps, seg->base, frame, seg->size, seg->flags);
+        ON_ERR_PUSH_RETURN(err, SPAWN_ERR_ELF_MAP);
+    }
+
+    img->instances++;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief loads a module into a new image
+ */
+static errval_t spawn_image_load(struct mem_region *mem_region, struct spawn_image **ret)
+{
+    errval_t err;
+    struct capability cap;
+    struct capref module_frame = {
+        .cnode = cnode_module,
+        .slot = mem_region->mrmod_slot
+    };
+    err = invoke_cap_identify(module_frame, &cap);
+    ON_ERR_RETURN(err);
+
+    struct spawn_image *img = calloc(1, sizeof(struct spawn_image));
+    if (img == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    img->module_slot = mem_region->mrmod_slot;
+
+    char *elf_address;
+    err = paging_map_frame_attr(get_current_paging_state(), (void **) &elf_address,
+                                get_size(&cap), module_frame, VREGION_FLAGS_READ_WRITE, NULL, NULL);
+    if (err_is_fail(err)) {
+        free(img);
+        return err_push(err, SPAWN_ERR_ELF_MAP);
+    }
+    img->mapped_elf = (lvaddr_t) elf_address;
+    img->mapped_elf_size = (size_t) mem_region->mrmod_size;
+
+    // the frames of a failed load are lost, the module is broken anyway
+    err = elf_load(EM_AARCH64, &spawn_image_alloc_segment, img, img->mapped_elf,
+                   img->mapped_elf_size, &img->entry);
+    if (err_is_fail(err)) {
+        free(img);
+        return err_push(err, SPAWN_ERR_LOAD);
+    }
+
+    struct Elf64_Shdr *got = elf64_find_section_header_name(img->mapped_elf,
+                                                           img->mapped_elf_size, ".got");
+    if (got == NULL) {
+        free(img);
+        return SPAWN_ERR_LOAD;
+    }
+    img->got_base = got->sh_addr;
+
+    img->next = spawn_images;
+    spawn_images = img;
+    *ret = img;
+    return SYS_ERR_OK;
+}
+
+errval_t spawn_get_image(const char *binary_name, struct spawn_image **ret)
+{
+    for (struct spawn_image *img = spawn_images; img != NULL; img = img->next) {
+        if (strcmp(img->name, binary_name) == 0) {
+            *ret = img;
+            return SYS_ERR_OK;
+        }
+    }
+
+    struct mem_region* mem_region = multiboot_find_module(bi, binary_name);
+    if (mem_region == NULL) {
+        return SPAWN_ERR_MAP_MODULE;
+    }
+
+    //this mem_region should be of type module
+    assert(mem_region->mr_type == RegionType_Module);
+
+    for (struct spawn_image *img = spawn_images; img != NULL; img = img->next) {
+        if (img->module_slot == mem_region->mrmod_slot) {
+            *ret = img;
+            return SYS_ERR_OK;
+        }
+    }
+    errval_t err = spawn_image_load(mem_region, ret);
+    ON_ERR_RETURN(err);
+
+    (*ret)->name = strdup(binary_name);
+    (*ret)->cmdline = multiboot_module_opts(mem_region);
+    return SYS_ERR_OK;
+}
+
+
+/**
+ * \brief Does the part of setting up a child that does not depend on the binary
+ *
+ * Creates the C-Space, the dispatcher and the L0 page table of the child and
+ * maps the arguments page and dispatcher frame into both vspaces. The caps
+ * passed by the spawner are only copied by spawn_setup_dispatcher.
+ */
+errval_t spawn_prepare(struct spawninfo *si)
 {
     errval_t err;
-    // const char* name = argv[0];
-    // DEBUG_PRINTF("Spawning process: %s\n", name);
-    // debug_printf("Spawning process: %s\n",argv[0]);
     struct capref cnode_child_l1;
     struct cnoderef child_ref;
     err = cnode_create_l1(&cnode_child_l1, &child_ref);
@@ -133,20 +308,13 @@ errval_t spawn_setup_dispatcher(int argc, const char *const *argv, struct spawni
 
     err = setup_c_space(cnode_child_l1, &taskcn, &basepagecn, &pagecn, &argcn, &alloc0, &alloc1, &alloc2);
     ON_ERR_RETURN(err);
+    si->taskcn = taskcn;
 
     // endpoint to itself in child cspace
     struct capref child_ep_cap = (struct capref) {
         .cnode = taskcn,
         .slot = TASKCN_SLOT_SELFEP
     };
-    struct capref child_stdout_cap = (struct capref) {
-        .cnode = taskcn,
-        .slot = TASKCN_SLOT_STDOUT_CAP
-    };
-    struct capref child_stdin_cap = (struct capref) {
-        .cnode = taskcn,
-        .slot = TASKCN_SLOT_STDIN_CAP
-    };
     struct capref child_dispatcher = (struct capref) {
         .cnode = taskcn,
         .slot = TASKCN_SLOT_DISPATCHER
@@ -171,10 +339,6 @@ errval_t spawn_setup_dispatcher(int argc, const char *const *argv, struct spawni
         .cnode = taskcn,
         .slot = TASKCN_SLOT_MEMORYEP
     };
-    struct capref spawner_ep_cap = (struct capref) {
-        .cnode = taskcn,
-        .slot = TASKCN_SLOT_SPAWNER_EP
-    };
 
     err = dispatcher_create(child_dispatcher);
     ON_ERR_PUSH_RETURN(err, SPAWN_ERR_CREATE_DISPATCHER);
@@ -196,26 +360,9 @@ errval_t spawn_setup_dispatcher(int argc, const char *const *argv, struct spawni
     err = cap_copy(init_ep_cap, si->cap_ep);
     ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_COPY_FAIL);
 
-    //err = endpoint_create(LMP_RECV_LENGTH, &si->child_stdout_cap, &si->child_stdout);
-    //ON_ERR_PUSH_RETURN(err, LIB_ERR_ENDPOINT_CREATE);
-
-    if (!capref_is_null(si->child_stdout_cap)) {
-        err = cap_copy(child_stdout_cap, si->child_stdout_cap);
-        ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_COPY_FAIL);
-    }
-    if (!capref_is_null(si->child_stdin_cap)) {
-        err = cap_copy(child_stdin_cap, si->child_stdin_cap);
-        ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_COPY_FAIL);
-    }
-
     err = cap_copy(mm_ep_cap, cap_mmep);
     ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_COPY_FAIL);
 
-    if (!capref_is_null(si->spawner_ep_cap)) {
-        err = cap_copy(spawner_ep_cap, si->spawner_ep_cap);
-        ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_COPY_FAIL);
-    }
-
     // ===========================================
     // create l0 vnode and initialize paging state
     // ===========================================
@@ -244,16 +391,81 @@ errval_t spawn_setup_dispatcher(int argc, const char *const *argv, struct spawni
     err = cap_copy(child_argspage, argframe);
     ON_ERR_RETURN(err);
 
-    void* arg_ptr;
-    err = paging_map_frame_complete(get_current_paging_state(), &arg_ptr, argframe, NULL, NULL);
+    err = paging_map_frame_complete(get_current_paging_state(), &si->args_buf, argframe, NULL, NULL);
     ON_ERR_PUSH_RETURN(err, SPAWN_ERR_MAP_ARGSPG_TO_SELF);
 
-
-    // TODO: organize vspace
-    lvaddr_t child_arg_ptr = 0x700000UL * 0x1000;
-    err = paging_map_fixed_attr(&si->ps, child_arg_ptr, argframe, BASE_PAGE_SIZE, VREGION_FLAGS_READ_WRITE);
+    err = paging_map_fixed_attr(&si->ps, SPAWN_ARGS_VADDR, argframe, BASE_PAGE_SIZE, VREGION_FLAGS_READ_WRITE);
     ON_ERR_PUSH_RETURN(err, SPAWN_ERR_MAP_ARGSPG_TO_NEW);
 
+    struct capref dispframe;
+    err = slot_alloc(&dispframe);
+    ON_ERR_RETURN(err);
+
+    err = cap_copy(dispframe, child_dispframe);
+    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_COPY_KERNEL_CAP);
+
+    err = paging_map_fixed_attr(&si->ps, SPAWN_DISPATCHER_VADDR, dispframe, DISPATCHER_FRAME_SIZE, VREGION_FLAGS_READ_WRITE);
+    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_MAP_DISPATCHER_TO_NEW);
+
+    err = paging_map_frame(get_current_paging_state(), &si->disp_buf, DISPATCHER_FRAME_SIZE, dispframe, NULL, NULL);
+    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_MAP_DISPATCHER_TO_SELF);
+
+    err = slot_alloc(&si->dispatcher);
+    ON_ERR_RETURN(err);
+
+    err = cap_copy(si->dispatcher, child_dispatcher);
+    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_COPY_KERNEL_CAP);
+
+    si->dispatcher_cap = cap_dispatcher;
+    si->dispframe_cap = child_dispframe;
+    si->prepared = true;
+    return SYS_ERR_OK;
+}
+
+errval_t spawn_setup_dispatcher(int argc, const char *const *argv, struct spawninfo *si,
+                domainid_t *pid)
+{
+    errval_t err;
+    // const char* name = argv[0];
+    // DEBUG_PRINTF("Spawning process: %s\n", name);
+    // debug_printf("Spawning process: %s\n",argv[0]);
+    if (!si->prepared) {
+        err = spawn_prepare(si);
+        ON_ERR_RETURN(err);
+    }
+
+    struct capref child_stdout_cap = (struct capref) {
+        .cnode = si->taskcn,
+        .slot = TASKCN_SLOT_STDOUT_CAP
+    };
+    struct capref child_stdin_cap = (struct capref) {
+        .cnode = si->taskcn,
+        .slot = TASKCN_SLOT_STDIN_CAP
+    };
+    struct capref spawner_ep_cap = (struct capref) {
+        .cnode = si->taskcn,
+        .slot = TASKCN_SLOT_SPAWNER_EP
+    };
+
+    //err = endpoint_create(LMP_RECV_LENGTH, &si->child_stdout_cap, &si->child_stdout);
+    //ON_ERR_PUSH_RETURN(err, LIB_ERR_ENDPOINT_CREATE);
+
+    if (!capref_is_null(si->child_stdout_cap)) {
+        err = cap_copy(child_stdout_cap, si->child_stdout_cap);
+        ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_COPY_FAIL);
+    }
+    if (!capref_is_null(si->child_stdin_cap)) {
+        err = cap_copy(child_stdin_cap, si->child_stdin_cap);
+        ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_COPY_FAIL);
+    }
+
+    if (!capref_is_null(si->spawner_ep_cap)) {
+        err = cap_copy(spawner_ep_cap, si->spawner_ep_cap);
+        ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_COPY_FAIL);
+    }
+
+    void *arg_ptr = si->args_buf;
+    lvaddr_t child_arg_ptr = SPAWN_ARGS_VADDR;
     memset(arg_ptr, 0, BASE_PAGE_SIZE);
     struct spawn_domain_params *sdp = arg_ptr;
     sdp->argc = argc;
@@ -262,7 +474,7 @@ errval_t spawn_setup_dispatcher(int argc, const char *const *argv, struct spawni
     for (int i = 0; i < argc; i++) {
         size_t len = strlen(argv[i]);
         if (argv_ptr + len + 1 > ((char*) arg_ptr) + BASE_PAGE_SIZE) {
-            return err_push(err, SPAWN_ERR_ARGSPG_OVERFLOW);
+            return SPAWN_ERR_ARGSPG_OVERFLOW;
         }
         memcpy(argv_ptr, argv[i], len + 1);
         sdp->argv[i] = (const char*) child_argv_ptr;
@@ -271,33 +483,28 @@ errval_t spawn_setup_dispatcher(int argc, const char *const *argv, struct spawni
     }
 
     genvaddr_t retentry;
-    err = elf_load(EM_AARCH64, &allocate_elf_memory, &si->ps, si->mapped_elf, si->mapped_elf_size, &retentry);
-    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_LOAD);
+    lvaddr_t got_base_address_in_childs_vspace;
+    if (si->image != NULL) {
+        err = spawn_map_image(si->image, &si->ps);
+        ON_ERR_PUSH_RETURN(err, SPAWN_ERR_LOAD);
+        retentry = si->image->entry;
+        got_base_address_in_childs_vspace = si->image->got_base;
+    }
+    else {
+        err = elf_load(EM_AARCH64, &allocate_elf_memory, &si->ps, si->mapped_elf, si->mapped_elf_size, &retentry);
+        ON_ERR_PUSH_RETURN(err, SPAWN_ERR_LOAD);
 
-    struct Elf64_Shdr *got = elf64_find_section_header_name(si->mapped_elf, si->mapped_elf_size, ".got");
-    NULLPTR_CHECK(got, SPAWN_ERR_LOAD);
+        struct Elf64_Shdr *got = elf64_find_section_header_name(si->mapped_elf, si->mapped_elf_size, ".got");
+        NULLPTR_CHECK(got, SPAWN_ERR_LOAD);
+        got_base_address_in_childs_vspace = got->sh_addr;
+    }
 
     //debug_printf("0x%lx -> 0x%lx\n", si->mapped_elf, si->mapped_elf_size);
-    lvaddr_t got_base_address_in_childs_vspace = got->sh_addr;
     //debug_printf("possible 0x%lx\n", got_base_address_in_childs_vspace);
     //lvaddr_t got_base_offset = got->sh_addr - si->mapped_elf;
 
-    struct capref dispframe;
-    err = slot_alloc(&dispframe);
-    ON_ERR_RETURN(err);
-
-    err = cap_copy(dispframe, child_dispframe);
-    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_COPY_KERNEL_CAP);
-
-    uint64_t dispaddr = ROUND_UP(0x12345678, DISPATCHER_FRAME_SIZE);
-
-    err = paging_map_fixed_attr(&si->ps, dispaddr, dispframe, DISPATCHER_FRAME_SIZE, VREGION_FLAGS_READ_WRITE);
-    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_MAP_DISPATCHER_TO_NEW);
-
-    void* dispaddr_init;
-    err = paging_map_frame(get_current_paging_state(), &dispaddr_init, DISPATCHER_FRAME_SIZE, dispframe, NULL, NULL);
-    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_MAP_DISPATCHER_TO_SELF);
-
+    void *dispaddr_init = si->disp_buf;
+    uint64_t dispaddr = SPAWN_DISPATCHER_VADDR;
     memset(dispaddr_init, 0, DISPATCHER_FRAME_SIZE);
 
     dispatcher_handle_t handle = (dispatcher_handle_t) dispaddr_init;
@@ -325,14 +532,6 @@ errval_t spawn_setup_dispatcher(int argc, const char *const *argv, struct spawni
     disp_gen->eh_frame_hdr = 0;
     disp_gen->eh_frame_hdr_size = 0;
 
-    err = slot_alloc(&si->dispatcher);
-    ON_ERR_RETURN(err);
-
-
-
-    err = cap_copy(si->dispatcher, child_dispatcher);
-    ON_ERR_PUSH_RETURN(err, SPAWN_ERR_COPY_KERNEL_CAP);
-
     aos_rpc_init_lmp(&si->rpc, cap_selfep, NULL_CAP, si->lmp_ep, NULL);
 
 
@@ -360,9 +559,6 @@ errval_t spawn_setup_dispatcher(int argc, const char *const *argv, struct spawni
     }
 
 
-    si->dispatcher_cap = cap_dispatcher;
-    si->dispframe_cap = child_dispframe;
-
     //dump_dispatcher(disp);
     return SYS_ERR_OK;
 }
@@ -445,13 +641,7 @@ errval_t allocate_elf_memory(void* state, genvaddr_t base, size_t size, uint32_t
     int64_t offset_in_page = base - real_base;
 
 
-    int actual_flags = 0;
-    if (flags & PF_R)
-        actual_flags |= KPI_PAGING_FLAGS_READ;
-    if (flags & PF_W)
-        actual_flags |= KPI_PAGING_FLAGS_WRITE;
-    if (flags & PF_X)
-        actual_flags |= KPI_PAGING_FLAGS_EXECUTE;
+    int actual_flags = elf_to_paging_flags(flags);
 
     //debug_printf("ALLOC ELF STUFF: 0x%lx -> 0x%lx\n", base, base + size);
 
@@ -509,33 +699,13 @@ static void strip_extra_spaces(char* str) {
 
 errval_t spawn_setup_module_by_name(const char *binary_name, struct spawninfo *si)
 {
-    errval_t err;
-    struct mem_region* mem_region = multiboot_find_module(bi, binary_name);
-    
-    if (mem_region == NULL) {
-        return SPAWN_ERR_MAP_MODULE;
-    }
-
-
-    //this mem_region should be of type module
-    assert(mem_region->mr_type == RegionType_Module);
-    struct capability cap;
-    struct capref child_frame = {
-        .cnode = cnode_module,
-        .slot = mem_region->mrmod_slot
-    };
-    err = invoke_cap_identify(child_frame, &cap);
+    struct spawn_image *img;
+    errval_t err = spawn_get_image(binary_name, &img);
     ON_ERR_RETURN(err);
 
-    size_t mapping_size = get_size(&cap);
-    // debug_printf("capsize: %ld\n", mapping_size);
-    char* elf_address;
-    
-    paging_map_frame_attr(get_current_paging_state(), (void **) &elf_address,
-                          mapping_size, child_frame, VREGION_FLAGS_READ_WRITE, NULL, NULL);
-
-    si->mapped_elf = (lvaddr_t) elf_address;
-    si->mapped_elf_size = (size_t) mem_region->mrmod_size;
+    si->image = img;
+    si->mapped_elf = img->mapped_elf;
+    si->mapped_elf_size = img->mapped_elf_size;
     
     return SYS_ERR_OK;
 }
@@ -574,9 +744,8 @@ errval_t spawn_setup_by_name(char *binary_name, struct spawninfo *si, domainid_t
 
     }
     else {
-        struct mem_region* mem_region = multiboot_find_module(bi, res[0]);
-        char * args_string = (char *)  multiboot_module_opts(mem_region);
-        char copy[strlen(args_string)];
+        char * args_string = (char *) si->image->cmdline;
+        char copy[strlen(args_string) + 1];
         strcpy(copy,args_string);
         strip_extra_spaces(copy);
 
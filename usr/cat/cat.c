@@ -22,8 +22,29 @@ int main(int argc, char *argv[])
         return 0;
     }
     else {
-        char ret[1000];
-        read_file(argv[1], sizeof ret, ret);
-        printf("%s\n", ret);
+        fs_service_handle_t fh;
+        errval_t err = fs_service_open(argv[1], 0, &fh);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "cat: cannot open %s", argv[1]);
+            return 1;
+        }
+
+        // one RPC per chunk, binary contents are written out unchanged
+        char buffer[FS_SERVICE_CHUNK_SIZE];
+        uint64_t offset = 0;
+        size_t read;
+        do {
+            err = fs_service_read(fh, offset, buffer, sizeof buffer, &read);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "cat: cannot read %s", argv[1]);
+                break;
+            }
+            fwrite(buffer, 1, read, stdout);
+            offset += read;
+        } while (read == sizeof buffer);
+        fflush(stdout);
+
+        fs_service_close(fh);
+        return err_is_ok(err) ? 0 : 1;
     }
 }
@@ -5,6 +5,7 @@
 #include <aos/waitset.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <aos/systime.h>
 #include <aos/aos.h>
 #include <aos/aos_rpc.h>
@@ -19,75 +20,91 @@
 
 
 #define INTERVAL 1000
-static char *myrequest = "request !!";
 
-int main(int argc, char *argv[])
-{
-    
+/// request sizes compared between both paths, the largest fills a server message
+static const size_t payloads[] = { 16, 256, 1024, MAX_SERVER_MESSAGE_SIZE - 64 };
+
+/// response buffer reused by nameservice_rpc_buf
+static char response_buf[MAX_SERVER_MESSAGE_SIZE];
 
+/**
+ * \brief sends count requests of size bytes, returns the mean time per call
+ *
+ * The server echoes every request. With buffered set, responses are received
+ * into response_buf instead of a buffer malloced by nameservice_rpc.
+ */
+static uint64_t measure_path(nameservice_chan_t chan, char *request, size_t size,
+                             int count, bool buffered)
+{
     errval_t err;
+    size_t response_bytes;
+    void *response;
 
+    uint64_t start = systime_to_ns(systime_now());
+    for (int i = 0; i < count; i++) {
+        if (buffered) {
+            response = response_buf;
+            err = nameservice_rpc_buf(chan, request, size, response_buf, sizeof(response_buf),
+                                      &response_bytes, NULL_CAP, NULL_CAP);
+        } else {
+            err = nameservice_rpc(chan, request, size, &response, &response_bytes,
+                                  NULL_CAP, NULL_CAP);
+        }
+        PANIC_IF_FAIL(err, "Failed to coomunicate with server\n");
+        assert(response_bytes == size && !memcmp(response, request, size) &&
+               "Not correct reply!");
+        if (!buffered) {
+            free(response);
+        }
+    }
+    uint64_t end = systime_to_ns(systime_now());
+    return (end - start) / count;
+}
 
-    // lmp_ep_send()
-    // debug_printf("Here!\n");
-    // uint64_t start = systime_to_ns(systime_now());
-    // lmp_ep_send0(get_init_rpc() -> channel.lmp.remote_cap,LMP_FLAG_SYNC,NULL_CAP);
-    // uint64_t end = systime_to_ns(systime_now());
-    // uint64_t  time  = (end - start) ;
-    // debug_printf("%lu\n",time);
-    // while(true){
-    //     uint64_t start = systime_to_ns(systime_now());
-    //     for (int i = 0; i < INTERVAL;++i){
-    //         err = aos_rpc_call(get_init_rpc(),AOS_RPC_SEND_STRING,"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\n");
-    //     }
-    //     uint64_t end = systime_to_ns(systime_now());
-    //     uint64_t  time  = (end - start) / INTERVAL;
-    //     debug_printf("%lu\n",time);
+int main(int argc, char *argv[])
+{
+    errval_t err;
 
-    // }
+    if (argc != 2) {
+        return 1;
+    }
 
-    // if(argc != 2){
-    //     return 1;
-    // }
     nameservice_chan_t chan;
-    // debug_printf("%s\n",argv[1]);
-    // uint64_t start = systime_to_ns(systime_now());
-    err = nameservice_lookup(argv[1],&chan);
+    err = nameservice_lookup(argv[1], &chan);
     PANIC_IF_FAIL(err, "failed to register lookup...\n");
-    // uint64_t end = systime_to_ns(systime_now());
-    // uint64_t tts = end - start;
-    // debug_printf("%lu\n",tts);
-    size_t request_size = strlen(myrequest);
-    size_t response_bytes;
-    void *response;
 
-    uint64_t count = 0;
-    uint64_t sum = 0;
-    while(true){
-        uint64_t start = systime_to_ns(systime_now());
+    char *request = malloc(MAX_SERVER_MESSAGE_SIZE);
+    assert(request);
+    memset(request, 'a', MAX_SERVER_MESSAGE_SIZE);
 
-        err = nameservice_rpc(chan, myrequest, request_size,
-                        &response, &response_bytes,
-                        NULL_CAP, NULL_CAP);
-        uint64_t end = systime_to_ns(systime_now());
-        uint64_t tts = end - start;
-        PANIC_IF_FAIL(err,"Failed to coomunicate with server\n");
-        assert(!strcmp((char*) response,"reply!!") && "Not correct reply!");
-        count+= 1;
-        sum += tts;
-        // debug_printf("%lu\n",tts);
-        if(count % INTERVAL == 0){
-            // double time = ((double) sum) /  INTERVAL;
-            debug_printf("%lu\n",sum / 1000);
-            // debug_printf("%lf\n",time);
-            sum = 0;
-            // if(disp_get_domain_id() == 8){
-            // }
+    // relayed: client -> init (-> init -> init) -> server, brokered: client -> server
+    debug_printf("path,payload[B],mean[ns],throughput[KiB/s]\n");
+    for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+        for (int relay = 1; relay >= 0; relay--) {
+            nameservice_set_relay(chan, relay);
+            // the first call over the brokered channel sets it up, keep it out
+            measure_path(chan, request, payloads[i], 1, false);
+            uint64_t mean = measure_path(chan, request, payloads[i], INTERVAL, false);
+            uint64_t kib = mean ? (payloads[i] * 1000000000UL / 1024) / mean : 0;
+            debug_printf("%s,%zu,%lu,%lu\n", relay ? "relayed" : "brokered",
+                         payloads[i], mean, kib);
         }
-        free(response);
     }
 
+    // allocations made by the nameservice per call, with and without caller buffers
+    nameservice_set_relay(chan, false);
+    debug_printf("api,payload[B],allocs/call,mean[ns]\n");
+    size_t sizes[] = { 16, MAX_SERVER_MESSAGE_SIZE - 64 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (int buffered = 0; buffered <= 1; buffered++) {
+            uint64_t allocs = nameservice_rpc_allocs();
+            uint64_t mean = measure_path(chan, request, sizes[i], INTERVAL, buffered);
+            allocs = nameservice_rpc_allocs() - allocs;
+            debug_printf("%s,%zu,%lu.%03lu,%lu\n", buffered ? "rpc_buf" : "rpc", sizes[i],
+                         allocs / INTERVAL, (allocs % INTERVAL) * 1000 / INTERVAL, mean);
+        }
+    }
 
-
+    free(request);
     return EXIT_SUCCESS;
 }
@@ -7,6 +7,7 @@
  * ETH Zurich D-INFK, Universitaetstrasse 6, CH-8092 Zurich. Attn: Systems Group.
  */
 
+#include <aos/deferred.h>
 #include <collections/hash_table.h>
 
 #ifndef ENET_H_
@@ -33,6 +34,12 @@ void inline ENET_DEBUG_UI32_AS_IP(char *msg, uint32_t ip) {}
 
 #define ENET_PROMISC
 
+#define IMX8X_ENET_INT 290  // GIC id of the ENET0 queue 0 interrupt (SPI 258)
+#define ENET_RX_BUDGET 64  // rx buffers handled per pass in polled mode
+
+// #define ENET_STATS_OPTION 1  // print interrupt and poll counters periodically
+#define ENET_STATS_INTERVAL_US 1000000
+
 #define TX_RING_SIZE 512
 #define ENET_RX_FRSIZE 2048
 #define ENET_RX_PAGES 256
@@ -86,6 +93,9 @@ struct enet_queue {
     size_t head;
     size_t tail;
 
+    // TX descriptors made ready since the last doorbell
+    size_t tx_pending;
+
     // alignment
     size_t align;
 
@@ -96,13 +106,14 @@ struct enet_queue {
     struct region_entry* regions;
 };
 
-// struct to represent a single udp packet in a receive-buffer
+#define UDP_SOCK_RX_SLOTS 32  // datagrams buffered per socket for RECV
+
+// struct to represent a single udp packet in the receive ring of a socket
 struct udp_recv_elem {
-    void *data;
     uint16_t f_port;
     uint32_t ip_addr;
     uint16_t len;
-    struct udp_recv_elem *next;
+    char data[ENET_MAX_PKT_SIZE];
 };
 
 // NOTE: all numbers (ip, ports,...) are in host-byte-order
@@ -112,10 +123,18 @@ struct aos_udp_socket {
     uint16_t l_port;  // local port
     /* uint8_t listen_only;  // non-zero if socket is only for listening */
 
-    struct udp_recv_elem *receive_buffer;
-    struct udp_recv_elem *last_elem;
+    struct udp_recv_elem *recv_slots;  // UDP_SOCK_RX_SLOTS preallocated slots
+    uint32_t recv_head;  // datagrams appended
+    uint32_t recv_tail;  // datagrams handed to the application
+    uint64_t rx_drops;  // datagrams dropped on a full receive ring
     /* uint64_t sock_id; */
 
+    struct udp_socket_rings *rings;  // shared with the application, NULL if not mapped
+    uint64_t rx_head;  // datagrams written to the rx ring
+    uint64_t rx_tail_cache;  // last seen tail of the rx ring
+    uint64_t tx_tail;  // datagrams taken from the tx ring
+    struct capref notify_ep;  // woken on rx while the application sleeps, or NULL_CAP
+
     struct aos_udp_socket* next;
 };
 
@@ -128,6 +147,43 @@ struct aos_icmp_socket {
     struct aos_icmp_socket *next;
 };
 
+#define ARP_TIMER_US 1000000  // period of ARP retransmits and aging
+#define ARP_PENDING_MAX 16  // packets held back per unresolved ip
+#define ARP_PENDING_TRIES 3  // requests sent before held packets are dropped
+#define ARP_REFRESH_US (60 * 1000000ULL)  // re-request entries older than this
+#define ARP_TIMEOUT_US (120 * 1000000ULL)  // forget entries older than this
+#define ARP_ANNOUNCE_US (60 * 1000000ULL)  // period of gratuitous ARP for our ip
+
+// entry of the inverse ARP table
+struct arp_entry {
+    uint64_t mac;
+    systime_t updated;  // last time the mapping was confirmed
+    uint8_t refreshes;  // requests sent since, once the entry is old
+};
+
+// packet waiting for the MAC of its destination, ready to send otherwise
+struct arp_pending_pkt {
+    struct devq_buf buf;
+    struct arp_pending_pkt *next;
+};
+
+// packets held back for an ip whose ARP request is outstanding
+struct arp_pending {
+    uint32_t ip;
+    uint8_t tries;  // requests sent
+    uint16_t count;
+    struct arp_pending_pkt *head;
+    struct arp_pending_pkt *tail;
+    struct arp_pending *next;
+};
+
+// counters of the rx path, see enet_rx_poll()
+struct enet_stats {
+    uint64_t irqs;  // rx interrupts taken
+    uint64_t polls;  // passes of the rx poll loop
+    uint64_t packets;  // packets handled in those passes
+};
+
 struct enet_driver_state {
     struct bfdriver_instance *bfi;
     struct capref regs;
@@ -144,11 +200,22 @@ struct enet_driver_state {
     struct capref tx_mem;  // send memcap
 
     collections_hash_table* arp_table;  // arp-related state
-    collections_hash_table* inv_table;  // inverse arp-table: ip 2 mac
+    collections_hash_table* inv_table;  // inverse arp-table: ip 2 struct arp_entry
+    struct arp_pending *arp_pending;  // packets waiting for ARP replies
+    uint64_t arp_drops;  // packets dropped without an ARP reply
+    systime_t arp_announced;  // last gratuitous ARP
+    struct periodic_event arp_event;
     struct enet_qstate* send_qstate;  // regionman for send-queue
 
     struct aos_udp_socket *sockets;
+    collections_hash_table *socket_table;  // local port to udp socket
     struct aos_icmp_socket *pings;
+
+    struct capref irq_ep;  // destination of rx interrupts
+    bool irqs_enabled;  // false if interrupts could not be set up, polls forever
+    bool polling;  // rx interrupts masked, rx ring is polled in batches
+    struct enet_stats stats;
+    struct periodic_event stats_event;
 };
 
 // ETH handler functions
@@ -159,6 +226,11 @@ errval_t handle_IP(struct enet_queue* q, struct devq_buf* buf,
                    lvaddr_t vaddr, struct enet_driver_state* st);
 errval_t handle_packet(struct enet_queue* q, struct devq_buf* buf,
                        struct enet_driver_state* st);
+struct arp_entry *arp_lookup(struct enet_driver_state *st, uint32_t ip);
+void arp_table_update(struct enet_driver_state *st, uint32_t ip, uint64_t mac);
+errval_t arp_hold_packet(struct enet_driver_state *st, uint32_t ip,
+                         struct devq_buf *buf);
+errval_t arp_timer_start(struct enet_driver_state *st);
 
 // UDP Socket functions
 /* struct aos_udp_socket* get_socket_from_id(struct enet_driver_state *st, */
@@ -170,6 +242,12 @@ struct aos_udp_socket* get_socket_from_port(struct enet_driver_state *st,
 errval_t udp_socket_append_message(struct aos_udp_socket *s, uint16_t f_port, uint32_t ip,
                                    void *data, uint32_t len);
 struct udp_recv_elem *udp_socket_receive(struct aos_udp_socket *s);
+errval_t udp_socket_map_rings(struct aos_udp_socket *s, struct capref frame);
+errval_t udp_socket_set_notify(struct aos_udp_socket *s, struct capref ep,
+                               coreid_t core);
+void udp_socket_poll_tx(struct enet_driver_state *st);
+bool udp_socket_tx_arm(struct enet_driver_state *st);
+void udp_socket_tx_disarm(struct enet_driver_state *st);
 errval_t udp_socket_teardown(struct enet_driver_state *st,
                              struct aos_udp_socket *socket);
 struct aos_udp_socket* create_udp_socket(struct enet_driver_state *st,
@@ -233,7 +233,7 @@ static errval_t enet_tx_enqueue(struct devq* que, regionid_t rid, genoffset_t of
     buf->valid_length = valid_length;
     buf->valid_data = valid_data;
     buf->rid = rid;
-    buf->flags = flags;
+    buf->flags = flags & ~ENET_TX_FLAG_MORE;
  
     // TODO alignment
     
@@ -253,8 +253,16 @@ static errval_t enet_tx_enqueue(struct devq* que, regionid_t rid, genoffset_t of
 
     cpu_dcache_wb_range((lvaddr_t) &q->ring[q->tail], sizeof(enet_bufdesc_t));
 
-    // activate TX
+    if (flags & ENET_TX_FLAG_MORE) {
+        // part of a batch, enet_tx_notify() rings the doorbell for all of them
+        q->tail = (q->tail + 1) & (q->size -1);
+        q->tx_pending++;
+        return SYS_ERR_OK;
+    }
+
+    // activate TX, this also sends descriptors of an unfinished batch
     enet_activate_tx_ring(q->d);
+    q->tx_pending = 0;
 
     // wait until sent
     int timeout = 5000;
@@ -274,6 +282,28 @@ static errval_t enet_tx_enqueue(struct devq* que, regionid_t rid, genoffset_t of
 
     return SYS_ERR_OK;
 }
+
+/**
+ * \brief Start the DMA for the descriptors enqueued with ENET_TX_FLAG_MORE.
+ * Does not wait for the packets to be sent, completed descriptors are
+ * returned by enet_tx_dequeue().
+ */
+static errval_t enet_tx_notify(struct devq* que)
+{
+    struct enet_queue* q = (struct enet_queue*) que;
+
+    if (q->tx_pending == 0) {
+        return SYS_ERR_OK;
+    }
+
+    ENET_DEBUG("TX doorbell for %zu descriptors \n", q->tx_pending);
+    dmb();
+    enet_activate_tx_ring(q->d);
+    q->tx_pending = 0;
+
+    return SYS_ERR_OK;
+}
+
 static errval_t enet_rx_enqueue(struct devq* que, regionid_t rid, genoffset_t offset,
                                 genoffset_t length, genoffset_t valid_data,
                                 genoffset_t valid_length, uint64_t flags)
@@ -477,6 +507,7 @@ errval_t enet_tx_queue_create(struct enet_queue ** q, struct enet_t* dev)
 
     txq->head = 0;
     txq->tail = 0;
+    txq->tx_pending = 0;
 
     err = devq_init(&txq->q, false);
     if (err_is_fail(err)) {
@@ -487,6 +518,7 @@ errval_t enet_tx_queue_create(struct enet_queue ** q, struct enet_t* dev)
     txq->q.f.reg = enet_register;
     txq->q.f.enq = enet_tx_enqueue;
     txq->q.f.deq = enet_tx_dequeue;
+    txq->q.f.notify = enet_tx_notify;
 
     *q = txq;
 
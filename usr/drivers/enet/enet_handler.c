@@ -7,6 +7,7 @@
 #include <devif/backends/net/enet_devif.h>
 #include <aos/aos.h>
 #include <aos/deferred.h>
+#include <aos/systime.h>
 #include <driverkit/driverkit.h>
 #include <dev/imx8x/enet_dev.h>
 #include <netutil/etharp.h>
@@ -110,6 +111,211 @@ static void print_arp_packet(struct arp_hdr* h) {
     deb_print_mac("eth_dst", &h->eth_dst);
 }
 
+/**
+ * \brief Look up the MAC of an ip in the ARP table.
+ * \return the entry, NULL if the ip has not been resolved (yet)
+ */
+struct arp_entry *arp_lookup(struct enet_driver_state *st, uint32_t ip) {
+    return collections_hash_find(st->inv_table, ip);
+}
+
+static void arp_pending_free(struct enet_driver_state *st,
+                             struct arp_pending *p, uint64_t *mac) {
+    struct arp_pending_pkt *next;
+    for (struct arp_pending_pkt *pp = p->head; pp; pp = next) {
+        next = pp->next;
+        if (mac) {
+            struct region_entry *entry = get_region(st->txq, pp->buf.rid);
+            struct eth_hdr *eh = (struct eth_hdr *) ((char *) entry->mem.vbase +
+                                                     pp->buf.offset +
+                                                     pp->buf.valid_data);
+            u64_to_eth_addr(*mac, &eh->dst);
+            dmb();
+            enqueue_buf_more(st->send_qstate, &pp->buf);
+        } else {
+            put_free_buf(st->send_qstate, &pp->buf);
+            st->arp_drops++;
+        }
+        free(pp);
+    }
+    enqueue_flush(st->send_qstate);
+    free(p);
+}
+
+/**
+ * \brief Remove the packets held back for ip. They are sent to mac, or
+ * dropped if mac is NULL.
+ */
+static void arp_pending_flush(struct enet_driver_state *st, uint32_t ip,
+                              uint64_t *mac) {
+    struct arp_pending **pp = &st->arp_pending;
+    for (; *pp; pp = &(*pp)->next) {
+        if ((*pp)->ip == ip) {
+            struct arp_pending *p = *pp;
+            *pp = p->next;
+            ETHARP_DEBUG("flushing %d packets held back\n", p->count);
+            arp_pending_free(st, p, mac);
+            return;
+        }
+    }
+}
+
+/**
+ * \brief Store (or confirm) that ip is at mac and send the packets waiting
+ * for it.
+ */
+void arp_table_update(struct enet_driver_state *st, uint32_t ip, uint64_t mac) {
+    // the MAC moved to another ip
+    uint32_t *stored_ip = collections_hash_find(st->arp_table, mac);
+    if (stored_ip && *stored_ip != ip) {
+        ETHARP_DEBUG("updating ARP table entry\n");
+        collections_hash_delete(st->inv_table, *stored_ip);
+        collections_hash_delete(st->arp_table, mac);
+        stored_ip = NULL;
+    }
+
+    // the ip moved to another MAC
+    struct arp_entry *e = arp_lookup(st, ip);
+    if (e && e->mac != mac) {
+        ETHARP_DEBUG("updating ARP table entry\n");
+        collections_hash_delete(st->arp_table, e->mac);
+    } else if (e == NULL) {
+        ETHARP_DEBUG("adding new ARP table entry\n");
+        e = malloc(sizeof(struct arp_entry));
+        collections_hash_insert(st->inv_table, ip, e);
+    }
+    e->mac = mac;
+    e->updated = systime_now();
+    e->refreshes = 0;
+
+    if (stored_ip == NULL) {
+        uint32_t *ip_ref = malloc(sizeof(uint32_t));
+        *ip_ref = ip;
+        collections_hash_insert(st->arp_table, mac, ip_ref);
+    }
+
+    arp_pending_flush(st, ip, &mac);
+}
+
+/**
+ * \brief Hold back a packet for ip until its ARP reply arrives. The packet
+ * is complete except for the destination MAC. The first packet for an ip
+ * sends the ARP request.
+ * \return ENET_ERR_ARP_UNKNOWN if the packet was dropped instead
+ */
+errval_t arp_hold_packet(struct enet_driver_state *st, uint32_t ip,
+                         struct devq_buf *buf) {
+    struct arp_pending *p = st->arp_pending;
+    for (; p && p->ip != ip; p = p->next)
+        ;
+
+    if (p == NULL) {
+        p = calloc(1, sizeof(struct arp_pending));
+        p->ip = ip;
+        p->next = st->arp_pending;
+        st->arp_pending = p;
+
+        errval_t err = arp_request(st, ip);
+        if (err_is_ok(err)) {
+            p->tries = 1;
+        }
+    }
+
+    if (p->count == ARP_PENDING_MAX) {
+        put_free_buf(st->send_qstate, buf);
+        st->arp_drops++;
+        return ENET_ERR_ARP_UNKNOWN;
+    }
+
+    struct arp_pending_pkt *pp = malloc(sizeof(struct arp_pending_pkt));
+    pp->buf = *buf;
+    pp->next = NULL;
+    if (p->tail) {
+        p->tail->next = pp;
+    } else {
+        p->head = pp;
+    }
+    p->tail = pp;
+    p->count++;
+    return SYS_ERR_OK;
+}
+
+#define ARP_AGE_BATCH 16  // entries expired or refreshed per timer tick
+
+/**
+ * \brief ARP timer: retransmit outstanding requests, drop packets whose
+ * destination does not answer, refresh and expire old entries and announce
+ * our own address.
+ */
+static void arp_timer(void *arg) {
+    struct enet_driver_state *st = (struct enet_driver_state *) arg;
+    systime_t now = systime_now();
+
+    struct arp_pending **pp = &st->arp_pending;
+    while (*pp) {
+        struct arp_pending *p = *pp;
+        if (p->tries >= ARP_PENDING_TRIES) {
+            ETHARP_DEBUG("no ARP reply, dropping %d packets\n", p->count);
+            *pp = p->next;
+            arp_pending_free(st, p, NULL);
+            continue;
+        }
+        if (err_is_ok(arp_request(st, p->ip))) {
+            p->tries++;
+        }
+        pp = &p->next;
+    }
+
+    // the table can't be modified while traversing it
+    uint32_t expired[ARP_AGE_BATCH];
+    int n_expired = 0;
+    if (collections_hash_traverse_start(st->inv_table) != -1) {
+        uint64_t key;
+        struct arp_entry *e = collections_hash_traverse_next(st->inv_table, &key);
+        for (; e; e = collections_hash_traverse_next(st->inv_table, &key)) {
+            uint64_t age = systime_to_us(now - e->updated);
+            if (age > ARP_TIMEOUT_US) {
+                if (n_expired < ARP_AGE_BATCH) {
+                    expired[n_expired++] = key;
+                }
+            } else if (age > ARP_REFRESH_US && e->refreshes < ARP_PENDING_TRIES) {
+                // entries in use are confirmed before they expire
+                if (err_is_ok(arp_request(st, key))) {
+                    e->refreshes++;
+                }
+            }
+        }
+        collections_hash_traverse_end(st->inv_table);
+    }
+
+    for (int i = 0; i < n_expired; i++) {
+        struct arp_entry *e = arp_lookup(st, expired[i]);
+        ETHARP_DEBUG("ARP table entry expired\n");
+        collections_hash_delete(st->arp_table, e->mac);
+        collections_hash_delete(st->inv_table, expired[i]);
+    }
+
+    if (systime_to_us(now - st->arp_announced) > ARP_ANNOUNCE_US) {
+        // gratuitous ARP: a request for our own address
+        if (err_is_ok(arp_request(st, STATIC_ENET_IP))) {
+            st->arp_announced = now;
+        }
+    }
+}
+
+/**
+ * \brief announce our address and start aging the ARP table.
+ */
+errval_t arp_timer_start(struct enet_driver_state *st) {
+    errval_t err = arp_request(st, STATIC_ENET_IP);
+    if (err_is_ok(err)) {
+        st->arp_announced = systime_now();
+    }
+
+    return periodic_event_create(&st->arp_event, get_default_waitset(),
+                                 ARP_TIMER_US, MKCLOSURE(arp_timer, st));
+}
+
 /**
  * \brief Handle an ARP request: possibly update local ARP table and send
  * back device's MAC address
@@ -118,6 +324,10 @@ static errval_t arp_request_handle(struct enet_queue* q, struct devq_buf* buf,
                                    struct arp_hdr *h, struct enet_driver_state* st,
                                    lvaddr_t original_header) {
     if (ntohl(h->ip_dst) != STATIC_ENET_IP) {
+        // refresh known senders, e.g. on gratuitous ARP
+        if (arp_lookup(st, ntohl(h->ip_src))) {
+            arp_table_update(st, ntohl(h->ip_src), eth_addr_to_u64(&h->eth_src));
+        }
         return SYS_ERR_OK;
     }
 
@@ -128,29 +338,7 @@ static errval_t arp_request_handle(struct enet_queue* q, struct devq_buf* buf,
 
     // extract src-info
     errval_t err;
-    uint64_t mac_src = eth_addr_to_u64(&h->eth_src);
-    uint32_t *ip_src_ref = malloc(sizeof(uint32_t));
-    *ip_src_ref = ntohl(h->ip_src);
-    uint64_t *mac_src_ref = malloc(sizeof(uint64_t));
-    *mac_src_ref = mac_src;
-
-    uint32_t *stored = collections_hash_find(st->arp_table, mac_src);
-    if (stored) {
-        if (*stored != *ip_src_ref) {
-            ETHARP_DEBUG("updating ARP table entry\n");
-            collections_hash_delete(st->arp_table, mac_src);
-            collections_hash_insert(st->arp_table, mac_src, ip_src_ref);
-            collections_hash_delete(st->inv_table, *ip_src_ref);
-            collections_hash_insert(st->inv_table, *ip_src_ref, mac_src_ref);
-        } else {
-            ETHARP_DEBUG("ARP entry already stored\n");
-        }
-    } else {
-        // save info in arp-table
-        ETHARP_DEBUG("adding new ARP table entry\n");
-        collections_hash_insert(st->arp_table, mac_src, ip_src_ref);
-        collections_hash_insert(st->inv_table, *ip_src_ref, mac_src_ref);
-    }
+    arp_table_update(st, ntohl(h->ip_src), eth_addr_to_u64(&h->eth_src));
 
     // reply to it
     struct devq_buf repl;
@@ -214,31 +402,9 @@ static errval_t arp_reply_handle(struct enet_queue* q, struct devq_buf* buf,
         return err;
     }
 
-    // if for us, just save contained information
+    // if for us, save contained information and send what waited for it
     ETHARP_DEBUG("reply for me :D\n");
-    uint64_t mac_src = eth_addr_to_u64(&h->eth_src);
-    uint32_t *ip_src_ref = malloc(sizeof(uint32_t));
-    *ip_src_ref = ntohl(h->ip_src);
-    uint64_t *mac_src_ref = malloc(sizeof(uint64_t));
-    *mac_src_ref = mac_src;
-
-    uint32_t *stored = collections_hash_find(st->arp_table, mac_src);
-    if (stored) {
-        if (*stored != *ip_src_ref) {
-            ETHARP_DEBUG("updating ARP table entry\n");
-            collections_hash_delete(st->arp_table, mac_src);
-            collections_hash_insert(st->arp_table, mac_src, ip_src_ref);
-            collections_hash_delete(st->inv_table, *ip_src_ref);
-            collections_hash_insert(st->inv_table, *ip_src_ref, mac_src_ref);
-        } else {
-            ETHARP_DEBUG("ARP entry already stored\n");
-        }
-    } else {
-        // save info in arp-table
-        ETHARP_DEBUG("adding new ARP table entry\n");
-        collections_hash_insert(st->arp_table, mac_src, ip_src_ref);
-        collections_hash_insert(st->inv_table, *ip_src_ref, mac_src_ref);
-    }
+    arp_table_update(st, ntohl(h->ip_src), eth_addr_to_u64(&h->eth_src));
 
     return err;
 }
@@ -21,6 +21,8 @@
 #include <aos/aos.h>
 #include <aos/nameserver.h>
 #include <aos/deferred.h>
+#include <aos/inthandler.h>
+#include <drivers/gic_dist.h>
 #include <driverkit/driverkit.h>
 #include <dev/imx8x/enet_dev.h>
 #include <netutil/etharp.h>
@@ -600,6 +602,123 @@ static void print_packet(struct enet_queue* q, struct devq_buf* buf) {
 }
 
 
+/**
+ * \brief Dequeue, handle and re-enqueue up to `budget` received buffers.
+ * \return number of buffers handled
+ */
+static size_t enet_rx_poll(struct enet_driver_state *st, size_t budget) {
+    errval_t err;
+    struct devq_buf buf;
+    size_t n;
+
+    for (n = 0; n < budget; n++) {
+        err = devq_dequeue((struct devq*) st->rxq, &buf.rid, &buf.offset,
+                           &buf.length, &buf.valid_data, &buf.valid_length,
+                           &buf.flags);
+        if (err_is_fail(err)) {
+            break;
+        }
+
+        ENET_DEBUG("Received Packet of size %lu \n", buf.valid_length);
+        handle_packet(st->rxq, &buf, st);
+        /* print_packet(st->rxq, &buf); */
+        err = devq_enqueue((struct devq*) st->rxq, buf.rid, buf.offset,
+                           buf.length, buf.valid_data, buf.valid_length,
+                           buf.flags);
+        assert(err_is_ok(err));
+    }
+
+    st->stats.polls++;
+    st->stats.packets += n;
+    return n;
+}
+
+/**
+ * \brief RX interrupt: mask further RX interrupts and poll the ring instead,
+ * until it runs dry.
+ */
+static void enet_rx_interrupt(void *arg) {
+    struct enet_driver_state *st = (struct enet_driver_state *) arg;
+
+    st->stats.irqs++;
+    enet_eimr_rxf_wrf(st->d, 0x0);
+    enet_eir_wr(st->d, enet_eir_rxf_insert(0x0, 0x1));
+    st->polling = true;
+}
+
+/**
+ * \brief Leave polled mode once the RX ring ran dry.
+ */
+static void enet_rx_rearm(struct enet_driver_state *st) {
+    enet_eir_wr(st->d, enet_eir_rxf_insert(0x0, 0x1));
+
+    // frames that arrived before clearing the event raise no interrupt
+    if (enet_rx_poll(st, ENET_RX_BUDGET) > 0) {
+        return;
+    }
+
+    st->polling = false;
+    enet_eimr_rxf_wrf(st->d, 0x1);
+}
+
+/**
+ * \brief Route the RX frame interrupt to this dispatcher.
+ */
+static errval_t enet_setup_interrupts(struct enet_driver_state *st) {
+    errval_t err;
+
+    struct capref gic_devframe = {
+        .cnode = cnode_task,
+        .slot = TASKCN_SLOT_BOOTINFO
+    };
+
+    void *gic_frame;
+    err = paging_map_frame_attr(get_current_paging_state(), &gic_frame,
+                                get_phys_size(gic_devframe), gic_devframe,
+                                DEVFRAME_ATTRIBUTES, NULL, NULL);
+    ON_ERR_RETURN(err);
+
+    struct gic_dist_s *gds;
+    err = gic_dist_init(&gds, gic_frame);
+    ON_ERR_RETURN(err);
+
+    err = inthandler_alloc_dest_irq_cap(IMX8X_ENET_INT, &st->irq_ep);
+    ON_ERR_RETURN(err);
+
+    err = inthandler_setup(st->irq_ep, get_default_waitset(),
+                           MKCLOSURE(enet_rx_interrupt, st));
+    ON_ERR_RETURN(err);
+
+    err = gic_dist_enable_interrupt(gds, IMX8X_ENET_INT,
+                                    1 << disp_get_core_id(), 5);
+    ON_ERR_RETURN(err);
+
+    enet_eir_wr(st->d, enet_eir_rxf_insert(0x0, 0x1));
+    enet_eimr_rxf_wrf(st->d, 0x1);
+    return SYS_ERR_OK;
+}
+
+#if defined(ENET_STATS_OPTION)
+static void enet_print_stats(void *arg) {
+    struct enet_driver_state *st = (struct enet_driver_state *) arg;
+    static struct enet_stats last;
+
+    uint64_t irqs = st->stats.irqs - last.irqs;
+    uint64_t polls = st->stats.polls - last.polls;
+    uint64_t packets = st->stats.packets - last.packets;
+    last = st->stats;
+    if (packets == 0 && irqs == 0) {
+        return;
+    }
+
+    uint64_t per_poll = polls ? packets * 100 / polls : 0;  // in 1/100
+    debug_printf("enet,%lu,%lu.%02lu,%lu\n",
+                 irqs * 1000000 / ENET_STATS_INTERVAL_US,
+                 per_poll / 100, per_poll % 100,
+                 packets * 1000000 / ENET_STATS_INTERVAL_US);
+}
+#endif
+
 int main(int argc, char *argv[]) {
     errval_t err;
 
@@ -636,6 +755,7 @@ int main(int argc, char *argv[]) {
     enet_initialize(st->d, (void *) st->d_vaddr);
     collections_hash_create(&st->arp_table, free);
     collections_hash_create(&st->inv_table, free);
+    collections_hash_create(&st->socket_table, NULL);
 
     assert(st->d != NULL);
     enet_read_mac(st);
@@ -701,43 +821,68 @@ int main(int argc, char *argv[]) {
 
     // initialize region-manager for send-queue
     st->send_qstate = malloc(sizeof(struct enet_qstate));
-    err = init_enet_qstate(st->txq, st->send_qstate);
+    err = init_enet_qstate((struct devq*) st->txq, st->txq->size - 1,
+                           st->send_qstate);
+    if (err_is_fail(err)) {
+        return err;
+    }
     for (int i = 0; i < st->txq->size - 1; i++) {
-        struct devq_buf *curb = malloc(sizeof(struct devq_buf));
-        curb->rid = rid;
-        curb->offset = i * 2048;
-        curb->length = 2048;
-        curb->valid_data = 0;
-        curb->valid_length = 2048;
-        curb->flags = 0;
-
-        struct dev_list *curn = malloc(sizeof(struct dev_list));
-        curn->cur = curb;
-
-        qstate_append_free(st->send_qstate, curn);
+        struct devq_buf curb = {
+            .rid = rid,
+            .offset = i * 2048,
+            .length = 2048,
+            .valid_data = 0,
+            .valid_length = 2048,
+            .flags = 0,
+        };
+        put_free_buf(st->send_qstate, &curb);
     }
 
     // initialize nameserver
     name_server_initialize(st);
 
-    struct devq_buf buf;
+    err = arp_timer_start(st);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "failed to start ARP timer");
+    }
+
+    err = enet_setup_interrupts(st);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "no RX interrupts, polling instead");
+    }
+    st->irqs_enabled = err_is_ok(err);
+    st->polling = true;
+
+#if defined(ENET_STATS_OPTION)
+    debug_printf("enet,irqs/s,pkts/poll,pkts/s\n");
+    periodic_event_create(&st->stats_event, get_default_waitset(),
+                          ENET_STATS_INTERVAL_US,
+                          MKCLOSURE(enet_print_stats, st));
+#endif
+
+    struct waitset *ws = get_default_waitset();
     while(true) {
-        err = event_dispatch_non_block(get_default_waitset());
-        if(err_no(err) == LIB_ERR_NO_EVENT) {
-            err = devq_dequeue((struct devq*) st->rxq, &buf.rid, &buf.offset,
-                               &buf.length, &buf.valid_data, &buf.valid_length,
-                               &buf.flags);
-            if (err_is_ok(err)) {
-                ENET_DEBUG("Received Packet of size %lu \n", buf.valid_length);
-                handle_packet(st->rxq, &buf, st);
-                /* print_packet(st->rxq, &buf); */
-                err = devq_enqueue((struct devq*) st->rxq, buf.rid, buf.offset,
-                                   buf.length, buf.valid_data, buf.valid_length,
-                                   buf.flags);
-                assert(err_is_ok(err));
-            } else {
+        if (st->polling) {
+            // under load: handle the RX ring in batches, serve clients in between
+            size_t n = enet_rx_poll(st, ENET_RX_BUDGET);
+            udp_socket_poll_tx(st);
+            event_dispatch_non_block(ws);
+
+            if (n < ENET_RX_BUDGET && st->irqs_enabled) {
+                enet_rx_rearm(st);
+            } else if (n == 0) {
                 thread_yield();
             }
+        } else {
+            // idle: sleep until a frame, a client request or a kick arrives
+            if (!udp_socket_tx_arm(st)) {
+                err = event_dispatch(ws);
+                if (err_is_fail(err)) {
+                    DEBUG_ERR(err, "in event_dispatch");
+                }
+            }
+            udp_socket_tx_disarm(st);
+            udp_socket_poll_tx(st);
         }
     }
 }
@@ -8,49 +8,42 @@
 
 /**
  * \brief Initialize an enet-qstate-struct.
+ * \param nbufs number of buffers that will ever be handed to the qstate,
+ * the free stack is never grown.
  */
-errval_t init_enet_qstate(struct enet_queue* queue,
+errval_t init_enet_qstate(struct devq* queue, size_t nbufs,
                                  struct enet_qstate* tgt) {
     assert(queue != NULL);
     tgt->queue = queue;
-    tgt->free = NULL;
+    tgt->free = calloc(nbufs, sizeof(struct devq_buf));
+    if (tgt->free == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    tgt->free_count = 0;
+    tgt->free_size = nbufs;
+    tgt->pending = 0;
     return SYS_ERR_OK;
 }
 
-/**
- * \brief Add a new free buffer to an enet-qstate.
- * NOTE: susceptible to heavily reuse a small number of buffs
- * \param fr Node containing the free devq_buf to be added.
- */
-void qstate_append_free(struct enet_qstate* qs,
-                               struct dev_list* fr) {
-    fr->next = qs->free;
-    qs->free = fr;
-}
-
 /**
  * \brief Dequeues as many buffers as it can.
  * NOTE: the 'content' of the buffers is completely ignored.
  * DO NOT USE THIS FOR THE RECEIVE QUEUE!!!! only for the send queue
  */
 errval_t dequeue_bufs(struct enet_qstate* qs) {
-    struct devq_buf buf;
-    errval_t err;
-
-    err = devq_dequeue((struct devq*) qs->queue, &buf.rid, &buf.offset,
-                       &buf.length, &buf.valid_data, &buf.valid_length,
-                       &buf.flags);
-
-    while (err_is_ok(err)) {
-        struct devq_buf* nub = calloc(1, sizeof(struct devq_buf));
-        struct dev_list* nul = calloc(1, sizeof(struct dev_list));
-        *nub = buf;
-        nul->cur = nub;
-        qstate_append_free(qs, nul);
+    errval_t err = SYS_ERR_OK;
 
-        err = devq_dequeue((struct devq*) qs->queue, &buf.rid, &buf.offset,
-                           &buf.length, &buf.valid_data, &buf.valid_length,
-                           &buf.flags);
+    while (qs->free_count < qs->free_size) {
+        struct devq_buf* buf = &qs->free[qs->free_count];
+        err = devq_dequeue(qs->queue, &buf->rid, &buf->offset,
+                           &buf->length, &buf->valid_data, &buf->valid_length,
+                           &buf->flags);
+        if (err_is_fail(err)) {
+            break;
+        }
+        // backends other than enet hand the flags back unchanged
+        buf->flags &= ~ENET_TX_FLAG_MORE;
+        qs->free_count++;
     }
 
     return err;
@@ -60,35 +53,67 @@ errval_t dequeue_bufs(struct enet_qstate* qs) {
  * \brief Retrieve a free buffer from a qstate.
  * NOTE: atm, if the buffer is never put back into the queue, the enet
  * devq might run out of memory.
- * also, if no free buffer is available, "dequeue_bufs" will be called
+ * Completed buffers are only reclaimed, all at once, when the stack is empty.
  * make sure, this is never called on the in-queue, only the out-queue.
  */
 errval_t get_free_buf(struct enet_qstate* qs, struct devq_buf* ret) {
-    if (qs->free == NULL) {
+    if (qs->free_count == 0) {
+        // a batch that was never notified would never complete
+        enqueue_flush(qs);
         dequeue_bufs(qs);
 
-        if (qs->free == NULL) {
+        if (qs->free_count == 0) {
             // NOTE: could also create and add new region here if wanted
             return DEVQ_ERR_NO_FREE_BUFFER;
         }
     }
 
-    struct dev_list* fr = qs->free;
-    struct devq_buf* fb = fr->cur;
-
-    qs->free = qs->free->next;
-
-    *ret = *fb;
-    free(fr);
-    free(fb);
+    *ret = qs->free[--qs->free_count];
     return SYS_ERR_OK;
 }
 
+/**
+ * \brief Hand back a buffer from get_free_buf() that was not enqueued.
+ * Also used to fill the qstate initially.
+ */
+void put_free_buf(struct enet_qstate* qs, struct devq_buf* buf) {
+    assert(qs->free_count < qs->free_size);
+    qs->free[qs->free_count++] = *buf;
+}
+
 /**
  * \brief Put a new buf into a queue.
+ * Also sends the buffers enqueued with enqueue_buf_more() before.
  */
 errval_t enqueue_buf(struct enet_qstate* qs, struct devq_buf* buf) {
-    return devq_enqueue((struct devq*) qs->queue, buf->rid, buf->offset,
+    qs->pending = 0;
+    return devq_enqueue(qs->queue, buf->rid, buf->offset,
                         buf->length, buf->valid_data, buf->valid_length,
                         buf->flags);
 }
+
+/**
+ * \brief Put a new buf into a queue without starting the transmission.
+ * Call enqueue_flush() after the last buffer of a batch.
+ */
+errval_t enqueue_buf_more(struct enet_qstate* qs, struct devq_buf* buf) {
+    errval_t err = devq_enqueue(qs->queue, buf->rid, buf->offset,
+                                buf->length, buf->valid_data,
+                                buf->valid_length,
+                                buf->flags | ENET_TX_FLAG_MORE);
+    if (err_is_ok(err)) {
+        qs->pending++;
+    }
+    return err;
+}
+
+/**
+ * \brief Send all buffers enqueued with enqueue_buf_more(), with one doorbell.
+ */
+errval_t enqueue_flush(struct enet_qstate* qs) {
+    if (qs->pending == 0) {
+        return SYS_ERR_OK;
+    }
+    qs->pending = 0;
+    return devq_notify(qs->queue);
+}
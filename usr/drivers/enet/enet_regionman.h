@@ -1,22 +1,24 @@
-struct dev_list {
-    struct devq_buf* cur;
-    struct dev_list* next;
-};
 
 // struct to keep track of an entire enet-region
 struct enet_qstate {
-    struct enet_queue* queue;
-    struct dev_list* free;
+    struct devq* queue;
+    struct devq_buf* free;  // stack of free buffers
+    size_t free_count;
+    size_t free_size;
+    size_t pending;         // enqueued with enqueue_buf_more(), not yet notified
 };
 
-errval_t init_enet_qstate(struct enet_queue* queue,
+errval_t init_enet_qstate(struct devq* queue, size_t nbufs,
                                 struct enet_qstate* tgt);
 
-void qstate_append_free(struct enet_qstate* qs,
-                               struct dev_list* fr);
-
 errval_t dequeue_bufs(struct enet_qstate* qs);
 
 errval_t get_free_buf(struct enet_qstate* qs, struct devq_buf* ret);
 
+void put_free_buf(struct enet_qstate* qs, struct devq_buf* buf);
+
 errval_t enqueue_buf(struct enet_qstate* qs, struct devq_buf* buf);
+
+errval_t enqueue_buf_more(struct enet_qstate* qs, struct devq_buf* buf);
+
+errval_t enqueue_flush(struct enet_qstate* qs);
@@ -0,0 +1,189 @@
+/**
+ * \file
+ * \brief Cost of the TX path of the enet driver, one doorbell per packet
+ *        against one doorbell per batch
+ *
+ * A local packet generator builds UDP frames in buffers of an enet_qstate
+ * and enqueues them to a loopback devq instead of the device. The loopback
+ * queue hands every buffer back at once, like a device that has sent it, so
+ * the numbers are the software cost of buffer management, header writing and
+ * enqueueing, plus the number of doorbells and reclaims the device would see.
+ * Results are printed as CSV.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <devif/queue_interface_backend.h>
+#include <devif/backends/loopback_devif.h>
+#include <devif/backends/net/enet_devif.h>
+#include <aos/aos.h>
+#include <aos/systime.h>
+#include <netutil/etharp.h>
+#include <netutil/htons.h>
+#include <netutil/ip.h>
+#include <netutil/checksum.h>
+#include <netutil/udp.h>
+
+#include "enet_regionman.h"
+
+#define BENCH_BUF_SIZE 2048
+// the loopback queue holds 256 entries, one less keeps it from running full
+#define BENCH_NBUFS 255
+#define BENCH_PACKETS 100000
+#define BENCH_PAYLOAD 64
+
+#define BENCH_SRC_IP 0x0a000201
+#define BENCH_DST_IP 0x0a000202
+
+static const size_t batches[] = { 1, 8, 32 };
+
+struct bench_stats {
+    uint64_t doorbells;
+    uint64_t reclaims;
+};
+
+static void *region;
+
+/// writes the ETH, IP and UDP headers and the payload of one frame
+static void gen_frame(struct devq_buf *buf, uint16_t id)
+{
+    const uint16_t eth_tot_len = BENCH_PAYLOAD + ETH_HLEN + IP_HLEN + UDP_HLEN;
+    struct eth_hdr *eh = (struct eth_hdr *) ((char *) region + buf->offset +
+                                             buf->valid_data);
+
+    memset(&eh->dst, 0x02, ETH_ADDR_LEN);
+    memset(&eh->src, 0x04, ETH_ADDR_LEN);
+    eh->type = htons(ETH_TYPE_IP);
+
+    struct ip_hdr *ih = (struct ip_hdr *) ((char *) eh + ETH_HLEN);
+    IPH_VHL_SET(ih, 4, 5);
+    ih->tos = 0;
+    ih->len = htons(eth_tot_len - ETH_HLEN);
+    ih->id = htons(id);
+    ih->offset = 0;
+    ih->ttl = 64;
+    ih->proto = IP_PROTO_UDP;
+    ih->src = htonl(BENCH_SRC_IP);
+    ih->dest = htonl(BENCH_DST_IP);
+    ih->chksum = 0;
+    ih->chksum = inet_checksum(ih, IP_HLEN);
+
+    struct udp_hdr *uh = (struct udp_hdr *) ((char *) ih + IP_HLEN);
+    uh->src = htons(4242);
+    uh->dest = htons(4243);
+    uh->len = htons(eth_tot_len - ETH_HLEN - IP_HLEN);
+    uh->chksum = 0;
+    memset((char *) uh + UDP_HLEN, (char) id, BENCH_PAYLOAD);
+
+    buf->valid_length = eth_tot_len;
+}
+
+static errval_t run(struct enet_qstate *qs, size_t batch,
+                    struct bench_stats *stats)
+{
+    errval_t err;
+
+    for (int i = 0; i < BENCH_PACKETS; i += batch) {
+        for (size_t j = 0; j < batch; j++) {
+            if (qs->free_count == 0) {
+                stats->reclaims++;
+            }
+
+            struct devq_buf buf;
+            err = get_free_buf(qs, &buf);
+            if (err_is_fail(err)) {
+                return err;
+            }
+
+            gen_frame(&buf, i + j);
+
+            if (batch == 1) {
+                // every packet is sent on its own, as enqueue_buf() does
+                err = enqueue_buf(qs, &buf);
+                stats->doorbells++;
+            } else {
+                err = enqueue_buf_more(qs, &buf);
+            }
+            if (err_is_fail(err)) {
+                return err;
+            }
+        }
+
+        if (batch > 1) {
+            err = enqueue_flush(qs);
+            if (err_is_fail(err)) {
+                return err;
+            }
+            stats->doorbells++;
+        }
+    }
+
+    return SYS_ERR_OK;
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+    struct capref frame;
+    size_t size = BENCH_NBUFS * BENCH_BUF_SIZE;
+
+    err = frame_alloc(&frame, size, &size);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "frame_alloc");
+    }
+    err = paging_map_frame(get_current_paging_state(), &region, size, frame,
+                           NULL, NULL);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "paging_map_frame");
+    }
+
+    debug_printf("batch,pkts,ns/pkt,doorbells,reclaims\n");
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        struct loopback_queue *lq;
+        err = loopback_queue_create(&lq);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "loopback_queue_create");
+        }
+
+        regionid_t rid;
+        err = devq_register((struct devq *) lq, frame, &rid);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "devq_register");
+        }
+
+        struct enet_qstate qs;
+        err = init_enet_qstate((struct devq *) lq, BENCH_NBUFS, &qs);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "init_enet_qstate");
+        }
+        for (int i = 0; i < BENCH_NBUFS; i++) {
+            struct devq_buf buf = {
+                .rid = rid,
+                .offset = i * BENCH_BUF_SIZE,
+                .length = BENCH_BUF_SIZE,
+                .valid_data = 0,
+                .valid_length = BENCH_BUF_SIZE,
+                .flags = 0,
+            };
+            put_free_buf(&qs, &buf);
+        }
+
+        struct bench_stats stats = { 0 };
+        uint64_t start = systime_now();
+        err = run(&qs, batches[b], &stats);
+        uint64_t ns = systime_to_ns(systime_now() - start);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "batch %zu failed", batches[b]);
+        } else {
+            debug_printf("%zu,%d,%lu,%lu,%lu\n", batches[b], BENCH_PACKETS,
+                         ns / BENCH_PACKETS, stats.doorbells, stats.reclaims);
+        }
+
+        free(qs.free);
+        devq_destroy((struct devq *) lq);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -60,8 +60,6 @@ static void udp_receive_handler_ns(struct enet_driver_state* st,
     rm->ip = ure->ip_addr;
     memcpy(rm->data, ure->data, ure->len);
 
-    free(ure->data);
-    free(ure);
     *response = (void *) rm;
     *response_bytes = mln;
 }
@@ -188,7 +186,8 @@ static void server_recv_handler(void *stptr, void *message,
             DEBUG_ERR(err, "oh no :(");
         }
         HAN_DEBUG("write repl\n");
-        *response_bytes = 0;
+        *response = &err;
+        *response_bytes = sizeof(errval_t);
         break;
     case ARP_TBL:
         HAN_DEBUG("ARP table\n");
@@ -202,6 +201,40 @@ static void server_recv_handler(void *stptr, void *message,
     case ICMP_PING_RECV:
         ping_recv_handler_ns(st, msg->ip, response, response_bytes);
         break;
+    case MAP_RINGS:
+        HAN_DEBUG("map rings\n");
+        sock = get_socket_from_port(st, msg->port);
+        if (sock == NULL) {
+            err = ENET_ERR_NO_SOCKET;
+        } else if (capref_is_null(rx_cap)) {
+            err = SYS_ERR_CAP_NOT_FOUND;
+        } else {
+            err = udp_socket_map_rings(sock, rx_cap);
+        }
+        *response = &err;
+        *response_bytes = sizeof(errval_t);
+        break;
+    case SET_NOTIFY:
+        HAN_DEBUG("notify\n");
+        sock = get_socket_from_port(st, msg->port);
+        if (sock == NULL) {
+            err = ENET_ERR_NO_SOCKET;
+        } else if (capref_is_null(rx_cap)) {
+            err = SYS_ERR_CAP_NOT_FOUND;
+        } else {
+            err = udp_socket_set_notify(sock, rx_cap,
+                ((struct udp_socket_notify_info *) msg->data)->core);
+        }
+        *response = &err;
+        *response_bytes = sizeof(errval_t);
+        break;
+    case KICK_TX:
+        // the main loop sends the tx rings once the request is handled
+        HAN_DEBUG("kick\n");
+        err = SYS_ERR_OK;
+        *response = &err;
+        *response_bytes = sizeof(errval_t);
+        break;
     }
 }
 
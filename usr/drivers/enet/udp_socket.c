@@ -7,6 +7,7 @@
 #include <devif/backends/net/enet_devif.h>
 #include <aos/aos.h>
 #include <aos/deferred.h>
+#include <aos/udp_service.h>
 #include <driverkit/driverkit.h>
 #include <dev/imx8x/enet_dev.h>
 #include <netutil/etharp.h>
@@ -39,6 +40,10 @@ static struct region_entry* get_region(struct enet_queue* q, regionid_t rid)
     return NULL;
 }
 
+static errval_t udp_socket_xmit(struct enet_driver_state *st, uint16_t port,
+                                void *data, uint16_t len, uint32_t ip_to,
+                                uint16_t port_to, bool more);
+
 /* /\** */
 /*  * \brief given an id and a driver state, retrieve the corresponding udp socket. */
 /*  * \return reference to the according udp socket, NULL if none could be found */
@@ -59,11 +64,46 @@ static struct region_entry* get_region(struct enet_queue* q, regionid_t rid)
  */
 struct aos_udp_socket* get_socket_from_port(struct enet_driver_state *st,
                                             uint16_t port) {
-    for (struct aos_udp_socket *i = st->sockets; i; i = i->next) {
-        if (i->l_port == port)
-            return i;
+    return collections_hash_find(st->socket_table, port);
+}
+
+/**
+ * \brief copies an incoming message into the rx ring of the socket.
+ * If the application has not caught up, the message is dropped and counted.
+ */
+static errval_t udp_socket_ring_push(struct aos_udp_socket *s, uint16_t f_port, uint32_t ip,
+                                     void *data, uint32_t len) {
+    struct udp_ring *rx = &s->rings->rx;
+
+    if (s->rx_head - s->rx_tail_cache == UDP_RING_SLOTS) {
+        s->rx_tail_cache = rx->tail;
+        if (s->rx_head - s->rx_tail_cache == UDP_RING_SLOTS) {
+            rx->drops++;
+            return SYS_ERR_OK;
+        }
+        dmb();  // overwrite slots only after the application is done with them
     }
-    return NULL;
+
+    if (len > MAX_PAYLOAD_LEN) {
+        len = MAX_PAYLOAD_LEN;
+    }
+
+    struct udp_ring_slot *slot = &rx->slots[s->rx_head % UDP_RING_SLOTS];
+    slot->msg.f_port = f_port;
+    slot->msg.ip = ip;
+    slot->msg.len = len;
+    memcpy(slot->data, data, len);
+
+    dmb();  // publish after write
+    rx->head = ++s->rx_head;
+
+    dmb();  // read the flag after publishing head, pairs with the application arming
+    if (rx->sleeping && !capref_is_null(s->notify_ep)) {
+        rx->sleeping = 0;
+        // a full endpoint already holds a wakeup, nothing is lost
+        lmp_ep_send0(s->notify_ep, LMP_SEND_FLAGS_DEFAULT, NULL_CAP);
+    }
+    return SYS_ERR_OK;
 }
 
 /**
@@ -72,43 +112,180 @@ struct aos_udp_socket* get_socket_from_port(struct enet_driver_state *st,
  * \param len length of the incoming message, in bytes
  * NOTE: the length should already be adjusted for the udp-header length
  * it should only describe the payload-length, without any headers.
+ * If the socket has rings mapped, data is copied straight into its rx ring.
  */
 errval_t udp_socket_append_message(struct aos_udp_socket *s, uint16_t f_port, uint32_t ip,
                                    void *data, uint32_t len) {
-    errval_t err = SYS_ERR_OK;
+    if (s->rings) {
+        return udp_socket_ring_push(s, f_port, ip, data, len);
+    }
 
-    struct udp_recv_elem *im = malloc(sizeof(struct udp_recv_elem));
-    void *msg_ptr = malloc(sizeof(char) * len);
-    im->data = msg_ptr;
+    if (s->recv_head - s->recv_tail == UDP_SOCK_RX_SLOTS) {
+        // the application does not keep up, drop the newest datagram
+        s->rx_drops++;
+        return SYS_ERR_OK;
+    }
+
+    if (len > ENET_MAX_PKT_SIZE) {
+        len = ENET_MAX_PKT_SIZE;
+    }
+
+    struct udp_recv_elem *im = &s->recv_slots[s->recv_head % UDP_SOCK_RX_SLOTS];
     im->len = len;
-    im->next = NULL;
     im->f_port = f_port;
     im->ip_addr = ip;
-    memcpy(msg_ptr, data, len);
-
-    struct udp_recv_elem *prev_last = s->last_elem;
-    if (prev_last) {
-        prev_last->next = im;
-        s->last_elem = im;
-    } else {
-        s->receive_buffer = im;
-        s->last_elem = im;
-    }
-    return err;
+    memcpy(im->data, data, len);
+    s->recv_head++;
+    return SYS_ERR_OK;
 }
 
+/**
+ * \brief takes the oldest datagram from the receive ring of the socket.
+ * \return the datagram, valid until the next one is appended, or NULL if none
+ * is pending.
+ */
 struct udp_recv_elem *udp_socket_receive(struct aos_udp_socket *s) {
-    if (s->receive_buffer == NULL) {
+    if (s->recv_head == s->recv_tail) {
         return NULL;
     }
 
-    struct udp_recv_elem *res = s->receive_buffer;
-    s->receive_buffer = res->next;
-    if (s->last_elem == res) {
-        s->last_elem = NULL;
+    return &s->recv_slots[s->recv_tail++ % UDP_SOCK_RX_SLOTS];
+}
+
+/**
+ * \brief maps the rings shared with the application owning the socket.
+ * \param frame frame holding a struct udp_socket_rings, zeroed by the application
+ */
+errval_t udp_socket_map_rings(struct aos_udp_socket *s, struct capref frame) {
+    if (s->rings) {
+        return LIB_ERR_NOT_IMPLEMENTED;
+    }
+
+    struct frame_identity fi;
+    errval_t err = frame_identify(frame, &fi);
+    ON_ERR_RETURN(err);
+    if (fi.bytes < sizeof(struct udp_socket_rings)) {
+        return LIB_ERR_RPC_ARGUMENT_OVERFLOW;
     }
 
-    return res;
+    void *buf;
+    err = paging_map_frame_complete(get_current_paging_state(), &buf, frame,
+                                    NULL, NULL);
+    ON_ERR_PUSH_RETURN(err, LIB_ERR_VSPACE_MAP);
+
+    s->rx_head = 0;
+    s->rx_tail_cache = 0;
+    s->tx_tail = 0;
+    s->rings = buf;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief sets the endpoint woken when a datagram arrives on the rx ring while
+ * the application sleeps.
+ * \param core core of the application, endpoints only work on the same core
+ */
+errval_t udp_socket_set_notify(struct aos_udp_socket *s, struct capref ep,
+                               coreid_t core) {
+    if (core != disp_get_core_id()) {
+        return LIB_ERR_NOT_IMPLEMENTED;
+    }
+
+    struct capability cap;
+    errval_t err = invoke_cap_identify(ep, &cap);
+    ON_ERR_RETURN(err);
+    if (cap.type != ObjType_EndPointLMP) {
+        return SYS_ERR_INVALID_SOURCE_TYPE;
+    }
+
+    if (!capref_is_null(s->notify_ep)) {
+        cap_destroy(s->notify_ep);
+    }
+    s->notify_ep = ep;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief sends the datagrams published on the tx rings of all sockets.
+ * Datagrams that cannot be sent (e.g. unknown destination) are counted as
+ * drops, if the device is out of buffers the rest is left for the next poll.
+ * The datagrams are sent as one batch, the device is notified once per poll.
+ */
+void udp_socket_poll_tx(struct enet_driver_state *st) {
+    for (struct aos_udp_socket *s = st->sockets; s; s = s->next) {
+        if (s->rings == NULL) {
+            continue;
+        }
+
+        struct udp_ring *tx = &s->rings->tx;
+        uint64_t head = tx->head;
+        if (head == s->tx_tail) {
+            continue;
+        }
+        dmb();  // read datagrams after head
+
+        while (s->tx_tail != head) {
+            struct udp_ring_slot *slot = &tx->slots[s->tx_tail % UDP_RING_SLOTS];
+            uint16_t len = slot->msg.len;
+            if (len > MAX_PAYLOAD_LEN) {
+                len = MAX_PAYLOAD_LEN;
+            }
+
+            errval_t err;
+            if (slot->msg.ip == 0) {
+                err = udp_socket_xmit(st, s->l_port, slot->data, len,
+                                      s->ip_dest, s->f_port, true);
+            } else {
+                err = udp_socket_xmit(st, s->l_port, slot->data, len,
+                                      slot->msg.ip, slot->msg.f_port, true);
+            }
+            if (err_no(err) == DEVQ_ERR_NO_FREE_BUFFER) {
+                break;
+            } else if (err_is_fail(err)) {
+                tx->drops++;
+            }
+            s->tx_tail++;
+        }
+
+        dmb();  // release slots after read
+        tx->tail = s->tx_tail;
+    }
+
+    // one doorbell for the datagrams of all sockets
+    enqueue_flush(st->send_qstate);
+}
+
+/**
+ * \brief announces to the applications that the driver is about to sleep,
+ * they send KICK_TX after publishing on their tx ring from then on.
+ * \return true if datagrams are already pending and the driver must not sleep
+ */
+bool udp_socket_tx_arm(struct enet_driver_state *st) {
+    for (struct aos_udp_socket *s = st->sockets; s; s = s->next) {
+        if (s->rings) {
+            s->rings->tx.sleeping = 1;
+        }
+    }
+
+    dmb();  // read head after announcing, pairs with aos_socket_send_commit
+
+    for (struct aos_udp_socket *s = st->sockets; s; s = s->next) {
+        if (s->rings && s->rings->tx.head != s->tx_tail) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief the driver is awake again, applications no longer need to kick it.
+ */
+void udp_socket_tx_disarm(struct enet_driver_state *st) {
+    for (struct aos_udp_socket *s = st->sockets; s; s = s->next) {
+        if (s->rings) {
+            s->rings->tx.sleeping = 0;
+        }
+    }
 }
 
 /**
@@ -117,6 +294,11 @@ struct udp_recv_elem *udp_socket_receive(struct aos_udp_socket *s) {
  */
 errval_t udp_socket_teardown(struct enet_driver_state *st,
                              struct aos_udp_socket *socket) {
+    if (socket == NULL) {
+        return ENET_ERR_NO_SOCKET;
+    }
+    collections_hash_delete(st->socket_table, socket->l_port);
+
     // remove from linked list
     if (st->sockets == socket) {  // easy case
         st->sockets = socket->next;
@@ -133,12 +315,13 @@ errval_t udp_socket_teardown(struct enet_driver_state *st,
     }
 
     // free all remaining data from in-buffer
-    for (struct udp_recv_elem *i = socket->receive_buffer;
-         i; i = i->next) {
-        free(i->data);
-        free(i);
+    free(socket->recv_slots);
+    if (!capref_is_null(socket->notify_ep)) {
+        cap_destroy(socket->notify_ep);
     }
 
+    // NOTE: unmapping is not supported, the rings of the socket stay mapped
+
     // free socket itself
     free(socket);
     return SYS_ERR_OK;
@@ -161,13 +344,25 @@ struct aos_udp_socket* create_udp_socket(struct enet_driver_state *st,
     }
 
     struct aos_udp_socket *nu = malloc(sizeof(struct aos_udp_socket));
+    if (nu == NULL) {
+        return NULL;
+    }
+    nu->recv_slots = malloc(UDP_SOCK_RX_SLOTS * sizeof(struct udp_recv_elem));
+    if (nu->recv_slots == NULL) {
+        free(nu);
+        return NULL;
+    }
     nu->ip_dest = ip_dest;
     nu->f_port = f_port;
     nu->l_port = l_port;
-    nu->receive_buffer = NULL;
-    nu->last_elem = NULL;
+    nu->recv_head = 0;
+    nu->recv_tail = 0;
+    nu->rx_drops = 0;
+    nu->rings = NULL;
+    nu->notify_ep = NULL_CAP;
     nu->next = st->sockets;
     st->sockets = nu;
+    collections_hash_insert(st->socket_table, l_port, nu);
 
     return nu;
 }
@@ -232,87 +427,22 @@ errval_t arp_request(struct enet_driver_state *st, uint32_t ip_to) {
  */
 errval_t udp_socket_send(struct enet_driver_state *st, uint16_t port,
                          void *data, uint16_t len) {
-    static uint16_t generic_id = 5555;  // NOTE: maybe store in socket obj instead
-    // possibly truncate len
-    if (len > UDP_SOCK_MAX_LEN)
-        len = UDP_SOCK_MAX_LEN;
-    const uint16_t eth_tot_len = len + ETH_HLEN + IP_HLEN + UDP_HLEN;
-
-    errval_t err;
     struct aos_udp_socket *sock = get_socket_from_port(st, port);
     if (sock == NULL) {
         return ENET_ERR_NO_SOCKET;
     }
 
-    // get packeT
-    struct devq_buf repl;
-    err = get_free_buf(st->send_qstate, &repl);
-    if (err_is_fail(err)) {
-        UDP_DEBUG("un4ble 2 get free buffer\n");
-        return err;
-    }
-
-    struct region_entry *entry = get_region(st->txq, repl.rid);
-    lvaddr_t maddr = (lvaddr_t) entry->mem.vbase + repl.offset + repl.valid_data;
-    struct eth_hdr *meh = (struct eth_hdr *) maddr;
-    uint64_t *mac_tgt = collections_hash_find(st->inv_table, sock->ip_dest);
-
-    if (mac_tgt == NULL) {
-        UDP_DEBUG("but...where (not to)? %d\n", sock->ip_dest);
-        print_arp_table(st);
-        err = arp_request(st, sock->ip_dest);
-        return err_is_fail(err) ? err : ENET_ERR_ARP_UNKNOWN;
-    }
-
-    // write ETH header
-    UDP_DEBUG("writing ETH header\n");
-    u64_to_eth_addr(*mac_tgt, &meh->dst);
-    uint8_t* macref = (uint8_t *) &(st->mac);
-    for (int i = 0; i < 6; i++) {
-        meh->src.addr[i] = macref[5 - i];
-    }
-    meh->type = htons(ETH_TYPE_IP);
-
-    // write IP header
-    UDP_DEBUG("writing IP header\n");
-    struct ip_hdr *mih = (struct ip_hdr *) ((char *) meh + ETH_HLEN);
-    IPH_VHL_SET(mih, 4, 5);
-    mih->tos = 0;  // ?
-    mih->len = htons(eth_tot_len - ETH_HLEN);
-    mih->id = ++generic_id;
-    mih->offset = 0;
-    mih->ttl = 64;
-    mih->proto = IP_PROTO_UDP;
-    mih->src = htonl(STATIC_ENET_IP);
-    mih->dest = htonl(sock->ip_dest);
-    mih->chksum = 0;
-    mih->chksum = inet_checksum(mih, IP_HLEN);
-
-    // write UDP header
-    UDP_DEBUG("writing UDP header\n");
-    struct udp_hdr *muh = (struct udp_hdr *) ((char *) mih + IP_HLEN);
-    muh->src = htons(port);
-    muh->dest = htons(sock->f_port);
-    muh->len = htons(len);
-    muh->chksum = 0;
-
-    // copy payload
-    UDP_DEBUG("writing payload\n");
-    memcpy((char *) muh + UDP_HLEN, data, len);
-    repl.valid_length = eth_tot_len;
-
-    dmb();
-
-    UDP_DEBUG("=========== SENDING MESSAGE\n");
-    err = enqueue_buf(st->send_qstate, &repl);
-
-    return err;
+    return udp_socket_send_to(st, port, data, len, sock->ip_dest, sock->f_port);
 }
 
-errval_t udp_socket_send_to(struct enet_driver_state *st, uint16_t port,
-                            void *data, uint16_t len, uint32_t ip_to,
-                            uint16_t port_to) {
-    UDP_DEBUG("sending to\n");
+/**
+ * \brief build a UDP message from port to ip_to:port_to and enqueue it.
+ * \param more only fill the descriptor, the caller sends the batch with
+ * enqueue_flush()
+ */
+static errval_t udp_socket_xmit(struct enet_driver_state *st, uint16_t port,
+                                void *data, uint16_t len, uint32_t ip_to,
+                                uint16_t port_to, bool more) {
     static uint16_t generic_id = 5555;  // NOTE: maybe store in socket obj instead
     // possibly truncate len
     if (len > UDP_SOCK_MAX_LEN)
@@ -320,12 +450,6 @@ errval_t udp_socket_send_to(struct enet_driver_state *st, uint16_t port,
     const uint16_t eth_tot_len = len + ETH_HLEN + IP_HLEN + UDP_HLEN;
 
     errval_t err;
-    struct aos_udp_socket *sock = get_socket_from_port(st, port);
-    if (sock == NULL) {
-        return ENET_ERR_NO_SOCKET;
-    }
-
-    UDP_DEBUG("found socket\n");
 
     // get packet
     struct devq_buf repl;
@@ -339,18 +463,9 @@ errval_t udp_socket_send_to(struct enet_driver_state *st, uint16_t port,
     struct region_entry *entry = get_region(st->txq, repl.rid);
     lvaddr_t maddr = (lvaddr_t) entry->mem.vbase + repl.offset + repl.valid_data;
     struct eth_hdr *meh = (struct eth_hdr *) maddr;
-    uint64_t *mac_tgt = collections_hash_find(st->inv_table, ip_to);
 
-    if (mac_tgt == NULL) {
-        UDP_DEBUG("but...where? %d\n", ip_to);
-        print_arp_table(st);
-        err = arp_request(st, ip_to);
-        return err_is_fail(err) ? err : ENET_ERR_ARP_UNKNOWN;
-    }
-
-    // write ETH header
+    // write ETH header, the destination is filled in below
     UDP_DEBUG("writing ETH header\n");
-    u64_to_eth_addr(*mac_tgt, &meh->dst);
     uint8_t* macref = (uint8_t *) &(st->mac);
     for (int i = 0; i < 6; i++) {
         meh->src.addr[i] = macref[5 - i];
@@ -385,14 +500,43 @@ errval_t udp_socket_send_to(struct enet_driver_state *st, uint16_t port,
     memcpy((char *) muh + UDP_HLEN, data, len);
     repl.valid_length = eth_tot_len;
 
+    struct arp_entry *mac_tgt = arp_lookup(st, ip_to);
+    if (mac_tgt == NULL) {
+        UDP_DEBUG("but...where? %d\n", ip_to);
+        return arp_hold_packet(st, ip_to, &repl);
+    }
+    u64_to_eth_addr(mac_tgt->mac, &meh->dst);
+
     dmb();
 
     UDP_DEBUG("=========== SENDING MESSAGE\n");
-    err = enqueue_buf(st->send_qstate, &repl);
+    if (more) {
+        err = enqueue_buf_more(st->send_qstate, &repl);
+    } else {
+        err = enqueue_buf(st->send_qstate, &repl);
+    }
 
     return err;
 }
 
+/**
+ * \brief send a UDP message over the provided port to ip_to:port_to.
+ * If the MAC of ip_to is not known yet, the packet is held back until the
+ * ARP reply arrives.
+ */
+errval_t udp_socket_send_to(struct enet_driver_state *st, uint16_t port,
+                            void *data, uint16_t len, uint32_t ip_to,
+                            uint16_t port_to) {
+    UDP_DEBUG("sending to\n");
+    struct aos_udp_socket *sock = get_socket_from_port(st, port);
+    if (sock == NULL) {
+        return ENET_ERR_NO_SOCKET;
+    }
+
+    UDP_DEBUG("found socket\n");
+    return udp_socket_xmit(st, port, data, len, ip_to, port_to, false);
+}
+
 /**
  * \brief retrieve reference to ping socket pinging the provided ip address
  * \return reference to a ping socket, or NULL if none could be found
@@ -468,7 +612,7 @@ errval_t ping_socket_send_next(struct enet_driver_state *st, uint32_t ip) {
     }
 
     // check if arp known
-    uint64_t *mac_tgt = collections_hash_find(st->inv_table, ip);
+    struct arp_entry *mac_tgt = arp_lookup(st, ip);
     if (mac_tgt == NULL) {
         ICMP_DEBUG("unknown ping-destination %d\n", ip);
         err = arp_request(st, ip);
@@ -498,7 +642,7 @@ errval_t ping_socket_send_next(struct enet_driver_state *st, uint32_t ip) {
 
     // write ETH header
     ICMP_DEBUG("writing ETH header\n");
-    u64_to_eth_addr(*mac_tgt, &meh->dst);
+    u64_to_eth_addr(mac_tgt->mac, &meh->dst);
     uint8_t* macref = (uint8_t *) &(st->mac);
     for (int i = 0; i < 6; i++) {
         meh->src.addr[i] = macref[5 - i];
@@ -28,6 +28,7 @@
  */
 
 #include <aos/aos.h>
+#include <aos/systime.h>
 #include <drivers/sdhc.h>
 #include <aos/deferred.h>
 #include <dev/imx8x/sdhc_dev.h>
@@ -97,6 +98,26 @@
 #define MMC_RSP_R6  (MMC_RSP_PRESENT|MMC_RSP_CRC|MMC_RSP_OPCODE)
 #define MMC_RSP_R7  (MMC_RSP_PRESENT|MMC_RSP_CRC|MMC_RSP_OPCODE)
 
+/// Upper bound for the command lines to become free and a command to complete
+#define SDHC_CMD_TIMEOUT_US     100000
+
+/// Upper bound for a data transfer, including the busy time of a write
+#define SDHC_DATA_TIMEOUT_US    1000000
+
+/// Status polls before the waiting thread starts to yield between polls
+#define SDHC_POLL_SPIN          1000
+
+/// DMA select value of the protocol control register for ADMA2
+#define SDHC_DMASEL_ADMA2       0x2
+
+/// ADMA2 descriptor attributes
+#define ADMA2_VALID             (1 << 0)
+#define ADMA2_END               (1 << 1)
+#define ADMA2_ACT_TRAN          (2 << 4)
+
+/// Largest length of a single ADMA2 descriptor, a multiple of the block size
+#define ADMA2_MAX_LEN           (32 * 1024)
+
 #define OCR_BUSY        0x80000000
 #define OCR_HCS         0x40000000
 #define OCR_S18R        0x1000000
@@ -115,6 +136,23 @@ struct sdhc_s {
     uint64_t read_bl_len;
     uint64_t write_bl_len ;
     uint64_t capacity_user;
+
+    // ADMA2 descriptor table (nocache)
+    struct adma2_desc *adma;
+    lpaddr_t adma_p;
+    size_t adma_entries;
+
+    // Request queue in submission order, and the requests of the running command
+    struct sdhc_req *queue_head;
+    struct sdhc_req *queue_tail;
+    struct sdhc_req *active;
+    systime_t active_deadline;
+};
+
+struct adma2_desc {
+    uint16_t attr;
+    uint16_t len;
+    uint32_t addr;
 };
 
 
@@ -123,8 +161,8 @@ struct cmd {
     unsigned int cmdarg;
     unsigned int resp_type;
     unsigned int response[4]; // The response of the command
-    genpaddr_t   dma_base;    // If a data transfer is necessary, use this
-                              // physical base address for read/write.
+    uint32_t     blkcnt;      // Number of blocks to transfer of a data command,
+                              // the buffers are described by the ADMA table.
 };
 
 #define dump(sd) do {\
@@ -181,11 +219,23 @@ static errval_t software_reset(struct sdhc_s *sd){
     return SYS_ERR_OK;
 }
 
+static bool is_read_cmd(struct cmd *cmd)
+{
+    return cmd->cmdidx == MMC_CMD_READ_SINGLE_BLOCK ||
+           cmd->cmdidx == MMC_CMD_READ_MULTIPLE_BLOCK;
+}
+
+static bool is_data_cmd(struct cmd *cmd)
+{
+    return is_read_cmd(cmd) ||
+           cmd->cmdidx == MMC_CMD_WRITE_SINGLE_BLOCK ||
+           cmd->cmdidx == MMC_CMD_WRITE_MULTIPLE_BLOCK;
+}
+
 static sdhc_cmd_xfr_typ_t xfr_typ_for_cmd(struct cmd *cmd){
     sdhc_cmd_xfr_typ_t c = 0;
 
-    if(cmd->cmdidx == MMC_CMD_READ_SINGLE_BLOCK ||
-       cmd->cmdidx == MMC_CMD_WRITE_SINGLE_BLOCK)
+    if(is_data_cmd(cmd))
     {
         c = sdhc_cmd_xfr_typ_dpsel_insert(c, 1);
     }
@@ -212,8 +262,145 @@ static sdhc_cmd_xfr_typ_t xfr_typ_for_cmd(struct cmd *cmd){
     return c;
 }
 
-static errval_t sdhc_send_cmd(struct sdhc_s * sd, struct cmd * cmd) {
-    DEBUG("sdhc_send_cmd: cmdidx=%d,cmdarg=%d\n", cmd->cmdidx, cmd->cmdarg);
+/**
+ * \brief Resets the CMD (and DATA) line state machines after an error
+ */
+static void sdhc_reset_lines(struct sdhc_s *sd, bool data)
+{
+    sdhc_sys_ctrl_rstc_wrf(&sd->dev, 1);
+    if (data) {
+        sdhc_sys_ctrl_rstd_wrf(&sd->dev, 1);
+    }
+
+    systime_t deadline = systime_now() + us_to_systime(SDHC_CMD_TIMEOUT_US);
+    while (sdhc_sys_ctrl_rstc_rdf(&sd->dev) || sdhc_sys_ctrl_rstd_rdf(&sd->dev)) {
+        if (systime_now() > deadline) {
+            DEBUG("Line reset TIMEOUT!\n");
+            return;
+        }
+    }
+}
+
+/**
+ * \brief Waits until the lines selected by mask in the present state are free
+ */
+static errval_t sdhc_wait_inhibit(struct sdhc_s *sd, uint32_t mask)
+{
+    systime_t deadline = systime_now() + us_to_systime(SDHC_CMD_TIMEOUT_US);
+    size_t polls = 0;
+
+    while (sdhc_pres_state_rawrd(&sd->dev) & mask) {
+        if (systime_now() > deadline) {
+            DEBUG("%s:%d: Card busy, lines not released.\n", __FUNCTION__, __LINE__);
+            dump(sd);
+            return SDHC_ERR_CMD_TIMEOUT;
+        }
+        if (++polls > SDHC_POLL_SPIN) {
+            thread_yield();
+        }
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Checks whether a command (and its data transfer) completed or failed.
+ *
+ * The status bits are cleared before the command is issued, so the first
+ * completion or error seen here belongs to it. The controller sets TC of a
+ * write only after the card released the busy signal, and of a multi-block
+ * transfer only after the automatic CMD12, so no additional delay is needed
+ * before the next command.
+ */
+static errval_t sdhc_check_complete(struct sdhc_s *sd, bool data, bool *done)
+{
+    sdhc_int_status_t st = sdhc_int_status_rd(&sd->dev);
+    *done = false;
+
+    if (sdhc_int_status_ctoe_extract(st)) {
+        if (sdhc_int_status_cce_extract(st)) {
+            DEBUG("%s:%d: ctoe = 1 ccrc = 1: Conflict on cmd line.\n",
+                    __FUNCTION__, __LINE__);
+            dump(sd);
+            sdhc_reset_lines(sd, false);
+            return SDHC_ERR_CMD_CONFLICT;
+        }
+        DEBUG("%s:%d: cto = 1 ccrc = 0: Abort.\n", __FUNCTION__, __LINE__);
+        dump(sd);
+        sdhc_reset_lines(sd, false);
+        return SDHC_ERR_CMD_TIMEOUT;
+    }
+    if (sdhc_int_status_cce_extract(st) || sdhc_int_status_cebe_extract(st)
+        || sdhc_int_status_cie_extract(st)) {
+        dump(sd);
+        sdhc_reset_lines(sd, false);
+        return SDHC_ERR_CMD_ERROR;
+    }
+
+    if (data) {
+        if (sdhc_int_status_dtoe_extract(st)) {
+            dump(sd);
+            sdhc_reset_lines(sd, true);
+            return SDHC_ERR_DATA_TIMEOUT;
+        }
+        if (sdhc_int_status_dce_extract(st) || sdhc_int_status_debe_extract(st)) {
+            dump(sd);
+            sdhc_reset_lines(sd, true);
+            return SDHC_ERR_DATA_CRC;
+        }
+        if (sdhc_int_status_dmae_extract(st)) {
+            DEBUG("ADMA error status: 0x%"PRIx32"\n",
+                  (uint32_t)sdhc_adma_err_status_rawrd(&sd->dev));
+            dump(sd);
+            sdhc_reset_lines(sd, true);
+            return SDHC_ERR_DMA;
+        }
+        if (sdhc_int_status_ac12e_extract(st)) {
+            dump(sd);
+            sdhc_reset_lines(sd, true);
+            return SDHC_ERR_CMD_ERROR;
+        }
+        *done = sdhc_int_status_cc_extract(st) && sdhc_int_status_tc_extract(st);
+    } else {
+        *done = sdhc_int_status_cc_extract(st);
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Polls the interrupt status until a command completed or failed.
+ */
+static errval_t sdhc_wait_complete(struct sdhc_s *sd, bool data)
+{
+    uint64_t timeout = data ? SDHC_DATA_TIMEOUT_US : SDHC_CMD_TIMEOUT_US;
+    systime_t deadline = systime_now() + us_to_systime(timeout);
+    size_t polls = 0;
+
+    while (true) {
+        bool done;
+        errval_t err = sdhc_check_complete(sd, data, &done);
+        if (err_is_fail(err) || done) {
+            return err;
+        }
+
+        if (systime_now() > deadline) {
+            dump(sd);
+            sdhc_reset_lines(sd, data);
+            return data ? SDHC_ERR_DATA_TIMEOUT : SDHC_ERR_CMD_TIMEOUT;
+        }
+        if (++polls > SDHC_POLL_SPIN) {
+            thread_yield();
+        }
+    }
+}
+
+/**
+ * \brief Issues a command without waiting for its completion.
+ *
+ * For data commands, the ADMA table must describe the buffers already.
+ */
+static errval_t sdhc_issue_cmd(struct sdhc_s * sd, struct cmd * cmd) {
+    errval_t err;
+    DEBUG("sdhc_issue_cmd: cmdidx=%d,cmdarg=%d\n", cmd->cmdidx, cmd->cmdarg);
 
     uint32_t mask; // TODO: in some cases we don't need to wait for all
     if(cmd->cmdidx == MMC_CMD_STOP_TRANSMISSION) {
@@ -221,11 +408,11 @@ static errval_t sdhc_send_cmd(struct sdhc_s * sd, struct cmd * cmd) {
     } else {
        mask = 3;
     }
-    while(sdhc_pres_state_rawrd(&sd->dev) & mask){
-        DEBUG("Card busy!\n");
+    err = sdhc_wait_inhibit(sd, mask);
+    if (err_is_fail(err)) {
+        return err;
     }
     DEBUG("Card ready (data & cmd inhibit are clear)!\n");
-    barrelfish_usleep(10000);
 
     // Clear interrupts
     sdhc_int_status_rawwr(&sd->dev, ~0x0);
@@ -236,18 +423,28 @@ static errval_t sdhc_send_cmd(struct sdhc_s * sd, struct cmd * cmd) {
     // CMD argument
     sdhc_cmd_arg_wr(&sd->dev, cmd->cmdarg);
 
-    // Mixer controler
-    int is_read = cmd->cmdidx == MMC_CMD_READ_SINGLE_BLOCK;
-    int is_write = cmd->cmdidx == MMC_CMD_WRITE_SINGLE_BLOCK;
-    sdhc_mix_ctrl_wr(&sd->dev, 0); 
-    sdhc_mix_ctrl_dmaen_wrf(&sd->dev, is_read || is_write);
-    sdhc_mix_ctrl_dtdsel_wrf(&sd->dev, is_read);
-
-    if(is_read || is_write){
-        // DMA address setup
-        assert((cmd->dma_base >> 32) == 0);
+    // Mixer controler, multi-block transfers are terminated by an auto CMD12
+    bool data = is_data_cmd(cmd);
+    bool multi = data && cmd->blkcnt > 1;
+    sdhc_mix_ctrl_t m = 0;
+    m = sdhc_mix_ctrl_dmaen_insert(m, data);
+    m = sdhc_mix_ctrl_dtdsel_insert(m, is_read_cmd(cmd));
+    m = sdhc_mix_ctrl_msbsel_insert(m, multi);
+    m = sdhc_mix_ctrl_bcen_insert(m, multi);
+    m = sdhc_mix_ctrl_ac12en_insert(m, multi);
+    sdhc_mix_ctrl_wr(&sd->dev, m);
+
+    if(data){
+        // ADMA2 setup, make sure the descriptors are visible to the device
+        dmb();
         sdhc_vend_spec2_acmd23_argu2_en_wrf(&sd->dev, 0);
-        sdhc_ds_addr_wr(&sd->dev, cmd->dma_base);
+        sdhc_prot_ctrl_dmasel_wrf(&sd->dev, SDHC_DMASEL_ADMA2);
+        sdhc_adma_sys_addr_wr(&sd->dev, sd->adma_p);
+
+        sdhc_blk_att_t b = 0;
+        b = sdhc_blk_att_blkcnt_insert(b, cmd->blkcnt);
+        b = sdhc_blk_att_blksize_insert(b, SDHC_BLOCK_SIZE);
+        sdhc_blk_att_wr(&sd->dev, b);
 
         //Set watermark
         sdhc_wtmk_lvl_rd_wml_wrf(&sd->dev, 16);
@@ -257,37 +454,10 @@ static errval_t sdhc_send_cmd(struct sdhc_s * sd, struct cmd * cmd) {
     sdhc_cmd_xfr_typ_t c = xfr_typ_for_cmd(cmd);
     sdhc_cmd_xfr_typ_wr(&sd->dev, c);
 
-    //DEBUG("%s:%d: Wait until irq_stat.tc || irq_stat.cc \n", __FUNCTION__, __LINE__);
-    uint32_t tc = 0;
-    uint32_t cc = 0;
-    size_t i = 0;
-    do {
-        uint32_t ctoe = sdhc_int_status_ctoe_rdf(&sd->dev);
-        uint32_t cce = sdhc_int_status_cce_rdf(&sd->dev);
-        tc = sdhc_int_status_tc_rdf(&sd->dev);
-        cc = sdhc_int_status_cc_rdf(&sd->dev);
-
-        if (ctoe == 0x1 && cce == 0x1) {
-            DEBUG("%s:%d: ctoe = 1 ccrc = 1: Conflict on cmd line.\n",
-                    __FUNCTION__, __LINE__);
-            dump(sd);
-            return SDHC_ERR_CMD_CONFLICT;
-        }
-        if (ctoe == 0x1 && cce == 0x0) {
-            DEBUG("%s:%d: cto = 1 ccrc = 0: Abort.\n", __FUNCTION__, __LINE__);
-            dump(sd);
-            return SDHC_ERR_CMD_TIMEOUT;
-        }
-
-        if (i++ > 1000) {
-            dump(sd);
-            USER_PANIC("Command not Ackd?");
-        }
-        barrelfish_usleep(100);
-        if(tc || cc) break;
-    } while (true);
-    DEBUG("Command complete!\n");
+    return SYS_ERR_OK;
+}
 
+static void sdhc_read_response(struct sdhc_s * sd, struct cmd * cmd) {
     if(cmd->resp_type & MMC_RSP_136){
         uint32_t r0 = sdhc_cmd_rsp0_rd(&sd->dev);
         uint32_t r1 = sdhc_cmd_rsp1_rd(&sd->dev);
@@ -300,6 +470,23 @@ static errval_t sdhc_send_cmd(struct sdhc_s * sd, struct cmd * cmd) {
     } else {
         cmd->response[0] = sdhc_cmd_rsp0_rd(&sd->dev);
     }
+}
+
+static errval_t sdhc_send_cmd(struct sdhc_s * sd, struct cmd * cmd) {
+    errval_t err;
+
+    err = sdhc_issue_cmd(sd, cmd);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    err = sdhc_wait_complete(sd, is_data_cmd(cmd));
+    if (err_is_fail(err)) {
+        return err;
+    }
+    DEBUG("Command complete!\n");
+
+    sdhc_read_response(sd, cmd);
     return SYS_ERR_OK;
 }
 
@@ -464,13 +651,8 @@ static errval_t sdhc_card_init(struct sdhc_s* sd){
         return err;
     }      
 
-    return SYS_ERR_OK;
-}
-
-errval_t sdhc_read_block(struct sdhc_s* sd, int index, lpaddr_t dest)
-{
-    errval_t err;
-
+    // High capacity cards have a fixed block length, others keep it until
+    // the next power cycle, so it is set once here
     struct cmd set_blocklen = {
         .cmdidx = MMC_CMD_SET_BLOCKLEN,
         .cmdarg = SDHC_BLOCK_SIZE,
@@ -482,52 +664,226 @@ errval_t sdhc_read_block(struct sdhc_s* sd, int index, lpaddr_t dest)
         return err;
     }
 
-    struct cmd read_block = {
-        .cmdidx = MMC_CMD_READ_SINGLE_BLOCK,
-        .cmdarg = index,
-        .resp_type = MMC_RSP_R1,
-        .dma_base = dest
+    return SYS_ERR_OK;
+}
 
-    };
-    err = sdhc_send_cmd(sd, &read_block);
-    if(err_is_fail(err)){
-        DEBUG_ERR(err, "read_block");
-        return err;
+/**
+ * \brief Describes the buffers of a chain of requests in the ADMA2 table
+ */
+static void adma_fill(struct sdhc_s *sd, struct sdhc_req *reqs)
+{
+    size_t n = 0;
+
+    for (struct sdhc_req *r = reqs; r != NULL; r = r->next) {
+        lpaddr_t addr = r->buf;
+        size_t left = (size_t)r->count * SDHC_BLOCK_SIZE;
+
+        while (left > 0) {
+            size_t len = MIN(left, ADMA2_MAX_LEN);
+            assert(n < sd->adma_entries);
+            assert((addr >> 32) == 0 && (addr & 0x3) == 0);
+
+            sd->adma[n].attr = ADMA2_VALID | ADMA2_ACT_TRAN;
+            sd->adma[n].len = len;
+            sd->adma[n].addr = addr;
+            addr += len;
+            left -= len;
+            n++;
+        }
     }
 
-    return SYS_ERR_OK;
+    assert(n > 0);
+    sd->adma[n - 1].attr |= ADMA2_END;
 }
 
-errval_t sdhc_write_block(struct sdhc_s* sd, int index, lpaddr_t source){
+/**
+ * \brief Runs the done callbacks of the requests of the finished command
+ */
+static void complete_active(struct sdhc_s *sd, errval_t err)
+{
+    struct sdhc_req *r = sd->active;
+    sd->active = NULL;
+
+    while (r != NULL) {
+        // The callback may reuse the request
+        struct sdhc_req *next = r->next;
+        r->next = NULL;
+        if (r->done != NULL) {
+            r->done(r, err);
+        }
+        r = next;
+    }
+}
+
+/**
+ * \brief Starts a command for the head of the queue and every following
+ *        request that continues it on the card.
+ */
+static errval_t start_next(struct sdhc_s *sd)
+{
     errval_t err;
+    struct sdhc_req *first = sd->queue_head;
+    struct sdhc_req *last = first;
+    uint32_t count = first->count;
+
+    while (last->next != NULL && last->next->write == first->write
+           && last->next->lba == last->lba + last->count
+           && count + last->next->count <= SDHC_MAX_BLOCKS) {
+        last = last->next;
+        count += last->count;
+    }
 
-    struct cmd set_blocklen = {
-        .cmdidx = MMC_CMD_SET_BLOCKLEN,
-        .cmdarg = SDHC_BLOCK_SIZE,
-        .resp_type = MMC_RSP_R1
-    };
-    err = sdhc_send_cmd(sd, &set_blocklen);
-    if(err_is_fail(err)){
-        DEBUG_ERR(err, "set_blocklen");
-        return err;
+    sd->queue_head = last->next;
+    if (sd->queue_head == NULL) {
+        sd->queue_tail = NULL;
     }
+    last->next = NULL;
+    sd->active = first;
 
-    struct cmd write_block = {
-        .cmdidx = MMC_CMD_WRITE_SINGLE_BLOCK,
-        .cmdarg = index,
-        .resp_type = MMC_RSP_R1,
-        .dma_base = source 
+    adma_fill(sd, first);
 
+    struct cmd xfer = {
+        .cmdarg = first->lba,
+        .resp_type = MMC_RSP_R1,
+        .blkcnt = count
     };
-    err = sdhc_send_cmd(sd, &write_block);
-    if(err_is_fail(err)){
-        DEBUG_ERR(err, "read_block");
+    if (first->write) {
+        xfer.cmdidx = count > 1 ? MMC_CMD_WRITE_MULTIPLE_BLOCK : MMC_CMD_WRITE_SINGLE_BLOCK;
+    } else {
+        xfer.cmdidx = count > 1 ? MMC_CMD_READ_MULTIPLE_BLOCK : MMC_CMD_READ_SINGLE_BLOCK;
+    }
+
+    sd->active_deadline = systime_now() + us_to_systime(SDHC_DATA_TIMEOUT_US);
+    err = sdhc_issue_cmd(sd, &xfer);
+    if (err_is_fail(err)) {
+        complete_active(sd, err);
         return err;
     }
 
     return SYS_ERR_OK;
 }
 
+errval_t sdhc_submit(struct sdhc_s* sd, struct sdhc_req *req)
+{
+    if (req->count == 0 || req->count > SDHC_MAX_BLOCKS) {
+        return SDHC_ERR_REQ_SIZE;
+    }
+
+    req->next = NULL;
+    if (sd->queue_tail != NULL) {
+        sd->queue_tail->next = req;
+    } else {
+        sd->queue_head = req;
+    }
+    sd->queue_tail = req;
+
+    return SYS_ERR_OK;
+}
+
+errval_t sdhc_poll(struct sdhc_s* sd)
+{
+    errval_t err = SYS_ERR_OK;
+
+    if (sd->active != NULL) {
+        bool done;
+        err = sdhc_check_complete(sd, true, &done);
+        if (err_is_ok(err) && !done) {
+            if (systime_now() <= sd->active_deadline) {
+                return SYS_ERR_OK;
+            }
+            dump(sd);
+            sdhc_reset_lines(sd, true);
+            err = SDHC_ERR_DATA_TIMEOUT;
+        }
+        complete_active(sd, err);
+    }
+
+    if (sd->active == NULL && sd->queue_head != NULL) {
+        errval_t start_err = start_next(sd);
+        if (err_is_ok(err)) {
+            err = start_err;
+        }
+    }
+
+    return err;
+}
+
+errval_t sdhc_flush(struct sdhc_s* sd)
+{
+    errval_t ret = SYS_ERR_OK;
+    size_t polls = 0;
+
+    while (sd->active != NULL || sd->queue_head != NULL) {
+        errval_t err = sdhc_poll(sd);
+        if (err_is_fail(err) && err_is_ok(ret)) {
+            ret = err;
+        }
+        if (++polls > SDHC_POLL_SPIN) {
+            thread_yield();
+        }
+    }
+
+    return ret;
+}
+
+static void sync_done(struct sdhc_req *req, errval_t err)
+{
+    *(errval_t *)req->arg = err;
+}
+
+static errval_t sdhc_transfer(struct sdhc_s* sd, uint32_t lba, size_t count,
+                              lpaddr_t buf, bool write)
+{
+    errval_t err;
+
+    while (count > 0) {
+        errval_t result = SYS_ERR_OK;
+        struct sdhc_req req = {
+            .lba = lba,
+            .count = MIN(count, SDHC_MAX_BLOCKS),
+            .buf = buf,
+            .write = write,
+            .done = sync_done,
+            .arg = &result
+        };
+
+        err = sdhc_submit(sd, &req);
+        if (err_is_fail(err)) {
+            return err;
+        }
+        sdhc_flush(sd);
+        if (err_is_fail(result)) {
+            DEBUG_ERR(result, write ? "write_blocks" : "read_blocks");
+            return result;
+        }
+
+        lba += req.count;
+        buf += req.count * SDHC_BLOCK_SIZE;
+        count -= req.count;
+    }
+
+    return SYS_ERR_OK;
+}
+
+errval_t sdhc_read_blocks(struct sdhc_s* sd, uint32_t lba, size_t count, lpaddr_t dest)
+{
+    return sdhc_transfer(sd, lba, count, dest, false);
+}
+
+errval_t sdhc_write_blocks(struct sdhc_s* sd, uint32_t lba, size_t count, lpaddr_t source)
+{
+    return sdhc_transfer(sd, lba, count, source, true);
+}
+
+errval_t sdhc_read_block(struct sdhc_s* sd, int index, lpaddr_t dest)
+{
+    return sdhc_transfer(sd, index, 1, dest, false);
+}
+
+errval_t sdhc_write_block(struct sdhc_s* sd, int index, lpaddr_t source){
+    return sdhc_transfer(sd, index, 1, source, true);
+}
+
 static errval_t card_init(struct sdhc_s * sd){
     //Initialize and identify the card. Roughly following SDHC specification,
     //3.6 Card Initialization and Identification.
@@ -603,6 +959,21 @@ errval_t sdhc_init(struct sdhc_s** sd_ret, void *base)
     }
     DEBUG("reset done.\n");
 
+    if (!sdhc_host_ctrl_cap_admas_rdf(&sd->dev)) {
+        return SDHC_ERR_NO_ADMA;
+    }
+
+    struct capref adma_cap;
+    size_t retbytes;
+    err = frame_alloc_and_map_flags(&adma_cap, BASE_PAGE_SIZE, &retbytes,
+                                    (void **)&sd->adma, VREGION_FLAGS_READ_WRITE_NOCACHE);
+    if (err_is_fail(err)) {
+       DEBUG_ERR(err, "adma table alloc failed");
+       return err;
+    }
+    sd->adma_p = get_phys_addr(adma_cap);
+    sd->adma_entries = retbytes / sizeof(struct adma2_desc);
+
     err = card_init(sd);
     if (err_is_fail(err)) {
        DEBUG_ERR(err, "card init failed (No card present?)");
@@ -25,11 +25,10 @@ int main(int argc, char **argv) {
 
     struct udp_msg *in = malloc(sizeof(struct udp_msg) + 2048 * sizeof(char));
     while (1) {
-        err = aos_socket_receive(&sock, in);
-
+        err = aos_socket_receive_blocking(&sock, in);
         if (err_is_fail(err)) {
-            thread_yield();
-            continue;
+            DEBUG_ERR(err, "unable to receive");
+            break;
         }
 
         // printf("received message:\n%s", in->data);
@@ -0,0 +1,311 @@
+/**
+ * \file
+ * \brief fatfs read and path lookup benchmark
+ *
+ * Needs the sdcard, so init has to start it in place of the filesystemserver
+ * (build init with FS_SERVER_MODULE set to "fatfs_bench"). A test file and a
+ * directory tree of DEPTH levels are created on the card on the first run.
+ * Every measurement is done with the block cache disabled and enabled and
+ * prints one of
+ *
+ *   `fatfs_seq,cache_blocks,bytes,MB/s`
+ *   `fatfs_rand,cache_blocks,reads,MB/s`
+ *   `fatfs_resolve,cache_blocks,depth,first[us],mean[us]`
+ *
+ * where the resolve numbers are for opening the file at the bottom of the tree.
+ * Before that, the raw single block performance of the driver is measured on
+ * SDHC_TEST_BLOCK (writes store back what was read) and printed as
+ *
+ *   `sdhc_iops,read|write,ops,IOPS`
+ */
+
+/*
+ * Copyright (c) 2019, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aos/aos.h>
+#include <aos/aos_rpc.h>
+#include <aos/systime.h>
+#include <aos/default_interfaces.h>
+#include <fs/fs.h>
+#include <fs/fatfs.h>
+
+#define FILE_PATH "/sdcard/FBENCH.DAT"
+#define FILE_SIZE (256 * 1024)
+#define TREE_ROOT "/sdcard/FBTREE"
+#define DEPTH 8
+#define LEAF_NAME "LEAF.TXT"
+
+#define RAND_READS 256
+#define RESOLVE_ROUNDS 32
+#define READ_CHUNK 4096
+#define IOPS_ROUNDS 256
+
+static const size_t cache_sizes[] = { 0, FATFS_CACHE_DEFAULT_BLOCKS };
+
+static char buf[READ_CHUNK];
+static char leaf_path[256];
+
+static errval_t prepare_file(fatfs_mount_t mount)
+{
+    errval_t err;
+    fatfs_handle_t fh;
+    struct fs_fileinfo info;
+
+    err = fatfs_open(mount, FILE_PATH, &fh);
+    if (err_is_ok(err)) {
+        err = fatfs_stat(mount, fh, &info);
+        fatfs_close(mount, fh);
+        ON_ERR_RETURN(err);
+        if (info.size == FILE_SIZE) {
+            return SYS_ERR_OK;
+        }
+        err = fatfs_remove(mount, FILE_PATH);
+        ON_ERR_RETURN(err);
+    }
+
+    err = fatfs_create(mount, FILE_PATH, &fh);
+    ON_ERR_RETURN(err);
+
+    size_t written = 0;
+    while (written < FILE_SIZE) {
+        for (int i = 0; i < sizeof(buf); i++) {
+            buf[i] = (char)(written + i);
+        }
+
+        size_t chunk = MIN(sizeof(buf), FILE_SIZE - written);
+        size_t off = 0;
+        while (off < chunk) {
+            size_t ret;
+            err = fatfs_write(mount, fh, buf + off, chunk - off, &ret);
+            if (err_is_fail(err)) {
+                fatfs_close(mount, fh);
+                return err;
+            }
+            off += ret;
+        }
+        written += chunk;
+    }
+
+    fatfs_close(mount, fh);
+    return SYS_ERR_OK;
+}
+
+static errval_t prepare_tree(fatfs_mount_t mount)
+{
+    errval_t err;
+    fatfs_handle_t fh;
+
+    snprintf(leaf_path, sizeof(leaf_path), "%s", TREE_ROOT);
+    err = fatfs_mkdir(mount, leaf_path);
+    if (err_is_fail(err) && err_no(err) != FS_ERR_EXISTS) {
+        return err;
+    }
+
+    for (int d = 1; d <= DEPTH; d++) {
+        size_t len = strlen(leaf_path);
+        snprintf(leaf_path + len, sizeof(leaf_path) - len, "/L%d", d);
+        err = fatfs_mkdir(mount, leaf_path);
+        if (err_is_fail(err) && err_no(err) != FS_ERR_EXISTS) {
+            return err;
+        }
+    }
+
+    size_t len = strlen(leaf_path);
+    snprintf(leaf_path + len, sizeof(leaf_path) - len, "/%s", LEAF_NAME);
+    err = fatfs_create(mount, leaf_path, &fh);
+    if (err_is_ok(err)) {
+        fatfs_close(mount, fh);
+    } else if (err_no(err) != FS_ERR_EXISTS) {
+        return err;
+    }
+
+    return SYS_ERR_OK;
+}
+
+/// throughput in kB/s, printed as MB/s with three decimals
+static uint64_t kbps(size_t bytes, systime_t t)
+{
+    uint64_t us = systime_to_us(t);
+    return us ? (uint64_t)bytes * 1000 / us : 0;
+}
+
+static errval_t bench_sequential(fatfs_mount_t mount, size_t cache_blocks)
+{
+    errval_t err;
+    fatfs_handle_t fh;
+
+    err = fatfs_open(mount, FILE_PATH, &fh);
+    ON_ERR_RETURN(err);
+
+    size_t total = 0;
+    systime_t start = systime_now();
+    while (total < FILE_SIZE) {
+        size_t ret;
+        err = fatfs_read(mount, fh, buf, sizeof(buf), &ret);
+        if (err_is_fail(err) || ret == 0) {
+            break;
+        }
+        total += ret;
+    }
+    systime_t end = systime_now();
+    fatfs_close(mount, fh);
+    ON_ERR_RETURN(err);
+
+    uint64_t kb = kbps(total, end - start);
+    debug_printf("fatfs_seq,%zu,%zu,%lu.%03lu\n", cache_blocks, total, kb / 1000, kb % 1000);
+    return SYS_ERR_OK;
+}
+
+static errval_t bench_random(fatfs_mount_t mount, size_t cache_blocks)
+{
+    errval_t err;
+    fatfs_handle_t fh;
+    uint32_t seed = 42;
+
+    err = fatfs_open(mount, FILE_PATH, &fh);
+    ON_ERR_RETURN(err);
+
+    size_t total = 0;
+    systime_t start = systime_now();
+    for (int i = 0; i < RAND_READS; i++) {
+        seed = seed * 1103515245 + 12345;
+        off_t off = (off_t)((seed >> 8) % (FILE_SIZE / SDHC_BLOCK_SIZE)) * SDHC_BLOCK_SIZE;
+
+        size_t ret;
+        err = fatfs_seek(mount, fh, FS_SEEK_SET, off);
+        if (err_is_fail(err)) {
+            break;
+        }
+        err = fatfs_read(mount, fh, buf, SDHC_BLOCK_SIZE, &ret);
+        if (err_is_fail(err)) {
+            break;
+        }
+        total += ret;
+    }
+    systime_t end = systime_now();
+    fatfs_close(mount, fh);
+    ON_ERR_RETURN(err);
+
+    uint64_t kb = kbps(total, end - start);
+    debug_printf("fatfs_rand,%zu,%d,%lu.%03lu\n", cache_blocks, RAND_READS, kb / 1000, kb % 1000);
+    return SYS_ERR_OK;
+}
+
+static errval_t bench_resolve(fatfs_mount_t mount, size_t cache_blocks)
+{
+    errval_t err;
+    fatfs_handle_t fh;
+    systime_t first = 0, sum = 0;
+
+    for (int i = 0; i < RESOLVE_ROUNDS; i++) {
+        systime_t start = systime_now();
+        err = fatfs_open(mount, leaf_path, &fh);
+        systime_t t = systime_now() - start;
+        ON_ERR_RETURN(err);
+        fatfs_close(mount, fh);
+
+        if (i == 0) {
+            first = t;
+        }
+        sum += t;
+    }
+
+    debug_printf("fatfs_resolve,%zu,%d,%lu,%lu\n", cache_blocks, DEPTH,
+                 systime_to_us(first), systime_to_us(sum) / RESOLVE_ROUNDS);
+    return SYS_ERR_OK;
+}
+
+static errval_t bench_iops(fatfs_mount_t st)
+{
+    struct fatfs_mount *mount = st;
+    errval_t err;
+    struct capref frame;
+    void *va;
+    size_t retbytes;
+
+    err = frame_alloc_and_map_flags(&frame, SDHC_BLOCK_SIZE, &retbytes, &va,
+                                    VREGION_FLAGS_READ_WRITE_NOCACHE);
+    ON_ERR_RETURN(err);
+    lpaddr_t pa = get_phys_addr(frame);
+
+    for (int write = 0; write <= 1 && err_is_ok(err); write++) {
+        systime_t start = systime_now();
+        for (int i = 0; i < IOPS_ROUNDS; i++) {
+            if (write) {
+                err = sdhc_write_block(mount->ds, SDHC_TEST_BLOCK, pa);
+            } else {
+                err = sdhc_read_block(mount->ds, SDHC_TEST_BLOCK, pa);
+            }
+            if (err_is_fail(err)) {
+                break;
+            }
+        }
+        if (err_is_ok(err)) {
+            uint64_t us = systime_to_us(systime_now() - start);
+            debug_printf("sdhc_iops,%s,%d,%lu\n", write ? "write" : "read", IOPS_ROUNDS,
+                         us ? (uint64_t)IOPS_ROUNDS * 1000000 / us : 0);
+        }
+    }
+
+    // NOTE: unmapping is not supported, the mapping stays unused
+    cap_destroy(frame);
+    return err;
+}
+
+static errval_t run(void)
+{
+    errval_t err;
+    fatfs_mount_t mount;
+
+    err = fatfs_mount("/sdcard", &mount);
+    ON_ERR_RETURN(err);
+
+    err = bench_iops(mount);
+    ON_ERR_RETURN(err);
+
+    err = prepare_file(mount);
+    ON_ERR_PUSH_RETURN(err, FS_ERR_WRITE);
+    err = prepare_tree(mount);
+    ON_ERR_PUSH_RETURN(err, FS_ERR_WRITE);
+    err = fatfs_sync(mount);
+    ON_ERR_RETURN(err);
+
+    for (size_t c = 0; c < sizeof(cache_sizes) / sizeof(cache_sizes[0]); c++) {
+        // Starts every run with an empty cache
+        err = fatfs_set_cache_size(mount, cache_sizes[c]);
+        ON_ERR_RETURN(err);
+
+        err = bench_resolve(mount, cache_sizes[c]);
+        ON_ERR_RETURN(err);
+        err = bench_sequential(mount, cache_sizes[c]);
+        ON_ERR_RETURN(err);
+        err = bench_random(mount, cache_sizes[c]);
+        ON_ERR_RETURN(err);
+
+        fatfs_print_cache_stats(mount);
+    }
+
+    return SYS_ERR_OK;
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err = run();
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "fatfs benchmark failed");
+    }
+
+    // init waits for the filesystem before it continues booting
+    aos_rpc_call(get_init_rpc(), INIT_FS_ON);
+    return err_is_ok(err) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
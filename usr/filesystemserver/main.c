@@ -21,90 +21,280 @@
 #include <aos/aos_rpc.h>
 #include <aos/nameserver.h>
 #include <aos/fs_service.h>
+#include <fs/fatfs.h>
 
 #include <aos/default_interfaces.h>
 
 
-__unused
-static void file_read(char *path, size_t size, char **ret)
+/// an open file or directory
+struct fs_session {
+    bool used;
+    bool dir;
+    bool dirty;                     ///< written, sync on close
+    uint32_t gen;                   ///< distinguishes reuses of the slot
+    fatfs_handle_t fh;
+    char *pending;                  ///< entry read by readdir that didn't fit
+    struct fs_fileinfo pending_info;
+};
+
+static fatfs_mount_t mount;
+static struct fs_session sessions[FS_SERVICE_MAX_HANDLES];
+
+/// responses are built here, they are sent before the next request is handled
+static uint64_t response_buf[MAX_SERVER_MESSAGE_SIZE / sizeof(uint64_t)];
+
+static errval_t session_alloc(struct fs_session **ret, fs_service_handle_t *handle)
 {
-    FILE *f = fopen(path, "r");
-    if (f == NULL) {
-        debug_printf("Error: file not found\n");
-        return;
+    for (size_t i = 0; i < FS_SERVICE_MAX_HANDLES; i++) {
+        if (!sessions[i].used) {
+            struct fs_session *s = &sessions[i];
+            s->used = true;
+            s->dir = false;
+            s->dirty = false;
+            s->gen++;
+            s->fh = NULL;
+            s->pending = NULL;
+            *ret = s;
+            *handle = ((uint64_t)s->gen << 32) | i;
+            return SYS_ERR_OK;
+        }
     }
-    //debug_printf(">>>> |%s|%zu\n", path, size);
-    char *content = calloc(1, size);
-    //debug_printf("CALLING READ\n");
-    fread(content, 1, size, f);
-    //debug_printf(">>>> |%s|%zu|\n", content, strlen(content));
-    content[size+1] = '\0';
-    fclose(f);
-    *ret = content;
+    return FS_ERR_HANDLE_LIMIT;
 }
 
-
-__unused
-static void file_write(char *path, char *buffer, size_t size)
+static errval_t session_get(fs_service_handle_t handle, bool dir, struct fs_session **ret)
 {
-    FILE *f = fopen(path, "w");
-    if (f == NULL) {
-        debug_printf("Error: file not found\n");
-        return;
+    uint32_t i = handle & 0xffffffff;
+    if (i >= FS_SERVICE_MAX_HANDLES || !sessions[i].used || sessions[i].gen != handle >> 32) {
+        return FS_ERR_INVALID_FH;
     }
-
-    fwrite(buffer, 1, size, f);
-    fclose(f);
+    if (sessions[i].dir != dir) {
+        return dir ? FS_ERR_NOTDIR : FS_ERR_NOTFILE;
+    }
+    *ret = &sessions[i];
+    return SYS_ERR_OK;
 }
 
-__unused
-static void file_delete(char *path)
+static errval_t handle_open(struct fs_service_message *msg, const char *path,
+                            struct fs_service_response *resp)
 {
-    rm(path);
+    errval_t err;
+    fatfs_handle_t fh;
+    fs_service_handle_t handle;
+    bool created = false;
+
+    err = fatfs_open(mount, path, &fh);
+    if (err_no(err) == FS_ERR_NOTFOUND && (msg->flags & FS_SERVICE_O_CREATE)) {
+        err = fatfs_create(mount, path, &fh);
+        created = true;
+    }
+    ON_ERR_RETURN(err);
+
+    // fatfs_truncate only shrinks files
+    struct fs_fileinfo info;
+    err = fatfs_stat(mount, fh, &info);
+    if (err_is_ok(err) && (msg->flags & FS_SERVICE_O_TRUNC) && info.size > 0) {
+        err = fatfs_truncate(mount, fh, 0);
+    }
+    if (err_is_fail(err)) {
+        fatfs_close(mount, fh);
+        return err;
+    }
+
+    struct fs_session *s;
+    err = session_alloc(&s, &handle);
+    if (err_is_fail(err)) {
+        fatfs_close(mount, fh);
+        return err;
+    }
+    s->fh = fh;
+    s->dirty = created || (msg->flags & FS_SERVICE_O_TRUNC);
+    resp->handle = handle;
+    return SYS_ERR_OK;
 }
 
-__unused
-static void dir_read(char *path, char **ret)
+static errval_t handle_opendir(const char *path, struct fs_service_response *resp)
 {
     errval_t err;
-    fs_dirhandle_t dh;
-    err = opendir(path, &dh);
+    fatfs_handle_t fh;
+    fs_service_handle_t handle;
+
+    err = fatfs_opendir(mount, path, &fh);
+    ON_ERR_RETURN(err);
+
+    struct fs_session *s;
+    err = session_alloc(&s, &handle);
     if (err_is_fail(err)) {
-        return;
+        fatfs_closedir(mount, fh);
+        return err;
     }
+    s->fh = fh;
+    s->dir = true;
+    resp->handle = handle;
+    return SYS_ERR_OK;
+}
 
-    assert(dh);
+static errval_t handle_close(fs_service_handle_t handle)
+{
+    errval_t err;
+    struct fs_session *s;
 
-    char *str = calloc(1, 1000);
-    str[0] = '\0';
+    err = session_get(handle, false, &s);
+    if (err_no(err) == FS_ERR_NOTFILE) {
+        err = session_get(handle, true, &s);
+    }
+    ON_ERR_RETURN(err);
 
-    do {
-        char *name;
-        err = readdir(dh, &name);
-        if (err_no(err) == FS_ERR_INDEX_BOUNDS) {
-            break;
-        } else if (err_is_fail(err)) {
-            closedir(dh);
-            return;
+    if (s->dir) {
+        free(s->pending);
+        err = fatfs_closedir(mount, s->fh);
+    } else {
+        err = fatfs_close(mount, s->fh);
+        if (s->dirty && err_is_ok(err)) {
+            err = filesystem_sync();
         }
-        strcat(str, name);
-        strcat(str, "\n");
-    } while(err_is_ok(err));
-    closedir(dh);
+    }
+    s->used = false;
+    return err;
+}
 
-    *ret = str;
+static errval_t handle_read(struct fs_service_message *msg, struct fs_service_response *resp)
+{
+    errval_t err;
+    struct fs_session *s;
+
+    err = session_get(msg->handle, false, &s);
+    ON_ERR_RETURN(err);
+
+    // FAT file sizes are 32 bit
+    if (msg->offset > UINT32_MAX) {
+        return FS_ERR_INDEX_BOUNDS;
+    }
+
+    err = fatfs_seek(mount, s->fh, FS_SEEK_SET, msg->offset);
+    ON_ERR_RETURN(err);
+
+    size_t bytes;
+    err = fatfs_read(mount, s->fh, resp->data, MIN(msg->size, FS_SERVICE_CHUNK_SIZE), &bytes);
+    ON_ERR_RETURN(err);
+
+    resp->size = bytes;
+    return SYS_ERR_OK;
 }
 
-__unused
-static void dir_create(char *path)
+static errval_t handle_write(struct fs_service_message *msg, struct fs_service_response *resp)
+{
+    errval_t err;
+    struct fs_session *s;
+
+    err = session_get(msg->handle, false, &s);
+    ON_ERR_RETURN(err);
+
+    // FAT file sizes are 32 bit
+    if (msg->offset > UINT32_MAX) {
+        return FS_ERR_INDEX_BOUNDS;
+    }
+
+    err = fatfs_seek(mount, s->fh, FS_SEEK_SET, msg->offset);
+    ON_ERR_RETURN(err);
+
+    size_t bytes;
+    err = fatfs_write(mount, s->fh, msg->data, msg->size, &bytes);
+    ON_ERR_RETURN(err);
+
+    s->dirty = true;
+    resp->size = bytes;
+    return SYS_ERR_OK;
+}
+
+static errval_t handle_stat(struct fs_service_message *msg, struct fs_service_response *resp)
 {
-    mkdir(path);
+    errval_t err;
+    struct fs_session *s;
+
+    err = session_get(msg->handle, false, &s);
+    if (err_no(err) == FS_ERR_NOTFILE) {
+        err = session_get(msg->handle, true, &s);
+    }
+    ON_ERR_RETURN(err);
+
+    struct fs_fileinfo info;
+    err = fatfs_stat(mount, s->fh, &info);
+    ON_ERR_RETURN(err);
+
+    resp->type = info.type;
+    resp->size = info.size;
+    return SYS_ERR_OK;
 }
 
-__unused
-static void dir_delete(char *path)
+/// fills the response with as many directory entries as fit
+static errval_t handle_readdir(struct fs_service_message *msg, struct fs_service_response *resp,
+                               size_t *data_bytes)
 {
-    rmdir(path);
+    errval_t err;
+    struct fs_session *s;
+
+    err = session_get(msg->handle, true, &s);
+    ON_ERR_RETURN(err);
+
+    size_t used = 0;
+    while (true) {
+        char *name = s->pending;
+        struct fs_fileinfo info = s->pending_info;
+        s->pending = NULL;
+        if (name == NULL) {
+            err = fatfs_dir_read_next(mount, s->fh, &name, &info);
+            if (err_no(err) == FS_ERR_INDEX_BOUNDS) {
+                break;
+            }
+            ON_ERR_RETURN(err);
+        }
+
+        size_t name_len = strlen(name) + 1;
+        size_t rec = sizeof(struct fs_service_dirent) + name_len;
+        if (used + rec > FS_SERVICE_CHUNK_SIZE) {
+            // send it with the next batch
+            s->pending = name;
+            s->pending_info = info;
+            break;
+        }
+
+        struct fs_service_dirent *de = (struct fs_service_dirent *)(resp->data + used);
+        de->type = info.type;
+        de->size = info.size;
+        de->name_len = name_len;
+        memcpy(de->name, name, name_len);
+        free(name);
+
+        used += rec;
+        resp->count++;
+    }
+
+    *data_bytes = used;
+    return SYS_ERR_OK;
+}
+
+/// runs a modifying path operation and writes the result to the card
+static errval_t handle_path_op(enum fs_service_messagetype type, const char *path)
+{
+    errval_t err;
+
+    switch (type) {
+    case FS_MSG_REMOVE:
+        err = fatfs_remove(mount, path);
+        break;
+    case FS_MSG_MKDIR:
+        err = fatfs_mkdir(mount, path);
+        break;
+    case FS_MSG_RMDIR:
+        err = fatfs_rmdir(mount, path);
+        break;
+    default:
+        return FS_ERR_BAD_REQUEST;
+    }
+    ON_ERR_RETURN(err);
+
+    return filesystem_sync();
 }
 
 __unused
@@ -135,56 +325,76 @@ static void server_recv_handler(void *stptr, void *message,
                                 void **response, size_t *response_bytes,
                                 struct capref rx_cap, struct capref *tx_cap)
 {
-    //debug_printf(">> START CALLEE\n");
-    struct fs_service_message *fsm = (struct fs_service_message *) message;
-
-    size_t path_size = fsm->path_size;
-    size_t data_size = fsm->data_size;
-
-    char path[path_size + 1];
-    memcpy(path, fsm->data, path_size);
-    path[path_size] = '\0';
-    *response_bytes = 0;
-    //debug_printf(">> GOT TYPE: %d\n", fsm->type);
-    switch (fsm->type) {
-    case F_READ: {
-        //debug_printf(">> GOT HERE\n");
-        file_read(path, data_size, (char **) response);
-        *response_bytes = strlen(*response);
-        break;
+    errval_t err;
+    struct fs_service_message *msg = message;
+    struct fs_service_response *resp = (struct fs_service_response *)response_buf;
+    size_t data_bytes = 0;
+
+    memset(resp, 0, sizeof(*resp));
+    *response = resp;
+
+    if (bytes < sizeof(*msg)) {
+        resp->err = FS_ERR_BAD_REQUEST;
+        *response_bytes = sizeof(*resp);
+        return;
     }
-    case F_WRITE: {
-        char data[data_size + 1];
-        data[data_size] = '\0';
-        memcpy(data, fsm->data + path_size, data_size);
-        file_write(path, data, data_size);
-        break;
+
+    // the path, or the data of a write, follows the header
+    size_t payload = bytes - sizeof(*msg);
+    bool has_path = msg->type == FS_MSG_OPEN || msg->type == FS_MSG_OPENDIR ||
+                    msg->type == FS_MSG_REMOVE || msg->type == FS_MSG_MKDIR ||
+                    msg->type == FS_MSG_RMDIR || msg->type == FS_MSG_SPAWN_ELF;
+    if ((has_path || msg->type == FS_MSG_WRITE) && msg->size > payload) {
+        resp->err = FS_ERR_BAD_REQUEST;
+        *response_bytes = sizeof(*resp);
+        return;
     }
-    case F_RM: {
-        file_delete(path);
-        break;
+
+    char path[has_path ? msg->size + 1 : 1];
+    if (has_path) {
+        memcpy(path, msg->data, msg->size);
     }
-    case D_READ: {
-        dir_read(path, (char **) response);
-        *response_bytes = strlen(*response);
+    path[has_path ? msg->size : 0] = '\0';
+
+    switch (msg->type) {
+    case FS_MSG_OPEN:
+        err = handle_open(msg, path, resp);
         break;
-    }
-    case D_MKDIR: {
-        dir_create(path);
+    case FS_MSG_OPENDIR:
+        err = handle_opendir(path, resp);
         break;
-    }
-    case D_RM: {
-        dir_delete(path);
+    case FS_MSG_CLOSE:
+        err = handle_close(msg->handle);
         break;
-    }
-    case SPAWN_ELF: {
+    case FS_MSG_READ:
+        err = handle_read(msg, resp);
+        data_bytes = resp->size;
+        break;
+    case FS_MSG_WRITE:
+        err = handle_write(msg, resp);
+        break;
+    case FS_MSG_STAT:
+        err = handle_stat(msg, resp);
+        break;
+    case FS_MSG_READDIR:
+        err = handle_readdir(msg, resp, &data_bytes);
+        break;
+    case FS_MSG_REMOVE:
+    case FS_MSG_MKDIR:
+    case FS_MSG_RMDIR:
+        err = handle_path_op(msg->type, path);
+        break;
+    case FS_MSG_SPAWN_ELF:
         elf_file_spawn(path);
+        err = SYS_ERR_OK;
         break;
-    }
     default:
+        err = FS_ERR_BAD_REQUEST;
         break;
     }
-    //debug_printf(">> END CALLEE\n");
+
+    resp->err = err;
+    *response_bytes = sizeof(*resp) + (err_is_ok(err) ? data_bytes : 0);
 }
 
 int main(int argc, char *argv[])
@@ -199,6 +409,7 @@ int main(int argc, char *argv[])
         DEBUG_ERR(SDHC_ERR_TEST_FAILED, "SDHC INIT FAILED");
         return EXIT_FAILURE;
     }
+    mount = filesystem_get_mount();
     debug_printf(">> LINK FS NAMESERVER\n");
     // NAMESERVER LINK
     err = nameservice_register_properties("/fs", server_recv_handler, NULL, true,"type=fs");
@@ -59,6 +59,9 @@
 
 coreid_t my_core_id;
 
+/// Children every init keeps prepared ahead of time, 0 disables the pool
+#define SPAWN_POOL_SIZE 4
+
 
 static errval_t init_foreign_core(void){
     errval_t err;
@@ -152,12 +155,17 @@ static errval_t init_foreign_core(void){
     return SYS_ERR_OK;
 }
 
+/// Module that gets the sdcard, "fatfs_bench" runs the fatfs benchmark instead
+#ifndef FS_SERVER_MODULE
+#define FS_SERVER_MODULE "filesystemserver"
+#endif
+
 __unused
 static errval_t init_filesystemserver(void)
 {
     errval_t err;
     struct spawninfo *fs_si;
-    err = spawn_filesystem("filesystemserver", &fs_si);
+    err = spawn_filesystem(FS_SERVER_MODULE, &fs_si);
     return err;
 }
 
@@ -304,6 +312,11 @@ static int bsp_main(int argc, char *argv[])
     // Grading
     grading_test_late();
 
+    err = spawn_pool_set_size(SPAWN_POOL_SIZE);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "Failed to fill the spawn pool\n");
+    }
+
     // debug_printf("Message handler loop\n");
 
     struct waitset *default_ws = get_default_waitset();
@@ -348,10 +361,11 @@ static int app_main(int argc, char *argv[])
     grading_test_early();
 
     grading_test_late();
-    
-
 
-  
+    err = spawn_pool_set_size(SPAWN_POOL_SIZE);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "Failed to fill the spawn pool\n");
+    }
 
     // Hang around
     struct waitset *default_ws = get_default_waitset();
@@ -4,6 +4,7 @@
  */
 
 #include "mem_alloc.h"
+#include "ram_cache.h"
 #include <mm/mm.h>
 #include <aos/paging.h>
 #include <grading.h>
@@ -15,7 +16,20 @@ struct bootinfo *bi;
 
 errval_t aos_ram_alloc_aligned(struct capref *ret, size_t size, size_t alignment)
 {
-    return mm_alloc_aligned(&aos_mm, size, alignment, ret);
+    errval_t err;
+
+    if (ram_cache_alloc(ret, size, alignment)) {
+        return SYS_ERR_OK;
+    }
+
+    err = mm_alloc_aligned(&aos_mm, size, alignment, ret);
+    if (err_no(err) == LIB_ERR_RAM_ALLOC_FIXED_EXHAUSTED && disp_get_core_id() != 0) {
+        // application cores get more memory from the BSP in large chunks
+        err = ram_cache_request_foreign_chunk();
+        ON_ERR_RETURN(err);
+        err = mm_alloc_aligned(&aos_mm, size, alignment, ret);
+    }
+    return err;
 }
 
 errval_t aos_ram_free(struct capref cap)
@@ -28,6 +42,10 @@ errval_t aos_ram_free(struct capref cap)
         return err;
     }
 
+    if (ram_cache_free(cap, get_address(&c), get_size(&c))) {
+        return SYS_ERR_OK;
+    }
+
     return mm_free(&aos_mm, cap, get_address(&c), get_size(&c));
 }
 
@@ -112,6 +130,9 @@ errval_t initialize_ram_alloc(void)
     // Grading
     grading_test_mm(&aos_mm);
 
+    err = ram_cache_init();
+    ON_ERR_RETURN(err);
+
     return SYS_ERR_OK;
 }
 
@@ -130,7 +151,9 @@ errval_t initialize_ram_alloc_foreign(struct capref cap){
     // ON_ERR_PUSH_RETURN(err, LIB_ERR_RAM_ALLOC_SET);
 
     err = add_foreign_ram_cap(cap);
-    return SYS_ERR_OK;
+    ON_ERR_RETURN(err);
+
+    return ram_cache_init();
 }
 
 errval_t add_foreign_ram_cap(struct capref cap){
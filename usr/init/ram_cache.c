@@ -0,0 +1,271 @@
+/**
+ * \file
+ * \brief Per-core cache of pre-allocated RAM caps in front of the local mm
+ *
+ * Domains on this core request RAM from the memory server thread of init.
+ * For the common sizes (a base page and a large page) we keep a pool of
+ * already retyped RAM caps, so such a request is served by popping a capref
+ * instead of going through mm. The pools are refilled in batches and trimmed
+ * back to mm periodically from the default waitset, i.e. when init is idle.
+ * A pool that has not been used for RAM_CACHE_IDLE_RUNS maintenance runs
+ * returns one batch per run until it is down to its low watermark.
+ * On application cores, mm itself is refilled from the BSP in large chunks
+ * whenever it runs dry.
+ */
+
+#include "ram_cache.h"
+#include "mem_alloc.h"
+#include <mm/mm.h>
+#include <aos/deferred.h>
+#include <aos/default_interfaces.h>
+
+#define RAM_CACHE_MAX_CAPS 256
+
+struct ram_cache_class {
+    size_t size;   ///< Size (and alignment) of the caps in this class
+    size_t low;    ///< Refill when fewer than this many caps are cached
+    size_t high;   ///< Give caps back to mm when more than this are cached
+    size_t batch;  ///< Number of caps moved per refill
+
+    size_t count;  ///< Number of caps currently cached
+    struct capref caps[RAM_CACHE_MAX_CAPS];
+
+    /* statistics */
+    size_t hits;
+    size_t misses;
+    size_t refills;
+    size_t trims;
+    size_t frees;
+
+    size_t last_ops;   ///< hits + misses + frees at the last maintenance run
+    size_t idle_runs;  ///< maintenance runs without any use of the pool
+};
+
+static struct ram_cache_class classes[] = {
+    { .size = BASE_PAGE_SIZE,  .low = 32, .high = 192, .batch = 64 },
+    { .size = LARGE_PAGE_SIZE, .low = 2,  .high = 8,   .batch = 4  },
+};
+
+static struct thread_mutex cache_mutex;
+static struct thread_mutex foreign_mutex;
+static struct periodic_event maintain_event;
+static bool cache_enabled = false;
+
+static struct ram_cache_class *find_class(size_t size, size_t alignment)
+{
+    for (int i = 0; i < ARRAY_LENGTH(classes); i++) {
+        if (classes[i].size == size && alignment <= size) {
+            return &classes[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Allocate RAM from the local mm, asking the BSP for more if an
+ * application core runs out.
+ */
+static errval_t alloc_backing(struct capref *ret, size_t size, size_t alignment)
+{
+    errval_t err = mm_alloc_aligned(&aos_mm, size, alignment, ret);
+    if (err_no(err) == LIB_ERR_RAM_ALLOC_FIXED_EXHAUSTED && disp_get_core_id() != 0) {
+        err = ram_cache_request_foreign_chunk();
+        ON_ERR_RETURN(err);
+        err = mm_alloc_aligned(&aos_mm, size, alignment, ret);
+    }
+    return err;
+}
+
+/**
+ * \brief Bring the pool of one class back between its watermarks.
+ *
+ * The caps are allocated from (or freed to) mm without holding the cache
+ * mutex, so the memory server thread can keep serving hits meanwhile.
+ */
+static void maintain_class(struct ram_cache_class *c)
+{
+    errval_t err;
+    struct capref batch[RAM_CACHE_MAX_CAPS];
+    size_t n = 0;
+
+    thread_mutex_lock(&cache_mutex);
+    size_t ops = c->hits + c->misses + c->frees;
+    if (ops == c->last_ops) {
+        c->idle_runs++;
+    } else {
+        c->idle_runs = 0;
+        c->last_ops = ops;
+    }
+
+    bool refill = cache_enabled && c->count < c->low;
+    size_t target = cache_enabled ? c->high : 0;
+    if (cache_enabled && c->idle_runs >= RAM_CACHE_IDLE_RUNS && c->count > c->low) {
+        // unused for a while, hand back the surplus one batch at a time
+        target = c->count - c->low > c->batch ? c->count - c->batch : c->low;
+    }
+    while (c->count > target) {
+        batch[n++] = c->caps[--c->count];
+    }
+    if (n > 0) {
+        c->trims++;
+    }
+    thread_mutex_unlock(&cache_mutex);
+
+    if (n > 0) {
+        for (size_t i = 0; i < n; i++) {
+            err = mm_free(&aos_mm, batch[i], get_phys_addr(batch[i]), c->size);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "returning cached RAM cap to mm");
+            }
+        }
+        return;
+    }
+
+    if (!refill) {
+        return;
+    }
+
+    for (n = 0; n < c->batch; n++) {
+        err = alloc_backing(&batch[n], c->size, c->size);
+        if (err_is_fail(err)) {
+            break;
+        }
+    }
+
+    thread_mutex_lock(&cache_mutex);
+    size_t i = 0;
+    while (i < n && c->count < RAM_CACHE_MAX_CAPS) {
+        c->caps[c->count++] = batch[i++];
+    }
+    c->refills++;
+    thread_mutex_unlock(&cache_mutex);
+
+    // lost a race against ram_cache_free filling the pool up
+    for (; i < n; i++) {
+        mm_free(&aos_mm, batch[i], get_phys_addr(batch[i]), c->size);
+    }
+}
+
+static void maintain_handler(void *arg)
+{
+    for (int i = 0; i < ARRAY_LENGTH(classes); i++) {
+        maintain_class(&classes[i]);
+    }
+}
+
+/**
+ * \brief Sets up the pools and the periodic maintenance event. Must be called
+ * once the local mm has been initialized.
+ */
+errval_t ram_cache_init(void)
+{
+    thread_mutex_init(&cache_mutex);
+    thread_mutex_init(&foreign_mutex);
+
+    for (int i = 0; i < ARRAY_LENGTH(classes); i++) {
+        assert(classes[i].high <= RAM_CACHE_MAX_CAPS);
+        classes[i].count = 0;
+    }
+    cache_enabled = true;
+
+    return periodic_event_create(&maintain_event, get_default_waitset(),
+                                 RAM_CACHE_MAINTAIN_INTERVAL,
+                                 MKCLOSURE(maintain_handler, NULL));
+}
+
+/**
+ * \brief Try to serve a RAM request from the cache.
+ *
+ * \returns true if `ret` was filled in with a cached cap
+ */
+bool ram_cache_alloc(struct capref *ret, size_t size, size_t alignment)
+{
+    struct ram_cache_class *c = find_class(size, alignment);
+    if (c == NULL) {
+        return false;
+    }
+
+    bool hit = false;
+    thread_mutex_lock(&cache_mutex);
+    if (cache_enabled && c->count > 0) {
+        *ret = c->caps[--c->count];
+        c->hits++;
+        hit = true;
+    } else {
+        c->misses++;
+    }
+    thread_mutex_unlock(&cache_mutex);
+
+    return hit;
+}
+
+/**
+ * \brief Try to put a freed RAM cap back into the cache.
+ *
+ * \returns true if the cache took ownership of `cap`
+ */
+bool ram_cache_free(struct capref cap, genpaddr_t base, size_t size)
+{
+    struct ram_cache_class *c = find_class(size, size);
+    if (c == NULL || base % size != 0) {
+        return false;
+    }
+
+    bool taken = false;
+    thread_mutex_lock(&cache_mutex);
+    if (cache_enabled && c->count < c->high) {
+        c->caps[c->count++] = cap;
+        c->frees++;
+        taken = true;
+    }
+    thread_mutex_unlock(&cache_mutex);
+
+    return taken;
+}
+
+/**
+ * \brief Enable or disable the cache. When disabled, all requests go to mm
+ * and the pools are drained on the next maintenance run.
+ */
+void ram_cache_set_enabled(bool enabled)
+{
+    thread_mutex_lock(&cache_mutex);
+    cache_enabled = enabled;
+    thread_mutex_unlock(&cache_mutex);
+}
+
+void ram_cache_print_stats(void)
+{
+    for (int i = 0; i < ARRAY_LENGTH(classes); i++) {
+        struct ram_cache_class *c = &classes[i];
+        debug_printf("ram cache %zu: %zu cached, %zu hits, %zu misses, "
+                     "%zu frees, %zu refills, %zu trims\n", c->size, c->count,
+                     c->hits, c->misses, c->frees, c->refills, c->trims);
+    }
+}
+
+/**
+ * \brief Request a large chunk of RAM from the BSP and add it to the local mm.
+ */
+errval_t ram_cache_request_foreign_chunk(void)
+{
+    errval_t err;
+
+    struct aos_rpc *bsp_rpc = get_core_channel(0);
+    if (disp_get_core_id() == 0 || bsp_rpc == NULL) {
+        return LIB_ERR_RAM_ALLOC_FIXED_EXHAUSTED;
+    }
+
+    thread_mutex_lock(&foreign_mutex);
+    struct capref chunk;
+    uintptr_t chunk_size;
+    err = aos_rpc_call(bsp_rpc, INIT_IFACE_GET_RAM, RAM_CACHE_FOREIGN_CHUNK,
+                       BASE_PAGE_SIZE, &chunk, &chunk_size);
+    if (err_is_ok(err)) {
+        err = add_foreign_ram_cap(chunk);
+    }
+    thread_mutex_unlock(&foreign_mutex);
+
+    ON_ERR_PUSH_RETURN(err, LIB_ERR_RAM_ALLOC);
+    return SYS_ERR_OK;
+}
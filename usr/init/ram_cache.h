@@ -0,0 +1,28 @@
+/**
+ * \file
+ * \brief Per-core cache of pre-allocated RAM caps in front of the local mm
+ */
+
+#ifndef _INIT_RAM_CACHE_H_
+#define _INIT_RAM_CACHE_H_
+
+#include <aos/aos.h>
+
+/// Size of the RAM regions requested from the BSP when this core runs out
+#define RAM_CACHE_FOREIGN_CHUNK (64UL * 1024 * 1024)
+
+/// Interval in which the pools are refilled/trimmed (us)
+#define RAM_CACHE_MAINTAIN_INTERVAL 10000
+
+/// Maintenance runs without any use after which a pool is trimmed to its low watermark
+#define RAM_CACHE_IDLE_RUNS 100
+
+errval_t ram_cache_init(void);
+bool ram_cache_alloc(struct capref *ret, size_t size, size_t alignment);
+bool ram_cache_free(struct capref cap, genpaddr_t base, size_t size);
+void ram_cache_set_enabled(bool enabled);
+void ram_cache_print_stats(void);
+
+errval_t ram_cache_request_foreign_chunk(void);
+
+#endif /* _INIT_RAM_CACHE_H_ */
@@ -17,6 +17,7 @@
 #include "rpc_server.h"
 #include "spawn_server.h"
 #include "mem_alloc.h"
+#include "ram_cache.h"
 #include "../../lib/aos/include/init.h"
 #include "routing.h"
 
@@ -93,6 +94,8 @@ errval_t start_memory_server_thread(void)
 
     aos_rpc_init_lmp(&memory_server, cap_mmep, NULL_CAP, mm_ep, &mm_waitset);
     aos_rpc_register_handler(&memory_server, MM_IFACE_GET_RAM, handle_request_ram);
+    aos_rpc_register_handler(&memory_server, MM_IFACE_RAM_CACHE_CTL, handle_ram_cache_ctl);
+    aos_rpc_register_handler(&memory_server, MM_IFACE_GET_RAM_BATCH, handle_request_ram_batch);
 
     memory_server.lmp_server_mode = true;
 
@@ -147,6 +150,89 @@ void handle_send_string(struct aos_rpc *r, const char *string) {
     grading_rpc_handler_string(string);
 }
 
+struct ump_bench_sink {
+    struct ump_chan chan;
+    size_t n_msgs;
+    size_t burst;
+};
+
+static int ump_bench_sink_func(void *arg)
+{
+    struct ump_bench_sink *sink = arg;
+    DECLARE_MESSAGES(sink->chan, msgs, UMP_BENCH_MAX_BURST);
+
+    size_t received = 0;
+    while (received < sink->n_msgs) {
+        received += ump_chan_receive_batch(&sink->chan, msgs, sink->burst);
+    }
+
+    DECLARE_MESSAGE(sink->chan, done);
+    done->data[0] = received;
+    while (!ump_chan_send(&sink->chan, done, false));
+
+    free(sink);
+    return 0;
+}
+
+/**
+ * \brief handler function for the ump burst benchmark
+ *
+ * Maps the frame (once, later calls with the same frame reuse the mapping),
+ * sets up a ring channel on it (receiving on the first half)
+ * and starts a thread draining `n_msgs` messages in bursts of up to `burst`,
+ * which then answers with a single message on the second half.
+ */
+void handle_ump_bench(struct aos_rpc *r, struct capref frame, uintptr_t n_msgs,
+                      uintptr_t burst)
+{
+    // the sender reuses its frame for all bursts, so is the mapping
+    static genpaddr_t mapped_base;
+    static void *mapped_buf = NULL;
+    errval_t err;
+
+    struct frame_identity id;
+    err = frame_identify(frame, &id);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "identifying ump benchmark frame");
+        return;
+    }
+
+    void *buf;
+    if (mapped_buf != NULL && id.base == mapped_base) {
+        buf = mapped_buf;
+        // this copy is not needed, the mapped one is kept
+        cap_destroy(frame);
+    } else {
+        // NOTE: unmapping is not supported, a previous mapping stays unused
+        err = paging_map_frame_complete(get_current_paging_state(), &buf, frame, NULL, NULL);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "mapping ump benchmark frame");
+            return;
+        }
+        mapped_base = id.base;
+        mapped_buf = buf;
+    }
+
+    struct ump_bench_sink *sink = malloc(sizeof(struct ump_bench_sink));
+    if (sink == NULL) {
+        DEBUG_ERR(LIB_ERR_MALLOC_FAIL, "ump benchmark sink");
+        return;
+    }
+
+    const size_t half = UMP_BENCH_FRAME_SIZE / 2;
+    ump_chan_init_default(&sink->chan, buf + half, half, buf, half);
+    sink->n_msgs = n_msgs;
+    sink->burst = burst > UMP_BENCH_MAX_BURST ? UMP_BENCH_MAX_BURST : burst;
+
+    struct thread *t = thread_create(ump_bench_sink_func, sink);
+    if (t == NULL) {
+        DEBUG_ERR(LIB_ERR_THREAD_CREATE, "ump benchmark sink");
+        free(sink);
+        return;
+    }
+    thread_detach(t);
+}
+
 /**
  * \brief handler function for putchar rpc call
  */
@@ -178,6 +264,37 @@ void handle_request_ram(struct aos_rpc *r, uintptr_t size, uintptr_t alignment,
     }
 }
 
+/**
+ * \brief handler function for batched ram alloc rpc call
+ *
+ * Hands out `count` blocks of `size` bytes as a single RAM cap, which the
+ * client splits up by retyping. If there is not enough contiguous memory left,
+ * the batch is halved until it fits; `ret_count` holds the number of blocks
+ * actually handed out.
+ */
+void handle_request_ram_batch(struct aos_rpc *r, uintptr_t count, uintptr_t size,
+                              struct capref *cap, uintptr_t *ret_count)
+{
+    errval_t err = LIB_ERR_RAM_ALLOC;
+    *ret_count = 0;
+    for (; count > 0; count /= 2) {
+        err = ram_alloc_aligned(cap, count * size, size);
+        if (err_is_ok(err)) {
+            *ret_count = count;
+            return;
+        }
+    }
+    DEBUG_ERR(err, "Error in batched remote ram allocation!\n");
+}
+
+/**
+ * \brief handler function for enabling/disabling the per-core RAM cache
+ */
+void handle_ram_cache_ctl(struct aos_rpc *r, uintptr_t enable) {
+    ram_cache_set_enabled(enable != 0);
+    ram_cache_print_stats();
+}
+
 /**
  * \brief handler function for initiate rpc call
  * 
@@ -673,6 +790,8 @@ errval_t initialize_rpc_handlers(struct aos_rpc *rpc)
     aos_rpc_register_handler(rpc,INIT_CLIENT_CALL3,&handle_client_call3);
     aos_rpc_register_handler(rpc,INIT_BINDING_REQUEST,&handle_binding_request);
     aos_rpc_register_handler(rpc, INIT_IFACE_GET_ALL_MODULES, &handle_get_all_modules);
+    aos_rpc_register_handler(rpc, INIT_IFACE_GET_RAM, &handle_request_ram);
+    aos_rpc_register_handler(rpc, INIT_IFACE_UMP_BENCH, &handle_ump_bench);
     aos_rpc_register_handler(rpc,INIT_FS_ON,&handle_fs_on);
 
     return SYS_ERR_OK;
@@ -18,6 +18,11 @@ errval_t start_memory_server_thread(void);
 //     MEMORY_SERVER
 // } ;
 
+/// Size of the frame shared for an ump burst benchmark (one ring per direction)
+#define UMP_BENCH_FRAME_SIZE (4 * BASE_PAGE_SIZE)
+/// Largest burst sent/received at once in the ump burst benchmark
+#define UMP_BENCH_MAX_BURST 64
+
 errval_t init_core_channel(coreid_t coreid, lvaddr_t urpc_frame);
 void register_core_channel_handlers(struct aos_rpc *rpc);
 
@@ -29,6 +34,11 @@ void handle_getchar(struct aos_rpc *r, uintptr_t *c);
 void handle_request_ram(struct aos_rpc *r, uintptr_t size,
                         uintptr_t alignment, struct capref *cap,
                         uintptr_t *ret_size);
+void handle_request_ram_batch(struct aos_rpc *r, uintptr_t count, uintptr_t size,
+                              struct capref *cap, uintptr_t *ret_count);
+void handle_ram_cache_ctl(struct aos_rpc *r, uintptr_t enable);
+void handle_ump_bench(struct aos_rpc *r, struct capref frame, uintptr_t n_msgs,
+                      uintptr_t burst);
 void handle_initiate(struct aos_rpc *rpc, struct capref cap);
 void handle_spawn(struct aos_rpc *old_rpc, const char *name,
                   uintptr_t core_id, uintptr_t *new_pid);
@@ -145,6 +145,36 @@ errval_t spawn_new_domain(const char *mod_name, int argc, char **argv, domainid_
 }
 
 
+/**
+ * \brief returns a DevFrame covering the GIC distributor
+ *
+ * The distributor can be retyped out of the device frame only once, drivers
+ * taking interrupts get copies of this cap.
+ */
+static errval_t get_gic_dist_frame(struct capref *ret)
+{
+    static struct capref gic_dist_frame;
+    static bool retyped = false;
+    errval_t err;
+
+    if (!retyped) {
+        err = slot_alloc(&gic_dist_frame);
+        ON_ERR_PUSH_RETURN(err, LIB_ERR_SLOT_ALLOC);
+
+        struct capref dev_frame = (struct capref) {
+            .cnode = cnode_task,
+            .slot = TASKCN_SLOT_DEV
+        };
+        size_t source_addr = get_phys_addr(dev_frame);
+        err = cap_retype(gic_dist_frame, dev_frame, IMX8X_GIC_DIST_BASE - source_addr, ObjType_DevFrame, IMX8X_GIC_DIST_SIZE, 1);
+        ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_RETYPE);
+        retyped = true;
+    }
+
+    *ret = gic_dist_frame;
+    return SYS_ERR_OK;
+}
+
 errval_t spawn_lpuart_driver(const char *mod_name, struct spawninfo **ret_si, struct capref in, struct capref out)
 {
     errval_t err;
@@ -202,9 +232,11 @@ errval_t spawn_lpuart_driver(const char *mod_name, struct spawninfo **ret_si, st
     err = cap_retype(child_dev_frame, dev_frame, IMX8X_UART3_BASE - source_addr, ObjType_DevFrame, IMX8X_UART_SIZE, 1);
     ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_RETYPE);
 
-    source_addr = get_phys_addr(dev_frame);
-    err = cap_retype(child_dev_frame2, dev_frame, IMX8X_GIC_DIST_BASE - source_addr, ObjType_DevFrame, IMX8X_GIC_DIST_SIZE, 1);
-    ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_RETYPE);
+    struct capref gic_dist_frame;
+    err = get_gic_dist_frame(&gic_dist_frame);
+    ON_ERR_RETURN(err);
+    err = cap_copy(child_dev_frame2, gic_dist_frame);
+    ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_COPY);
 
 
     struct capref irq = (struct capref) {
@@ -265,16 +297,23 @@ errval_t spawn_enet_driver(const char *mod_name, struct spawninfo **ret_si) {
         .cnode = child_taskcn,
         .slot = TASKCN_SLOT_DEV
     };
-    /* struct capref child_dev_frame2 = (struct capref) { */
-    /*     .cnode = child_taskcn, */
-    /*     .slot = TASKCN_SLOT_BOOTINFO */
-    /* }; */
+    struct capref child_dev_frame2 = (struct capref) {
+        .cnode = child_taskcn,
+        .slot = TASKCN_SLOT_BOOTINFO
+    };
 
     // write capabilities to access the enet driver into the child
     size_t source_addr = get_phys_addr(dev_frame);
     err = cap_retype(child_dev_frame, dev_frame, IMX8X_ENET_BASE - source_addr, ObjType_DevFrame, IMX8X_ENET_SIZE, 1);
     ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_RETYPE);
 
+    // the driver takes rx interrupts
+    struct capref gic_dist_frame;
+    err = get_gic_dist_frame(&gic_dist_frame);
+    ON_ERR_RETURN(err);
+    err = cap_copy(child_dev_frame2, gic_dist_frame);
+    ON_ERR_PUSH_RETURN(err, LIB_ERR_CAP_COPY);
+
     struct capref irq = (struct capref) {
         .cnode = child_taskcn,
         .slot = TASKCN_SLOT_IRQ
@@ -6,12 +6,14 @@
 #include <aos/paging.h>
 #include <aos/waitset.h>
 #include <aos/aos_rpc.h>
+#include <aos/default_interfaces.h>
 #include <mm/mm.h>
 #include <grading.h>
 #include <aos/core_state.h>
 #include <aos/systime.h>
 #include <aos/deferred.h>
 #include <aos/waitset.h>
+#include <aos/nameserver.h>
 
 
 #include <spawn/spawn.h>
@@ -192,46 +194,160 @@ static int test_malloc_64MiB(void) {
 
 int benchmark_mm(void);
 /**
- * \brief Benchmarks mm by doing a lot of calls to ram_alloc.
+ * \brief Benchmarks mm by doing a lot of calls to ram_alloc, keeping up to
+ * MM_BENCH_OUTSTANDING nodes allocated, then freeing every other one to
+ * fragment the free space and measuring alloc/free latency in that state.
  */
+#define MM_BENCH_OUTSTANDING 12000
+#define MM_BENCH_BATCH 1000
 int benchmark_mm(void)
-{   
-
+{
     errval_t err;
     TEST_START;
-    const int nBenches = 5000;
 
-    for (int i = 0; i < 10; i++) {
+    struct capref *caps = malloc(MM_BENCH_OUTSTANDING * sizeof(struct capref));
+    if (caps == NULL) {
+        return 1;
+    }
+
+    debug_printf("phase,outstanding,ns_per_op\n");
+
+    // grow the number of outstanding nodes, measuring allocation latency
+    for (int i = 0; i < MM_BENCH_OUTSTANDING; i += MM_BENCH_BATCH) {
         uint64_t before = systime_now();
-        for (int j = 0; j < nBenches; j++) {
-            struct capref thrown_away;
-            err  = ram_alloc(&thrown_away, BASE_PAGE_SIZE);
-            // debug_printf("Allocated ram!\n");
-            if(err_is_fail(err)){
-                DEBUG_ERR(err,"Failed to allocate ram in benchmarkmm\n");
+        for (int j = i; j < i + MM_BENCH_BATCH; j++) {
+            err = ram_alloc(&caps[j], BASE_PAGE_SIZE);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "Failed to allocate ram in benchmark_mm\n");
+                return 1;
             }
         }
         uint64_t end = systime_now();
+        debug_printf("alloc,%d,%ld\n", i + MM_BENCH_BATCH,
+                     systime_to_ns(end - before) / MM_BENCH_BATCH);
+    }
 
-        debug_printf("measurement %d took: %ld\n", i, systime_to_ns(end - before));
+    // free every other node, so none of the freed nodes can be coalesced
+    uint64_t before = systime_now();
+    for (int j = 0; j < MM_BENCH_OUTSTANDING; j += 2) {
+        err = aos_ram_free(caps[j]);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "Failed to free ram in benchmark_mm\n");
+            return 1;
+        }
     }
+    uint64_t end = systime_now();
+    debug_printf("free_fragmenting,%d,%ld\n", MM_BENCH_OUTSTANDING / 2,
+                 systime_to_ns(end - before) / (MM_BENCH_OUTSTANDING / 2));
+
+    // allocations larger than a single page cannot use the holes
+    before = systime_now();
+    for (int j = 0; j < MM_BENCH_OUTSTANDING; j += 2) {
+        err = ram_alloc(&caps[j], 2 * BASE_PAGE_SIZE);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "Failed to allocate ram in benchmark_mm\n");
+            return 1;
+        }
+    }
+    end = systime_now();
+    debug_printf("alloc_fragmented,%d,%ld\n", MM_BENCH_OUTSTANDING,
+                 systime_to_ns(end - before) / (MM_BENCH_OUTSTANDING / 2));
+
+    // free everything, every free coalesces with at least one neighbour
+    before = systime_now();
+    for (int j = 0; j < MM_BENCH_OUTSTANDING; j++) {
+        err = aos_ram_free(caps[j]);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "Failed to free ram in benchmark_mm\n");
+            return 1;
+        }
+    }
+    end = systime_now();
+    debug_printf("free_coalescing,0,%ld\n",
+                 systime_to_ns(end - before) / MM_BENCH_OUTSTANDING);
+
+    free(caps);
     return 0;
+}
 
-    /*
-      struct capref cr = (struct capref) {
-      .cnode = cnode_root,
-      .slot = 0
-      };
-    
-      for (int i = 0; i < 1000; i++) {
-      cr.slot = i;
-      char buf[256];
-      debug_print_cap_at_capref(buf, 256, cr);
-      debug_printf("root slot %d: %s\n", i, buf);
-      }
-    */
+/// Messages sent per burst size in benchmark_ump_bursts
+#define UMP_BENCH_MSGS 8192
+
+/**
+ * \brief Stream messages to core 0 over a fresh ump ring in bursts of 1 to
+ * UMP_BENCH_MAX_BURST messages, print throughput.
+ *
+ * \param payload Bytes to place in every message, NULL to send a sequence number
+ * \param payload_bytes Number of payload bytes per message (at most the data
+ *                      part of a message), used for the bytes/s column
+ */
+static int benchmark_ump_bursts(const char *payload, size_t payload_bytes)
+{
+    // one frame for all runs, so core 0 can keep its mapping of it too
+    static struct capref frame;
+    static void *buf = NULL;
+    errval_t err;
+
+    if (buf == NULL) {
+        size_t frame_size;
+        err = frame_alloc(&frame, UMP_BENCH_FRAME_SIZE, &frame_size);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "Failed to allocate ump benchmark frame\n");
+            return 1;
+        }
+        err = paging_map_frame_complete(get_current_paging_state(), &buf, frame, NULL, NULL);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "Failed to map ump benchmark frame\n");
+            cap_destroy(frame);
+            buf = NULL;
+            return 1;
+        }
+    }
+
+    debug_printf("burst,msgs/s,bytes/s\n");
+    for (size_t burst = 1; burst <= UMP_BENCH_MAX_BURST; burst *= 2) {
+        // the sink of the previous burst is done with the frame, start with
+        // empty rings again
+        memset(buf, 0, UMP_BENCH_FRAME_SIZE);
+
+        // send on the first half, core 0 answers on the second
+        struct ump_chan uc;
+        const size_t half = UMP_BENCH_FRAME_SIZE / 2;
+        ump_chan_init_default(&uc, buf, half, buf + half, half);
+
+        err = aos_rpc_call(get_core_channel(0), INIT_IFACE_UMP_BENCH, frame,
+                           UMP_BENCH_MSGS, burst);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "Failed to start ump benchmark on core 0\n");
+            return 1;
+        }
+
+        DECLARE_MESSAGES(uc, msgs, UMP_BENCH_MAX_BURST);
+        for (size_t i = 0; i < burst; i++) {
+            struct ump_msg *m = ump_msg_at(&uc, msgs, i);
+            if (payload != NULL) {
+                memcpy(m->data, payload, payload_bytes);
+            } else {
+                m->data[0] = i;
+            }
+        }
 
+        uint64_t before = systime_now();
+        for (size_t sent = 0; sent < UMP_BENCH_MSGS; ) {
+            size_t n = UMP_BENCH_MSGS - sent < burst ? UMP_BENCH_MSGS - sent : burst;
+            sent += ump_chan_send_batch(&uc, msgs, n, false);
+        }
+        DECLARE_MESSAGE(uc, done);
+        while (!ump_chan_receive(&uc, done));
+        uint64_t ns = systime_to_ns(systime_now() - before);
+
+        debug_printf("%zu,%lu,%lu\n", burst, UMP_BENCH_MSGS * 1000000000UL / ns,
+                     UMP_BENCH_MSGS * payload_bytes * 1000000000UL / ns);
+    }
+
+    return 0;
 }
+
 int benchmark_ump_strings(void);
 int benchmark_ump_strings(void) {
     char *ref = "Chapter one - The boy who lived: Mr and Mrs Dursley, of number four, "
@@ -276,7 +392,7 @@ int benchmark_ump_strings(void) {
         debug_printf("%d,%ld\n", x[i], y[i]);
     }
 
-    return 0;
+    return benchmark_ump_bursts(ref, UMP_MSG_N_WORDS * sizeof(uint64_t));
 }
 
 int benchmark_ump_numbers(void);
@@ -296,12 +412,59 @@ int benchmark_ump_numbers(void) {
         }
         debug_printf("%d,%ld\n", i, systime_to_ns(after - before));
     }
+    return benchmark_ump_bursts(NULL, sizeof(uint64_t));
+}
+
+/// Instances alive after each step of benchmark_spawn
+static const int spawn_bench_instances[] = { 1, 5, 10, 25, 50 };
+
+int benchmark_spawn(void);
+/**
+ * \brief Spawns up to 50 instances of hello, measuring the latency of a spawn
+ * and the physical memory taken by each instance.
+ */
+int benchmark_spawn(void)
+{
+    errval_t err;
+    TEST_START;
+
+    struct spawn_image *img;
+    err = spawn_get_image("hello", &img);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "Failed to load hello in benchmark_spawn\n");
+        return 1;
+    }
+    debug_printf("image,shared[B],private[B]\n");
+    debug_printf("hello,%zu,%zu\n", img->shared_bytes, img->private_bytes);
+
+    debug_printf("instances,mean[ns],bytes/instance\n");
+    int spawned = 0;
+    for (size_t i = 0; i < ARRAY_LENGTH(spawn_bench_instances); i++) {
+        int n = spawn_bench_instances[i] - spawned;
+        gensize_t avail = aos_mm.stats_bytes_available;
+
+        uint64_t before = systime_now();
+        for (int j = 0; j < n; j++) {
+            domainid_t pid;
+            err = spawn_new_domain("hello", 0, NULL, &pid, NULL_CAP, NULL_CAP, NULL_CAP, NULL);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "Failed to spawn hello in benchmark_spawn\n");
+                return 1;
+            }
+        }
+        uint64_t end = systime_now();
+        spawned += n;
+
+        debug_printf("%d,%ld,%lu\n", spawned, systime_to_ns(end - before) / n,
+                     (avail - aos_mm.stats_bytes_available) / n);
+    }
     return 0;
 }
 
 // put your test functions for core 0 in this array, keep NULL as last element
 int (*bsp_tests[])(void) = {
     //&benchmark_mm,
+    //&benchmark_spawn,
     //&test_printf,
     //&test_getchar,
     //&test_malloc,
@@ -351,8 +514,45 @@ int run_init_tests(int core_id) {
 
 static int counter;
 #define SERVER "server_perf /server"
+#define SERVER_NAME "/server"
+#define NS_WARM_LOOKUPS 64
 static coreid_t s_core;
 
+/**
+ * \brief Measures looking up the server spawned in the previous round, once
+ * uncached and then NS_WARM_LOOKUPS times from the lookup cache. Prints
+ * `ns_lookup,servers,cold[ns],warm_mean[ns]`.
+ */
+static void measure_ns_lookup(int server)
+{
+    errval_t err;
+    char name[64];
+    nameservice_chan_t chan;
+
+    snprintf(name, sizeof(name), SERVER_NAME "%d", server);
+
+    uint64_t start = systime_now();
+    err = nameservice_lookup(name, &chan);
+    uint64_t cold = systime_now() - start;
+    if (err_is_fail(err)) {
+        // not registered yet, try again with the next one
+        return;
+    }
+
+    start = systime_now();
+    for (int i = 0; i < NS_WARM_LOOKUPS; i++) {
+        err = nameservice_lookup(name, &chan);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "warm lookup of %s failed", name);
+            return;
+        }
+    }
+    uint64_t warm = systime_now() - start;
+
+    debug_printf("ns_lookup,%d,%lu,%lu\n", server + 1, systime_to_ns(cold),
+                 systime_to_ns(warm) / NS_WARM_LOOKUPS);
+}
+
 static void spawn_next_server(void * arg){
     
 
@@ -363,6 +563,9 @@ static void spawn_next_server(void * arg){
     strcat(buffer,counter_string);
     spawn_new_domain(buffer, s_core,NULL,NULL,NULL_CAP,NULL_CAP,NULL_CAP,NULL);
     // debug_printf("Spawned new server -client: %d, %s, %d\n",counter,buffer,s_core);
+    if (counter > 0) {
+        measure_ns_lookup(counter - 1);
+    }
     counter++;
 }
 void run_ns_perf_test(coreid_t server_core, uint64_t spawn_interval){
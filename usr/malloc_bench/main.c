@@ -0,0 +1,84 @@
+/**
+ * \file
+ * \brief malloc/free throughput benchmark
+ *
+ * Every thread repeatedly allocates a window of objects of one size and frees
+ * them again. Prints `threads,size[B],ops/s` where one op is a malloc or a free.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <aos/aos.h>
+#include <aos/systime.h>
+
+#define WINDOW 32
+#define TOTAL_BYTES (32UL * 1024 * 1024)
+#define MAX_THREADS 8
+
+static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+static const int thread_counts[] = { 1, 2, 4, 8 };
+
+static int bench_thread(void *arg)
+{
+    size_t size = (size_t)arg;
+    size_t rounds = TOTAL_BYTES / (size * WINDOW);
+    if (rounds < 16) {
+        rounds = 16;
+    }
+
+    void *objs[WINDOW];
+    for (size_t r = 0; r < rounds; r++) {
+        for (int i = 0; i < WINDOW; i++) {
+            objs[i] = malloc(size);
+            if (objs[i] == NULL) {
+                debug_printf("malloc(%zu) failed\n", size);
+                return -1;
+            }
+            // touch the object so both allocators pay for backing it
+            *(volatile char *)objs[i] = (char)i;
+        }
+        for (int i = 0; i < WINDOW; i++) {
+            free(objs[i]);
+        }
+    }
+    return (int)rounds;
+}
+
+static void bench(int n_threads, size_t size)
+{
+    struct thread *threads[MAX_THREADS];
+    uint64_t ops = 0;
+
+    uint64_t start = systime_now();
+    for (int t = 0; t < n_threads; t++) {
+        threads[t] = thread_create(bench_thread, (void *)size);
+        assert(threads[t] != NULL);
+    }
+    for (int t = 0; t < n_threads; t++) {
+        int rounds;
+        errval_t err = thread_join(threads[t], &rounds);
+        if (err_is_fail(err) || rounds < 0) {
+            DEBUG_ERR(err, "benchmark thread failed");
+            return;
+        }
+        ops += 2 * (uint64_t)rounds * WINDOW;
+    }
+    uint64_t ns = systime_to_ns(systime_now() - start);
+
+    debug_printf("%d,%zu,%lu\n", n_threads, size, ns ? ops * 1000000000UL / ns : 0);
+}
+
+int main(int argc, char *argv[])
+{
+    // warm up the heap so the first configuration does not pay for page faults alone
+    bench(1, 16);
+
+    debug_printf("threads,size[B],ops/s\n");
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            bench(thread_counts[t], sizes[s]);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -10,6 +10,7 @@
 #include <aos/aos_rpc.h>
 #include <aos/waitset.h>
 #include <aos/systime.h>
+#include <aos/deferred.h>
 #include <aos/paging.h>
 #include <aos/nameserver.h>
 #include <aos/default_interfaces.h>
@@ -22,7 +23,7 @@ static void setup_calc_connection(struct capref frame)
 {
     void *shared;
     paging_map_frame_complete(get_current_paging_state(), &shared, frame, NULL, NULL);
-    aos_rpc_init_ump_default(&calc_connection, (lvaddr_t) shared, get_phys_size(frame), 0);
+    aos_rpc_init_ump_bulk(&calc_connection, (lvaddr_t) shared, get_phys_size(frame), AOS_RPC_BULK_UMP_SIZE, 0);
     aos_rpc_set_interface(&calc_connection, get_ms_interface(), MS_IFACE_N_FUNCTIONS, malloc(MS_IFACE_N_FUNCTIONS * sizeof(void *)));
 }
 
@@ -32,15 +33,84 @@ static void remote_ipi(struct capref ipi_ep)
     ump_chan_switch_remote_pinged(&calc_connection.channel.ump, ipi_ep);
 }
 
+/// endpoint the server pings us on, in pinged or adaptive mode
+struct notify_ep {
+    struct lmp_endpoint *ep;
+    struct capref ep_cap;
+    struct capref ipi_ep;   ///< handed to the server
+};
+
 __unused
-static void local_ipi(struct capref *ipi_ep)
+static void local_ipi(struct notify_ep *n)
 {
-    struct lmp_endpoint *ep;
-    struct capref epcap;
-    endpoint_create(LMP_RECV_LENGTH, &epcap, &ep);
-    slot_alloc(ipi_ep);
-    cap_retype(*ipi_ep, epcap, 0, ObjType_EndPointIPI, 0, 1);
-    ump_chan_switch_local_pinged(&calc_connection.channel.ump, ep);
+    endpoint_create(LMP_RECV_LENGTH, &n->ep_cap, &n->ep);
+    slot_alloc(&n->ipi_ep);
+    cap_retype(n->ipi_ep, n->ep_cap, 0, ObjType_EndPointIPI, 0, 1);
+    ump_chan_switch_local_pinged(&calc_connection.channel.ump, n->ep);
+}
+
+__unused
+static void remote_adaptive(struct capref ipi_ep)
+{
+    ump_chan_switch_remote_adaptive(&calc_connection.channel.ump, ipi_ep);
+}
+
+__unused
+static void local_adaptive(struct notify_ep *n)
+{
+    endpoint_create(LMP_RECV_LENGTH, &n->ep_cap, &n->ep);
+    ipi_endpoint_create(n->ep_cap, &n->ipi_ep);
+    ump_chan_switch_local_adaptive(&calc_connection.channel.ump, n->ep);
+}
+
+/**
+ * \brief Tear down an endpoint the channel no longer uses. Pings the server
+ * sent before it switched over are taken off first.
+ */
+static void notify_ep_free(struct notify_ep *n)
+{
+    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;
+    while (err_is_ok(lmp_endpoint_recv(n->ep, &msg.buf, NULL)));
+
+    lmp_endpoint_free(n->ep);
+    cap_destroy(n->ipi_ep);
+    cap_destroy(n->ep_cap);
+}
+
+/**
+ * \brief Count busy-loop iterations during 100ms.
+ *
+ * Run while the connection is idle: if the server shares this core, the
+ * drop compared to other modes is the CPU time its receive side burns.
+ */
+static uint64_t idle_probe(void)
+{
+    systime_t end = systime_now() + us_to_systime(100000);
+    uint64_t iterations = 0;
+    while (systime_now() < end) {
+        iterations++;
+    }
+    return iterations;
+}
+
+static void measure_mode(const char *mode)
+{
+    const size_t tries = 1000;
+    uint64_t total = 0;
+    for (int k = 0; k < 10; k++) {
+        systime_t beg = systime_now();
+        for (int j = 0; j < tries; j++) {
+            aos_rpc_call(&calc_connection, AOS_RPC_ROUNDTRIP);
+        }
+        systime_t after = systime_now();
+        printf("time: %ld\n", systime_to_ns((after - beg)) / tries);
+        total += systime_to_ns(after - beg) / tries;
+    }
+
+    // let an adaptive receiver run out of its spin window before probing
+    barrelfish_usleep(10000);
+    printf("mode,rtt[ns],idle_probe[iterations/100ms]\n");
+    printf("%s,%lu,%lu\n", mode, total / 10, idle_probe());
 }
 
 
@@ -57,7 +127,7 @@ int main(int argc, char *argv[])
         printf("servicenames[%d]: %s\n", i, servicenames[i]);
 
         struct capref frame;
-        frame_alloc(&frame, BASE_PAGE_SIZE, NULL);
+        frame_alloc(&frame, BASE_PAGE_SIZE + AOS_RPC_BULK_UMP_SIZE, NULL);
         setup_calc_connection(frame);
 
         nameservice_chan_t chan;
@@ -67,54 +137,40 @@ int main(int argc, char *argv[])
         void *buf; size_t buf_size;
         nameservice_rpc(chan, (void *) cmd1, sizeof cmd1, &buf, &buf_size, frame, NULL_CAP);
 
-        for (int k = 0; k < 10; k++) {
-            size_t tries = 1000;
-            systime_t beg = systime_now();
-            for (int j = 0; j < tries; j++) {
-                aos_rpc_call(&calc_connection, AOS_RPC_ROUNDTRIP);
-            }
-            systime_t after = systime_now();
-            printf("time: %ld\n", systime_to_ns((after - beg)) / tries);
-        }
+        measure_mode("polled");
 
         printf("switching to non-yield\n");
         calc_connection.ump_dont_yield = true;
+        measure_mode("polled_no_yield");
 
-        for (int k = 0; k < 10; k++) {
-            size_t tries = 1000;
-            systime_t beg = systime_now();
-            for (int j = 0; j < tries; j++) {
-                aos_rpc_call(&calc_connection, AOS_RPC_ROUNDTRIP);
-            }
-            systime_t after = systime_now();
-            printf("time: %ld\n", systime_to_ns((after - beg)) / tries);
-        }
+        printf("switching to adaptive\n");
+
+        struct notify_ep adaptive_ep;
+        struct capref remote_adaptive_ep;
+        local_adaptive(&adaptive_ep);
+        slot_alloc(&remote_adaptive_ep);
 
+        const char cmd2[] = "set_adaptive";
+        nameservice_rpc(chan, (void *) cmd2, sizeof cmd2, &buf, &buf_size, adaptive_ep.ipi_ep, remote_adaptive_ep);
+        remote_adaptive(remote_adaptive_ep);
+        measure_mode("adaptive");
 
         printf("switching to pinged\n");
 
-        struct capref ipi_ep;
-        struct capref remote_ipi_ep;
-        local_ipi(&ipi_ep);
-        slot_alloc(&remote_ipi_ep);
+        struct notify_ep pinged_ep;
+        struct capref remote_pinged_ep;
+        local_ipi(&pinged_ep);
+        slot_alloc(&remote_pinged_ep);
 
-        const char cmd2[] = "set_ipi";
-        nameservice_rpc(chan, (void *) cmd2, sizeof cmd2, &buf, &buf_size, ipi_ep, remote_ipi_ep);
-        remote_ipi(remote_ipi_ep);
+        const char cmd3[] = "set_ipi";
+        nameservice_rpc(chan, (void *) cmd3, sizeof cmd3, &buf, &buf_size, pinged_ep.ipi_ep, remote_pinged_ep);
+        remote_ipi(remote_pinged_ep);
 
-        char bouf[128];
-        debug_print_cap_at_capref(bouf, 128, remote_ipi_ep);
-        //debug_printf("We received %s\n", bouf);
+        // the server pings the new endpoint from now on
+        notify_ep_free(&adaptive_ep);
+        cap_destroy(remote_adaptive_ep);
 
-        for (int k = 0; k < 10; k++) {
-            size_t tries = 1000;
-            systime_t beg = systime_now();
-            for (int j = 0; j < tries; j++) {
-                aos_rpc_call(&calc_connection, AOS_RPC_ROUNDTRIP);
-            }
-            systime_t after = systime_now();
-            printf("time: %ld\n", systime_to_ns((after - beg)) / tries);
-        }
+        measure_mode("pinged");
 
         struct calc_request cr;
         cr.max_iterations = 250;
@@ -50,7 +50,7 @@ static void setup_calc_connection(struct capref frame)
     debug_print_cap_at_capref(buf, 128, frame);
     //debug_printf("cap is %s\n", buf);
     err = paging_map_frame_complete(get_current_paging_state(), &shared, frame, NULL, NULL);
-    aos_rpc_init_ump_default(&calc_connection, (lvaddr_t) shared, get_phys_size(frame), 1);
+    aos_rpc_init_ump_bulk(&calc_connection, (lvaddr_t) shared, get_phys_size(frame), AOS_RPC_BULK_UMP_SIZE, 1);
     aos_rpc_set_interface(&calc_connection, get_ms_interface(), MS_IFACE_N_FUNCTIONS, malloc(MS_IFACE_N_FUNCTIONS * sizeof(void *)));
 
     void handle_roundtrip(struct aos_rpc *rpc) { return; }
@@ -78,6 +78,21 @@ static void local_ipi(struct capref *ipi_ep)
 }
 
 
+static void remote_adaptive(struct capref ipi_ep)
+{
+    ump_chan_switch_remote_adaptive(&calc_connection.channel.ump, ipi_ep);
+}
+
+static void local_adaptive(struct capref *ipi_ep)
+{
+    struct lmp_endpoint *ep;
+    struct capref epcap;
+    endpoint_create(LMP_RECV_LENGTH, &epcap, &ep);
+    ipi_endpoint_create(epcap, ipi_ep);
+    ump_chan_switch_local_adaptive(&calc_connection.channel.ump, ep);
+}
+
+
 static void server_recv_handler(void *st, void *message,
                                 size_t bytes,
                                 void **response, size_t *response_bytes,
@@ -90,6 +105,10 @@ static void server_recv_handler(void *st, void *message,
         remote_ipi(rx_cap);
         local_ipi(tx_cap);
     }
+    else if (strcmp(message, "set_adaptive") == 0) {
+        remote_adaptive(rx_cap);
+        local_adaptive(tx_cap);
+    }
 
     static const char resp[] = "OK";
     *response = resp;
@@ -1,17 +1,26 @@
 #include <stdio.h>
+#include <string.h>
 
 #include <aos/aos.h>
 #include <aos/systime.h>
+#include <aos/deferred.h>
 #include <aos/aos_rpc.h>
 #include <aos/default_interfaces.h>
 
 
 void benchmark_rpc(void);
+void benchmark_ram_batch(void);
+void benchmark_ram_cache(void);
 
 int main(int argc, char *argv[])
 {
     printf("Starting performance measurments\n");
 
+    if (argc > 1 && !strcmp(argv[1], "ram")) {
+        benchmark_ram_cache();
+        return 0;
+    }
+
     benchmark_rpc();
 
     return 0;
@@ -54,4 +63,149 @@ void benchmark_rpc(void)
     for (int i = 0; i < n_measures; i++) avg += times[i];
     avg /= n_measures;
     debug_printf("Average time to request frame of size 4096 over %d measurements: %ld [ns]\n", n_measures, systime_to_ns(avg));
+
+    benchmark_ram_batch();
+}
+
+
+/**
+ * \brief Compares getting `count` pages with one request each to getting them
+ * with a single batched request which is then split up locally.
+ */
+void benchmark_ram_batch(void)
+{
+    struct aos_rpc *rpc = aos_rpc_get_memory_channel();
+    static struct capref caps[64];
+
+    debug_printf("Testing batched ram requests\n");
+    debug_printf("count,single[ns/page],batched[ns/page]\n");
+    for (size_t count = 1; count <= 64; count *= 4) {
+        errval_t err;
+        uint64_t start = systime_now();
+        for (size_t i = 0; i < count; i++) {
+            uintptr_t act_size;
+            err = aos_rpc_call(rpc, MM_IFACE_GET_RAM, BASE_PAGE_SIZE, BASE_PAGE_SIZE, &caps[i], &act_size);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "single ram request");
+                for (size_t j = 0; j < i; j++) {
+                    cap_destroy(caps[j]);
+                }
+                return;
+            }
+        }
+        uint64_t single = systime_now() - start;
+        for (size_t i = 0; i < count; i++) {
+            cap_destroy(caps[i]);
+        }
+
+        start = systime_now();
+        struct capref batch;
+        size_t ret_count;
+        err = aos_rpc_get_ram_batch(rpc, count, BASE_PAGE_SIZE, &batch, &ret_count);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "batched ram request");
+            return;
+        }
+        for (size_t i = 0; i < ret_count; i++) {
+            err = slot_alloc(&caps[i]);
+            if (err_is_ok(err)) {
+                err = cap_retype(caps[i], batch, i * BASE_PAGE_SIZE, ObjType_RAM, BASE_PAGE_SIZE, 1);
+                if (err_is_fail(err)) {
+                    slot_free(caps[i]);
+                }
+            }
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "splitting batched ram");
+                for (size_t j = 0; j < i; j++) {
+                    cap_destroy(caps[j]);
+                }
+                cap_destroy(batch);
+                return;
+            }
+        }
+        uint64_t batched = systime_now() - start;
+        for (size_t i = 0; i < ret_count; i++) {
+            cap_destroy(caps[i]);
+        }
+        cap_destroy(batch);
+
+        debug_printf("%zu,%ld,%ld\n", count, systime_to_ns(single) / count, systime_to_ns(batched) / count);
+    }
+
+    // touching a fresh heap buffer faults in one large page after the other
+    const size_t heap_bytes = 32 * LARGE_PAGE_SIZE;
+    char *buf = malloc(heap_bytes);
+    if (buf == NULL) {
+        debug_printf("could not allocate heap buffer\n");
+        return;
+    }
+    uint64_t start = systime_now();
+    for (size_t off = 0; off < heap_bytes; off += BASE_PAGE_SIZE) {
+        buf[off] = 1;
+    }
+    uint64_t end = systime_now();
+    debug_printf("Touching %zu MiB of fresh heap: %ld [ns]\n", heap_bytes >> 20, systime_to_ns(end - start));
+
+    // same again, but announcing the access to the paging code beforehand
+    char *buf2 = malloc(heap_bytes);
+    if (buf2 != NULL) {
+        start = systime_now();
+        paging_region_prefault(&get_current_paging_state()->heap_region, (lvaddr_t) buf2, heap_bytes);
+        for (size_t off = 0; off < heap_bytes; off += BASE_PAGE_SIZE) {
+            buf2[off] = 1;
+        }
+        end = systime_now();
+        debug_printf("Touching %zu MiB of prefaulted heap: %ld [ns]\n", heap_bytes >> 20, systime_to_ns(end - start));
+        free(buf2);
+    }
+    free(buf);
+}
+
+
+/**
+ * \brief Measures the average latency of RAM requests of a given size to the
+ * memory server of the core we are running on.
+ */
+static uint64_t measure_ram_requests(struct aos_rpc *rpc, size_t size, int n_measures)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < n_measures; i++) {
+        struct capref ram;
+        uintptr_t act_size;
+        uint64_t start = systime_now();
+        errval_t err = aos_rpc_call(rpc, MM_IFACE_GET_RAM, size, size, &ram, &act_size);
+        uint64_t end = systime_now();
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "requesting ram");
+            return 0;
+        }
+        total += end - start;
+        cap_destroy(ram);
+    }
+    return systime_to_ns(total / n_measures);
+}
+
+/**
+ * \brief Compares RAM request latency with and without the per-core RAM cache
+ * of init. Spawn this with the argument "ram" on every core to get per-core numbers.
+ */
+void benchmark_ram_cache(void)
+{
+    const int n_measures = 16;
+    struct aos_rpc *rpc = aos_rpc_get_memory_channel();
+    coreid_t core = disp_get_core_id();
+
+    debug_printf("core,size,cache,avg_latency[ns]\n");
+    for (int enabled = 0; enabled <= 1; enabled++) {
+        aos_rpc_call(rpc, MM_IFACE_RAM_CACHE_CTL, enabled);
+        // let init refill (or drain) its pools
+        barrelfish_usleep(100000);
+
+        uint64_t small = measure_ram_requests(rpc, BASE_PAGE_SIZE, n_measures);
+        debug_printf("%d,4KiB,%s,%ld\n", core, enabled ? "on" : "off", small);
+
+        barrelfish_usleep(100000);
+        uint64_t large = measure_ram_requests(rpc, LARGE_PAGE_SIZE, n_measures / 4);
+        debug_printf("%d,2MiB,%s,%ld\n", core, enabled ? "on" : "off", large);
+    }
 }
@@ -19,16 +19,18 @@
 // #define TEST_BINARY  "nameservicetest"
 
 // extern struct aos_rpc fresh_connection;
-static char *myresponse = "reply!!";
-// static char buffer[512];
+static char response_buf[MAX_SERVER_MESSAGE_SIZE];
+
+/// echoes every request, so both directions carry the request size
 static void server_recv_handler(void *st, void *message,
                                 size_t bytes,
                                 void **response, size_t *response_bytes,
                                 struct capref rx_cap, struct capref *tx_cap)
 {
-    // debug_printf("server: got a request: %s\n", (char *)message);
-    *response = myresponse;
-    *response_bytes = strlen(myresponse);
+    bytes = MIN(bytes, sizeof(response_buf));
+    memcpy(response_buf, message, bytes);
+    *response = response_buf;
+    *response_bytes = bytes;
 }
 
 
@@ -5,6 +5,10 @@
  * This file contains code to test recursive spawning (a child
  * spawning another child. Note that you need to have implemented
  * aos_rpc_process_spawn for it to work.)
+ *
+ * "spawnTester bench <count> [interval ms]" measures the latency of spawning
+ * count children, each child reports the time from the spawn request to its
+ * main function as "first".
  */
 
 /*
@@ -18,7 +22,10 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <aos/aos.h>
+#include <aos/systime.h>
+#include <aos/deferred.h>
 #include <spawn/spawn.h>
 #include <aos/aos_rpc.h>
 
@@ -45,6 +52,35 @@ static char * utostr(uint8_t i) {
     return ret;
 } 
 
+/**
+ * \brief Spawns count children one after the other, waiting interval_ms
+ * in between, and prints the latency of every spawn as CSV.
+ */
+static int spawn_benchmark(int count, uint64_t interval_ms)
+{
+    errval_t err;
+    debug_printf("spawn,i,latency[ns]\n");
+    for (int i = 0; i < count; i++) {
+        char cmdline[64];
+        uint64_t start = systime_now();
+        snprintf(cmdline, sizeof(cmdline), "spawnTester first %lu", start);
+
+        domainid_t pid;
+        err = aos_rpc_process_spawn(proc_rpc, cmdline, my_core_id, &pid);
+        uint64_t end = systime_now();
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "spawning child %d failed\n", i);
+            return EXIT_FAILURE;
+        }
+        debug_printf("spawn,%d,%lu\n", i, systime_to_ns(end - start));
+
+        if (interval_ms > 0) {
+            barrelfish_usleep(interval_ms * 1000);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
     
     // get a channel to init
@@ -59,6 +95,17 @@ int main(int argc, char *argv[]) {
         DEBUG_PRINTF("spawnTester with level 0 is running.\n");
         return EXIT_SUCCESS;
 
+    } else if (strcmp(argv[1], "first") == 0 && argc > 2) {
+        uint64_t now = systime_now();
+        uint64_t start = strtoull(argv[2], NULL, 10);
+        debug_printf("first,%lu\n", systime_to_ns(now - start));
+        return EXIT_SUCCESS;
+
+    } else if (strcmp(argv[1], "bench") == 0) {
+        int count = argc > 2 ? strtol(argv[2], NULL, 10) : 10;
+        uint64_t interval_ms = argc > 3 ? strtoull(argv[3], NULL, 10) : 0;
+        return spawn_benchmark(count, interval_ms);
+
     } else {
         uint8_t level = strtoul(argv[1], NULL, 10);
         DEBUG_PRINTF("spawnTester with level %d is running.\n", level);
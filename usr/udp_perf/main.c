@@ -0,0 +1,175 @@
+/**
+ * \file
+ * \brief Datagram rate and round trip times of UDP sockets, over the RPC
+ *        path and over rings shared with the driver
+ *
+ * Run against a UDP echo server, e.g. `socat UDP-LISTEN:PORT,fork PIPE` on
+ * the host. Results are printed as CSV.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <aos/aos.h>
+#include <aos/systime.h>
+#include <aos/udp_service.h>
+
+#define LOCAL_PORT 4242
+#define RTT_TIMEOUT_US 100000
+#define RESOLVE_TIMEOUT_US 3000000
+
+static const uint16_t sizes[] = { 64, 1400 };
+
+static char payload[MAX_PAYLOAD_LEN];
+static struct udp_msg *in;
+
+static uint32_t parse_ip(const char *s)
+{
+    uint32_t ip = 0;
+    for (int i = 0; i < 4; i++) {
+        ip = (ip << 8) | (atoi(s) & 0xff);
+        while (*s && *s != '.') {
+            s++;
+        }
+        if (*s) {
+            s++;
+        }
+    }
+    return ip;
+}
+
+static errval_t send_one(struct aos_socket *sock, uint16_t len)
+{
+    errval_t err;
+    do {
+        err = aos_socket_send(sock, payload, len);
+        if (err == ENET_ERR_RING_FULL) {
+            thread_yield();
+        }
+    } while (err == ENET_ERR_RING_FULL);
+    return err;
+}
+
+/// waits until the driver has taken all datagrams from the tx ring
+static void flush_tx(struct aos_socket *sock)
+{
+    while (sock->rings && sock->rings->tx.tail != sock->tx_head) {
+        thread_yield();
+    }
+}
+
+/// discards echoes still in flight from an earlier run
+static void drain_rx(struct aos_socket *sock)
+{
+    uint64_t end = systime_now() + us_to_systime(RTT_TIMEOUT_US);
+    while (systime_now() < end) {
+        if (err_is_fail(aos_socket_receive(sock, in))) {
+            thread_yield();
+        }
+    }
+}
+
+static void run(struct aos_socket *sock, const char *path, uint16_t len, int count)
+{
+    // rate: datagrams handed to the device per second
+    uint64_t start = systime_now();
+    int sent = 0;
+    for (int i = 0; i < count; i++) {
+        if (err_is_ok(send_one(sock, len))) {
+            sent++;
+        }
+    }
+    flush_tx(sock);
+    uint64_t ns = systime_to_ns(systime_now() - start);
+    drain_rx(sock);
+
+    // latency: one datagram in flight at a time
+    uint64_t rtt_total = 0;
+    int rounds = count / 10 > 0 ? count / 10 : 1;
+    int lost = 0;
+    for (int i = 0; i < rounds; i++) {
+        uint64_t t0 = systime_now();
+        uint64_t deadline = t0 + us_to_systime(RTT_TIMEOUT_US);
+        errval_t err = send_one(sock, len);
+        bool echoed = false;
+        while (err_is_ok(err) && systime_now() < deadline) {
+            if (err_is_ok(aos_socket_receive(sock, in))) {
+                echoed = true;
+                break;
+            }
+            thread_yield();
+        }
+        if (!echoed) {
+            lost++;
+            continue;
+        }
+        rtt_total += systime_to_ns(systime_now() - t0);
+    }
+
+    uint64_t pps = ns ? sent * 1000000000ULL / ns : 0;
+    uint64_t rtt = rounds > lost ? rtt_total / (rounds - lost) : 0;
+    debug_printf("%s,%u,%lu,%lu,%d\n", path, len, pps, rtt, lost);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        printf("usage: udp_perf IP PORT [COUNT]\n"
+               "  sends COUNT datagrams to a UDP echo server at IP:PORT\n");
+        return EXIT_SUCCESS;
+    }
+
+    uint32_t ip = parse_ip(argv[1]);
+    uint16_t port = atoi(argv[2]);
+    int count = argc > 3 ? atoi(argv[3]) : 1000;
+
+    struct aos_socket sock;
+    errval_t err = aos_socket_initialize(&sock, ip, port, LOCAL_PORT);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "unable to initialize socket");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (char) i;
+    }
+    in = malloc(UDP_MSG_MAX_SIZE);
+
+    // resolve the destination before timing, the driver holds back datagrams
+    // until the ARP reply arrives
+    err = aos_socket_send(&sock, payload, sizes[0]);
+    uint64_t deadline = systime_now() + us_to_systime(RESOLVE_TIMEOUT_US);
+    while (err_is_ok(err) && err_is_fail(aos_socket_receive(&sock, in))) {
+        if (systime_now() > deadline) {
+            err = ENET_ERR_ARP_UNKNOWN;
+            break;
+        }
+        thread_yield();
+    }
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "unable to reach %s", argv[1]);
+        goto out;
+    }
+    drain_rx(&sock);
+
+    debug_printf("path,payload[B],pkts/s,rtt[ns],lost\n");
+    for (size_t i = 0; i < ARRAY_LENGTH(sizes); i++) {
+        run(&sock, "rpc", sizes[i], count);
+    }
+
+    err = aos_socket_map_rings(&sock);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "unable to map socket rings");
+        goto out;
+    }
+    for (size_t i = 0; i < ARRAY_LENGTH(sizes); i++) {
+        run(&sock, "rings", sizes[i], count);
+    }
+    debug_printf("rings,drops,rx %lu,tx %lu\n", sock.rings->rx.drops,
+                 sock.rings->tx.drops);
+
+out:
+    aos_socket_teardown(&sock);
+    free(in);
+    return EXIT_SUCCESS;
+}